@@ -0,0 +1,949 @@
+/***************************************************************************
+MIT License
+
+Copyright(c) 2023 lvchengTSH
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this softwareand associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright noticeand this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+***************************************************************************/
+
+
+// light map baker benchmark
+//
+// usage: example_gi_benchmark [--scene=all|cornell_box|city_block|foliage_field|corridor] [--triangles=N] [--lights=N] [--instances=N]
+//                             [--atlas=N] [--samples=N] [--stream=N] [--repeat=N] [--cpu_probes=N] [--out=report.json]
+//
+// --stream=N bakes N atlases at a time with BakeLightMapStreaming, 0 runs the separate passes on all atlases at once
+// --cpu_probes=N also traces an N^3 probe grid over the scene bounds with the cpu probe pass, once in ray order and once
+//                with SBakeConfig::m_bCpuRayReordering, 0 skips the cpu probe pass
+//
+// the scenes are generated from a fixed seed, so the same arguments always bake the same geometry and lights
+// every stage time is the min and the median of the repeats, the first bake of a scene is a warm up and is not measured
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <cmath>
+#include <assert.h>
+#include "../hwrtl_gi.h"
+
+using namespace hwrtl;
+using namespace hwrtl::gi;
+
+#pragma warning (disable: 4996)
+
+/***************************************************************************
+* Deterministic Random
+* 
+* std distributions are implementation defined, use pcg32 and map the bits ourselves
+***************************************************************************/
+
+struct SBenchmarkRandom
+{
+    uint64_t m_state;
+
+    SBenchmarkRandom(uint64_t seed) : m_state(seed * 6364136223846793005ull + 1442695040888963407ull) {}
+
+    uint32_t NextUint()
+    {
+        uint64_t oldState = m_state;
+        m_state = oldState * 6364136223846793005ull + 1442695040888963407ull;
+        uint32_t xorShifted = uint32_t(((oldState >> 18u) ^ oldState) >> 27u);
+        uint32_t rot = uint32_t(oldState >> 59u);
+        return (xorShifted >> rot) | (xorShifted << ((~rot + 1u) & 31));
+    }
+
+    // [minValue, maxValue)
+    float NextFloat(float minValue, float maxValue)
+    {
+        return minValue + (maxValue - minValue) * float(NextUint() >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+/***************************************************************************
+* Scene Generators
+***************************************************************************/
+
+struct SBenchmarkMesh
+{
+    std::vector<Vec3> m_positions;
+    std::vector<Vec2> m_lightMapUVs; // chart local [0,1] uvs until LayoutLightMapCharts
+    std::vector<Vec3> m_normals;
+    std::vector<Vec2> m_textureUVs; // chart local [0,1] uvs
+    std::vector<uint32_t> m_chartFirstVertex;
+    Vec2i m_lightMapSize;
+
+    Vec3 m_baseColor = Vec3(0.55f, 0.55f, 0.55f);
+    std::vector<uint32_t> m_baseColorTexels; // optional, rgba8 srgb
+    Vec2i m_baseColorSize;
+    bool m_bAlphaMasked = false; // uses SBenchmarkScene::m_alphaMask
+};
+
+struct SBenchmarkLight
+{
+    bool m_bDirectional;
+    Vec3 m_color;
+    Vec3 m_positionOrDirection;
+    float m_attenuation;
+    float m_radius;
+};
+
+struct SBenchmarkInstance
+{
+    uint32_t m_meshIndex;
+    Vec3 m_scale;
+    Vec3 m_translate;
+};
+
+struct SBenchmarkScene
+{
+    std::string m_name;
+    std::vector<SBenchmarkMesh> m_meshes;
+    std::vector<SBenchmarkInstance> m_instances;
+    std::vector<SBenchmarkLight> m_lights;
+    std::vector<Vec3> m_environmentRadiance; // optional, see SetEnvironmentLight
+    Vec2i m_environmentSize;
+    std::vector<uint8_t> m_alphaMask; // shared by the alpha masked meshes
+    Vec2i m_alphaMaskSize;
+};
+
+struct SBenchmarkParams
+{
+    uint32_t m_triangleNum;
+    uint32_t m_lightNum;
+    uint32_t m_instanceNum; // city block only
+    uint32_t m_atlasSize;
+};
+
+static float Vec3Length(Vec3 vec)
+{
+    return std::sqrt(vec.x * vec.x + vec.y * vec.y + vec.z * vec.z);
+}
+
+// a subdivided quad chart: origin + u * axisU + v * axisV, the winding follows the normal
+static void AddGridChart(SBenchmarkMesh& mesh, Vec3 origin, Vec3 axisU, Vec3 axisV, Vec3 normal, uint32_t subdivision)
+{
+    Vec3 windingNormal = CrossVec3(axisV, axisU);
+    if (windingNormal.Dot(normal) < 0.0f)
+    {
+        std::swap(axisU, axisV);
+    }
+
+    mesh.m_chartFirstVertex.push_back(uint32_t(mesh.m_positions.size()));
+    float invSubdivision = 1.0f / float(subdivision);
+    for (uint32_t y = 0; y < subdivision; y++)
+    {
+        for (uint32_t x = 0; x < subdivision; x++)
+        {
+            Vec2 uv0 = Vec2(float(x + 0), float(y + 0)) * invSubdivision;
+            Vec2 uv1 = Vec2(float(x + 1), float(y + 0)) * invSubdivision;
+            Vec2 uv2 = Vec2(float(x + 1), float(y + 1)) * invSubdivision;
+            Vec2 uv3 = Vec2(float(x + 0), float(y + 1)) * invSubdivision;
+
+            const Vec2 triangleUVs[6] = { uv0, uv1, uv2, uv0, uv2, uv3 };
+            for (uint32_t index = 0; index < 6; index++)
+            {
+                mesh.m_positions.push_back(origin + axisU * triangleUVs[index].x + axisV * triangleUVs[index].y);
+                mesh.m_lightMapUVs.push_back(triangleUVs[index]);
+                mesh.m_normals.push_back(normal);
+                mesh.m_textureUVs.push_back(triangleUVs[index]);
+            }
+        }
+    }
+}
+
+// faceMask bit n skips the face n (-x, +x, -y, +y, -z, +z)
+static void AddBox(SBenchmarkMesh& mesh, Vec3 center, Vec3 halfExtent, uint32_t subdivision, bool bInward, uint32_t faceMask = 0)
+{
+    const Vec3 axes[3] = { Vec3(1, 0, 0), Vec3(0, 1, 0), Vec3(0, 0, 1) };
+    const float extents[3] = { halfExtent.x, halfExtent.y, halfExtent.z };
+
+    for (uint32_t faceIndex = 0; faceIndex < 6; faceIndex++)
+    {
+        if (faceMask & (1u << faceIndex))
+        {
+            continue;
+        }
+
+        uint32_t axisIndex = faceIndex / 2;
+        float faceSign = (faceIndex % 2) == 0 ? -1.0f : 1.0f;
+        Vec3 axisU = axes[(axisIndex + 1) % 3] * (2.0f * extents[(axisIndex + 1) % 3]);
+        Vec3 axisV = axes[(axisIndex + 2) % 3] * (2.0f * extents[(axisIndex + 2) % 3]);
+        Vec3 faceCenter = center + axes[axisIndex] * (faceSign * extents[axisIndex]);
+        Vec3 normal = axes[axisIndex] * (bInward ? -faceSign : faceSign);
+        AddGridChart(mesh, faceCenter - axisU * 0.5f - axisV * 0.5f, axisU, axisV, normal, subdivision);
+    }
+}
+
+// lay the charts out on a grid with one texel of padding around each chart
+static void LayoutLightMapCharts(SBenchmarkMesh& mesh, uint32_t chartTexels, uint32_t atlasSize)
+{
+    uint32_t chartNum = uint32_t(mesh.m_chartFirstVertex.size());
+    uint32_t columnNum = uint32_t(std::ceil(std::sqrt(double(chartNum))));
+    uint32_t rowNum = (chartNum + columnNum - 1) / columnNum;
+
+    // the atlas packer needs two more texels of padding
+    uint32_t maxMeshSize = atlasSize - 2;
+    while (chartTexels > 1 && (chartTexels + 2) * columnNum > maxMeshSize)
+    {
+        chartTexels /= 2;
+    }
+
+    uint32_t cellSize = chartTexels + 2;
+    mesh.m_lightMapSize = Vec2i(cellSize * columnNum, cellSize * rowNum);
+    assert(uint32_t(mesh.m_lightMapSize.x) <= maxMeshSize && uint32_t(mesh.m_lightMapSize.y) <= maxMeshSize);
+
+    for (uint32_t chartIndex = 0; chartIndex < chartNum; chartIndex++)
+    {
+        uint32_t beginVertex = mesh.m_chartFirstVertex[chartIndex];
+        uint32_t endVertex = chartIndex + 1 < chartNum ? mesh.m_chartFirstVertex[chartIndex + 1] : uint32_t(mesh.m_positions.size());
+        Vec2 chartOffset = Vec2(float((chartIndex % columnNum) * cellSize + 1), float((chartIndex / columnNum) * cellSize + 1));
+
+        for (uint32_t vertexIndex = beginVertex; vertexIndex < endVertex; vertexIndex++)
+        {
+            Vec2 texelUV = chartOffset + mesh.m_lightMapUVs[vertexIndex] * float(chartTexels);
+            mesh.m_lightMapUVs[vertexIndex] = texelUV / Vec2(mesh.m_lightMapSize);
+        }
+    }
+}
+
+static uint32_t PackSRGB8(Vec3 linearColor)
+{
+    uint32_t packedColor = 255u << 24;
+    const float channels[3] = { linearColor.x, linearColor.y, linearColor.z };
+    for (uint32_t channel = 0; channel < 3; channel++)
+    {
+        float value = std::min(std::max(channels[channel], 0.0f), 1.0f);
+        float srgbValue = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+        packedColor |= uint32_t(srgbValue * 255.0f + 0.5f) << (channel * 8);
+    }
+    return packedColor;
+}
+
+static uint32_t SubdivisionForTriangles(uint32_t triangleNum, uint32_t chartNum)
+{
+    return std::max(uint32_t(std::sqrt(double(triangleNum) / double(2 * chartNum))), 1u);
+}
+
+static void AddIdentityInstance(SBenchmarkScene& scene, uint32_t meshIndex)
+{
+    scene.m_instances.push_back(SBenchmarkInstance{ meshIndex, Vec3(1, 1, 1), Vec3(0, 0, 0) });
+}
+
+// equirectangular sky, z up, the first row is the zenith: a blue gradient above the horizon and a dark ground below it
+static void GenerateSkyEnvironment(SBenchmarkScene& scene, uint32_t width, uint32_t height)
+{
+    const float pi = 3.14159265f;
+    const Vec3 zenithRadiance = Vec3(0.15f, 0.3f, 0.7f);
+    const Vec3 horizonRadiance = Vec3(0.7f, 0.75f, 0.8f);
+    const Vec3 groundRadiance = Vec3(0.08f, 0.07f, 0.06f);
+
+    scene.m_environmentSize = Vec2i(width, height);
+    scene.m_environmentRadiance.resize(width * height);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        float cosTheta = std::cos((float(y) + 0.5f) / float(height) * pi);
+        Vec3 radiance = cosTheta > 0.0f ? horizonRadiance * (1.0f - cosTheta) + zenithRadiance * cosTheta : groundRadiance;
+        for (uint32_t x = 0; x < width; x++)
+        {
+            scene.m_environmentRadiance[y * width + x] = radiance;
+        }
+    }
+}
+
+// closed room without the front wall and two boxes inside, sphere lights on a grid below the ceiling
+// the room has a base color texture with one column per wall: red -x wall, green +x wall, the other walls and the boxes are white
+static void GenerateCornellBox(SBenchmarkScene& scene, const SBenchmarkParams& params)
+{
+    scene.m_name = "cornell_box";
+
+    uint32_t chartNum = 5 + 6 * 2;
+    uint32_t subdivision = SubdivisionForTriangles(params.m_triangleNum, chartNum);
+    const Vec3 whiteColor = Vec3(0.725f, 0.71f, 0.68f);
+
+    SBenchmarkMesh room;
+    AddBox(room, Vec3(0, 0, 4), Vec3(4, 4, 4), subdivision, true, 1u << 2);
+    LayoutLightMapCharts(room, 256, params.m_atlasSize);
+
+    const uint32_t wallNum = uint32_t(room.m_chartFirstVertex.size());
+    const uint32_t wallTexels = 16;
+    for (uint32_t wallIndex = 0; wallIndex < wallNum; wallIndex++)
+    {
+        uint32_t endVertex = wallIndex + 1 < wallNum ? room.m_chartFirstVertex[wallIndex + 1] : uint32_t(room.m_textureUVs.size());
+        for (uint32_t vertexIndex = room.m_chartFirstVertex[wallIndex]; vertexIndex < endVertex; vertexIndex++)
+        {
+            room.m_textureUVs[vertexIndex].x = (float(wallIndex) + room.m_textureUVs[vertexIndex].x) / float(wallNum);
+        }
+    }
+
+    room.m_baseColorSize = Vec2i(wallNum * wallTexels, wallTexels);
+    for (uint32_t y = 0; y < wallTexels; y++)
+    {
+        for (uint32_t x = 0; x < wallNum * wallTexels; x++)
+        {
+            uint32_t wallIndex = x / wallTexels;
+            room.m_baseColorTexels.push_back(PackSRGB8(wallIndex == 0 ? Vec3(0.63f, 0.065f, 0.05f) : (wallIndex == 1 ? Vec3(0.14f, 0.45f, 0.091f) : whiteColor)));
+        }
+    }
+
+    SBenchmarkMesh tallBox;
+    AddBox(tallBox, Vec3(-1.5f, 1.0f, 2.5f), Vec3(1.0f, 1.0f, 2.5f), subdivision, false, 1u << 4);
+    LayoutLightMapCharts(tallBox, 64, params.m_atlasSize);
+    tallBox.m_baseColor = whiteColor;
+
+    SBenchmarkMesh shortBox;
+    AddBox(shortBox, Vec3(1.5f, -1.0f, 1.0f), Vec3(1.0f, 1.0f, 1.0f), subdivision, false, 1u << 4);
+    LayoutLightMapCharts(shortBox, 64, params.m_atlasSize);
+    shortBox.m_baseColor = whiteColor;
+
+    scene.m_meshes.push_back(room);
+    scene.m_meshes.push_back(tallBox);
+    scene.m_meshes.push_back(shortBox);
+    for (uint32_t index = 0; index < scene.m_meshes.size(); index++)
+    {
+        AddIdentityInstance(scene, index);
+    }
+
+    uint32_t lightGrid = uint32_t(std::ceil(std::sqrt(double(params.m_lightNum))));
+    for (uint32_t index = 0; index < params.m_lightNum; index++)
+    {
+        float x = (float(index % lightGrid) + 0.5f) / float(lightGrid) * 6.0f - 3.0f;
+        float y = (float(index / lightGrid) + 0.5f) / float(lightGrid) * 6.0f - 3.0f;
+        float intensity = 4.0f / float(params.m_lightNum);
+        scene.m_lights.push_back(SBenchmarkLight{ false, Vec3(intensity, intensity, intensity), Vec3(x, y, 7.5f), 8.0f, 0.25f });
+    }
+}
+
+// one building mesh instanced on a grid with random heights, a ground plane, the sun, the sky and street lights
+static void GenerateCityBlock(SBenchmarkScene& scene, const SBenchmarkParams& params)
+{
+    scene.m_name = "city_block";
+    SBenchmarkRandom random(0xC17B10C);
+
+    uint32_t instanceNum = std::max(params.m_instanceNum, 1u);
+    uint32_t subdivision = SubdivisionForTriangles(params.m_triangleNum / instanceNum, 5);
+
+    SBenchmarkMesh building;
+    AddBox(building, Vec3(0, 0, 1), Vec3(1, 1, 1), subdivision, false, 1u << 4);
+    LayoutLightMapCharts(building, 32, params.m_atlasSize);
+
+    uint32_t gridSize = uint32_t(std::ceil(std::sqrt(double(instanceNum))));
+    float blockSize = 6.0f;
+    float halfCity = float(gridSize) * blockSize * 0.5f;
+
+    SBenchmarkMesh ground;
+    AddGridChart(ground, Vec3(-halfCity - blockSize, -halfCity - blockSize, 0), Vec3(2.0f * halfCity + 2.0f * blockSize, 0, 0), Vec3(0, 2.0f * halfCity + 2.0f * blockSize, 0), Vec3(0, 0, 1), 4);
+    LayoutLightMapCharts(ground, params.m_atlasSize, params.m_atlasSize);
+
+    scene.m_meshes.push_back(building);
+    scene.m_meshes.push_back(ground);
+    AddIdentityInstance(scene, 1);
+
+    for (uint32_t index = 0; index < instanceNum; index++)
+    {
+        float x = (float(index % gridSize) + 0.5f) * blockSize - halfCity;
+        float y = (float(index / gridSize) + 0.5f) * blockSize - halfCity;
+        Vec3 scale = Vec3(random.NextFloat(1.5f, 2.5f), random.NextFloat(1.5f, 2.5f), random.NextFloat(2.0f, 12.0f));
+        scene.m_instances.push_back(SBenchmarkInstance{ 0, scale, Vec3(x, y, 0) });
+    }
+
+    scene.m_lights.push_back(SBenchmarkLight{ true, Vec3(1.0f, 0.95f, 0.85f), Vec3(-0.4f, -0.3f, -1.0f), 0.0f, 0.0f });
+    for (uint32_t index = 1; index < params.m_lightNum; index++)
+    {
+        Vec3 position = Vec3(random.NextFloat(-halfCity, halfCity), random.NextFloat(-halfCity, halfCity), 3.0f);
+        scene.m_lights.push_back(SBenchmarkLight{ false, Vec3(1.0f, 0.8f, 0.5f), position, 10.0f, 0.2f });
+    }
+
+    GenerateSkyEnvironment(scene, 256, 128);
+}
+
+// patches of small randomly oriented leaf cards over a ground plane, every patch is a unique mesh
+// the leaf cards share an alpha mask: a leaf shape with a transparent border, so the opacity micro maps have opaque, transparent and unknown micro triangles
+static void GenerateFoliageField(SBenchmarkScene& scene, const SBenchmarkParams& params)
+{
+    scene.m_name = "foliage_field";
+    SBenchmarkRandom random(0xF011A6E);
+
+    const uint32_t maskSize = 32;
+    scene.m_alphaMaskSize = Vec2i(maskSize, maskSize);
+    for (uint32_t y = 0; y < maskSize; y++)
+    {
+        for (uint32_t x = 0; x < maskSize; x++)
+        {
+            // pointed at both ends of the u axis, widest in the middle
+            float u = (float(x) + 0.5f) / float(maskSize) * 2.0f - 1.0f;
+            float v = (float(y) + 0.5f) / float(maskSize) * 2.0f - 1.0f;
+            float halfWidth = 0.6f * (1.0f - u * u);
+            scene.m_alphaMask.push_back(std::abs(v) < halfWidth ? 255 : 0);
+        }
+    }
+
+    const uint32_t leavesPerPatch = 4096;
+    const float patchSize = 4.0f;
+
+    uint32_t leafNum = std::max(params.m_triangleNum / 2, 1u);
+    uint32_t patchNum = (leafNum + leavesPerPatch - 1) / leavesPerPatch;
+    uint32_t patchGrid = uint32_t(std::ceil(std::sqrt(double(patchNum))));
+    float halfField = float(patchGrid) * patchSize * 0.5f;
+
+    SBenchmarkMesh ground;
+    AddGridChart(ground, Vec3(-halfField, -halfField, 0), Vec3(2.0f * halfField, 0, 0), Vec3(0, 2.0f * halfField, 0), Vec3(0, 0, 1), 4);
+    LayoutLightMapCharts(ground, params.m_atlasSize, params.m_atlasSize);
+    scene.m_meshes.push_back(ground);
+    AddIdentityInstance(scene, 0);
+
+    for (uint32_t patchIndex = 0; patchIndex < patchNum; patchIndex++)
+    {
+        Vec3 patchMin = Vec3(float(patchIndex % patchGrid) * patchSize - halfField, float(patchIndex / patchGrid) * patchSize - halfField, 0);
+        uint32_t patchLeafNum = std::min(leavesPerPatch, leafNum - patchIndex * leavesPerPatch);
+
+        SBenchmarkMesh patch;
+        for (uint32_t leafIndex = 0; leafIndex < patchLeafNum; leafIndex++)
+        {
+            Vec3 leafCenter = patchMin + Vec3(random.NextFloat(0, patchSize), random.NextFloat(0, patchSize), random.NextFloat(0.05f, 1.5f));
+            Vec3 normal = NormalizeVec3(Vec3(random.NextFloat(-1, 1), random.NextFloat(-1, 1), random.NextFloat(0.2f, 1.0f)));
+            Vec3 tangent = NormalizeVec3(CrossVec3(std::abs(normal.z) < 0.9f ? Vec3(0, 0, 1) : Vec3(1, 0, 0), normal));
+            Vec3 bitangent = CrossVec3(normal, tangent);
+
+            float leafSize = random.NextFloat(0.05f, 0.15f);
+            AddGridChart(patch, leafCenter - tangent * leafSize * 0.5f - bitangent * leafSize * 0.5f, tangent * leafSize, bitangent * leafSize, normal, 1);
+        }
+        LayoutLightMapCharts(patch, 2, params.m_atlasSize);
+        patch.m_bAlphaMasked = true;
+
+        scene.m_meshes.push_back(patch);
+        AddIdentityInstance(scene, uint32_t(scene.m_meshes.size() - 1));
+    }
+
+    scene.m_lights.push_back(SBenchmarkLight{ true, Vec3(1.0f, 1.0f, 0.9f), Vec3(0.3f, 0.2f, -1.0f), 0.0f, 0.0f });
+    for (uint32_t index = 1; index < params.m_lightNum; index++)
+    {
+        Vec3 position = Vec3(random.NextFloat(-halfField, halfField), random.NextFloat(-halfField, halfField), 2.0f);
+        scene.m_lights.push_back(SBenchmarkLight{ false, Vec3(0.6f, 0.9f, 0.6f), position, 4.0f, 0.1f });
+    }
+}
+
+// a long closed corridor, one segment per light, every light sees only a few segments but every hit shades all the lights
+static void GenerateCorridor(SBenchmarkScene& scene, const SBenchmarkParams& params)
+{
+    scene.m_name = "corridor";
+
+    const float segmentLength = 4.0f;
+    uint32_t segmentNum = std::max(params.m_lightNum, 1u);
+    uint32_t subdivision = SubdivisionForTriangles(params.m_triangleNum, segmentNum * 4);
+
+    // split the corridor into meshes that fit into the atlas
+    const uint32_t segmentsPerMesh = 16;
+    for (uint32_t firstSegment = 0; firstSegment < segmentNum; firstSegment += segmentsPerMesh)
+    {
+        SBenchmarkMesh corridorPart;
+        for (uint32_t segmentIndex = firstSegment; segmentIndex < std::min(firstSegment + segmentsPerMesh, segmentNum); segmentIndex++)
+        {
+            Vec3 center = Vec3((float(segmentIndex) + 0.5f) * segmentLength, 0, 1.5f);
+            AddBox(corridorPart, center, Vec3(segmentLength * 0.5f, 1.5f, 1.5f), subdivision, true, (1u << 0) | (1u << 1));
+        }
+        LayoutLightMapCharts(corridorPart, 64, params.m_atlasSize);
+        scene.m_meshes.push_back(corridorPart);
+        AddIdentityInstance(scene, uint32_t(scene.m_meshes.size() - 1));
+    }
+
+    for (uint32_t index = 0; index < params.m_lightNum; index++)
+    {
+        float hue = float(index % 3);
+        Vec3 color = Vec3(hue == 0 ? 1.0f : 0.3f, hue == 1 ? 1.0f : 0.3f, hue == 2 ? 1.0f : 0.3f);
+        scene.m_lights.push_back(SBenchmarkLight{ false, color, Vec3((float(index) + 0.5f) * segmentLength, 0, 2.7f), 6.0f, 0.15f });
+    }
+}
+
+/***************************************************************************
+* Benchmark
+***************************************************************************/
+
+enum EBenchmarkStage
+{
+    BS_UPLOAD = 0,
+    BS_PACKING,
+    BS_GBUFFER,
+    BS_RT_PREPARE, // acceleration structure build on the gpu and ray tracing pipeline creation
+    BS_TRACING,
+    BS_DENOISE,
+    BS_ENCODE,
+    BS_READBACK,
+    BS_TOTAL,
+    BS_NUM,
+};
+
+static const char* benchmarkStageNames[BS_NUM] = { "upload", "packing", "gbuffer", "rt_prepare", "tracing", "denoise", "encode", "readback", "total" };
+
+struct SBenchmarkRun
+{
+    double m_stageMs[BS_NUM] = {};
+    uint64_t m_rayNum = 0;
+    double m_megaRaysPerSecond = 0.0;
+    uint64_t m_peakMemoryBytes = 0;
+    uint32_t m_atlasNum = 0;
+    uint64_t m_texelNum = 0;
+    uint64_t m_irradianceHash = 0;
+};
+
+struct SBenchmarkCpuProbeRun
+{
+    uint64_t m_rayNum = 0;
+    double m_nodesPerRay = 0.0;
+    double m_megaRaysPerSecond = 0.0;
+    double m_reorderMs = 0.0;
+};
+
+struct SBenchmarkResult
+{
+    std::string m_sceneName;
+    uint64_t m_triangleNum = 0;
+    uint32_t m_meshNum = 0;
+    uint32_t m_instanceNum = 0;
+    uint32_t m_lightNum = 0;
+    std::vector<SBenchmarkRun> m_runs;
+    std::vector<SBenchmarkCpuProbeRun> m_cpuProbeRuns; // in ray order, reordered
+};
+
+static double GetElapsedMs(std::chrono::steady_clock::time_point beginTime)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - beginTime).count();
+}
+
+// packing is an internal step of the gbuffer prepare pass, take it from the profile zones
+static double GetProfileZoneMs(const std::vector<SProfileZone>& zones, const std::string& zoneName)
+{
+    double zoneMs = 0.0;
+    for (uint32_t index = 0; index < zones.size(); index++)
+    {
+        std::string name = zones[index].m_name;
+        if (name.size() >= zoneName.size() && name.compare(name.size() - zoneName.size(), zoneName.size(), zoneName) == 0)
+        {
+            zoneMs += double(zones[index].m_durationNs) * 1e-6;
+        }
+    }
+    return zoneMs;
+}
+
+static uint64_t HashBytes(uint64_t hash, const uint8_t* pData, uint64_t byteSize)
+{
+    for (uint64_t index = 0; index < byteSize; index++)
+    {
+        hash = (hash ^ pData[index]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static void SetMeshMaterial(const SBenchmarkScene& scene, const SBenchmarkMesh& mesh, SBakeMeshDesc& bakeMeshDesc)
+{
+    bakeMeshDesc.m_baseColor = mesh.m_baseColor;
+    if (!mesh.m_baseColorTexels.empty())
+    {
+        bakeMeshDesc.m_pTextureUVData = mesh.m_textureUVs.data();
+        bakeMeshDesc.m_pBaseColorData = mesh.m_baseColorTexels.data();
+        bakeMeshDesc.m_baseColorSize = mesh.m_baseColorSize;
+    }
+    if (mesh.m_bAlphaMasked)
+    {
+        bakeMeshDesc.m_pTextureUVData = mesh.m_textureUVs.data();
+        bakeMeshDesc.m_pAlphaMaskData = scene.m_alphaMask.data();
+        bakeMeshDesc.m_alphaMaskSize = scene.m_alphaMaskSize;
+    }
+}
+
+static void AddSceneLights(const SBenchmarkScene& scene)
+{
+    for (uint32_t index = 0; index < scene.m_lights.size(); index++)
+    {
+        const SBenchmarkLight& light = scene.m_lights[index];
+        if (light.m_bDirectional)
+        {
+            AddDirectionalLight(light.m_color, light.m_positionOrDirection, false);
+        }
+        else
+        {
+            AddSphereLight(light.m_color, light.m_positionOrDirection, false, light.m_attenuation, light.m_radius);
+        }
+    }
+
+    if (!scene.m_environmentRadiance.empty())
+    {
+        SetEnvironmentLight(scene.m_environmentRadiance.data(), scene.m_environmentSize, 1.0f, false);
+    }
+}
+
+static SBenchmarkRun BakeScene(const SBenchmarkScene& scene, uint32_t atlasSize, uint32_t bakerSamples, uint32_t streamWindow)
+{
+    SBenchmarkRun run;
+
+    SBakeConfig bakeConfig;
+    bakeConfig.m_maxAtlasSize = atlasSize;
+    bakeConfig.m_bakerSamples = bakerSamples;
+    bakeConfig.m_bCollectRayStats = true; // the ray counters cost a few percent of the tracing time, every run pays the same cost
+
+    std::vector<SBakeMeshDesc> bakeMeshDescs;
+    for (uint32_t index = 0; index < scene.m_instances.size(); index++)
+    {
+        const SBenchmarkInstance& instance = scene.m_instances[index];
+        const SBenchmarkMesh& mesh = scene.m_meshes[instance.m_meshIndex];
+
+        SBakeMeshDesc bakeMeshDesc;
+        bakeMeshDesc.m_meshInstanceInfo.m_instanceFlag = EInstanceFlag::FRONTFACE_CCW;
+        bakeMeshDesc.m_meshInstanceInfo.m_transform[0][0] = instance.m_scale.x;
+        bakeMeshDesc.m_meshInstanceInfo.m_transform[1][1] = instance.m_scale.y;
+        bakeMeshDesc.m_meshInstanceInfo.m_transform[2][2] = instance.m_scale.z;
+        bakeMeshDesc.m_meshInstanceInfo.m_transform[0][3] = instance.m_translate.x;
+        bakeMeshDesc.m_meshInstanceInfo.m_transform[1][3] = instance.m_translate.y;
+        bakeMeshDesc.m_meshInstanceInfo.m_transform[2][3] = instance.m_translate.z;
+        bakeMeshDesc.m_pPositionData = mesh.m_positions.data();
+        bakeMeshDesc.m_pLightMapUVData = mesh.m_lightMapUVs.data();
+        bakeMeshDesc.m_pNormalData = mesh.m_normals.data();
+        bakeMeshDesc.m_nVertexCount = uint32_t(mesh.m_positions.size());
+        bakeMeshDesc.m_nLightMapSize = mesh.m_lightMapSize;
+        bakeMeshDesc.m_meshIndex = int(index);
+        SetMeshMaterial(scene, mesh, bakeMeshDesc);
+        bakeMeshDescs.push_back(bakeMeshDesc);
+    }
+
+    auto totalBeginTime = std::chrono::steady_clock::now();
+
+    InitGIBaker(bakeConfig);
+    ResetProfiler();
+    ResetMemoryPeak();
+
+    auto beginTime = std::chrono::steady_clock::now();
+    AddBakeMeshsAndCreateVB(bakeMeshDescs);
+    run.m_stageMs[BS_UPLOAD] = GetElapsedMs(beginTime);
+
+    AddSceneLights(scene);
+
+    std::vector<SOutputAtlasInfo> outputAtlas;
+    std::vector<SProfileZone> profileZones;
+    if (streamWindow > 0)
+    {
+        // the passes are interleaved per atlas window, the stage times are the sums of the profile zones
+        // and don't include the pipeline state creation, except for rt_prepare which is the whole ray tracing prepare pass
+        BakeLightMapStreaming(outputAtlas, streamWindow);
+
+        GetProfileZones(profileZones);
+        run.m_stageMs[BS_GBUFFER] = GetProfileZoneMs(profileZones, "ExecuteGBufferPassForAtlases");
+        run.m_stageMs[BS_TRACING] = GetProfileZoneMs(profileZones, "ExecuteRayTracingPassForAtlases");
+        run.m_stageMs[BS_DENOISE] = GetProfileZoneMs(profileZones, "ExecuteDenoiseLightMapPass") + GetProfileZoneMs(profileZones, "ExecuteDilateLightMapPass");
+        run.m_stageMs[BS_ENCODE] = GetProfileZoneMs(profileZones, "ExecuteEncodeLightMapPass");
+        run.m_stageMs[BS_READBACK] = GetProfileZoneMs(profileZones, "ReadBackEncodedAtlas");
+        run.m_stageMs[BS_PACKING] = GetProfileZoneMs(profileZones, "PackMeshIntoAtlas");
+        run.m_stageMs[BS_RT_PREPARE] = GetProfileZoneMs(profileZones, "PrePareLightMapRayTracingPass");
+    }
+    else
+    {
+        beginTime = std::chrono::steady_clock::now();
+        PrePareLightMapGBufferPass();
+        ExecuteLightMapGBufferPass();
+        run.m_stageMs[BS_GBUFFER] = GetElapsedMs(beginTime);
+
+        // BuildRayTracingScene only records the build, it runs on the gpu at the end of the prepare pass
+        beginTime = std::chrono::steady_clock::now();
+        PrePareLightMapRayTracingPass();
+        run.m_stageMs[BS_RT_PREPARE] = GetElapsedMs(beginTime);
+
+        beginTime = std::chrono::steady_clock::now();
+        ExecuteLightMapRayTracingPass();
+        run.m_stageMs[BS_TRACING] = GetElapsedMs(beginTime);
+
+        beginTime = std::chrono::steady_clock::now();
+        DenoiseAndDilateLightMap();
+        run.m_stageMs[BS_DENOISE] = GetElapsedMs(beginTime);
+
+        beginTime = std::chrono::steady_clock::now();
+        EncodeResulttLightMap();
+        run.m_stageMs[BS_ENCODE] = GetElapsedMs(beginTime);
+
+        beginTime = std::chrono::steady_clock::now();
+        GetEncodedLightMapTexture(outputAtlas);
+        run.m_stageMs[BS_READBACK] = GetElapsedMs(beginTime);
+
+        GetProfileZones(profileZones);
+        run.m_stageMs[BS_PACKING] = GetProfileZoneMs(profileZones, "PackMeshIntoAtlas");
+        run.m_stageMs[BS_GBUFFER] -= run.m_stageMs[BS_PACKING];
+    }
+
+    SRayTracingStats rayTracingStats;
+    GetLightMapRayTracingStats(rayTracingStats);
+    run.m_rayNum = rayTracingStats.GetTotalRayCount();
+    run.m_megaRaysPerSecond = rayTracingStats.GetMegaRaysPerSecond();
+
+    SMemoryReport memoryReport;
+    GetMemoryReport(memoryReport);
+    run.m_peakMemoryBytes = memoryReport.m_peakBytes;
+
+    run.m_irradianceHash = 1469598103934665603ull;
+    run.m_atlasNum = uint32_t(outputAtlas.size());
+    for (uint32_t index = 0; index < outputAtlas.size(); index++)
+    {
+        const SOutputAtlasInfo& atlasInfo = outputAtlas[index];
+        run.m_texelNum += uint64_t(atlasInfo.m_lightMapSize.x) * uint64_t(atlasInfo.m_lightMapSize.y);
+        run.m_irradianceHash = HashBytes(run.m_irradianceHash, (const uint8_t*)atlasInfo.destIrradianceOutputData, atlasInfo.m_lightMapByteSize);
+    }
+
+    FreeLightMapCpuData();
+    DeleteGIBaker();
+
+    run.m_stageMs[BS_TOTAL] = GetElapsedMs(totalBeginTime);
+    return run;
+}
+
+static SBenchmarkCpuProbeRun TraceSceneProbes(const SBenchmarkScene& scene, uint32_t bakerSamples, uint32_t probeGrid, bool bRayReordering)
+{
+    SBakeConfig bakeConfig;
+    bakeConfig.m_bakerSamples = bakerSamples;
+    bakeConfig.m_bCpuProbeRayTracing = true;
+    bakeConfig.m_bCpuRayReordering = bRayReordering;
+
+    Vec3 sceneMin = Vec3(1e30f, 1e30f, 1e30f);
+    Vec3 sceneMax = Vec3(-1e30f, -1e30f, -1e30f);
+    std::vector<SBakeMeshDesc> bakeMeshDescs;
+    for (uint32_t index = 0; index < scene.m_instances.size(); index++)
+    {
+        const SBenchmarkInstance& instance = scene.m_instances[index];
+        const SBenchmarkMesh& mesh = scene.m_meshes[instance.m_meshIndex];
+        for (const Vec3& position : mesh.m_positions)
+        {
+            Vec3 worldPosition = position * instance.m_scale + instance.m_translate;
+            sceneMin = Vec3(std::min(sceneMin.x, worldPosition.x), std::min(sceneMin.y, worldPosition.y), std::min(sceneMin.z, worldPosition.z));
+            sceneMax = Vec3(std::max(sceneMax.x, worldPosition.x), std::max(sceneMax.y, worldPosition.y), std::max(sceneMax.z, worldPosition.z));
+        }
+
+        SBakeMeshDesc bakeMeshDesc;
+        bakeMeshDesc.m_meshInstanceInfo.m_instanceFlag = EInstanceFlag::FRONTFACE_CCW;
+        bakeMeshDesc.m_meshInstanceInfo.m_transform[0][0] = instance.m_scale.x;
+        bakeMeshDesc.m_meshInstanceInfo.m_transform[1][1] = instance.m_scale.y;
+        bakeMeshDesc.m_meshInstanceInfo.m_transform[2][2] = instance.m_scale.z;
+        bakeMeshDesc.m_meshInstanceInfo.m_transform[0][3] = instance.m_translate.x;
+        bakeMeshDesc.m_meshInstanceInfo.m_transform[1][3] = instance.m_translate.y;
+        bakeMeshDesc.m_meshInstanceInfo.m_transform[2][3] = instance.m_translate.z;
+        bakeMeshDesc.m_pPositionData = mesh.m_positions.data();
+        bakeMeshDesc.m_pLightMapUVData = mesh.m_lightMapUVs.data();
+        bakeMeshDesc.m_pNormalData = mesh.m_normals.data();
+        bakeMeshDesc.m_nVertexCount = uint32_t(mesh.m_positions.size());
+        bakeMeshDesc.m_nLightMapSize = mesh.m_lightMapSize;
+        bakeMeshDesc.m_meshIndex = int(index);
+        SetMeshMaterial(scene, mesh, bakeMeshDesc);
+        bakeMeshDescs.push_back(bakeMeshDesc);
+    }
+
+    InitGIBaker(bakeConfig);
+    AddBakeMeshsAndCreateVB(bakeMeshDescs);
+    AddSceneLights(scene);
+
+    // keep the probes off the bounding walls of the closed scenes
+    Vec3 inset = (sceneMax - sceneMin) * (0.5f / float(probeGrid));
+    AddProbeVolume(sceneMin + inset, sceneMax - inset, Vec3i(probeGrid, probeGrid, probeGrid));
+    PrePareProbeRayTracingPass();
+    ExecuteProbeRayTracingPass();
+
+    SCpuRayTracingStats cpuRayTracingStats;
+    GetCpuProbeRayTracingStats(cpuRayTracingStats);
+    DeleteGIBaker();
+
+    SBenchmarkCpuProbeRun run;
+    run.m_rayNum = cpuRayTracingStats.GetTotalRayCount();
+    run.m_nodesPerRay = cpuRayTracingStats.GetNodesPerRay();
+    run.m_megaRaysPerSecond = cpuRayTracingStats.GetMegaRaysPerSecond();
+    run.m_reorderMs = cpuRayTracingStats.m_reorderSeconds * 1e3;
+    return run;
+}
+
+static double GetStageMin(const std::vector<SBenchmarkRun>& runs, uint32_t stage)
+{
+    double minMs = runs[0].m_stageMs[stage];
+    for (uint32_t index = 1; index < runs.size(); index++)
+    {
+        minMs = std::min(minMs, runs[index].m_stageMs[stage]);
+    }
+    return minMs;
+}
+
+static double GetStageMedian(const std::vector<SBenchmarkRun>& runs, uint32_t stage)
+{
+    std::vector<double> stageMs;
+    for (uint32_t index = 0; index < runs.size(); index++)
+    {
+        stageMs.push_back(runs[index].m_stageMs[stage]);
+    }
+    std::sort(stageMs.begin(), stageMs.end());
+    return stageMs[stageMs.size() / 2];
+}
+
+static bool WriteBenchmarkReport(const std::string& reportPath, const std::vector<SBenchmarkResult>& results, uint32_t atlasSize, uint32_t bakerSamples, uint32_t streamWindow, uint32_t cpuProbeGrid)
+{
+    std::ofstream reportFile(reportPath, std::ios::out | std::ios::trunc);
+    if (!reportFile.is_open())
+    {
+        return false;
+    }
+
+    reportFile << "{\n  \"version\": 1,\n  \"backend\": \"dx12\",\n  \"profiler\": " << (HWRTL_ENABLE_PROFILER ? "true" : "false");
+    reportFile << ",\n  \"atlas_size\": " << atlasSize << ",\n  \"baker_samples\": " << bakerSamples;
+    reportFile << ",\n  \"stream_window\": " << streamWindow << ",\n  \"cpu_probe_grid\": " << cpuProbeGrid << ",\n  \"scenes\": [";
+
+    for (uint32_t resultIndex = 0; resultIndex < results.size(); resultIndex++)
+    {
+        const SBenchmarkResult& result = results[resultIndex];
+        const SBenchmarkRun& firstRun = result.m_runs[0];
+
+        reportFile << (resultIndex == 0 ? "\n" : ",\n") << "    {\n";
+        reportFile << "      \"name\": \"" << result.m_sceneName << "\",\n";
+        reportFile << "      \"triangles\": " << result.m_triangleNum << ",\n";
+        reportFile << "      \"meshes\": " << result.m_meshNum << ",\n";
+        reportFile << "      \"instances\": " << result.m_instanceNum << ",\n";
+        reportFile << "      \"lights\": " << result.m_lightNum << ",\n";
+        reportFile << "      \"atlases\": " << firstRun.m_atlasNum << ",\n";
+        reportFile << "      \"texels\": " << firstRun.m_texelNum << ",\n";
+        reportFile << "      \"repeat\": " << result.m_runs.size() << ",\n";
+        reportFile << "      \"rays\": " << firstRun.m_rayNum << ",\n";
+        reportFile << "      \"mrays_per_second\": " << firstRun.m_megaRaysPerSecond << ",\n";
+        reportFile << "      \"peak_memory_bytes\": " << firstRun.m_peakMemoryBytes << ",\n";
+        reportFile << "      \"irradiance_hash\": \"" << std::hex << firstRun.m_irradianceHash << std::dec << "\",\n";
+        if (!result.m_cpuProbeRuns.empty())
+        {
+            static const char* cpuProbeRunNames[2] = { "ray_order", "reordered" };
+            reportFile << "      \"cpu_probes\": {";
+            for (uint32_t runIndex = 0; runIndex < result.m_cpuProbeRuns.size(); runIndex++)
+            {
+                const SBenchmarkCpuProbeRun& cpuProbeRun = result.m_cpuProbeRuns[runIndex];
+                reportFile << (runIndex == 0 ? "\n" : ",\n") << "        \"" << cpuProbeRunNames[runIndex] << "\": { \"rays\": " << cpuProbeRun.m_rayNum << ", \"nodes_per_ray\": " << cpuProbeRun.m_nodesPerRay;
+                reportFile << ", \"mrays_per_second\": " << cpuProbeRun.m_megaRaysPerSecond << ", \"reorder_ms\": " << cpuProbeRun.m_reorderMs << " }";
+            }
+            reportFile << "\n      },\n";
+        }
+        reportFile << "      \"stages_ms\": {";
+        for (uint32_t stage = 0; stage < BS_NUM; stage++)
+        {
+            reportFile << (stage == 0 ? "\n" : ",\n") << "        \"" << benchmarkStageNames[stage] << "\": { \"min\": " << GetStageMin(result.m_runs, stage) << ", \"median\": " << GetStageMedian(result.m_runs, stage) << " }";
+        }
+        reportFile << "\n      }\n    }";
+    }
+
+    reportFile << "\n  ]\n}\n";
+    return reportFile.good();
+}
+
+static std::string GetArgValue(int argc, char** argv, const std::string& argName, const std::string& defaultValue)
+{
+    std::string argPrefix = "--" + argName + "=";
+    for (int index = 1; index < argc; index++)
+    {
+        std::string arg = argv[index];
+        if (arg.compare(0, argPrefix.size(), argPrefix) == 0)
+        {
+            return arg.substr(argPrefix.size());
+        }
+    }
+    return defaultValue;
+}
+
+int main(int argc, char** argv)
+{
+    std::string sceneArg = GetArgValue(argc, argv, "scene", "all");
+    std::string triangleArg = GetArgValue(argc, argv, "triangles", "");
+    std::string lightArg = GetArgValue(argc, argv, "lights", "");
+    uint32_t instanceNum = std::stoul(GetArgValue(argc, argv, "instances", "64"));
+    uint32_t atlasSize = std::stoul(GetArgValue(argc, argv, "atlas", "2048"));
+    uint32_t bakerSamples = std::stoul(GetArgValue(argc, argv, "samples", "16"));
+    uint32_t streamWindow = std::stoul(GetArgValue(argc, argv, "stream", "0"));
+    uint32_t repeatNum = std::max(uint32_t(std::stoul(GetArgValue(argc, argv, "repeat", "3"))), 1u);
+    uint32_t cpuProbeGrid = std::stoul(GetArgValue(argc, argv, "cpu_probes", "0"));
+    std::string reportPath = GetArgValue(argc, argv, "out", "gi_benchmark.json");
+
+    typedef void(*SceneGenerator)(SBenchmarkScene&, const SBenchmarkParams&);
+    struct SBenchmarkSceneDesc
+    {
+        const char* m_name;
+        SceneGenerator m_generator;
+        uint32_t m_defaultTriangleNum;
+        uint32_t m_defaultLightNum;
+    };
+
+    const SBenchmarkSceneDesc sceneDescs[] =
+    {
+        { "cornell_box", GenerateCornellBox, 20000, 1 },
+        { "city_block", GenerateCityBlock, 200000, 16 },
+        { "foliage_field", GenerateFoliageField, 500000, 1 },
+        { "corridor", GenerateCorridor, 50000, 64 },
+    };
+
+    std::vector<SBenchmarkResult> results;
+    for (const SBenchmarkSceneDesc& sceneDesc : sceneDescs)
+    {
+        if (sceneArg != "all" && sceneArg != sceneDesc.m_name)
+        {
+            continue;
+        }
+
+        SBenchmarkParams params;
+        params.m_triangleNum = triangleArg.empty() ? sceneDesc.m_defaultTriangleNum : std::stoul(triangleArg);
+        params.m_lightNum = std::max(lightArg.empty() ? sceneDesc.m_defaultLightNum : uint32_t(std::stoul(lightArg)), 1u);
+        params.m_instanceNum = instanceNum;
+        params.m_atlasSize = atlasSize;
+
+        SBenchmarkScene scene;
+        sceneDesc.m_generator(scene, params);
+
+        SBenchmarkResult result;
+        result.m_sceneName = scene.m_name;
+        result.m_meshNum = uint32_t(scene.m_meshes.size());
+        result.m_instanceNum = uint32_t(scene.m_instances.size());
+        result.m_lightNum = uint32_t(scene.m_lights.size() + (scene.m_environmentRadiance.empty() ? 0 : 1));
+        for (uint32_t index = 0; index < scene.m_instances.size(); index++)
+        {
+            result.m_triangleNum += scene.m_meshes[scene.m_instances[index].m_meshIndex].m_positions.size() / 3;
+        }
+
+        BakeScene(scene, atlasSize, bakerSamples, streamWindow); // warm up, shader compilation and driver caches
+        for (uint32_t repeatIndex = 0; repeatIndex < repeatNum; repeatIndex++)
+        {
+            result.m_runs.push_back(BakeScene(scene, atlasSize, bakerSamples, streamWindow));
+        }
+
+        std::cout << result.m_sceneName << ": " << result.m_triangleNum << " triangles, " << result.m_instanceNum << " instances, " << result.m_lightNum << " lights\n";
+        for (uint32_t stage = 0; stage < BS_NUM; stage++)
+        {
+            std::cout << "    " << benchmarkStageNames[stage] << ": " << GetStageMedian(result.m_runs, stage) << " ms\n";
+        }
+        std::cout << "    " << result.m_runs[0].m_megaRaysPerSecond << " Mrays/s\n";
+
+        if (cpuProbeGrid > 0)
+        {
+            for (bool bRayReordering : { false, true })
+            {
+                SBenchmarkCpuProbeRun cpuProbeRun = TraceSceneProbes(scene, bakerSamples, cpuProbeGrid, bRayReordering);
+                std::cout << "    cpu probes " << (bRayReordering ? "reordered" : "ray order") << ": " << cpuProbeRun.m_nodesPerRay << " nodes/ray, " << cpuProbeRun.m_megaRaysPerSecond << " Mrays/s\n";
+                result.m_cpuProbeRuns.push_back(cpuProbeRun);
+            }
+        }
+
+        results.push_back(result);
+    }
+
+    if (!WriteBenchmarkReport(reportPath, results, atlasSize, bakerSamples, streamWindow, cpuProbeGrid))
+    {
+        std::cout << "failed to write " << reportPath << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,520 @@
+/***************************************************************************
+MIT License
+
+Copyright(c) 2023 lvchengTSH
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this softwareand associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright noticeand this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+***************************************************************************/
+
+
+// light map determinism and regression check
+//
+// usage: example_gi_determinism [--samples=N] [--seed=N] [--reference=reference.hwlm] [--max-rmse=F] [--min-psnr=F] [--scene-file=scene.hwsc]
+//
+// 1. bakes the scene twice with the same seed, the two bakes must be bit identical
+// 2. bakes the scene with another seed, the difference must stay within the noise thresholds
+// 3. compares the bake with the reference container, the reference is written if it doesn't exist yet
+// 4. writes the scene as a bake scene file and maps it again, the mesh descs must match the written ones
+// 5. samples a mesh light with SampleMeshLight, the triangle counts must follow the area cdf (chi-square test)
+// 6. repeats 1 and 2 for the scene lit only by an emissive panel
+// 7. repeats 1 and 2 for the outdoor scene lit by the sun and an environment map, the ground has a base color texture
+//    and an alpha masked fence casts a shadow
+//
+// returns 0 if every check passes
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include "../hwrtl_gi.h"
+
+using namespace hwrtl;
+using namespace hwrtl::gi;
+
+#pragma warning (disable: 4996)
+
+struct SDeterminismMesh
+{
+    std::vector<Vec3> m_positions;
+    std::vector<Vec2> m_lightMapUVs;
+    std::vector<Vec3> m_normals;
+    std::vector<Vec2> m_textureUVs; // chart local [0,1] uvs
+    Vec2i m_lightMapSize;
+
+    Vec3 m_baseColor = Vec3(0.55f, 0.55f, 0.55f);
+    std::vector<uint32_t> m_baseColorTexels; // optional, rgba8 srgb
+    Vec2i m_baseColorSize;
+    std::vector<uint8_t> m_alphaMaskTexels; // optional
+    Vec2i m_alphaMaskSize;
+};
+
+struct SDeterminismScene
+{
+    std::vector<SDeterminismMesh> m_meshes;
+    bool m_bSun = false;
+    bool m_bSphereLight = false;
+    int m_emissiveMeshIndex = -1; // see AddMeshLight
+    Vec3 m_emittedRadiance;
+    std::vector<Vec3> m_environmentRadiance; // optional, see SetEnvironmentLight
+    Vec2i m_environmentSize;
+};
+
+// the encoded atlas owns a copy of the read back data, the baker data is freed with the baker
+struct SOwnedAtlas
+{
+    std::vector<SOutputAtlasInfo> m_atlas;
+    std::vector<std::vector<uint8_t>> m_irradianceData;
+    std::vector<std::vector<uint8_t>> m_directionalityData;
+};
+
+// one quad per chart, the charts are laid out in a row with two texels of padding
+static void AddQuadChart(SDeterminismMesh& mesh, Vec3 origin, Vec3 axisU, Vec3 axisV, Vec3 normal, uint32_t chartIndex, uint32_t chartNum, uint32_t chartTexels)
+{
+    if (CrossVec3(axisV, axisU).Dot(normal) < 0.0f)
+    {
+        std::swap(axisU, axisV);
+    }
+
+    float cellSize = float(chartTexels + 2);
+    float atlasWidth = cellSize * chartNum;
+    Vec2 uvOffset = Vec2((cellSize * chartIndex + 1.0f) / atlasWidth, 1.0f / cellSize);
+    Vec2 uvScale = Vec2(float(chartTexels) / atlasWidth, float(chartTexels) / cellSize);
+
+    const Vec2 quadUVs[6] = { Vec2(0, 0), Vec2(1, 0), Vec2(1, 1), Vec2(0, 0), Vec2(1, 1), Vec2(0, 1) };
+    for (uint32_t index = 0; index < 6; index++)
+    {
+        mesh.m_positions.push_back(origin + axisU * quadUVs[index].x + axisV * quadUVs[index].y);
+        mesh.m_lightMapUVs.push_back(Vec2(uvOffset.x + quadUVs[index].x * uvScale.x, uvOffset.y + quadUVs[index].y * uvScale.y));
+        mesh.m_normals.push_back(normal);
+        mesh.m_textureUVs.push_back(quadUVs[index]);
+    }
+    mesh.m_lightMapSize = Vec2i(int(atlasWidth), int(cellSize));
+}
+
+// a ground plane and an open box standing on it
+static void CreateBoxOnGroundMeshes(std::vector<SDeterminismMesh>& outMeshes)
+{
+    outMeshes.resize(2);
+
+    AddQuadChart(outMeshes[0], Vec3(-4, -4, 0), Vec3(8, 0, 0), Vec3(0, 8, 0), Vec3(0, 0, 1), 0, 1, 128);
+
+    const uint32_t boxChartTexels = 32;
+    SDeterminismMesh& boxMesh = outMeshes[1];
+    AddQuadChart(boxMesh, Vec3(-1, -1, 2), Vec3(2, 0, 0), Vec3(0, 2, 0), Vec3(0, 0, 1), 0, 5, boxChartTexels); // top
+    AddQuadChart(boxMesh, Vec3(-1, -1, 0), Vec3(0, 0, 2), Vec3(2, 0, 0), Vec3(0, -1, 0), 1, 5, boxChartTexels); // -y
+    AddQuadChart(boxMesh, Vec3(-1, 1, 0), Vec3(2, 0, 0), Vec3(0, 0, 2), Vec3(0, 1, 0), 2, 5, boxChartTexels); // +y
+    AddQuadChart(boxMesh, Vec3(-1, -1, 0), Vec3(0, 2, 0), Vec3(0, 0, 2), Vec3(-1, 0, 0), 3, 5, boxChartTexels); // -x
+    AddQuadChart(boxMesh, Vec3(1, -1, 0), Vec3(0, 0, 2), Vec3(0, 2, 0), Vec3(1, 0, 0), 4, 5, boxChartTexels); // +x
+}
+
+static void CreateDeterminismScene(SDeterminismScene& outScene)
+{
+    CreateBoxOnGroundMeshes(outScene.m_meshes);
+    outScene.m_bSun = true;
+    outScene.m_bSphereLight = true;
+}
+
+// the box lit only by a panel facing down above it
+static void CreateEmissivePanelScene(SDeterminismScene& outScene)
+{
+    CreateBoxOnGroundMeshes(outScene.m_meshes);
+    outScene.m_meshes.resize(3);
+    AddQuadChart(outScene.m_meshes[2], Vec3(-1.5, -1.5, 3.5), Vec3(3, 0, 0), Vec3(0, 3, 0), Vec3(0, 0, -1), 0, 1, 16);
+    outScene.m_emissiveMeshIndex = 2;
+    outScene.m_emittedRadiance = Vec3(4.0, 3.8, 3.5);
+}
+
+static uint32_t PackSRGB8(Vec3 linearColor)
+{
+    uint32_t packedColor = 255u << 24;
+    const float channels[3] = { linearColor.x, linearColor.y, linearColor.z };
+    for (uint32_t channel = 0; channel < 3; channel++)
+    {
+        float value = std::min(std::max(channels[channel], 0.0f), 1.0f);
+        float srgbValue = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+        packedColor |= uint32_t(srgbValue * 255.0f + 0.5f) << (channel * 8);
+    }
+    return packedColor;
+}
+
+// the box under the sun and an equirectangular sky, z up, the first row is the zenith
+// the ground repeats a checker texture four times, it is larger than the albedo cache and gets box filtered
+// the fence is a single alpha masked quad with slats and round knot holes, the slat edges cross micro triangles
+static void CreateOutdoorScene(SDeterminismScene& outScene)
+{
+    CreateBoxOnGroundMeshes(outScene.m_meshes);
+    outScene.m_bSun = true;
+
+    SDeterminismMesh& groundMesh = outScene.m_meshes[0];
+    const uint32_t checkerSize = 64;
+    groundMesh.m_baseColorSize = Vec2i(checkerSize, checkerSize);
+    for (uint32_t y = 0; y < checkerSize; y++)
+    {
+        for (uint32_t x = 0; x < checkerSize; x++)
+        {
+            groundMesh.m_baseColorTexels.push_back(PackSRGB8(((x / 8 + y / 8) % 2) == 0 ? Vec3(0.6f, 0.55f, 0.45f) : Vec3(0.2f, 0.3f, 0.15f)));
+        }
+    }
+    for (uint32_t vertexIndex = 0; vertexIndex < groundMesh.m_textureUVs.size(); vertexIndex++)
+    {
+        groundMesh.m_textureUVs[vertexIndex] = groundMesh.m_textureUVs[vertexIndex] * 4.0f;
+    }
+    outScene.m_meshes[1].m_baseColor = Vec3(0.7f, 0.68f, 0.65f);
+
+    outScene.m_meshes.resize(3);
+    SDeterminismMesh& fenceMesh = outScene.m_meshes[2];
+    AddQuadChart(fenceMesh, Vec3(-3, 2.5, 0), Vec3(6, 0, 0), Vec3(0, 0, 1.5), Vec3(0, 1, 0), 0, 1, 64);
+    const uint32_t maskWidth = 96;
+    const uint32_t maskHeight = 24;
+    fenceMesh.m_alphaMaskSize = Vec2i(maskWidth, maskHeight);
+    for (uint32_t y = 0; y < maskHeight; y++)
+    {
+        for (uint32_t x = 0; x < maskWidth; x++)
+        {
+            float knotX = float(x % 12) - 3.5f;
+            float knotY = float(y) - 12.0f;
+            bool bSlat = (x % 12) < 8;
+            bool bKnot = knotX * knotX + knotY * knotY < 4.0f;
+            fenceMesh.m_alphaMaskTexels.push_back(bSlat && !bKnot ? 255 : 0);
+        }
+    }
+
+    const float pi = 3.14159265f;
+    const uint32_t width = 64;
+    const uint32_t height = 32;
+    outScene.m_environmentSize = Vec2i(width, height);
+    outScene.m_environmentRadiance.resize(width * height);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        float cosTheta = std::cos((float(y) + 0.5f) / float(height) * pi);
+        for (uint32_t x = 0; x < width; x++)
+        {
+            // a brighter patch of sky on one side keeps the importance sampling busy
+            float skyScale = (x < width / 4) ? 3.0f : 1.0f;
+            outScene.m_environmentRadiance[y * width + x] = cosTheta > 0.0f ? Vec3(0.2f, 0.35f, 0.7f) * skyScale : Vec3(0.05f, 0.05f, 0.05f);
+        }
+    }
+}
+
+static void BakeDeterminismScene(const SDeterminismScene& scene, uint32_t bakerSamples, uint32_t bakeSeed, SOwnedAtlas& outAtlas)
+{
+    const std::vector<SDeterminismMesh>& meshes = scene.m_meshes;
+
+    SBakeConfig bakeConfig;
+    bakeConfig.m_maxAtlasSize = 1024;
+    bakeConfig.m_bakerSamples = bakerSamples;
+    bakeConfig.m_bakeSeed = bakeSeed;
+
+    std::vector<SBakeMeshDesc> bakeMeshDescs;
+    for (uint32_t index = 0; index < meshes.size(); index++)
+    {
+        SBakeMeshDesc bakeMeshDesc;
+        bakeMeshDesc.m_meshInstanceInfo.m_instanceFlag = EInstanceFlag::FRONTFACE_CCW;
+        bakeMeshDesc.m_pPositionData = meshes[index].m_positions.data();
+        bakeMeshDesc.m_pLightMapUVData = meshes[index].m_lightMapUVs.data();
+        bakeMeshDesc.m_pNormalData = meshes[index].m_normals.data();
+        bakeMeshDesc.m_nVertexCount = uint32_t(meshes[index].m_positions.size());
+        bakeMeshDesc.m_nLightMapSize = meshes[index].m_lightMapSize;
+        bakeMeshDesc.m_meshIndex = int(index);
+        bakeMeshDesc.m_baseColor = meshes[index].m_baseColor;
+        if (!meshes[index].m_baseColorTexels.empty())
+        {
+            bakeMeshDesc.m_pTextureUVData = meshes[index].m_textureUVs.data();
+            bakeMeshDesc.m_pBaseColorData = meshes[index].m_baseColorTexels.data();
+            bakeMeshDesc.m_baseColorSize = meshes[index].m_baseColorSize;
+        }
+        if (!meshes[index].m_alphaMaskTexels.empty())
+        {
+            bakeMeshDesc.m_pTextureUVData = meshes[index].m_textureUVs.data();
+            bakeMeshDesc.m_pAlphaMaskData = meshes[index].m_alphaMaskTexels.data();
+            bakeMeshDesc.m_alphaMaskSize = meshes[index].m_alphaMaskSize;
+        }
+        bakeMeshDescs.push_back(bakeMeshDesc);
+    }
+
+    InitGIBaker(bakeConfig);
+    AddBakeMeshsAndCreateVB(bakeMeshDescs);
+    if (scene.m_bSun)
+    {
+        AddDirectionalLight(Vec3(1.0, 0.95, 0.9), Vec3(-0.4, -0.3, -0.85), false);
+    }
+    if (scene.m_bSphereLight)
+    {
+        AddSphereLight(Vec3(2.0, 1.0, 0.6), Vec3(2.5, -2.5, 1.5), false, 8.0f, 0.25f);
+    }
+    if (scene.m_emissiveMeshIndex >= 0)
+    {
+        AddMeshLight(scene.m_emissiveMeshIndex, scene.m_emittedRadiance, false);
+    }
+    if (!scene.m_environmentRadiance.empty())
+    {
+        SetEnvironmentLight(scene.m_environmentRadiance.data(), scene.m_environmentSize, 1.0f, false);
+    }
+
+    PrePareLightMapGBufferPass();
+    ExecuteLightMapGBufferPass();
+    PrePareLightMapRayTracingPass();
+    ExecuteLightMapRayTracingPass();
+    DenoiseAndDilateLightMap();
+    EncodeResulttLightMap();
+
+    std::vector<SOutputAtlasInfo> outputAtlas;
+    GetEncodedLightMapTexture(outputAtlas);
+
+    outAtlas.m_atlas = outputAtlas;
+    outAtlas.m_irradianceData.resize(outputAtlas.size());
+    outAtlas.m_directionalityData.resize(outputAtlas.size());
+    for (uint32_t index = 0; index < outputAtlas.size(); index++)
+    {
+        const uint8_t* pIrradiance = (const uint8_t*)outputAtlas[index].destIrradianceOutputData;
+        const uint8_t* pDirectionality = (const uint8_t*)outputAtlas[index].destDirectionalityOutputData;
+        outAtlas.m_irradianceData[index].assign(pIrradiance, pIrradiance + outputAtlas[index].m_lightMapByteSize);
+        outAtlas.m_directionalityData[index].assign(pDirectionality, pDirectionality + outputAtlas[index].m_lightMapByteSize);
+        outAtlas.m_atlas[index].destIrradianceOutputData = outAtlas.m_irradianceData[index].data();
+        outAtlas.m_atlas[index].destDirectionalityOutputData = outAtlas.m_directionalityData[index].data();
+    }
+
+    FreeLightMapCpuData();
+    DeleteGIBaker();
+}
+
+// an odd instance count, the instance table size is not a multiple of the bake scene array alignment
+static bool CheckBakeSceneRoundTrip(const std::vector<SDeterminismMesh>& meshes, const std::string& sceneFilePath)
+{
+    std::vector<SBakeMeshDesc> bakeMeshDescs;
+    for (uint32_t index = 0; index < 3; index++)
+    {
+        const SDeterminismMesh& mesh = meshes[std::min(index, uint32_t(meshes.size() - 1))];
+
+        SBakeMeshDesc bakeMeshDesc;
+        bakeMeshDesc.m_meshInstanceInfo.m_instanceFlag = EInstanceFlag::FRONTFACE_CCW;
+        bakeMeshDesc.m_meshInstanceInfo.m_transform[0][3] = float(index) * 4.0f;
+        bakeMeshDesc.m_pPositionData = mesh.m_positions.data();
+        bakeMeshDesc.m_pLightMapUVData = mesh.m_lightMapUVs.data();
+        bakeMeshDesc.m_pNormalData = mesh.m_normals.data();
+        bakeMeshDesc.m_nVertexCount = uint32_t(mesh.m_positions.size());
+        bakeMeshDesc.m_nLightMapSize = mesh.m_lightMapSize;
+        bakeMeshDesc.m_meshIndex = int(index);
+        bakeMeshDescs.push_back(bakeMeshDesc);
+    }
+
+    SBakeSceneView sceneView;
+    if (WriteBakeScene(sceneFilePath, bakeMeshDescs, std::vector<SBakeSceneLight>()) == false || MapBakeScene(sceneFilePath, sceneView) == false)
+    {
+        return false;
+    }
+
+    std::vector<SBakeMeshDesc> mappedMeshDescs;
+    GetBakeSceneMeshDescs(sceneView, mappedMeshDescs);
+
+    bool bMatch = mappedMeshDescs.size() == bakeMeshDescs.size();
+    for (uint32_t index = 0; bMatch && index < bakeMeshDescs.size(); index++)
+    {
+        const SBakeMeshDesc& written = bakeMeshDescs[index];
+        const SBakeMeshDesc& mapped = mappedMeshDescs[index];
+        bMatch = mapped.m_nVertexCount == written.m_nVertexCount && mapped.m_meshIndex == written.m_meshIndex &&
+            mapped.m_nLightMapSize.x == written.m_nLightMapSize.x && mapped.m_nLightMapSize.y == written.m_nLightMapSize.y &&
+            mapped.m_meshInstanceInfo.m_transform[0][3] == written.m_meshInstanceInfo.m_transform[0][3] &&
+            memcmp(mapped.m_pPositionData, written.m_pPositionData, sizeof(Vec3) * written.m_nVertexCount) == 0 &&
+            memcmp(mapped.m_pLightMapUVData, written.m_pLightMapUVData, sizeof(Vec2) * written.m_nVertexCount) == 0 &&
+            mapped.m_pNormalData != nullptr && memcmp(mapped.m_pNormalData, written.m_pNormalData, sizeof(Vec3) * written.m_nVertexCount) == 0;
+    }
+
+    UnmapBakeScene(sceneView);
+    return bMatch;
+}
+
+// a row of triangles with the local areas 0, 1, 2, ... 7, the degenerated triangle must never be picked
+static bool CheckMeshLightSampler(uint32_t sampleNum)
+{
+    const uint32_t triangleNum = 8;
+    SDeterminismMesh lightMesh;
+    for (uint32_t triangleIndex = 0; triangleIndex < triangleNum; triangleIndex++)
+    {
+        float triangleWidth = float(triangleIndex) * 2.0f;
+        lightMesh.m_positions.push_back(Vec3(0, float(triangleIndex) * 2.0f, 3));
+        lightMesh.m_positions.push_back(Vec3(0, float(triangleIndex) * 2.0f + 1.0f, 3));
+        lightMesh.m_positions.push_back(Vec3(triangleWidth, float(triangleIndex) * 2.0f, 3));
+    }
+    lightMesh.m_lightMapUVs.assign(lightMesh.m_positions.size(), Vec2(0, 0));
+    lightMesh.m_normals.assign(lightMesh.m_positions.size(), Vec3(0, 0, -1));
+
+    SBakeConfig bakeConfig;
+    bakeConfig.m_maxAtlasSize = 1024;
+
+    // the instance transform scales x by 2, the areas are measured in world space
+    SBakeMeshDesc bakeMeshDesc;
+    bakeMeshDesc.m_meshInstanceInfo.m_instanceFlag = EInstanceFlag::FRONTFACE_CCW;
+    bakeMeshDesc.m_meshInstanceInfo.m_transform[0][0] = 2.0f;
+    bakeMeshDesc.m_pPositionData = lightMesh.m_positions.data();
+    bakeMeshDesc.m_pLightMapUVData = lightMesh.m_lightMapUVs.data();
+    bakeMeshDesc.m_pNormalData = lightMesh.m_normals.data();
+    bakeMeshDesc.m_nVertexCount = uint32_t(lightMesh.m_positions.size());
+    bakeMeshDesc.m_nLightMapSize = Vec2i(8, 8);
+    bakeMeshDesc.m_meshIndex = 0;
+
+    InitGIBaker(bakeConfig);
+    AddBakeMesh(bakeMeshDesc);
+    uint32_t lightIndex = AddMeshLight(0, Vec3(1, 1, 1), false);
+
+    const float totalArea = 2.0f * float(triangleNum * (triangleNum - 1) / 2);
+    std::vector<uint32_t> triangleCounts(triangleNum, 0);
+    bool bValidSamples = true;
+    std::mt19937 randomEngine(1);
+    std::uniform_real_distribution<float> randomDistribution(0.0f, 1.0f);
+    for (uint32_t sampleIndex = 0; sampleIndex < sampleNum; sampleIndex++)
+    {
+        float randomX = randomDistribution(randomEngine);
+        float randomY = randomDistribution(randomEngine);
+
+        SMeshLightSample meshLightSample;
+        if (SampleMeshLight(lightIndex, randomX, randomY, meshLightSample) == false || meshLightSample.m_triangleIndex >= triangleNum)
+        {
+            bValidSamples = false;
+            break;
+        }
+        bValidSamples = bValidSamples && std::abs(meshLightSample.m_areaPdf * totalArea - 1.0f) < 1e-4f && std::abs(meshLightSample.m_position.z - 3.0f) < 1e-4f;
+        triangleCounts[meshLightSample.m_triangleIndex]++;
+    }
+    DeleteGIBaker();
+
+    // 99.9% quantile of the chi-square distribution with triangleNum - 2 = 6 degrees of freedom
+    const double chiSquareBound = 22.46;
+    double chiSquare = 0.0;
+    for (uint32_t triangleIndex = 1; triangleIndex < triangleNum; triangleIndex++)
+    {
+        double expectedCount = double(sampleNum) * double(triangleIndex) / double(triangleNum * (triangleNum - 1) / 2);
+        chiSquare += (double(triangleCounts[triangleIndex]) - expectedCount) * (double(triangleCounts[triangleIndex]) - expectedCount) / expectedCount;
+    }
+
+    bool bPassed = bValidSamples && triangleCounts[0] == 0 && chiSquare < chiSquareBound;
+    std::cout << (bPassed ? "" : "FAILED ") << "mesh light sampler: chi-square " << chiSquare << " (bound " << chiSquareBound << ") over " << sampleNum << " samples"
+        << ", degenerated triangle samples " << triangleCounts[0] << std::endl;
+    return bPassed;
+}
+
+static void PrintDiff(const char* checkName, const SLightMapDiff& diff)
+{
+    std::cout << checkName << ": " << diff.m_differentTexelNum << "/" << diff.m_comparedTexelNum << " texels differ"
+        << ", max error " << diff.m_maxAbsError << ", rmse " << diff.m_rmse << ", psnr " << diff.m_psnr << " dB" << std::endl;
+}
+
+static std::string GetArgValue(int argc, char** argv, const std::string& argName, const std::string& defaultValue)
+{
+    std::string argPrefix = "--" + argName + "=";
+    for (int index = 1; index < argc; index++)
+    {
+        std::string arg = argv[index];
+        if (arg.compare(0, argPrefix.size(), argPrefix) == 0)
+        {
+            return arg.substr(argPrefix.size());
+        }
+    }
+    return defaultValue;
+}
+
+// bakes the scene twice with bakeSeed and once with bakeSeed + 1, outFirstBake is the first bake
+static bool CheckSeedDeterminism(const char* sceneName, const SDeterminismScene& scene, uint32_t bakerSamples, uint32_t bakeSeed, double maxRmse, double minPsnr, SOwnedAtlas& outFirstBake)
+{
+    SOwnedAtlas secondBake;
+    SOwnedAtlas reseededBake;
+    BakeDeterminismScene(scene, bakerSamples, bakeSeed, outFirstBake);
+    BakeDeterminismScene(scene, bakerSamples, bakeSeed, secondBake);
+    BakeDeterminismScene(scene, bakerSamples, bakeSeed + 1, reseededBake);
+
+    bool bPassed = true;
+
+    SLightMapDiff diff;
+    if (CompareLightMapAtlases(outFirstBake.m_atlas, secondBake.m_atlas, diff) == false || diff.IsBitIdentical() == false)
+    {
+        bPassed = false;
+        std::cout << "FAILED ";
+    }
+    PrintDiff((std::string(sceneName) + " same seed").c_str(), diff);
+
+    if (CompareLightMapAtlases(outFirstBake.m_atlas, reseededBake.m_atlas, diff) == false || diff.IsWithinThreshold(maxRmse, minPsnr) == false)
+    {
+        bPassed = false;
+        std::cout << "FAILED ";
+    }
+    PrintDiff((std::string(sceneName) + " different seed").c_str(), diff);
+
+    return bPassed;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t bakerSamples = std::stoul(GetArgValue(argc, argv, "samples", "64"));
+    uint32_t bakeSeed = std::stoul(GetArgValue(argc, argv, "seed", "0"));
+    std::string referencePath = GetArgValue(argc, argv, "reference", "determinism_reference.hwlm");
+    double maxRmse = std::stod(GetArgValue(argc, argv, "max-rmse", "4.0"));
+    double minPsnr = std::stod(GetArgValue(argc, argv, "min-psnr", "36.0"));
+    std::string sceneFilePath = GetArgValue(argc, argv, "scene-file", "determinism_scene.hwsc");
+
+    SDeterminismScene scene;
+    CreateDeterminismScene(scene);
+
+    SOwnedAtlas firstBake;
+    bool bPassed = CheckSeedDeterminism("box", scene, bakerSamples, bakeSeed, maxRmse, minPsnr, firstBake);
+
+    SLightMapDiff diff;
+    if (std::ifstream(referencePath).good())
+    {
+        SLightMapContainerView referenceContainer;
+        if (MapLightMapContainer(referencePath, referenceContainer) == false)
+        {
+            std::cout << "FAILED can't read the reference " << referencePath << std::endl;
+            return 1;
+        }
+
+        if (CompareLightMapContainer(referenceContainer, firstBake.m_atlas, diff) == false || diff.IsWithinThreshold(maxRmse, minPsnr) == false)
+        {
+            bPassed = false;
+            std::cout << "FAILED ";
+        }
+        PrintDiff("reference", diff);
+        UnmapLightMapContainer(referenceContainer);
+    }
+    else
+    {
+        bool bWritten = WriteLightMapContainer(referencePath, firstBake.m_atlas);
+        std::cout << (bWritten ? "reference written to " : "FAILED can't write the reference ") << referencePath << std::endl;
+        bPassed = bPassed && bWritten;
+    }
+
+    bool bSceneRoundTrip = CheckBakeSceneRoundTrip(scene.m_meshes, sceneFilePath);
+    std::cout << (bSceneRoundTrip ? "" : "FAILED ") << "bake scene round trip: " << sceneFilePath << std::endl;
+    bPassed = bPassed && bSceneRoundTrip;
+
+    bPassed = CheckMeshLightSampler(1u << 20) && bPassed;
+
+    SDeterminismScene emissivePanelScene;
+    CreateEmissivePanelScene(emissivePanelScene);
+    SOwnedAtlas emissivePanelBake;
+    bPassed = CheckSeedDeterminism("emissive panel", emissivePanelScene, bakerSamples, bakeSeed, maxRmse, minPsnr, emissivePanelBake) && bPassed;
+
+    SDeterminismScene outdoorScene;
+    CreateOutdoorScene(outdoorScene);
+    SOwnedAtlas outdoorBake;
+    bPassed = CheckSeedDeterminism("outdoor", outdoorScene, bakerSamples, bakeSeed, maxRmse, minPsnr, outdoorBake) && bPassed;
+
+    return bPassed ? 0 : 1;
+}
@@ -467,6 +467,13 @@ int main()
             }
         }
 
+        WriteLightMapContainer(tgaSavePath + "lightmap.hwlm", outputAtlas);
+        WriteProfilerChromeTrace(tgaSavePath + "bake_trace.json"); // open in chrome://tracing
+
+        SMemoryReport memoryReport;
+        GetMemoryReport(memoryReport);
+        std::cout << FormatMemoryReport(memoryReport);
+
         // add your code here!
         FreeLightMapCpuData();
         DeleteGIBaker();
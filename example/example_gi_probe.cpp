@@ -21,3 +21,112 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 ***************************************************************************/
+
+#include <iostream>
+#include "../hwrtl_gi.h"
+
+using namespace hwrtl;
+using namespace hwrtl::gi;
+
+#pragma warning (disable: 4996)
+/*
+// two quads: a ground plane and a wall, the probes between them receive the bounce light of both
+void CreateProbeScenePlane(Vec3 origin, Vec3 axisU, Vec3 axisV, std::vector<Vec3>& planeGeoPositions, std::vector<Vec2>& planeGeoLightMapUV)
+{
+    planeGeoPositions.resize(6);
+    planeGeoLightMapUV.resize(6);
+
+    planeGeoPositions[0] = origin; planeGeoLightMapUV[0] = Vec2(0.0, 0.0);
+    planeGeoPositions[1] = origin + axisU; planeGeoLightMapUV[1] = Vec2(1.0, 0.0);
+    planeGeoPositions[2] = origin + axisU + axisV; planeGeoLightMapUV[2] = Vec2(1.0, 1.0);
+
+    planeGeoPositions[3] = planeGeoPositions[0]; planeGeoLightMapUV[3] = planeGeoLightMapUV[0];
+    planeGeoPositions[4] = planeGeoPositions[2]; planeGeoLightMapUV[4] = planeGeoLightMapUV[2];
+    planeGeoPositions[5] = origin + axisV; planeGeoLightMapUV[5] = Vec2(0.0, 1.0);
+}
+
+std::vector<Vec3>groundPlaneGeoPositions;
+std::vector<Vec2>groundPlaneGeoLightMapUV;
+
+std::vector<Vec3>wallPlaneGeoPositions;
+std::vector<Vec2>wallPlaneGeoLightMapUV;
+
+void CreateAndAddScene(std::vector<SBakeMeshDesc>& bakeMeshDescs)
+{
+    CreateProbeScenePlane(Vec3(-4, -4, 0), Vec3(0, 8, 0), Vec3(8, 0, 0), groundPlaneGeoPositions, groundPlaneGeoLightMapUV);
+    CreateProbeScenePlane(Vec3(-4, 4, 0), Vec3(8, 0, 0), Vec3(0, 0, 8), wallPlaneGeoPositions, wallPlaneGeoLightMapUV);
+
+    SBakeMeshDesc groundPlane;
+    groundPlane.m_meshInstanceInfo = SMeshInstanceInfo();
+    groundPlane.m_meshInstanceInfo.m_instanceFlag = EInstanceFlag::FRONTFACE_CCW;
+    groundPlane.m_pPositionData = groundPlaneGeoPositions.data();
+    groundPlane.m_pLightMapUVData = groundPlaneGeoLightMapUV.data();
+    groundPlane.m_nVertexCount = 6;
+    groundPlane.m_nLightMapSize = Vec2i(256, 256);
+    groundPlane.m_meshIndex = 0;
+
+    SBakeMeshDesc wallPlane = groundPlane;
+    wallPlane.m_pPositionData = wallPlaneGeoPositions.data();
+    wallPlane.m_pLightMapUVData = wallPlaneGeoLightMapUV.data();
+    wallPlane.m_meshIndex = 1;
+
+    bakeMeshDescs.push_back(groundPlane);
+    bakeMeshDescs.push_back(wallPlane);
+}
+
+//int ProbeExampleEntry()
+int main()
+{
+    _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
+    {
+        std::vector<SBakeMeshDesc> sceneMesh;
+        CreateAndAddScene(sceneMesh);
+
+        SBakeConfig bakeConfig;
+        bakeConfig.m_maxAtlasSize = 1024;
+        bakeConfig.m_bakerSamples = 4;
+        bakeConfig.m_probeRayCount = 256;
+
+        InitGIBaker(bakeConfig);
+        AddBakeMeshsAndCreateVB(sceneMesh);
+        AddDirectionalLight(Vec3(1.0, 1.0, 1.0), Vec3(-1, -1, 1), false);
+        AddSphereLight(Vec3(1.6, 0.8, 0.8), Vec3(-2.5, 2.5, 2.5), false, 5.0, 0.5);
+
+        // 8 * 8 * 4 probes above the ground plane
+        AddProbeVolume(Vec3(-3.5, -3.5, 0.5), Vec3(3.5, 3.5, 4.0), Vec3i(8, 8, 4));
+
+        // octree probes, dense near the ground and the wall, sparse in the empty space
+        AddAdaptiveProbeVolume(Vec3(-4.5, -4.5, -0.5), Vec3(4.5, 4.5, 8.5), 4);
+
+        // the light map passes can be executed before or after the probe pass, they share the acceleration structures
+        PrePareProbeRayTracingPass();
+        ExecuteProbeRayTracingPass();
+
+        std::vector<SOutputProbeVolumeInfo> outputProbeVolumes;
+        GetProbeVolumeData(outputProbeVolumes);
+
+        std::size_t exampleFilePath = std::string(__FILE__).find("example");
+        std::string probeSavePath = std::string(__FILE__).substr(0, exampleFilePath) + "HWRT\\";
+
+        for (uint32_t index = 0; index < outputProbeVolumes.size(); index++)
+        {
+            const SOutputProbeVolumeInfo& probeVolume = outputProbeVolumes[index];
+            std::string volumeSavePath = probeSavePath + "probe_volume_" + std::to_string(index) + ".bin";
+
+            // resolution + packed rgb sh coefficients + depth moments + adaptive volume lookup data, see SOutputProbeVolumeInfo
+            FILE* volumeFile = fopen(volumeSavePath.c_str(), "wb");
+            fwrite(&probeVolume.m_probeResolution, sizeof(Vec3i), 1, volumeFile);
+            fwrite(probeVolume.m_shCoefficients.data(), sizeof(float), probeVolume.m_shCoefficients.size(), volumeFile);
+            fwrite(&probeVolume.m_probeMaxDepth, sizeof(float), 1, volumeFile);
+            fwrite(probeVolume.m_depthMoments.data(), sizeof(uint16_t), probeVolume.m_depthMoments.size(), volumeFile);
+            fwrite(probeVolume.m_indirection.data(), sizeof(uint32_t), probeVolume.m_indirection.size(), volumeFile);
+            fwrite(probeVolume.m_bricks.data(), sizeof(SProbeBrick), probeVolume.m_bricks.size(), volumeFile);
+            fclose(volumeFile);
+        }
+
+        // add your code here!
+        DeleteGIBaker();
+    }
+    _CrtDumpMemoryLeaks();
+    return 0;
+}*/
@@ -0,0 +1,330 @@
+/***************************************************************************
+MIT License
+
+Copyright(c) 2023 lvchengTSH
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this softwareand associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright noticeand this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+***************************************************************************/
+
+
+// command line light map bake driver, runs a full bake of a bake scene file (see WriteBakeScene)
+//
+// usage: hwrtl_bake --scene=scene.hwsc --out=output_dir [--atlas=N] [--samples=N] [--seed=N] [--mode=lighting|ao] [--ao-distance=F]
+//                   [--stream=N] [--sh-l2] [--compact-gbuffer] [--ray-stats] [--tga] [--trace]
+//
+// --stream=N bakes N atlases at a time with BakeLightMapStreaming, 0 runs the separate passes on all atlases at once
+//
+// output_dir/lightmap.hwlm          light map container, see WriteLightMapContainer
+// output_dir/bake_summary.json      stage times, ray throughput and peak memory
+// output_dir/atlas_N_*.tga          encoded irradiance and directionality of every atlas if --tga is set
+// output_dir/bake_trace.json        profiler chrome trace if --trace is set
+//
+// the output directory is created if its parent exists, the exit code is one of EBakeExitCode
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <string>
+#include <direct.h>
+#include "../hwrtl_gi.h"
+
+using namespace hwrtl;
+using namespace hwrtl::gi;
+
+#pragma warning (disable: 4996)
+
+enum EBakeExitCode
+{
+    BEC_SUCCESS = 0,
+    BEC_INVALID_ARGS = 1,
+    BEC_SCENE_LOAD_FAILED = 2,
+    BEC_OUTPUT_WRITE_FAILED = 3,
+};
+
+struct SBakeArgs
+{
+    std::string m_scenePath;
+    std::string m_outputDir;
+    uint32_t m_streamWindow = 0;
+    bool m_bWriteTga = false;
+    bool m_bWriteTrace = false;
+    SBakeConfig m_bakeConfig;
+};
+
+struct SBakeStageTime
+{
+    std::string m_name;
+    double m_ms;
+};
+
+static double GetElapsedMs(std::chrono::steady_clock::time_point beginTime)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - beginTime).count();
+}
+
+static void PrintUsage()
+{
+    std::cout << "usage: hwrtl_bake --scene=scene.hwsc --out=output_dir [--atlas=N] [--samples=N] [--seed=N] [--mode=lighting|ao] [--ao-distance=F]\n"
+        << "                  [--stream=N] [--sh-l2] [--compact-gbuffer] [--ray-stats] [--tga] [--trace]\n";
+}
+
+// unknown arguments are errors, a typo must not silently bake with the default settings
+static bool ParseBakeArgs(int argc, char** argv, SBakeArgs& outArgs)
+{
+    outArgs.m_bakeConfig.m_maxAtlasSize = 2048;
+    outArgs.m_bakeConfig.m_bakerSamples = 64;
+
+    for (int index = 1; index < argc; index++)
+    {
+        std::string arg = argv[index];
+        std::size_t equalPos = arg.find('=');
+        std::string argName = arg.substr(0, equalPos);
+        std::string argValue = equalPos == std::string::npos ? std::string() : arg.substr(equalPos + 1);
+
+        try
+        {
+            if (argName == "--scene") { outArgs.m_scenePath = argValue; }
+            else if (argName == "--out") { outArgs.m_outputDir = argValue; }
+            else if (argName == "--atlas") { outArgs.m_bakeConfig.m_maxAtlasSize = std::stoul(argValue); }
+            else if (argName == "--samples") { outArgs.m_bakeConfig.m_bakerSamples = std::stoul(argValue); }
+            else if (argName == "--seed") { outArgs.m_bakeConfig.m_bakeSeed = std::stoul(argValue); }
+            else if (argName == "--ao-distance") { outArgs.m_bakeConfig.m_aoMaxDistance = std::stof(argValue); }
+            else if (argName == "--stream") { outArgs.m_streamWindow = std::stoul(argValue); }
+            else if (argName == "--sh-l2") { outArgs.m_bakeConfig.m_bSHL2Directionality = true; }
+            else if (argName == "--compact-gbuffer") { outArgs.m_bakeConfig.m_bCompactGBuffer = true; }
+            else if (argName == "--ray-stats") { outArgs.m_bakeConfig.m_bCollectRayStats = true; }
+            else if (argName == "--tga") { outArgs.m_bWriteTga = true; }
+            else if (argName == "--trace") { outArgs.m_bWriteTrace = true; }
+            else if (argName == "--mode")
+            {
+                if (argValue == "lighting") { outArgs.m_bakeConfig.m_bakeMode = EBakeMode::BM_LIGHTING; }
+                else if (argValue == "ao") { outArgs.m_bakeConfig.m_bakeMode = EBakeMode::BM_AMBIENT_OCCLUSION; }
+                else
+                {
+                    std::cout << "unknown bake mode " << argValue << "\n";
+                    return false;
+                }
+            }
+            else
+            {
+                std::cout << "unknown argument " << arg << "\n";
+                return false;
+            }
+        }
+        catch (const std::exception&)
+        {
+            std::cout << "invalid value for " << argName << ": " << argValue << "\n";
+            return false;
+        }
+    }
+
+    if (outArgs.m_scenePath.empty() || outArgs.m_outputDir.empty() || outArgs.m_bakeConfig.m_maxAtlasSize == 0)
+    {
+        return false;
+    }
+    return true;
+}
+
+static bool WriteAtlasTga(const std::string& filePath, Vec2i size, const uint8_t* pRGBAData)
+{
+    FILE* tgaFile = fopen(filePath.c_str(), "wb");
+    if (tgaFile == nullptr)
+    {
+        return false;
+    }
+
+    uint8_t tgaHeader[18] = { 0,0,2,0,0,0,0,0,0,0,0,0 };
+    tgaHeader[12] = size.x % 256;
+    tgaHeader[13] = size.x / 256;
+    tgaHeader[14] = size.y % 256;
+    tgaHeader[15] = size.y / 256;
+    tgaHeader[16] = 32;
+    tgaHeader[17] = 8;
+
+    // tga stores bgra
+    std::vector<uint8_t> bgraData(uint64_t(size.x) * size.y * 4);
+    for (uint64_t pixelIndex = 0; pixelIndex < bgraData.size(); pixelIndex += 4)
+    {
+        bgraData[pixelIndex + 0] = pRGBAData[pixelIndex + 2];
+        bgraData[pixelIndex + 1] = pRGBAData[pixelIndex + 1];
+        bgraData[pixelIndex + 2] = pRGBAData[pixelIndex + 0];
+        bgraData[pixelIndex + 3] = pRGBAData[pixelIndex + 3];
+    }
+
+    bool bWritten = fwrite(tgaHeader, sizeof(tgaHeader), 1, tgaFile) == 1;
+    bWritten = bWritten && fwrite(bgraData.data(), bgraData.size(), 1, tgaFile) == 1;
+    fclose(tgaFile);
+    return bWritten;
+}
+
+static bool WriteBakeSummary(const std::string& filePath, const SBakeArgs& bakeArgs, const SBakeSceneHeader& sceneHeader,
+    const std::vector<SOutputAtlasInfo>& outputAtlas, const std::vector<SBakeStageTime>& stageTimes, const SMemoryReport& memoryReport)
+{
+    std::ofstream summaryFile(filePath, std::ios::out | std::ios::trunc);
+    if (!summaryFile.is_open())
+    {
+        return false;
+    }
+
+    uint64_t texelNum = 0;
+    for (uint32_t index = 0; index < outputAtlas.size(); index++)
+    {
+        texelNum += uint64_t(outputAtlas[index].m_lightMapSize.x) * uint64_t(outputAtlas[index].m_lightMapSize.y);
+    }
+
+    summaryFile << "{\n  \"version\": 1,\n  \"scene\": \"" << bakeArgs.m_scenePath << "\",\n";
+    summaryFile << "  \"instances\": " << sceneHeader.m_instanceNum << ",\n";
+    summaryFile << "  \"meshes\": " << sceneHeader.m_meshNum << ",\n";
+    summaryFile << "  \"lights\": " << sceneHeader.m_lightNum << ",\n";
+    summaryFile << "  \"atlas_size\": " << bakeArgs.m_bakeConfig.m_maxAtlasSize << ",\n";
+    summaryFile << "  \"baker_samples\": " << bakeArgs.m_bakeConfig.m_bakerSamples << ",\n";
+    summaryFile << "  \"bake_seed\": " << bakeArgs.m_bakeConfig.m_bakeSeed << ",\n";
+    summaryFile << "  \"stream_window\": " << bakeArgs.m_streamWindow << ",\n";
+    summaryFile << "  \"atlases\": " << outputAtlas.size() << ",\n";
+    summaryFile << "  \"texels\": " << texelNum << ",\n";
+    summaryFile << "  \"peak_memory_bytes\": " << memoryReport.m_peakBytes << ",\n";
+
+    if (bakeArgs.m_bakeConfig.m_bCollectRayStats)
+    {
+        SRayTracingStats rayTracingStats;
+        GetLightMapRayTracingStats(rayTracingStats);
+        summaryFile << "  \"rays\": " << rayTracingStats.GetTotalRayCount() << ",\n";
+        summaryFile << "  \"mrays_per_second\": " << rayTracingStats.GetMegaRaysPerSecond() << ",\n";
+    }
+
+    summaryFile << "  \"stage_ms\": {";
+    for (uint32_t index = 0; index < stageTimes.size(); index++)
+    {
+        summaryFile << (index == 0 ? "\n" : ",\n") << "    \"" << stageTimes[index].m_name << "\": " << stageTimes[index].m_ms;
+    }
+    summaryFile << "\n  }\n}\n";
+    return summaryFile.good();
+}
+
+int main(int argc, char** argv)
+{
+    SBakeArgs bakeArgs;
+    if (!ParseBakeArgs(argc, argv, bakeArgs))
+    {
+        PrintUsage();
+        return BEC_INVALID_ARGS;
+    }
+
+    std::vector<SBakeStageTime> stageTimes;
+    auto totalBeginTime = std::chrono::steady_clock::now();
+
+    auto beginTime = std::chrono::steady_clock::now();
+    SBakeSceneView sceneView;
+    if (!MapBakeScene(bakeArgs.m_scenePath, sceneView) || sceneView.m_pHeader->m_instanceNum == 0)
+    {
+        std::cout << "can't load the bake scene " << bakeArgs.m_scenePath << "\n";
+        return BEC_SCENE_LOAD_FAILED;
+    }
+    SBakeSceneHeader sceneHeader = *sceneView.m_pHeader;
+
+    std::vector<SBakeMeshDesc> bakeMeshDescs;
+    GetBakeSceneMeshDescs(sceneView, bakeMeshDescs);
+    stageTimes.push_back(SBakeStageTime{ "load", GetElapsedMs(beginTime) });
+
+    InitGIBaker(bakeArgs.m_bakeConfig);
+
+    beginTime = std::chrono::steady_clock::now();
+    AddBakeMeshsAndCreateVB(bakeMeshDescs);
+    AddBakeSceneLights(sceneView);
+    stageTimes.push_back(SBakeStageTime{ "upload", GetElapsedMs(beginTime) });
+
+    std::vector<SOutputAtlasInfo> outputAtlas;
+    if (bakeArgs.m_streamWindow > 0)
+    {
+        beginTime = std::chrono::steady_clock::now();
+        BakeLightMapStreaming(outputAtlas, bakeArgs.m_streamWindow);
+        stageTimes.push_back(SBakeStageTime{ "streaming_bake", GetElapsedMs(beginTime) });
+    }
+    else
+    {
+        beginTime = std::chrono::steady_clock::now();
+        PrePareLightMapGBufferPass();
+        ExecuteLightMapGBufferPass();
+        stageTimes.push_back(SBakeStageTime{ "gbuffer", GetElapsedMs(beginTime) });
+
+        beginTime = std::chrono::steady_clock::now();
+        PrePareLightMapRayTracingPass();
+        ExecuteLightMapRayTracingPass();
+        stageTimes.push_back(SBakeStageTime{ "tracing", GetElapsedMs(beginTime) });
+
+        beginTime = std::chrono::steady_clock::now();
+        DenoiseAndDilateLightMap();
+        stageTimes.push_back(SBakeStageTime{ "denoise", GetElapsedMs(beginTime) });
+
+        beginTime = std::chrono::steady_clock::now();
+        EncodeResulttLightMap();
+        stageTimes.push_back(SBakeStageTime{ "encode", GetElapsedMs(beginTime) });
+
+        beginTime = std::chrono::steady_clock::now();
+        GetEncodedLightMapTexture(outputAtlas);
+        stageTimes.push_back(SBakeStageTime{ "readback", GetElapsedMs(beginTime) });
+    }
+
+    SMemoryReport memoryReport;
+    GetMemoryReport(memoryReport);
+
+    beginTime = std::chrono::steady_clock::now();
+    _mkdir(bakeArgs.m_outputDir.c_str());
+    std::string outputPrefix = bakeArgs.m_outputDir + "/";
+
+    bool bWritten = WriteLightMapContainer(outputPrefix + "lightmap.hwlm", outputAtlas);
+    if (bakeArgs.m_bWriteTga)
+    {
+        for (uint32_t index = 0; index < outputAtlas.size(); index++)
+        {
+            const SOutputAtlasInfo& atlasInfo = outputAtlas[index];
+            std::string atlasPrefix = outputPrefix + "atlas_" + std::to_string(index);
+            bWritten = bWritten && WriteAtlasTga(atlasPrefix + "_irradiance.tga", atlasInfo.m_lightMapSize, (const uint8_t*)atlasInfo.destIrradianceOutputData);
+            bWritten = bWritten && WriteAtlasTga(atlasPrefix + "_directionality.tga", atlasInfo.m_lightMapSize, (const uint8_t*)atlasInfo.destDirectionalityOutputData);
+        }
+    }
+    if (bakeArgs.m_bWriteTrace)
+    {
+        bWritten = bWritten && WriteProfilerChromeTrace(outputPrefix + "bake_trace.json");
+    }
+    stageTimes.push_back(SBakeStageTime{ "write", GetElapsedMs(beginTime) });
+    stageTimes.push_back(SBakeStageTime{ "total", GetElapsedMs(totalBeginTime) });
+
+    bWritten = bWritten && WriteBakeSummary(outputPrefix + "bake_summary.json", bakeArgs, sceneHeader, outputAtlas, stageTimes, memoryReport);
+
+    std::cout << bakeArgs.m_scenePath << ": " << sceneHeader.m_instanceNum << " instances, " << sceneHeader.m_lightNum << " lights, " << outputAtlas.size() << " atlases\n";
+    for (uint32_t index = 0; index < stageTimes.size(); index++)
+    {
+        std::cout << "    " << stageTimes[index].m_name << ": " << stageTimes[index].m_ms << " ms\n";
+    }
+    std::cout << "    peak memory: " << memoryReport.m_peakBytes / (1024 * 1024) << " MB\n";
+
+    FreeLightMapCpuData();
+
+    // the baker keeps pointers to the mapped vertex data, see MapBakeScene
+    UnmapBakeScene(sceneView);
+    DeleteGIBaker();
+
+    if (!bWritten)
+    {
+        std::cout << "can't write the bake output to " << bakeArgs.m_outputDir << "\n";
+        return BEC_OUTPUT_WRITE_FAILED;
+    }
+    return BEC_SUCCESS;
+}
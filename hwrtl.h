@@ -26,7 +26,7 @@ SOFTWARE.
 // DOCUMENTATION
 // 
 // Dx12 hardware ray tracing library usage:
-//		step 1. copy hwrtl.h, hwrtl_dx12.cpp to your project
+//		step 1. copy hwrtl.h, hwrtl_dx12.cpp, hwrtl_profiler.cpp to your project (hwrtl_profiler.cpp is not needed if HWRTL_ENABLE_PROFILER is 0)
 //		step 2. enable graphics api by #define ENABLE_DX12_WIN 1
 // 
 // Vk hardware ray tracing libirary usage:
@@ -49,9 +49,16 @@ SOFTWARE.
 #include <sstream>
 #include <locale>
 #include <codecvt>
+#include <algorithm>
+#include <thread>
 
 #define ENABLE_DX12_WIN 1
 
+// scoped cpu zones, see HWRTL_PROFILE_SCOPE and WriteProfilerChromeTrace, define HWRTL_ENABLE_PROFILER 0 to compile them out
+#ifndef HWRTL_ENABLE_PROFILER
+#define HWRTL_ENABLE_PROFILER 1
+#endif
+
 namespace hwrtl
 {
 #define DEFINE_ENUM_FLAG_OPERATORS(ENUMTYPE) \
@@ -174,6 +181,149 @@ namespace hwrtl
 
 	using WstringConverter = std::wstring_convert<std::codecvt_utf8<wchar_t>>;
 
+	// split [0, count) into contiguous chunks, one chunk per hardware thread, the calling thread runs the first chunk
+	template<typename FUNC>
+	inline void ParallelFor(uint32_t count, const FUNC& func)
+	{
+		uint32_t threadNum = std::max(std::min(std::thread::hardware_concurrency(), count), 1u);
+		uint32_t chunkSize = (count + threadNum - 1) / std::max(threadNum, 1u);
+
+		std::vector<std::thread> workerThreads;
+		for (uint32_t threadIndex = 1; threadIndex < threadNum; threadIndex++)
+		{
+			workerThreads.emplace_back([&func, threadIndex, chunkSize, count]()
+			{
+				for (uint32_t index = threadIndex * chunkSize; index < std::min((threadIndex + 1) * chunkSize, count); index++)
+				{
+					func(index);
+				}
+			});
+		}
+
+		for (uint32_t index = 0; index < std::min(chunkSize, count); index++)
+		{
+			func(index);
+		}
+
+		for (uint32_t threadIndex = 0; threadIndex < workerThreads.size(); threadIndex++)
+		{
+			workerThreads[threadIndex].join();
+		}
+	}
+
+	/***************************************************************************
+	* Profiler
+	* 
+	* every thread records its zones into its own ring buffer, the oldest zones are overwritten when the ring buffer is full
+	* gpu work is included in the zones that wait for the gpu (Execute* passes, LockTextureForRead ...)
+	* implemented in hwrtl_profiler.cpp
+	***************************************************************************/
+
+	#define HWRTL_PROFILER_RING_BUFFER_SIZE 8192
+
+	struct SProfileZone
+	{
+		const char* m_name; // must be a string literal
+		uint64_t m_beginNs; // relative to the first zone of the process
+		uint64_t m_durationNs;
+	};
+
+	class CScopedProfileZone
+	{
+	public:
+		CScopedProfileZone(const char* name);
+		~CScopedProfileZone();
+	private:
+		const char* m_name;
+		const char* m_parentName; // restored as the current zone of the thread on exit
+		uint64_t m_beginNs;
+	};
+
+#if HWRTL_ENABLE_PROFILER
+#define HWRTL_PROFILE_CONCAT_INNER(a, b) a##b
+#define HWRTL_PROFILE_CONCAT(a, b) HWRTL_PROFILE_CONCAT_INNER(a, b)
+#define HWRTL_PROFILE_SCOPE(name) hwrtl::CScopedProfileZone HWRTL_PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define HWRTL_PROFILE_FUNCTION() HWRTL_PROFILE_SCOPE(__FUNCTION__)
+#else
+#define HWRTL_PROFILE_SCOPE(name)
+#define HWRTL_PROFILE_FUNCTION()
+#endif
+
+#if HWRTL_ENABLE_PROFILER
+	void ResetProfiler();
+
+	// innermost open zone of the calling thread, null if no zone is open
+	const char* GetCurrentProfileZoneName();
+
+	// chrome://tracing or https://ui.perfetto.dev json format
+	bool WriteProfilerChromeTrace(const std::string& filePath);
+
+	// zones still in the ring buffers of all threads, other threads may keep recording while the zones are copied
+	void GetProfileZones(std::vector<SProfileZone>& outZones);
+#else
+	// no zones are recorded, hwrtl_profiler.cpp doesn't need to be linked
+	inline void ResetProfiler() {}
+	inline const char* GetCurrentProfileZoneName() { return nullptr; }
+	inline bool WriteProfilerChromeTrace(const std::string& filePath) { return false; }
+	inline void GetProfileZones(std::vector<SProfileZone>& outZones) {}
+#endif
+
+	/***************************************************************************
+	* Memory Report
+	*
+	* every rhi allocation is tagged with a category, its bytes are returned when the last reference to the resource is released
+	* sizes are the heap footprint reported by the device (alignment included), not the requested size
+	* upload and staging allocations live in host visible heaps, the other categories live in video memory
+	***************************************************************************/
+
+	enum class EMemoryCategory : uint32_t
+	{
+		MC_VERTEX_BUFFER = 0,
+		MC_INDEX_BUFFER,
+		MC_CONSTANT_BUFFER,
+		MC_STRUCTURED_BUFFER, // structured, byte address and uav buffers
+		MC_RENDER_TARGET, // gbuffer and other rtv / dsv textures
+		MC_ACCUMULATION, // uav textures
+		MC_SHADER_RESOURCE, // read only textures created with initial data
+		MC_UPLOAD, // temp upload buffers
+		MC_STAGING, // readback buffers used by LockTextureForRead and LockBufferForRead
+		MC_BLAS,
+		MC_TLAS, // tlas and its instance descs
+		MC_SCRATCH, // acceleration structure build scratch
+		MC_SHADER_TABLE,
+		MC_NUM,
+	};
+
+	struct SMemoryCategoryStats
+	{
+		uint64_t m_liveBytes = 0;
+		uint64_t m_peakBytes = 0;
+		uint64_t m_liveAllocationNum = 0;
+		uint64_t m_totalAllocationNum = 0;
+	};
+
+	struct SMemoryReport
+	{
+		SMemoryCategoryStats m_categories[uint32_t(EMemoryCategory::MC_NUM)];
+
+		uint64_t m_liveBytes = 0;
+		uint64_t m_liveHostBytes = 0; // upload and staging part of m_liveBytes
+
+		// peak of the total, not the sum of the category peaks
+		uint64_t m_peakBytes = 0;
+		uint64_t m_categoryBytesAtPeak[uint32_t(EMemoryCategory::MC_NUM)] = {};
+		const char* m_peakProfileZone = nullptr; // innermost profile zone open when the peak was reached, null when the profiler is disabled
+	};
+
+	const char* GetMemoryCategoryName(EMemoryCategory memoryCategory);
+	void GetMemoryReport(SMemoryReport& outMemoryReport);
+
+	// peaks restart from the current live bytes
+	void ResetMemoryPeak();
+
+	// human readable table, one line per category
+	std::string FormatMemoryReport(const SMemoryReport& memoryReport);
+
 	inline Vec3 NormalizeVec3(Vec3 vec);
 	inline Vec3 CrossVec3(Vec3 A, Vec3 B)
 	{
@@ -236,6 +386,7 @@ namespace hwrtl
 		FT_DepthStencil,
 		FT_RGBA8_UNORM, 
 		FT_RGBA32_FLOAT,
+		FT_RGBA32_UINT,
 	};
 
 	enum class ETexUsage
@@ -253,7 +404,8 @@ namespace hwrtl
 		USAGE_IB = (1 << 1), // index buffer
 		USAGE_CB = (1 << 2), // constant buffer
 		USAGE_Structure = (1 << 3), // structure buffer
-		USAGE_BYTE_ADDRESS = (1 << 4)  // byte address buffer for bindless vb ib
+		USAGE_BYTE_ADDRESS = (1 << 4),  // byte address buffer for bindless vb ib
+		USAGE_UAV = (1 << 5), // read write structure buffer
 	};
 	DEFINE_ENUM_FLAG_OPERATORS(EBufferUsage);
 
@@ -271,6 +423,7 @@ namespace hwrtl
 	{
 		ERayShaderType m_eShaderType;
 		const std::wstring m_entryPoint;
+		const std::wstring m_anyHitEntryPoint; // RAY_CHS only, optional any hit shader in the same hit group
 	};
 
 	struct STextureCreateDesc
@@ -366,6 +519,7 @@ namespace hwrtl
 	{
 		uint32_t m_nVertexCount = 0;
 		uint32_t m_nIndexStride = 0;
+		bool m_bOpaque = true; // the any hit shader only runs on the non opaque geometries
 		std::vector<SMeshInstanceInfo>instanes;
 
 		std::shared_ptr<CBuffer>m_pVertexBuffer;
@@ -397,6 +551,16 @@ namespace hwrtl
 		std::vector<EVertexFormat>vertexLayouts; 
 		std::vector<ETexFormat>rtFormats; 
 		ETexFormat dsFormat;
+		std::vector<SShaderDefine> shaderDefines;
+	};
+
+	// read only file mapping, m_pData stays valid until UnmapFile
+	struct SMappedFile
+	{
+		const void* m_pData = nullptr;
+		uint64_t m_nByteSize = 0;
+		void* m_hFile = nullptr;
+		void* m_hMapping = nullptr;
 	};
 
 	class CDeviceCommand
@@ -418,6 +582,9 @@ namespace hwrtl
 
 		virtual void* LockTextureForRead(std::shared_ptr<CTexture2D> readBackTexture) = 0;
 		virtual void UnLockTexture(std::shared_ptr<CTexture2D> readBackTexture) = 0;
+
+		virtual void* LockBufferForRead(std::shared_ptr<CBuffer> readBackBuffer) = 0;
+		virtual void UnLockBuffer(std::shared_ptr<CBuffer> readBackBuffer) = 0;
 	};
 
 	class CContext
@@ -442,6 +609,7 @@ namespace hwrtl
 		virtual void SetShaderSRV(std::shared_ptr<CTexture2D>tex2D, uint32_t bindIndex) = 0;
 		virtual void SetShaderSRV(std::shared_ptr<CBuffer>buffer, uint32_t bindIndex) = 0;
 		virtual void SetShaderUAV(std::shared_ptr<CTexture2D>tex2D, uint32_t bindIndex) = 0;
+		virtual void SetShaderUAV(std::shared_ptr<CBuffer>buffer, uint32_t bindIndex) = 0;
 
 		virtual void SetRootConstants(uint32_t bindIndex, uint32_t num32BitValuesToSet, const void* srcData, uint32_t destRootConstantOffsets) = 0;
 
@@ -480,6 +648,9 @@ namespace hwrtl
 	std::shared_ptr<CRayTracingContext> CreateRayTracingContext();
 	std::shared_ptr<CGraphicsContext> CreateGraphicsContext();
 
+	bool MapFileForRead(const std::string& filePath, SMappedFile& outMappedFile);
+	void UnmapFile(SMappedFile& mappedFile);
+
 	inline Vec3 NormalizeVec3(Vec3 vec)
 	{
 		float lenght = sqrt(vec.x * vec.x + vec.y * vec.y + vec.z * vec.z);
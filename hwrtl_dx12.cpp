@@ -73,6 +73,9 @@ SOFTWARE.
 #include <vector>
 #include <stdexcept>
 #include <assert.h>
+#include <mutex>
+#include <atomic>
+#include <iomanip>
 
 #pragma comment(lib,"d3dcompiler.lib")
 #pragma comment(lib,"dxcompiler.lib")
@@ -144,6 +147,7 @@ namespace hwrtl
         ID3D12ResourcePtr& AllocResource(uint32_t& allocIndex);
         ID3D12ResourcePtr& GetResource(uint32_t index);
         void FreeResource(uint32_t index);
+        void FreeAllResources();
     private:
         uint32_t m_currFreeIndex;
         std::vector<ID3D12ResourcePtr>m_resources;
@@ -162,9 +166,18 @@ namespace hwrtl
         void ResetPassSlotStartIndex();
 
         uint32_t GetAndAddCurrentPassSlotStart(uint32_t numSlotUsed);
+
+        // bindless slots of destroyed resources, reused after the command lists that may reference them have finished
+        void FreeSlotAfterGpuFinish(uint32_t index);
+        void ReturnPendingFreeSlots();
+        uint32_t GetSlotVersion();
     private:
         uint32_t m_maxDescNum;
 
+        std::vector<uint32_t> m_pendingFreeSlots;
+        std::vector<uint32_t> m_freeSlots;
+        uint32_t m_nSlotVersion = 0; // incremented whenever a freed slot is reused, the bindless tables must be copied again
+
         ID3D12DescriptorHeapPtr m_pDescHeap;
 
         D3D12_CPU_DESCRIPTOR_HANDLE m_hCpuBegin;
@@ -184,16 +197,13 @@ namespace hwrtl
     {
         D3D12_CPU_DESCRIPTOR_HANDLE m_pCpuDescHandle;
         D3D12_GPU_DESCRIPTOR_HANDLE m_pGpuDescHandle;
-        uint32_t indexInDescManager;
+        uint32_t indexInDescManager = UINT32_MAX;
     };
 
     class CDxTexture2D : public CTexture2D
     {
     public:
-        ~CDxTexture2D()
-        {
-            // TODO: Release Desc In Desc Manager
-        }
+        ~CDxTexture2D();
 
         virtual uint32_t GetOrAddTexBindlessIndex()override;
 
@@ -213,10 +223,7 @@ namespace hwrtl
     class CDxBuffer : public CBuffer
     {
     public:
-        ~CDxBuffer()
-        {
-            // TODO: Release Desc In Desc Manager
-        }
+        ~CDxBuffer();
 
         virtual uint32_t GetOrAddByteAddressBindlessIndex() override;
 
@@ -228,6 +235,8 @@ namespace hwrtl
 
         D3D12_VERTEX_BUFFER_VIEW m_vbv;
 
+        ID3D12ResourcePtr m_pStagereSource;
+
         bool m_bBindlessValid = false;
         uint32_t m_bindlessDescIndex;
     };
@@ -361,6 +370,9 @@ namespace hwrtl
 
         virtual void* LockTextureForRead(std::shared_ptr<CTexture2D> readBackTexture)override;
         virtual void UnLockTexture(std::shared_ptr<CTexture2D> readBackTexture) override;
+
+        virtual void* LockBufferForRead(std::shared_ptr<CBuffer> readBackBuffer)override;
+        virtual void UnLockBuffer(std::shared_ptr<CBuffer> readBackBuffer) override;
     };
 
     class CDx12RayTracingContext : public CRayTracingContext
@@ -378,6 +390,7 @@ namespace hwrtl
         virtual void SetShaderSRV(std::shared_ptr<CBuffer>buffer, uint32_t bindIndex) override;
 
         virtual void SetShaderUAV(std::shared_ptr<CTexture2D>tex2D, uint32_t bindIndex)override;
+        virtual void SetShaderUAV(std::shared_ptr<CBuffer>buffer, uint32_t bindIndex)override;
 
         virtual void SetConstantBuffer(std::shared_ptr<CBuffer> constantBuffer, uint32_t bindIndex)override;
         virtual void SetRootConstants(uint32_t bindIndex, uint32_t numRootConstantToSet, const void* srcData, uint32_t destRootConstantOffsets) override;
@@ -397,10 +410,12 @@ namespace hwrtl
 
         std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>m_byteBufferBindlessHandles;
         uint32_t m_byteBufferbindlessNum = 0;
+        uint32_t m_byteBufferBindlessVersion = 0;
         bool m_bByteBufferBindlessTableDirty = false;
         
         std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>m_tex2DBindlessHandles;
         uint32_t m_tex2DBindlessNum = 0;
+        uint32_t m_tex2DBindlessVersion = 0;
         bool m_bTex2DBindlessTableDirty = false;
 
         D3D12_CPU_DESCRIPTOR_HANDLE m_viewHandles[4][nHandlePerView];
@@ -481,6 +496,7 @@ namespace hwrtl
         PIXEndCapture(false);
 #endif
         delete pDXDevice;
+        pDXDevice = nullptr;
     }
 
     std::shared_ptr <CDeviceCommand> hwrtl::CreateDeviceCommand()
@@ -498,6 +514,180 @@ namespace hwrtl
         return std::make_shared<CDxGraphicsContext>();
     }
 
+    /***************************************************************************
+    * File Mapping
+    ***************************************************************************/
+
+    bool hwrtl::MapFileForRead(const std::string& filePath, SMappedFile& outMappedFile)
+    {
+        outMappedFile = SMappedFile();
+
+        HANDLE hFile = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(hFile, &fileSize) == FALSE || fileSize.QuadPart == 0)
+        {
+            CloseHandle(hFile);
+            return false;
+        }
+
+        HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (hMapping == nullptr)
+        {
+            CloseHandle(hFile);
+            return false;
+        }
+
+        const void* pData = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        if (pData == nullptr)
+        {
+            CloseHandle(hMapping);
+            CloseHandle(hFile);
+            return false;
+        }
+
+        outMappedFile.m_pData = pData;
+        outMappedFile.m_nByteSize = uint64_t(fileSize.QuadPart);
+        outMappedFile.m_hFile = hFile;
+        outMappedFile.m_hMapping = hMapping;
+        return true;
+    }
+
+    void hwrtl::UnmapFile(SMappedFile& mappedFile)
+    {
+        if (mappedFile.m_pData != nullptr)
+        {
+            UnmapViewOfFile(mappedFile.m_pData);
+        }
+
+        if (mappedFile.m_hMapping != nullptr)
+        {
+            CloseHandle(mappedFile.m_hMapping);
+        }
+
+        if (mappedFile.m_hFile != nullptr)
+        {
+            CloseHandle(mappedFile.m_hFile);
+        }
+
+        mappedFile = SMappedFile();
+    }
+
+    /***************************************************************************
+    * Memory Report
+    ***************************************************************************/
+
+    static std::mutex memoryReportMutex;
+    static SMemoryReport memoryReport;
+
+    static bool IsHostMemoryCategory(EMemoryCategory memoryCategory)
+    {
+        return memoryCategory == EMemoryCategory::MC_UPLOAD || memoryCategory == EMemoryCategory::MC_STAGING;
+    }
+
+    static void AddMemoryAllocation(EMemoryCategory memoryCategory, uint64_t byteSize)
+    {
+        std::lock_guard<std::mutex> lock(memoryReportMutex);
+
+        SMemoryCategoryStats& categoryStats = memoryReport.m_categories[uint32_t(memoryCategory)];
+        categoryStats.m_liveBytes += byteSize;
+        categoryStats.m_peakBytes = (std::max)(categoryStats.m_peakBytes, categoryStats.m_liveBytes);
+        categoryStats.m_liveAllocationNum++;
+        categoryStats.m_totalAllocationNum++;
+
+        memoryReport.m_liveBytes += byteSize;
+        memoryReport.m_liveHostBytes += IsHostMemoryCategory(memoryCategory) ? byteSize : 0;
+
+        if (memoryReport.m_liveBytes > memoryReport.m_peakBytes)
+        {
+            memoryReport.m_peakBytes = memoryReport.m_liveBytes;
+            for (uint32_t index = 0; index < uint32_t(EMemoryCategory::MC_NUM); index++)
+            {
+                memoryReport.m_categoryBytesAtPeak[index] = memoryReport.m_categories[index].m_liveBytes;
+            }
+            memoryReport.m_peakProfileZone = GetCurrentProfileZoneName();
+        }
+    }
+
+    static void RemoveMemoryAllocation(EMemoryCategory memoryCategory, uint64_t byteSize)
+    {
+        std::lock_guard<std::mutex> lock(memoryReportMutex);
+
+        SMemoryCategoryStats& categoryStats = memoryReport.m_categories[uint32_t(memoryCategory)];
+        assert(categoryStats.m_liveBytes >= byteSize && categoryStats.m_liveAllocationNum > 0);
+        categoryStats.m_liveBytes -= byteSize;
+        categoryStats.m_liveAllocationNum--;
+
+        memoryReport.m_liveBytes -= byteSize;
+        memoryReport.m_liveHostBytes -= IsHostMemoryCategory(memoryCategory) ? byteSize : 0;
+    }
+
+    const char* hwrtl::GetMemoryCategoryName(EMemoryCategory memoryCategory)
+    {
+        static const char* memoryCategoryNames[] =
+        {
+            "VertexBuffer",
+            "IndexBuffer",
+            "ConstantBuffer",
+            "StructuredBuffer",
+            "RenderTarget",
+            "Accumulation",
+            "ShaderResource",
+            "Upload",
+            "Staging",
+            "BLAS",
+            "TLAS",
+            "Scratch",
+            "ShaderTable",
+        };
+        static_assert(sizeof(memoryCategoryNames) / sizeof(memoryCategoryNames[0]) == uint32_t(EMemoryCategory::MC_NUM), "missing memory category name");
+        assert(memoryCategory < EMemoryCategory::MC_NUM);
+        return memoryCategoryNames[uint32_t(memoryCategory)];
+    }
+
+    void hwrtl::GetMemoryReport(SMemoryReport& outMemoryReport)
+    {
+        std::lock_guard<std::mutex> lock(memoryReportMutex);
+        outMemoryReport = memoryReport;
+    }
+
+    void hwrtl::ResetMemoryPeak()
+    {
+        std::lock_guard<std::mutex> lock(memoryReportMutex);
+        for (uint32_t index = 0; index < uint32_t(EMemoryCategory::MC_NUM); index++)
+        {
+            memoryReport.m_categories[index].m_peakBytes = memoryReport.m_categories[index].m_liveBytes;
+            memoryReport.m_categoryBytesAtPeak[index] = memoryReport.m_categories[index].m_liveBytes;
+        }
+        memoryReport.m_peakBytes = memoryReport.m_liveBytes;
+        memoryReport.m_peakProfileZone = GetCurrentProfileZoneName();
+    }
+
+    std::string hwrtl::FormatMemoryReport(const SMemoryReport& memoryReport)
+    {
+        auto toMB = [](uint64_t byteSize) { return double(byteSize) / (1024.0 * 1024.0); };
+
+        std::stringstream reportStream;
+        reportStream << std::fixed << std::setprecision(2);
+        reportStream << std::left << std::setw(18) << "Category" << std::right << std::setw(12) << "Live MB" << std::setw(12) << "Peak MB" << std::setw(12) << "At Peak MB" << std::setw(10) << "Live" << std::setw(10) << "Total" << "\n";
+
+        for (uint32_t index = 0; index < uint32_t(EMemoryCategory::MC_NUM); index++)
+        {
+            const SMemoryCategoryStats& categoryStats = memoryReport.m_categories[index];
+            reportStream << std::left << std::setw(18) << GetMemoryCategoryName(EMemoryCategory(index)) << std::right;
+            reportStream << std::setw(12) << toMB(categoryStats.m_liveBytes) << std::setw(12) << toMB(categoryStats.m_peakBytes) << std::setw(12) << toMB(memoryReport.m_categoryBytesAtPeak[index]);
+            reportStream << std::setw(10) << categoryStats.m_liveAllocationNum << std::setw(10) << categoryStats.m_totalAllocationNum << "\n";
+        }
+
+        reportStream << "Live " << toMB(memoryReport.m_liveBytes) << " MB (host " << toMB(memoryReport.m_liveHostBytes) << " MB), ";
+        reportStream << "peak " << toMB(memoryReport.m_peakBytes) << " MB in " << (memoryReport.m_peakProfileZone != nullptr ? memoryReport.m_peakProfileZone : "unknown zone") << "\n";
+        return reportStream.str();
+    }
+
     /***************************************************************************
     * Common Helper Functions
     ***************************************************************************/
@@ -649,6 +839,9 @@ namespace hwrtl
         {
         case ETexFormat::FT_RGBA8_UNORM:
             return 4;
+        case ETexFormat::FT_RGBA32_FLOAT:
+        case ETexFormat::FT_RGBA32_UINT:
+            return 16;
         }
         ThrowIfFailed(-1);
         return -1;
@@ -664,6 +857,9 @@ namespace hwrtl
         case ETexFormat::FT_RGBA32_FLOAT:
             return DXGI_FORMAT_R32G32B32A32_FLOAT;
             break;
+        case ETexFormat::FT_RGBA32_UINT:
+            return DXGI_FORMAT_R32G32B32A32_UINT;
+            break;
         case ETexFormat::FT_DepthStencil:
             return DXGI_FORMAT_D24_UNORM_S8_UINT;
             break;
@@ -695,6 +891,7 @@ namespace hwrtl
             return 4;
             break;
         case ETexFormat::FT_RGBA32_FLOAT:
+        case ETexFormat::FT_RGBA32_UINT:
             return 16;
             break;
         }
@@ -742,6 +939,15 @@ namespace hwrtl
             ThrowIfFailed(pDXDevice->m_pFence->SetEventOnCompletion(nFenceValue, pDXDevice->m_FenceEvent));
             WaitForSingleObject(pDXDevice->m_FenceEvent, INFINITE);
         }
+
+        // upload buffers and the bindless slots of destroyed resources are only referenced by the submitted command list,
+        // release them once it has finished
+        if (pDXDevice->m_eCmdState == ECmdState::CS_CLOSE)
+        {
+            pDXDevice->m_tempBuffers.FreeAllResources();
+            pDXDevice->m_bindlessByteAddressDescManager.ReturnPendingFreeSlots();
+            pDXDevice->m_bindlessTexDescManager.ReturnPendingFreeSlots();
+        }
     }
 
     static void Dx12ResetCmdAllocInternal()
@@ -781,6 +987,66 @@ namespace hwrtl
         1,1
     };
 
+    // {5B0C8F6E-3A7D-4C1B-9E2F-8D4A6B1C7E90}
+    static const GUID memoryTrackerGuid = { 0x5b0c8f6e, 0x3a7d, 0x4c1b, { 0x9e, 0x2f, 0x8d, 0x4a, 0x6b, 0x1c, 0x7e, 0x90 } };
+
+    // attached to the resource as private data, the resource releases it when the resource itself is destroyed
+    // so the bytes are returned wherever the last reference lives (temp buffers, acceleration structures, staging resources ...)
+    class CDx12MemoryTracker : public IUnknown
+    {
+    public:
+        CDx12MemoryTracker(EMemoryCategory memoryCategory, uint64_t byteSize)
+            : m_refCount(1)
+            , m_memoryCategory(memoryCategory)
+            , m_byteSize(byteSize)
+        {
+            AddMemoryAllocation(m_memoryCategory, m_byteSize);
+        }
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
+        {
+            if (riid == __uuidof(IUnknown))
+            {
+                *ppvObject = static_cast<IUnknown*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppvObject = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        ULONG STDMETHODCALLTYPE AddRef() override
+        {
+            return ++m_refCount;
+        }
+
+        ULONG STDMETHODCALLTYPE Release() override
+        {
+            ULONG refCount = --m_refCount;
+            if (refCount == 0)
+            {
+                RemoveMemoryAllocation(m_memoryCategory, m_byteSize);
+                delete this;
+            }
+            return refCount;
+        }
+
+    private:
+        std::atomic<ULONG> m_refCount;
+        EMemoryCategory m_memoryCategory;
+        uint64_t m_byteSize;
+    };
+
+    static void Dx12TrackResourceMemory(ID3D12Resource* pResource, EMemoryCategory memoryCategory)
+    {
+        D3D12_RESOURCE_DESC resDesc = pResource->GetDesc();
+        D3D12_RESOURCE_ALLOCATION_INFO allocationInfo = pDXDevice->m_pDevice->GetResourceAllocationInfo(0, 1, &resDesc);
+
+        CDx12MemoryTracker* pMemoryTracker = new CDx12MemoryTracker(memoryCategory, allocationInfo.SizeInBytes);
+        ThrowIfFailed(pResource->SetPrivateDataInterface(memoryTrackerGuid, pMemoryTracker));
+        pMemoryTracker->Release(); // the resource holds the only reference now
+    }
+
     // Row-by-row memcpy
     static void MemcpySubresource(const D3D12_MEMCPY_DEST* pDest, const D3D12_SUBRESOURCE_DATA* pSrc, SIZE_T rowSizeInBytes, UINT numRows, UINT numSlices)
     {
@@ -795,7 +1061,7 @@ namespace hwrtl
         }
     }
 
-    static ID3D12ResourcePtr CreateDefaultTexture(const void* pInitData, D3D12_RESOURCE_DESC textureDesc, UINT64 width, UINT64 height, uint32_t texPixelSize, ID3D12ResourcePtr& pUploadBuffer)
+    static ID3D12ResourcePtr CreateDefaultTexture(const void* pInitData, D3D12_RESOURCE_DESC textureDesc, UINT64 width, UINT64 height, uint32_t texPixelSize, EMemoryCategory memoryCategory, ID3D12ResourcePtr& pUploadBuffer)
     {
         ID3D12Device5Ptr pDevice = pDXDevice->m_pDevice;
         ID3D12GraphicsCommandList4Ptr pCmdList = pDXDevice->m_pCmdList;
@@ -809,6 +1075,7 @@ namespace hwrtl
 
         {
             ThrowIfFailed(pDevice->CreateCommittedResource(&defaultHeapProperies, D3D12_HEAP_FLAG_NONE, &textureDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&defaultTexture)));
+            Dx12TrackResourceMemory(defaultTexture, memoryCategory);
             pDevice->GetCopyableFootprints(&textureDesc, 0, 1, 0, &destLayouts, &numRows, &rowSizesInBytes, &interSize);
             //assert(interSize == width * height * texPixelSize);
         }
@@ -817,6 +1084,7 @@ namespace hwrtl
             D3D12_RESOURCE_DESC uploadBufferDesc{ D3D12_RESOURCE_DIMENSION_BUFFER, 0,interSize, 1,1,1,
                 DXGI_FORMAT_UNKNOWN, 1, 0,D3D12_TEXTURE_LAYOUT_ROW_MAJOR,D3D12_RESOURCE_FLAG_NONE };
             ThrowIfFailed(pDevice->CreateCommittedResource(&uploadHeapProperies, D3D12_HEAP_FLAG_NONE, &uploadBufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&pUploadBuffer)));
+            Dx12TrackResourceMemory(pUploadBuffer, EMemoryCategory::MC_UPLOAD);
         }
 
 
@@ -868,7 +1136,7 @@ namespace hwrtl
         return defaultTexture;
     }
 
-    static ID3D12ResourcePtr CreateDefaultBuffer(const void* pInitData, UINT64 nByteSize, ID3D12ResourcePtr& pUploadBuffer)
+    static ID3D12ResourcePtr CreateDefaultBuffer(const void* pInitData, UINT64 nByteSize, EMemoryCategory memoryCategory, ID3D12ResourcePtr& pUploadBuffer, D3D12_RESOURCE_FLAGS resourceFlags = D3D12_RESOURCE_FLAG_NONE)
     {
         ID3D12Device5Ptr pDevice = pDXDevice->m_pDevice;
         ID3D12GraphicsCommandList4Ptr pCmdList = pDXDevice->m_pCmdList;
@@ -882,11 +1150,15 @@ namespace hwrtl
             DXGI_FORMAT_UNKNOWN, 
             1, 0, 
             D3D12_TEXTURE_LAYOUT_ROW_MAJOR, 
-            D3D12_RESOURCE_FLAG_NONE
+            resourceFlags
         };
 
         ThrowIfFailed(pDevice->CreateCommittedResource(&defaultHeapProperies, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&defaultBuffer)));
+        Dx12TrackResourceMemory(defaultBuffer, memoryCategory);
+
+        bufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
         ThrowIfFailed(pDevice->CreateCommittedResource(&uploadHeapProperies, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&pUploadBuffer)));
+        Dx12TrackResourceMemory(pUploadBuffer, EMemoryCategory::MC_UPLOAD);
 
         D3D12_RESOURCE_BARRIER barrierBefore = {};
         barrierBefore.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
@@ -918,7 +1190,7 @@ namespace hwrtl
         return defaultBuffer;
     }
 
-    static ID3D12ResourcePtr Dx12CreateBuffer(uint64_t size, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initState, const D3D12_HEAP_PROPERTIES& heapProps)
+    static ID3D12ResourcePtr Dx12CreateBuffer(uint64_t size, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initState, const D3D12_HEAP_PROPERTIES& heapProps, EMemoryCategory memoryCategory)
     {
         ID3D12Device5Ptr pDevice = pDXDevice->m_pDevice;
 
@@ -937,6 +1209,7 @@ namespace hwrtl
 
         ID3D12ResourcePtr pBuffer;
         ThrowIfFailed(pDevice->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, initState, nullptr, IID_PPV_ARGS(&pBuffer)));
+        Dx12TrackResourceMemory(pBuffer, memoryCategory);
         return pBuffer;
     }
 
@@ -1318,6 +1591,7 @@ namespace hwrtl
             {
                 m_nextFreeResource[index] = index + 1;
             }
+            m_resources.resize(newSize);
         }
 
         allocIndex = m_currFreeIndex;
@@ -1332,12 +1606,23 @@ namespace hwrtl
 
     void CDXResouceManager::FreeResource(uint32_t index)
     {
-        m_resources[index].Release();
+        m_resources[index] = nullptr;
 
         m_nextFreeResource[index] = m_currFreeIndex;
         m_currFreeIndex = index;
     }
 
+    void CDXResouceManager::FreeAllResources()
+    {
+        for (uint32_t index = 0; index < m_resources.size(); index++)
+        {
+            // _com_ptr_t::Release throws on an empty slot
+            m_resources[index] = nullptr;
+            m_nextFreeResource[index] = index + 1;
+        }
+        m_currFreeIndex = 0;
+    }
+
     /***************************************************************************
     * CDXPassDescManager
     ***************************************************************************/
@@ -1372,6 +1657,14 @@ namespace hwrtl
 
     uint32_t CDXPassDescManager::GetAndAddCurrentPassSlotStart(uint32_t numSlotUsed)
     {
+        if (numSlotUsed == 1 && !m_freeSlots.empty())
+        {
+            uint32_t freeSlot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+            m_nSlotVersion++;
+            return freeSlot;
+        }
+
         uint32_t returnValue = m_nCurrentStartSlotIndex;
         m_nCurrentStartSlotIndex += numSlotUsed;
 
@@ -1386,6 +1679,24 @@ namespace hwrtl
     void CDXPassDescManager::ResetPassSlotStartIndex()
     {
         m_nCurrentStartSlotIndex = 0;
+        m_pendingFreeSlots.clear();
+        m_freeSlots.clear();
+    }
+
+    void CDXPassDescManager::FreeSlotAfterGpuFinish(uint32_t index)
+    {
+        m_pendingFreeSlots.push_back(index);
+    }
+
+    void CDXPassDescManager::ReturnPendingFreeSlots()
+    {
+        m_freeSlots.insert(m_freeSlots.end(), m_pendingFreeSlots.begin(), m_pendingFreeSlots.end());
+        m_pendingFreeSlots.clear();
+    }
+
+    uint32_t CDXPassDescManager::GetSlotVersion()
+    {
+        return m_nSlotVersion;
     }
 
     ID3D12DescriptorHeapPtr CDXPassDescManager::GetHeapPtr()
@@ -1434,6 +1745,49 @@ namespace hwrtl
 #endif
     }
 
+    /***************************************************************************
+    * CDxTexture2D / CDxBuffer
+    ***************************************************************************/
+
+    static void Dx12FreeView(CDx12DescManager& descManager, CDx12View& view)
+    {
+        if (view.indexInDescManager != UINT32_MAX)
+        {
+            descManager.FreeDesc(view.indexInDescManager);
+            view.indexInDescManager = UINT32_MAX;
+        }
+    }
+
+    CDxTexture2D::~CDxTexture2D()
+    {
+        // the descriptor heaps are destroyed with the device, nothing to return after Shutdown
+        if (pDXDevice != nullptr)
+        {
+            Dx12FreeView(pDXDevice->m_csuDescManager, m_srv);
+            Dx12FreeView(pDXDevice->m_csuDescManager, m_uav);
+            Dx12FreeView(pDXDevice->m_rtvDescManager, m_rtv);
+            Dx12FreeView(pDXDevice->m_dsvDescManager, m_dsv);
+            if (m_bBindlessValid)
+            {
+                pDXDevice->m_bindlessTexDescManager.FreeSlotAfterGpuFinish(m_bindlessDescIndex);
+            }
+        }
+    }
+
+    CDxBuffer::~CDxBuffer()
+    {
+        if (pDXDevice != nullptr)
+        {
+            Dx12FreeView(pDXDevice->m_csuDescManager, m_srv);
+            Dx12FreeView(pDXDevice->m_csuDescManager, m_uav);
+            Dx12FreeView(pDXDevice->m_csuDescManager, m_cbv);
+            if (m_bBindlessValid)
+            {
+                pDXDevice->m_bindlessByteAddressDescManager.FreeSlotAfterGpuFinish(m_bindlessDescIndex);
+            }
+        }
+    }
+
     /***************************************************************************
     * CBindlessResourceManager
     ***************************************************************************/
@@ -1487,11 +1841,15 @@ namespace hwrtl
 
     void CDxDeviceCommand::CloseAndExecuteCmdList()
     {
+        HWRTL_PROFILE_FUNCTION();
+
         Dx12CloseAndExecuteCmdListInternal();
     }
 
     void CDxDeviceCommand::WaitGPUCmdListFinish()
     {
+        HWRTL_PROFILE_FUNCTION();
+
         Dx12WaitGPUCmdListFinishInternal();
     }
 
@@ -1502,6 +1860,8 @@ namespace hwrtl
 
     std::shared_ptr<CRayTracingPipelineState> CDxDeviceCommand::CreateRTPipelineStateAndShaderTable(SRayTracingPSOCreateDesc& rtPsoDesc)
     {
+        HWRTL_PROFILE_FUNCTION();
+
         const std::wstring shaderPath = rtPsoDesc.filename;
         std::vector<SShader>rtShaders = rtPsoDesc.rtShaders;
         uint32_t maxTraceRecursionDepth = rtPsoDesc.maxTraceRecursionDepth;
@@ -1544,6 +1904,19 @@ namespace hwrtl
             };
         }
 
+        // any hit shaders shared by several hit groups are exported once
+        for (auto& rtShader : rtShaders)
+        {
+            if (!rtShader.m_anyHitEntryPoint.empty())
+            {
+                auto isSameEntryPoint = [&rtShader](LPCWSTR entryPoint) { return rtShader.m_anyHitEntryPoint == entryPoint; };
+                if (std::find_if(pEntryPoint.begin(), pEntryPoint.end(), isSameEntryPoint) == pEntryPoint.end())
+                {
+                    pEntryPoint.emplace_back(rtShader.m_anyHitEntryPoint.c_str());
+                }
+            }
+        }
+
         uint32_t subObjectsNum = 1 + hitProgramNum + 2 + 1 + 1; // dxil subobj + hit program number + shader config * 2 + pipeline config + global root signature * 1
 
         std::vector<D3D12_STATE_SUBOBJECT> stateSubObjects;
@@ -1601,11 +1974,12 @@ namespace hwrtl
                 hitgroupDesc[hitProgramIndex].Type = D3D12_HIT_GROUP_TYPE_TRIANGLES;
                 hitgroupDesc[hitProgramIndex].AnyHitShaderImport = rtShader.m_entryPoint.data();
                 hitgroupDesc[hitProgramIndex].ClosestHitShaderImport = nullptr;
+                hitProgramIndex++;
                 break;
             case ERayShaderType::RAY_CHS:
                 hitgroupDesc[hitProgramIndex].HitGroupExport = pHitGroupExports[hitProgramIndex].c_str();
                 hitgroupDesc[hitProgramIndex].Type = D3D12_HIT_GROUP_TYPE_TRIANGLES;
-                hitgroupDesc[hitProgramIndex].AnyHitShaderImport = nullptr;
+                hitgroupDesc[hitProgramIndex].AnyHitShaderImport = rtShader.m_anyHitEntryPoint.empty() ? nullptr : rtShader.m_anyHitEntryPoint.data();
                 hitgroupDesc[hitProgramIndex].ClosestHitShaderImport = rtShader.m_entryPoint.data();
                 hitProgramIndex++;
                 break;
@@ -1709,13 +2083,15 @@ namespace hwrtl
         }
         offsetShaderTableIndex += rayHitShaderIdentifiers.size();
 
-        pDxRayTracingPipelineState->m_pShaderTable = CreateDefaultBuffer(shaderTableData.data(), shaderTableSize, pDXDevice->m_tempBuffers.AllocResource());
+        pDxRayTracingPipelineState->m_pShaderTable = CreateDefaultBuffer(shaderTableData.data(), shaderTableSize, EMemoryCategory::MC_SHADER_TABLE, pDXDevice->m_tempBuffers.AllocResource());
 
         return pDxRayTracingPipelineState;
     }
 
     std::shared_ptr<CGraphicsPipelineState>  CDxDeviceCommand::CreateRSPipelineState(SRasterizationPSOCreateDesc& rsPsoDesc)
     {
+        HWRTL_PROFILE_FUNCTION();
+
         const std::wstring filename = rsPsoDesc.filename;
         std::vector<SShader>rtShaders = rsPsoDesc.rtShaders;
         SShaderResources rasterizationResources = rsPsoDesc.rasterizationResources;
@@ -1792,10 +2168,16 @@ namespace hwrtl
                 bool bVS = rtShaders[index].m_eShaderType == ERayShaderType::RS_VS;
                 LPCWSTR pTarget = bVS ? L"vs_6_1" : L"ps_6_1";
                 uint32_t shaderIndex = bVS ? 0 : 1;
-                DxcDefine dxcDefine;
-                dxcDefine.Name = L"INCLUDE_RT_SHADER";
-                dxcDefine.Value = L"0";
-                shaders[shaderIndex] = Dx12CompileRayTracingLibraryDXC(filename.c_str(), rtShaders[index].m_entryPoint.c_str(), pTarget, &dxcDefine, 1);
+                std::vector<DxcDefine> dxcDefines;
+                dxcDefines.resize(rsPsoDesc.shaderDefines.size() + 1);
+                dxcDefines[0].Name = L"INCLUDE_RT_SHADER";
+                dxcDefines[0].Value = L"0";
+                for (uint32_t defineIndex = 0; defineIndex < rsPsoDesc.shaderDefines.size(); defineIndex++)
+                {
+                    dxcDefines[defineIndex + 1].Name = rsPsoDesc.shaderDefines[defineIndex].m_defineName.c_str();
+                    dxcDefines[defineIndex + 1].Value = rsPsoDesc.shaderDefines[defineIndex].m_defineValue.c_str();
+                }
+                shaders[shaderIndex] = Dx12CompileRayTracingLibraryDXC(filename.c_str(), rtShaders[index].m_entryPoint.c_str(), pTarget, dxcDefines.data(), dxcDefines.size());
             }
 
             std::vector<D3D12_INPUT_ELEMENT_DESC>inputElementDescs;
@@ -1871,6 +2253,8 @@ namespace hwrtl
 
     std::shared_ptr<CTexture2D> CDxDeviceCommand::CreateTexture2D(STextureCreateDesc texCreateDesc) 
     {
+        HWRTL_PROFILE_FUNCTION();
+
         std::shared_ptr<CDxTexture2D> retDxTexture2D = std::make_shared<CDxTexture2D>();
 
         retDxTexture2D->m_texWidth = texCreateDesc.m_width;
@@ -1891,10 +2275,20 @@ namespace hwrtl
 
         CDx12Resouce* pDxResouce = &retDxTexture2D->m_dxResource;
 
+        EMemoryCategory memoryCategory = EMemoryCategory::MC_SHADER_RESOURCE;
+        if (EnumHasAnyFlags(texCreateDesc.m_eTexUsage, ETexUsage::USAGE_UAV))
+        {
+            memoryCategory = EMemoryCategory::MC_ACCUMULATION;
+        }
+        else if (EnumHasAnyFlags(texCreateDesc.m_eTexUsage, ETexUsage::USAGE_RTV | ETexUsage::USAGE_DSV))
+        {
+            memoryCategory = EMemoryCategory::MC_RENDER_TARGET;
+        }
+
         if (texCreateDesc.m_srcData != nullptr)
         {
             pDxResouce->m_pResource = CreateDefaultTexture(texCreateDesc.m_srcData, resDesc, texCreateDesc.m_width, texCreateDesc.m_height,
-                Dx12GetTexturePiexlSize(texCreateDesc.m_eTexFormat), pDXDevice->m_tempBuffers.AllocResource());
+                Dx12GetTexturePiexlSize(texCreateDesc.m_eTexFormat), memoryCategory, pDXDevice->m_tempBuffers.AllocResource());
             pDxResouce->m_resourceState = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
         }
         else
@@ -1902,6 +2296,7 @@ namespace hwrtl
             ID3D12Resource** pResoucePtr = &(pDxResouce->m_pResource);
             D3D12_RESOURCE_STATES InitialResourceState = D3D12_RESOURCE_STATE_COMMON;
             ThrowIfFailed(pDevice->CreateCommittedResource(&defaultHeapProperies, D3D12_HEAP_FLAG_NONE, &resDesc, InitialResourceState, nullptr, IID_PPV_ARGS(pResoucePtr)));
+            Dx12TrackResourceMemory(pDxResouce->m_pResource, memoryCategory);
             pDxResouce->m_resourceState = InitialResourceState;
         }
 
@@ -1976,12 +2371,30 @@ namespace hwrtl
 
     std::shared_ptr<CBuffer> CDxDeviceCommand::CreateBuffer(const void* pInitData, uint64_t nByteSize, uint64_t nStride, EBufferUsage bufferUsage) 
     {
+        HWRTL_PROFILE_FUNCTION();
+
         assert(pInitData != nullptr);
 
         auto dxBuffer = std::make_shared<CDxBuffer>();
         ID3D12Device5Ptr pDevice = pDXDevice->m_pDevice;
 
-        dxBuffer->m_dxResource.m_pResource = CreateDefaultBuffer(pInitData, nByteSize, pDXDevice->m_tempBuffers.AllocResource());
+        D3D12_RESOURCE_FLAGS resourceFlags = EnumHasAnyFlags(bufferUsage, EBufferUsage::USAGE_UAV) ? D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS : D3D12_RESOURCE_FLAG_NONE;
+
+        EMemoryCategory memoryCategory = EMemoryCategory::MC_STRUCTURED_BUFFER;
+        if (EnumHasAnyFlags(bufferUsage, EBufferUsage::USAGE_VB))
+        {
+            memoryCategory = EMemoryCategory::MC_VERTEX_BUFFER;
+        }
+        else if (EnumHasAnyFlags(bufferUsage, EBufferUsage::USAGE_IB))
+        {
+            memoryCategory = EMemoryCategory::MC_INDEX_BUFFER;
+        }
+        else if (EnumHasAnyFlags(bufferUsage, EBufferUsage::USAGE_CB))
+        {
+            memoryCategory = EMemoryCategory::MC_CONSTANT_BUFFER;
+        }
+
+        dxBuffer->m_dxResource.m_pResource = CreateDefaultBuffer(pInitData, nByteSize, memoryCategory, pDXDevice->m_tempBuffers.AllocResource(), resourceFlags);
 
         if (EnumHasAnyFlags(bufferUsage, EBufferUsage::USAGE_VB))
         {
@@ -2061,11 +2474,35 @@ namespace hwrtl
 
         }
 
+        if (EnumHasAnyFlags(bufferUsage, EBufferUsage::USAGE_UAV))
+        {
+            D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = nByteSize / nStride;
+            uavDesc.Buffer.StructureByteStride = nStride;
+            uavDesc.Buffer.CounterOffsetInBytes = 0;
+            uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
+
+            CDx12DescManager& csuDescManager = pDXDevice->m_csuDescManager;
+            uint32_t uavIndex = csuDescManager.AllocDesc();
+            D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle = csuDescManager.GetCPUHandle(uavIndex);
+            D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle = csuDescManager.GetGPUHandle(uavIndex);
+
+            pDevice->CreateUnorderedAccessView(dxBuffer->m_dxResource.m_pResource, nullptr, &uavDesc, cpuHandle);
+
+            dxBuffer->m_dxResource.m_resourceState = D3D12_RESOURCE_STATE_COMMON;
+            dxBuffer->m_uav = CDx12View{ cpuHandle ,gpuHandle ,uavIndex };
+        }
+
         return dxBuffer;
     }
 
     void CDxDeviceCommand::BuildBottomLevelAccelerationStructure(std::vector< std::shared_ptr<SGpuBlasData>>& inoutGPUMeshData)
     {
+        HWRTL_PROFILE_FUNCTION();
+
         ID3D12Device5Ptr pDevice = pDXDevice->m_pDevice;
         ID3D12GraphicsCommandList4Ptr pCmdList = pDXDevice->m_pCmdList;
 
@@ -2089,7 +2526,7 @@ namespace hwrtl
             geomDesc.Triangles.VertexCount = gpuMeshData->m_nVertexCount;
             geomDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
             geomDesc.Triangles.IndexCount = 0;
-            geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+            geomDesc.Flags = gpuMeshData->m_bOpaque ? D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE : D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
 
             geomDescs.push_back(geomDesc);
             D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
@@ -2102,8 +2539,8 @@ namespace hwrtl
             D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info;
             pDevice->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
 
-            ID3D12ResourcePtr pScratch = Dx12CreateBuffer(info.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, defaultHeapProperies);
-            ID3D12ResourcePtr pResult = Dx12CreateBuffer(info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, defaultHeapProperies);
+            ID3D12ResourcePtr pScratch = Dx12CreateBuffer(info.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, defaultHeapProperies, EMemoryCategory::MC_SCRATCH);
+            ID3D12ResourcePtr pResult = Dx12CreateBuffer(info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, defaultHeapProperies, EMemoryCategory::MC_BLAS);
 
             D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc = {};
             asDesc.Inputs = inputs;
@@ -2136,6 +2573,8 @@ namespace hwrtl
 
     std::shared_ptr<CTopLevelAccelerationStructure> CDxDeviceCommand::BuildTopAccelerationStructure(std::vector<std::shared_ptr<SGpuBlasData>>& gpuMeshData)
     {
+        HWRTL_PROFILE_FUNCTION();
+
         auto dxTLAS = std::make_shared<CDxTopLevelAccelerationStructure>();
 
         {
@@ -2158,30 +2597,30 @@ namespace hwrtl
             D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info;
             pDevice->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
 
-            ID3D12ResourcePtr pScratch = Dx12CreateBuffer(info.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, defaultHeapProperies);
-            ID3D12ResourcePtr pResult = Dx12CreateBuffer(info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, defaultHeapProperies);
+            ID3D12ResourcePtr pScratch = Dx12CreateBuffer(info.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, defaultHeapProperies, EMemoryCategory::MC_SCRATCH);
+            ID3D12ResourcePtr pResult = Dx12CreateBuffer(info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, defaultHeapProperies, EMemoryCategory::MC_TLAS);
 
             std::vector<D3D12_RAYTRACING_INSTANCE_DESC> instanceDescs;
             instanceDescs.resize(totalInstanceNum);
+            uint32_t instanceDescIndex = 0;
             for (uint32_t indexMesh = 0; indexMesh < gpuMeshData.size(); indexMesh++)
             {
+                auto pdxBLAS = CastTo<CDxBottomLevelAccelerationStructure>(gpuMeshData[indexMesh]->m_pBLAS);
                 for (uint32_t indexInstance = 0; indexInstance < gpuMeshData[indexMesh]->instanes.size(); indexInstance++)
                 {
-                    auto& gpuMeshDataIns = gpuMeshData[indexMesh];
-                    const SMeshInstanceInfo& meshInstanceInfo = gpuMeshDataIns->instanes[indexInstance];
-                    
-                    instanceDescs[indexMesh].InstanceID = meshInstanceInfo.m_instanceID;
-                    instanceDescs[indexMesh].InstanceContributionToHitGroupIndex = 0;
-                    instanceDescs[indexMesh].Flags = Dx12ConvertInstanceFlag(meshInstanceInfo.m_instanceFlag);
-                    memcpy(instanceDescs[indexMesh].Transform, &meshInstanceInfo.m_transform, sizeof(instanceDescs[indexMesh].Transform));
-
-                    auto pdxBLAS = CastTo<CDxBottomLevelAccelerationStructure>(gpuMeshData[indexMesh]->m_pBLAS);
-                    instanceDescs[indexMesh].AccelerationStructure = pdxBLAS->m_pblas->GetGPUVirtualAddress();
-                    instanceDescs[indexMesh].InstanceMask = 0xFF;
+                    const SMeshInstanceInfo& meshInstanceInfo = gpuMeshData[indexMesh]->instanes[indexInstance];
+                    D3D12_RAYTRACING_INSTANCE_DESC& instanceDesc = instanceDescs[instanceDescIndex++];
+
+                    instanceDesc.InstanceID = meshInstanceInfo.m_instanceID;
+                    instanceDesc.InstanceContributionToHitGroupIndex = 0;
+                    instanceDesc.Flags = Dx12ConvertInstanceFlag(meshInstanceInfo.m_instanceFlag);
+                    memcpy(instanceDesc.Transform, &meshInstanceInfo.m_transform, sizeof(instanceDesc.Transform));
+                    instanceDesc.AccelerationStructure = pdxBLAS->m_pblas->GetGPUVirtualAddress();
+                    instanceDesc.InstanceMask = 0xFF;
                 }
             }
 
-            ID3D12ResourcePtr pInstanceDescBuffer = CreateDefaultBuffer(instanceDescs.data(), sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * totalInstanceNum, pDXDevice->m_tempBuffers.AllocResource());
+            ID3D12ResourcePtr pInstanceDescBuffer = CreateDefaultBuffer(instanceDescs.data(), sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * totalInstanceNum, EMemoryCategory::MC_TLAS, pDXDevice->m_tempBuffers.AllocResource());
 
             D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc = {};
             asDesc.Inputs = inputs;
@@ -2225,6 +2664,8 @@ namespace hwrtl
    
     void* CDxDeviceCommand::LockTextureForRead(std::shared_ptr<CTexture2D> readBackTexture)
     {
+        HWRTL_PROFILE_FUNCTION();
+
         Dx12OpenCmdListInternal();
 
         CDxTexture2D* dxTex = static_cast<CDxTexture2D*>(readBackTexture.get());
@@ -2252,6 +2693,7 @@ namespace hwrtl
         bufferDesc.SampleDesc.Count = 1;
 
         ThrowIfFailed(pDevice->CreateCommittedResource(&readBackHeapProperies, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&dxTex->m_pStagereSource)));
+        Dx12TrackResourceMemory(dxTex->m_pStagereSource, EMemoryCategory::MC_STAGING);
         
         D3D12_RESOURCE_STATES originalResourceState = dxTex->m_dxResource.m_resourceState;
         pDXDevice->dxBarrierManager.AddResourceBarrier(&dxTex->m_dxResource, D3D12_RESOURCE_STATE_COPY_SOURCE);
@@ -2302,7 +2744,49 @@ namespace hwrtl
         CDxTexture2D* dxTex = static_cast<CDxTexture2D*>(readBackTexture.get());
         D3D12_RANGE writeRange = { 0, 0 };
         dxTex->m_pStagereSource->Unmap(0, &writeRange);
-        dxTex->m_pStagereSource->Release();
+        dxTex->m_pStagereSource = nullptr;
+    }
+
+    void* CDxDeviceCommand::LockBufferForRead(std::shared_ptr<CBuffer> readBackBuffer)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        Dx12OpenCmdListInternal();
+
+        CDxBuffer* dxBuffer = static_cast<CDxBuffer*>(readBackBuffer.get());
+        ID3D12ResourcePtr pSourceBuffer = dxBuffer->m_dxResource.m_pResource;
+
+        auto pCommandList = pDXDevice->m_pCmdList;
+        const auto desc = pSourceBuffer->GetDesc();
+
+        dxBuffer->m_pStagereSource = Dx12CreateBuffer(desc.Width, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, readBackHeapProperies, EMemoryCategory::MC_STAGING);
+
+        D3D12_RESOURCE_STATES originalResourceState = dxBuffer->m_dxResource.m_resourceState;
+        pDXDevice->dxBarrierManager.AddResourceBarrier(&dxBuffer->m_dxResource, D3D12_RESOURCE_STATE_COPY_SOURCE);
+        pDXDevice->dxBarrierManager.FlushResourceBarrier(pCommandList);
+
+        pCommandList->CopyBufferRegion(dxBuffer->m_pStagereSource, 0, pSourceBuffer, 0, desc.Width);
+
+        pDXDevice->dxBarrierManager.AddResourceBarrier(&dxBuffer->m_dxResource, originalResourceState);
+        pDXDevice->dxBarrierManager.FlushResourceBarrier(pCommandList);
+
+        Dx12CloseAndExecuteCmdListInternal();
+        Dx12WaitGPUCmdListFinishInternal();
+
+        Dx12OpenCmdListInternal();
+
+        void* pMappedMemory = nullptr;
+        D3D12_RANGE readRange = { 0, static_cast<SIZE_T>(desc.Width) };
+        ThrowIfFailed(dxBuffer->m_pStagereSource->Map(0, &readRange, &pMappedMemory));
+        return pMappedMemory;
+    }
+
+    void CDxDeviceCommand::UnLockBuffer(std::shared_ptr<CBuffer> readBackBuffer)
+    {
+        CDxBuffer* dxBuffer = static_cast<CDxBuffer*>(readBackBuffer.get());
+        D3D12_RANGE writeRange = { 0, 0 };
+        dxBuffer->m_pStagereSource->Unmap(0, &writeRange);
+        dxBuffer->m_pStagereSource = nullptr;
     }
 
     void CheckBinding(D3D12_CPU_DESCRIPTOR_HANDLE* handles)
@@ -2409,6 +2893,15 @@ namespace hwrtl
         pDXDevice->dxBarrierManager.AddResourceBarrier(&pDxTex2D->m_dxResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
     }
 
+    void CDx12RayTracingContext::SetShaderUAV(std::shared_ptr<CBuffer>buffer, uint32_t bindIndex)
+    {
+        CDxBuffer* pDxBuffer = static_cast<CDxBuffer*>(buffer.get());
+        m_viewHandles[uint32_t(ESlotType::ST_U)][bindIndex] = pDxBuffer->m_uav.m_pCpuDescHandle;
+        m_bViewTableDirty[uint32_t(ESlotType::ST_U)] = true;
+
+        pDXDevice->dxBarrierManager.AddResourceBarrier(&pDxBuffer->m_dxResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    }
+
     void hwrtl::CDx12RayTracingContext::SetConstantBuffer(std::shared_ptr<CBuffer> constantBuffer, uint32_t bindIndex)
     {
         CDxBuffer* pDxBuffer = static_cast<CDxBuffer*>(constantBuffer.get());
@@ -2455,6 +2948,13 @@ namespace hwrtl
         D3D12_DISPATCH_RAYS_DESC rayDispatchDesc = CreateRayTracingDesc(width, height);
 
         pCommandList->DispatchRays(&rayDispatchDesc);
+
+        // consecutive dispatches accumulate into the same uavs without a state change, order them so that
+        // the samples of a texel are always accumulated in the same order and the bake result is deterministic
+        D3D12_RESOURCE_BARRIER uavBarrier = {};
+        uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+        uavBarrier.UAV.pResource = nullptr;
+        pCommandList->ResourceBarrier(1, &uavBarrier);
     }
 
 
@@ -2502,7 +3002,7 @@ namespace hwrtl
             m_bByteBufferBindlessTableDirty = true;
         }
 
-        if (m_byteBufferbindlessNum != pDXDevice->m_bindlessByteAddressDescManager.GetCurrentHandleNum())
+        if (m_byteBufferbindlessNum != pDXDevice->m_bindlessByteAddressDescManager.GetCurrentHandleNum() || m_byteBufferBindlessVersion != pDXDevice->m_bindlessByteAddressDescManager.GetSlotVersion())
         {
             m_bByteBufferBindlessTableDirty = true;
         }
@@ -2510,6 +3010,7 @@ namespace hwrtl
         if (m_bByteBufferBindlessTableDirty)
         {
             m_byteBufferbindlessNum = pDXDevice->m_bindlessByteAddressDescManager.GetCurrentHandleNum();
+            m_byteBufferBindlessVersion = pDXDevice->m_bindlessByteAddressDescManager.GetSlotVersion();
             m_byteBufferBindlessHandles.resize(m_byteBufferbindlessNum);
             for (uint32_t index = 0; index < m_byteBufferbindlessNum; index++)
             {
@@ -2545,7 +3046,7 @@ namespace hwrtl
             m_bTex2DBindlessTableDirty = true;
         }
 
-        if (m_tex2DBindlessNum != pDXDevice->m_bindlessTexDescManager.GetCurrentHandleNum())
+        if (m_tex2DBindlessNum != pDXDevice->m_bindlessTexDescManager.GetCurrentHandleNum() || m_tex2DBindlessVersion != pDXDevice->m_bindlessTexDescManager.GetSlotVersion())
         {
             m_bTex2DBindlessTableDirty = true;
         }
@@ -2553,6 +3054,7 @@ namespace hwrtl
         if (m_bTex2DBindlessTableDirty)
         {
             m_tex2DBindlessNum = pDXDevice->m_bindlessTexDescManager.GetCurrentHandleNum();
+            m_tex2DBindlessVersion = pDXDevice->m_bindlessTexDescManager.GetSlotVersion();
             m_tex2DBindlessHandles.resize(m_tex2DBindlessNum);
             for (uint32_t index = 0; index < m_tex2DBindlessNum; index++)
             {
@@ -31,6 +31,17 @@ SOFTWARE.
 #include "hwrtl_gi.h"
 #include <stdlib.h>
 #include <assert.h>
+#include <float.h>
+#include <unordered_map>
+#include <map>
+#include <tuple>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cmath>
+#include <limits>
 
 #define STBRP_DEF static
 
@@ -116,7 +127,35 @@ namespace gi
         uint32_t m_ibStride;
         uint32_t m_ibIndex;
         uint32_t m_vbIndex;
-        uint32_t unused;
+        uint32_t m_meshLightIndexPlusOne; // 0 if the instance isn't emissive
+
+        // x: texel offset in the albedo cache, y: cache width | height << 16, 0 if there is no base color texture
+        // z: srgb rgba8 base color, w: byte address bindless index of the texture uv
+        uint32_t m_albedoInfo[4];
+
+        // x: opacity micro map offset, y: alpha mask offset, both in the alpha test buffer
+        // z: alpha mask width | height << 16, 0 if the mesh is opaque, w: micro map level | alpha cutoff << 8
+        uint32_t m_alphaInfo[4];
+    };
+
+    // see SMeshLightTriangle in hwrtl_gi.hlsl
+    struct SMeshLightTriangle
+    {
+        Vec3 m_vertex0;
+        float m_cdf; // area cdf inside the mesh light, 1 for the last triangle
+        Vec3 m_vertex1;
+        float m_area;
+        Vec3 m_vertex2;
+        float m_trianglePadding;
+    };
+    static_assert(sizeof(SMeshLightTriangle) == 48, "sizeof(SMeshLightTriangle) == 48");
+
+    // see SGBufferInstanceGpuData in hwrtl_gi.hlsl
+    struct SGBufferInstanceGpuData
+    {
+        Vec4 m_positionBoundsMin;
+        Vec4 m_positionBoundsSize;
+        uint32_t m_texelKeyInfo[4];
     };
 
 	struct SGIMesh
@@ -132,6 +171,9 @@ namespace gi
 
         std::shared_ptr<SGpuBlasData>m_pGpuMeshData;
 
+        const Vec3* m_pPositionData = nullptr; // user data, used by AddAdaptiveProbeVolume
+        const Vec2* m_pTextureUVData = nullptr; // user data, used by the cpu probe pass
+
         Vec2i m_nLightMapSize;
         Vec2i m_nAtlasOffset;
         Vec4 m_lightMapScaleAndBias;
@@ -143,6 +185,13 @@ namespace gi
         int m_nAtlasIndex;
 
         int m_meshIndex = -1;
+        int m_meshLightIndex = -1; // see AddMeshLight
+
+        uint32_t m_albedoCacheOffset = 0;
+        Vec2i m_albedoCacheSize = Vec2i(0, 0); // zero if there is no base color texture
+        Vec3 m_baseColor;
+
+        uint32_t m_alphaInfo[4] = { 0, 0, 0, 0 }; // see SMeshInstanceGpuData::m_alphaInfo
 
         SMeshInstanceInfo m_meshInstanceInfo;
 	};
@@ -154,14 +203,24 @@ namespace gi
         // gbuffer output
         std::shared_ptr<CTexture2D> m_hPosTexture;
         std::shared_ptr<CTexture2D> m_hNormalTexture;
+        std::shared_ptr<CTexture2D> m_hCompactGBufferTexture; // replaces the position and normal textures if m_bCompactGBuffer is enabled
 
         // ray tracing output + dilate ouput
         std::shared_ptr<CTexture2D> m_irradianceAndSampleCount;
         std::shared_ptr<CTexture2D> m_shDirectionality;
 
-        // denoiser output
+        // L2 sh directionality output + dilate output, luminance sh coefficient 4 - 7 and coefficient 8
+        std::shared_ptr<CTexture2D> m_shDirectionalityL2Part0;
+        std::shared_ptr<CTexture2D> m_shDirectionalityL2Part1;
+
+        // debug output, see rtTraversalCost in hwrtl_gi.hlsl
+        std::shared_ptr<CTexture2D> m_traversalCost;
+
+        // denoiser output, the L2 sh directionality is copied without denoising
         std::shared_ptr<CTexture2D> m_irradianceAndSampleCountPingPongTex;
         std::shared_ptr<CTexture2D> m_shDirectionalityPingPongTex;
+        std::shared_ptr<CTexture2D> m_shDirectionalityL2Part0PingPongTex;
+        std::shared_ptr<CTexture2D> m_shDirectionalityL2Part1PingPongTex;
 
         // encoded output
         std::shared_ptr<CTexture2D> m_irradianceAndSampleCountEncoded;
@@ -177,13 +236,6 @@ namespace gi
         uint32_t m_rpPadding2;
     };
 
-    // must match the light type define in hlsl code
-    enum class ELightType : uint32_t
-    {
-        LT_DIRECTION = 1 << 0,
-        LT_SPHERE   = 1 << 1,
-    };
-
     // must match the light define in hlsl code
     struct SRayTracingLight
     {
@@ -197,7 +249,9 @@ namespace gi
         float m_vAttenuation;
 
         float m_radius;
-        Vec3 m_rtLightPadding;
+        float m_meshLightArea;
+        uint32_t m_triangleOffset; // first triangle of the mesh light in m_meshLightTriangles
+        uint32_t m_triangleCount;
     };
 
     struct SRtGlobalConstantBuffer
@@ -205,10 +259,87 @@ namespace gi
         uint32_t m_nRtSceneLightCount;
         Vec2i m_nAtlasSize;
         uint32_t m_sampleIndex;
-        float m_rtGlobalCbPadding[60];
+        uint32_t m_nProbeCount;
+        uint32_t m_nProbeRayCount;
+        float m_probeMaxDepth;
+        float m_aoMaxDistance;
+        uint32_t m_bakeSeed;
+        uint32_t m_environmentLightIndex; // index + 1, 0 if there is no environment light
+        Vec2i m_environmentLightSize;
+        Vec4 m_environmentSH[HWRTL_SH_L2_COEFFICIENT_NUM];
+        float m_rtGlobalCbPadding[16];
     };
     static_assert(sizeof(SRtGlobalConstantBuffer) == 256, "sizeof(SRtGlobalConstantBuffer) == 256");
 
+    // must match RT_STATS_* in hwrtl_gi.hlsl
+    enum class ERayStatsCounter : uint32_t
+    {
+        RSC_PRIMARY_RAY = 0,
+        RSC_BOUNCE_RAY,
+        RSC_SHADOW_RAY,
+        RSC_OCCLUSION_RAY,
+        RSC_RAY_HIT,
+        RSC_RAY_MISS,
+        RSC_PATH_LENGTH,
+        RSC_NUM = RSC_PATH_LENGTH + HWRTL_RAY_STATS_MAX_BOUNCES + 1,
+    };
+
+    struct SProbeVolume
+    {
+        Vec3 m_volumeMin;
+        Vec3 m_volumeMax;
+        Vec3i m_probeResolution;
+
+        bool m_bAdaptive = false;
+        Vec3i m_indirectionSize;
+        std::vector<uint32_t> m_indirection;
+        std::vector<SProbeBrick> m_bricks;
+
+        std::vector<Vec4> m_probePositions;
+        uint32_t m_firstProbe = 0; // offset in the probe buffer
+    };
+
+    // see Cpu Wavefront Probe Tracing
+    struct SCpuRay
+    {
+        Vec3 m_origin;
+        float m_tMin;
+        Vec3 m_direction;
+        float m_tMax;
+    };
+
+    struct SCpuRayHit
+    {
+        float m_hitT; // negative if the ray misses
+        uint32_t m_triangleIndex;
+        float m_barycentricU;
+        float m_barycentricV;
+    };
+
+    struct SCpuBvhNode
+    {
+        Vec3 m_boundsMin;
+        uint32_t m_firstChildOrTriangle; // the right child is m_firstChildOrTriangle + 1
+        Vec3 m_boundsMax;
+        uint32_t m_triangleNum; // 0 for inner nodes
+    };
+    static_assert(sizeof(SCpuBvhNode) == 32, "sizeof(SCpuBvhNode) == 32");
+
+    struct SCpuBvhTriangle
+    {
+        Vec3 m_vertex0;
+        Vec3 m_edge1;
+        Vec3 m_edge2;
+        uint32_t m_giMeshIndex;
+        uint32_t m_primitiveIndex;
+    };
+
+    struct SCpuBvh
+    {
+        std::vector<SCpuBvhNode> m_nodes;
+        std::vector<SCpuBvhTriangle> m_triangles; // in leaf order
+    };
+
     class CHWRTLLightMapDenoiser
     {
     public:
@@ -219,6 +350,11 @@ namespace gi
 	public:
 		std::vector<SGIMesh> m_giMeshes;
         std::vector<SAtlas>m_atlas;
+
+        // instances of the same geometry share the vertex buffers and the blas, keyed by the user vertex data
+        std::unordered_map<const void*, std::shared_ptr<CBuffer>> m_sharedVertexBuffers;
+        std::unordered_map<const void*, std::shared_ptr<SGpuBlasData>> m_sharedGpuBlasData;
+        std::vector<std::shared_ptr<SGpuBlasData>> m_uniqueGpuBlasData; // in the order of the first instance
         std::vector<void*>m_irradianceReadBackData;
         std::vector<void*>m_directionalityReadBackData;
 
@@ -228,6 +364,11 @@ namespace gi
 
         std::shared_ptr<CBuffer> pRtSceneLight;
         std::shared_ptr<CBuffer> pRtSceneGlobalCB;
+        std::shared_ptr<CBuffer> pRtRayStats; // low and high 32 bit of every ERayStatsCounter
+        std::shared_ptr<CTexture2D> m_placeholderUAVTexture; // bound to the unused optional uav slots
+        double m_rayTracingPassSeconds = 0.0;
+        bool m_bStreamingBake = false; // the per atlas textures are created and released by BakeLightMapStreaming
+        std::shared_ptr<CBuffer> pProbeGlobalCB;
         std::shared_ptr<CBuffer> pDenoiseGlobalCB;
         std::shared_ptr<CBuffer> pVisualizeViewCB;
 
@@ -236,6 +377,7 @@ namespace gi
 
         std::shared_ptr<CGraphicsPipelineState>m_pLightMapGBufferPSO;
         std::shared_ptr<CRayTracingPipelineState>m_pRayTracingPSO;
+        std::shared_ptr<CRayTracingPipelineState>m_pProbeRayTracingPSO;
         std::shared_ptr<CGraphicsPipelineState>m_pDenoisePSO;
         std::shared_ptr<CGraphicsPipelineState>m_pDilatePSO;
         std::shared_ptr<CGraphicsPipelineState>m_pEncodeLightMapPSO;
@@ -244,8 +386,42 @@ namespace gi
         std::shared_ptr<CTopLevelAccelerationStructure> m_pTLAS;
         std::vector<SMeshInstanceGpuData> m_sceneInstanceData;
         std::shared_ptr<CBuffer> m_instanceGpuData;
+        std::shared_ptr<CBuffer> m_gbufferInstanceGpuData; // see SGBufferInstanceGpuData in hwrtl_gi.hlsl
 
         std::vector<SRayTracingLight> m_aRayTracingLights;
+        std::vector<SMeshLightTriangle> m_meshLightTriangles; // world space, the triangles of one mesh light are contiguous
+        std::shared_ptr<CBuffer> m_meshLightTriangleBuffer;
+
+        // see rtEnvironmentLight in hwrtl_gi.hlsl
+        int m_environmentLightIndex = -1;
+        std::vector<Vec4> m_environmentLightData;
+        Vec2i m_environmentLightSize = Vec2i(0, 0);
+        Vec4 m_environmentSH[HWRTL_SH_L2_COEFFICIENT_NUM];
+        std::shared_ptr<CBuffer> m_environmentLightBuffer;
+
+        // srgb rgba8 texels of the box filtered base color textures, keyed by the user texture data and its size
+        std::vector<uint32_t> m_albedoCacheTexels;
+        std::map<std::tuple<const void*, int, int>, uint32_t> m_albedoCacheOffsets;
+        std::shared_ptr<CBuffer> m_albedoCacheBuffer;
+
+        // opacity micro maps and alpha masks (4 texels per uint), see rtAlphaTestData in hwrtl_gi.hlsl
+        std::vector<uint32_t> m_alphaTestData;
+        std::map<std::tuple<const void*, int, int>, uint32_t> m_alphaMaskOffsets; // alpha mask, mask size
+        std::map<std::tuple<const void*, const void*, int, int, uint32_t>, uint32_t> m_opacityMicroMapOffsets; // texture uv, alpha mask, mask size, cutoff
+        std::shared_ptr<CBuffer> m_alphaTestBuffer;
+
+        std::vector<SProbeVolume> m_probeVolumes;
+        std::vector<Vec4> m_probePositions;
+        std::shared_ptr<CBuffer> m_probePositionBuffer;
+        std::shared_ptr<CBuffer> m_probeSHAndSampleCount;
+        std::shared_ptr<CBuffer> m_probeDepthMoments;
+        float m_probeMaxDepth = 0.0f;
+
+        // cpu probe pass, same layout as m_probeSHAndSampleCount and m_probeDepthMoments
+        SCpuBvh m_cpuBvh;
+        std::vector<Vec4> m_cpuProbeSHAndSampleCount;
+        std::vector<Vec4> m_cpuProbeDepthMoments;
+        SCpuRayTracingStats m_cpuRayTracingStats;
 
         static CDeviceCommand* GetDeviceCommand();
         static CRayTracingContext* GetRayTracingContext();
@@ -282,6 +458,98 @@ namespace gi
 
     static void PackMeshIntoAtlas();
 
+    static bool IsSHL2DirectionalityEnabled()
+    {
+        return pGiBaker->m_bakeConfig.m_bSHL2Directionality && pGiBaker->m_bakeConfig.m_bakeMode == EBakeMode::BM_LIGHTING;
+    }
+
+    static bool IsCompactGBufferEnabled()
+    {
+        return pGiBaker->m_bakeConfig.m_bCompactGBuffer;
+    }
+
+    static SShaderDefine GetCompactGBufferDefine()
+    {
+        return SShaderDefine{ L"COMPACT_GBUFFER", IsCompactGBufferEnabled() ? L"1" : L"0" };
+    }
+
+    static bool IsPreviewBakeEnabled()
+    {
+        return pGiBaker->m_bakeConfig.m_bPreviewBake;
+    }
+
+    // gbuffer and ray tracing output
+    static void CreateAtlasGBufferTextures(SAtlas& atlas)
+    {
+        STextureCreateDesc texCreateDesc{ ETexUsage::USAGE_SRV | ETexUsage::USAGE_RTV,ETexFormat::FT_RGBA32_FLOAT,pGiBaker->m_nAtlasSize.x,pGiBaker->m_nAtlasSize.y };
+        if (IsCompactGBufferEnabled())
+        {
+            STextureCreateDesc compactTexCreateDesc = texCreateDesc;
+            compactTexCreateDesc.m_eTexFormat = ETexFormat::FT_RGBA32_UINT;
+            atlas.m_hCompactGBufferTexture = CGIBaker::GetDeviceCommand()->CreateTexture2D(compactTexCreateDesc);
+        }
+        else
+        {
+            atlas.m_hPosTexture = CGIBaker::GetDeviceCommand()->CreateTexture2D(texCreateDesc);
+            atlas.m_hNormalTexture = CGIBaker::GetDeviceCommand()->CreateTexture2D(texCreateDesc);
+        }
+
+        STextureCreateDesc resTexCreateDesc = texCreateDesc;
+        resTexCreateDesc.m_eTexUsage = ETexUsage::USAGE_SRV | ETexUsage::USAGE_UAV | ETexUsage::USAGE_RTV;
+        atlas.m_irradianceAndSampleCount = CGIBaker::GetDeviceCommand()->CreateTexture2D(resTexCreateDesc);
+        atlas.m_shDirectionality = CGIBaker::GetDeviceCommand()->CreateTexture2D(resTexCreateDesc);
+
+        if (IsSHL2DirectionalityEnabled())
+        {
+            atlas.m_shDirectionalityL2Part0 = CGIBaker::GetDeviceCommand()->CreateTexture2D(resTexCreateDesc);
+            atlas.m_shDirectionalityL2Part1 = CGIBaker::GetDeviceCommand()->CreateTexture2D(resTexCreateDesc);
+        }
+
+        if (pGiBaker->m_bakeConfig.m_bTraversalCostOutput)
+        {
+            atlas.m_traversalCost = CGIBaker::GetDeviceCommand()->CreateTexture2D(resTexCreateDesc);
+        }
+    }
+
+    static void CreateAtlasDenoiseTextures(SAtlas& atlas)
+    {
+        STextureCreateDesc pinPongtexCreateDesc{ ETexUsage::USAGE_SRV | ETexUsage::USAGE_RTV,ETexFormat::FT_RGBA32_FLOAT,pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y };
+        atlas.m_irradianceAndSampleCountPingPongTex = CGIBaker::GetDeviceCommand()->CreateTexture2D(pinPongtexCreateDesc);
+        atlas.m_shDirectionalityPingPongTex = CGIBaker::GetDeviceCommand()->CreateTexture2D(pinPongtexCreateDesc);
+
+        if (IsSHL2DirectionalityEnabled())
+        {
+            atlas.m_shDirectionalityL2Part0PingPongTex = CGIBaker::GetDeviceCommand()->CreateTexture2D(pinPongtexCreateDesc);
+            atlas.m_shDirectionalityL2Part1PingPongTex = CGIBaker::GetDeviceCommand()->CreateTexture2D(pinPongtexCreateDesc);
+        }
+    }
+
+    static void CreateAtlasEncodeTextures(SAtlas& atlas)
+    {
+        STextureCreateDesc encodeTexCreateDesc{ ETexUsage::USAGE_SRV | ETexUsage::USAGE_RTV,ETexFormat::FT_RGBA8_UNORM,pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y };
+        atlas.m_irradianceAndSampleCountEncoded = CGIBaker::GetDeviceCommand()->CreateTexture2D(encodeTexCreateDesc);
+        atlas.m_shDirectionalityEncoded = CGIBaker::GetDeviceCommand()->CreateTexture2D(encodeTexCreateDesc);
+    }
+
+    // the geometries, the constant buffers and the output cpu data of the atlas are kept
+    static void ReleaseAtlasTextures(SAtlas& atlas)
+    {
+        atlas.m_hPosTexture = nullptr;
+        atlas.m_hNormalTexture = nullptr;
+        atlas.m_hCompactGBufferTexture = nullptr;
+        atlas.m_irradianceAndSampleCount = nullptr;
+        atlas.m_shDirectionality = nullptr;
+        atlas.m_shDirectionalityL2Part0 = nullptr;
+        atlas.m_shDirectionalityL2Part1 = nullptr;
+        atlas.m_traversalCost = nullptr;
+        atlas.m_irradianceAndSampleCountPingPongTex = nullptr;
+        atlas.m_shDirectionalityPingPongTex = nullptr;
+        atlas.m_shDirectionalityL2Part0PingPongTex = nullptr;
+        atlas.m_shDirectionalityL2Part1PingPongTex = nullptr;
+        atlas.m_irradianceAndSampleCountEncoded = nullptr;
+        atlas.m_shDirectionalityEncoded = nullptr;
+    }
+
     static void GenerateAtlas()
     {
         pGiBaker->m_atlas.resize(pGiBaker->m_nAtlasNum);
@@ -293,17 +561,12 @@ namespace gi
             pGiBaker->m_atlas[atlasIndex].m_atlasGeometries.push_back(giMeshDesc);
         }
 
-        for (uint32_t index = 0; index < pGiBaker->m_atlas.size(); index++)
+        if (!pGiBaker->m_bStreamingBake)
         {
-            STextureCreateDesc texCreateDesc{ ETexUsage::USAGE_SRV | ETexUsage::USAGE_RTV,ETexFormat::FT_RGBA32_FLOAT,pGiBaker->m_nAtlasSize.x,pGiBaker->m_nAtlasSize.y };
-            SAtlas& atlas = pGiBaker->m_atlas[index];
-            atlas.m_hPosTexture = CGIBaker::GetDeviceCommand()->CreateTexture2D(texCreateDesc);
-            atlas.m_hNormalTexture = CGIBaker::GetDeviceCommand()->CreateTexture2D(texCreateDesc);
-
-            STextureCreateDesc resTexCreateDesc = texCreateDesc;
-            resTexCreateDesc.m_eTexUsage = ETexUsage::USAGE_SRV | ETexUsage::USAGE_UAV | ETexUsage::USAGE_RTV;
-            atlas.m_irradianceAndSampleCount = CGIBaker::GetDeviceCommand()->CreateTexture2D(resTexCreateDesc);
-            atlas.m_shDirectionality = CGIBaker::GetDeviceCommand()->CreateTexture2D(resTexCreateDesc);
+            for (uint32_t index = 0; index < pGiBaker->m_atlas.size(); index++)
+            {
+                CreateAtlasGBufferTextures(pGiBaker->m_atlas[index]);
+            }
         }
     }
 
@@ -323,10 +586,17 @@ namespace gi
         vertexLayouts.push_back(EVertexFormat::FT_FLOAT2);
 
         std::vector<ETexFormat>rtFormats;
-        rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
-        rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+        if (IsCompactGBufferEnabled())
+        {
+            rtFormats.push_back(ETexFormat::FT_RGBA32_UINT);
+        }
+        else
+        {
+            rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+            rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+        }
 
-        SRasterizationPSOCreateDesc rsPsoCreateDesc = { shaderPath, rsShaders, rasterizationResources, vertexLayouts, rtFormats, ETexFormat::FT_None };
+        SRasterizationPSOCreateDesc rsPsoCreateDesc = { shaderPath, rsShaders, rasterizationResources, vertexLayouts, rtFormats, ETexFormat::FT_None, { GetCompactGBufferDefine() } };
         pGiBaker->m_pLightMapGBufferPSO = CGIBaker::GetDeviceCommand()->CreateRSPipelineState(rsPsoCreateDesc);
     }
 
@@ -354,618 +624,4136 @@ namespace gi
         {
             assert((bakeMeshDesc.m_pNormalData != nullptr) && "gi baker visualize pass need normal vertex buffer");
         }
-    }
 
-    void hwrtl::gi::AddBakeMeshsAndCreateVB(const std::vector<SBakeMeshDesc>& bakeMeshDescs)
-    {
-        for (uint32_t index = 0; index < bakeMeshDescs.size(); index++)
+        if (bakeMeshDesc.m_pBaseColorData != nullptr)
         {
-            const SBakeMeshDesc& bakeMeshDesc = bakeMeshDescs[index];
-            SGIMesh giMesh;
-
-            ValidateMeshDesc(bakeMeshDesc);
-
-            giMesh.m_positionVB = CGIBaker::GetDeviceCommand()->CreateBuffer(bakeMeshDesc.m_pPositionData, bakeMeshDesc.m_nVertexCount * sizeof(Vec3), sizeof(Vec3), EBufferUsage::USAGE_VB | EBufferUsage::USAGE_BYTE_ADDRESS);
-            giMesh.m_lightMapUVVB = CGIBaker::GetDeviceCommand()->CreateBuffer(bakeMeshDesc.m_pLightMapUVData, bakeMeshDesc.m_nVertexCount * sizeof(Vec2), sizeof(Vec2), EBufferUsage::USAGE_VB | EBufferUsage::USAGE_BYTE_ADDRESS);
-
-            //if (bakeMeshDesc.m_pIndexData)
-            //{
-            //    giMesh.m_indexBuffer = CGIBaker::GetDeviceCommand()->CreateBuffer(bakeMeshDesc.m_pIndexData, bakeMeshDesc.m_nIndexCount * sizeof(Vec3i), sizeof(Vec3i), EBufferUsage::USAGE_IB | EBufferUsage::USAGE_BYTE_ADDRESS);
-            //}
-
-            if (bakeMeshDesc.m_pNormalData)
-            {
-                giMesh.m_normalVB = CGIBaker::GetDeviceCommand()->CreateBuffer(bakeMeshDesc.m_pNormalData, bakeMeshDesc.m_nVertexCount * sizeof(Vec3), sizeof(Vec3), EBufferUsage::USAGE_VB | EBufferUsage::USAGE_BYTE_ADDRESS);
-            }
-           
-            giMesh.m_nVertexCount = bakeMeshDesc.m_nVertexCount;
-            giMesh.m_nLightMapSize = bakeMeshDesc.m_nLightMapSize;
-            giMesh.m_meshInstanceInfo = bakeMeshDesc.m_meshInstanceInfo;
-            giMesh.m_pGpuMeshData = std::make_shared<SGpuBlasData>();
+            assert((bakeMeshDesc.m_pTextureUVData != nullptr) && "the base color texture needs texture uv");
+            assert(bakeMeshDesc.m_baseColorSize.x > 0 && bakeMeshDesc.m_baseColorSize.y > 0);
+        }
 
-            giMesh.m_pGpuMeshData->m_nVertexCount = giMesh.m_nVertexCount;
-            giMesh.m_pGpuMeshData->m_pVertexBuffer = giMesh.m_positionVB;
+        if (bakeMeshDesc.m_pAlphaMaskData != nullptr)
+        {
+            assert((bakeMeshDesc.m_pTextureUVData != nullptr) && "the alpha mask needs texture uv");
+            assert(bakeMeshDesc.m_alphaMaskSize.x > 0 && bakeMeshDesc.m_alphaMaskSize.y > 0);
+            assert(bakeMeshDesc.m_alphaMaskSize.x < 65536 && bakeMeshDesc.m_alphaMaskSize.y < 65536);
+        }
+    }
 
-            assert(bakeMeshDesc.m_meshIndex >= 0);
-            giMesh.m_meshIndex = bakeMeshDesc.m_meshIndex;
+    /***************************************************************************
+    * Albedo Cache
+    * 
+    * the base color textures are box filtered to at most m_albedoCacheSize texels per axis when the mesh is added
+    * the bounce rays point sample the cache instead of the full resolution texture, see GetHitAlbedo in hwrtl_gi.hlsl
+    ***************************************************************************/
 
-            std::vector<SMeshInstanceInfo> instanceInfos;
-            instanceInfos.push_back(giMesh.m_meshInstanceInfo);
-            giMesh.m_pGpuMeshData->instanes = instanceInfos;
-            pGiBaker->m_giMeshes.push_back(giMesh);
-        }
+    static float SRGBToLinear(float srgbValue)
+    {
+        return srgbValue <= 0.04045f ? srgbValue / 12.92f : std::pow((srgbValue + 0.055f) / 1.055f, 2.4f);
     }
 
-    void hwrtl::gi::AddDirectionalLight(Vec3 color, Vec3 direction, bool isStationary)
+    static float LinearToSRGB(float linearValue)
     {
-        pGiBaker->m_aRayTracingLights.push_back(SRayTracingLight{ color ,isStationary ? 1u : 0u,NormalizeVec3(direction) ,ELightType::LT_DIRECTION });
+        linearValue = std::min(std::max(linearValue, 0.0f), 1.0f);
+        return linearValue <= 0.0031308f ? linearValue * 12.92f : 1.055f * std::pow(linearValue, 1.0f / 2.4f) - 0.055f;
     }
 
-    void hwrtl::gi::AddSphereLight(Vec3 color, Vec3 worldPosition, bool isStationary, float attenuation, float radius)
+    static uint32_t PackAlbedo(Vec3 linearColor)
     {
-        pGiBaker->m_aRayTracingLights.push_back(SRayTracingLight{ color ,isStationary ? 1u : 0u,Vec3(0,0,0) ,ELightType::LT_SPHERE,worldPosition ,attenuation ,radius });
+        uint32_t r = uint32_t(LinearToSRGB(linearColor.x) * 255.0f + 0.5f);
+        uint32_t g = uint32_t(LinearToSRGB(linearColor.y) * 255.0f + 0.5f);
+        uint32_t b = uint32_t(LinearToSRGB(linearColor.z) * 255.0f + 0.5f);
+        return r | (g << 8) | (b << 16) | (255u << 24);
     }
 
-	void hwrtl::gi::PrePareLightMapGBufferPass()
-	{
-        PrePareGBufferPassPSO();
-        PackMeshIntoAtlas();
-        GenerateAtlas();
+    // the cache texel averages the source texels it covers in linear space
+    static void AddAlbedoCache(const SBakeMeshDesc& bakeMeshDesc, SGIMesh& giMesh)
+    {
+        giMesh.m_baseColor = bakeMeshDesc.m_baseColor;
+        if (bakeMeshDesc.m_pBaseColorData == nullptr)
+        {
+            return;
+        }
 
-        for (uint32_t index = 0; index < pGiBaker->m_atlas.size(); index++)
+        const Vec2i sourceSize = bakeMeshDesc.m_baseColorSize;
+        const int maxCacheSize = int(std::max(pGiBaker->m_bakeConfig.m_albedoCacheSize, 1u));
+        giMesh.m_albedoCacheSize = Vec2i(std::min(sourceSize.x, maxCacheSize), std::min(sourceSize.y, maxCacheSize));
+
+        auto cacheKey = std::make_tuple((const void*)bakeMeshDesc.m_pBaseColorData, sourceSize.x, sourceSize.y);
+        auto cacheIter = pGiBaker->m_albedoCacheOffsets.find(cacheKey);
+        if (cacheIter != pGiBaker->m_albedoCacheOffsets.end())
         {
-            SAtlas& atlas = pGiBaker->m_atlas[index];
-            for (uint32_t geoIndex = 0; geoIndex < atlas.m_atlasGeometries.size(); geoIndex++)
-            {
-                SGIMesh& giMesh = atlas.m_atlasGeometries[geoIndex];
+            giMesh.m_albedoCacheOffset = cacheIter->second;
+            return;
+        }
 
-                struct SGbufferGenPerGeoCB
-                {
-                    Matrix44 m_worldTM;
-                    Vec4 lightMapScaleAndBias;
-                    float padding[44];
-                }gBufferCbData;
-                static_assert(sizeof(SGbufferGenPerGeoCB) == 256,"sizeof(SGbufferGenPerGeoCB) == 256");
+        giMesh.m_albedoCacheOffset = uint32_t(pGiBaker->m_albedoCacheTexels.size());
+        pGiBaker->m_albedoCacheOffsets[cacheKey] = giMesh.m_albedoCacheOffset;
 
-                gBufferCbData.m_worldTM.SetIdentity();
+        const Vec2i cacheSize = giMesh.m_albedoCacheSize;
+        for (int cacheY = 0; cacheY < cacheSize.y; cacheY++)
+        {
+            const int sourceBeginY = cacheY * sourceSize.y / cacheSize.y;
+            const int sourceEndY = std::max((cacheY + 1) * sourceSize.y / cacheSize.y, sourceBeginY + 1);
+            for (int cacheX = 0; cacheX < cacheSize.x; cacheX++)
+            {
+                const int sourceBeginX = cacheX * sourceSize.x / cacheSize.x;
+                const int sourceEndX = std::max((cacheX + 1) * sourceSize.x / cacheSize.x, sourceBeginX + 1);
 
-                for (uint32_t i = 0; i < 4; i++)
+                Vec3 linearSum(0, 0, 0);
+                for (int sourceY = sourceBeginY; sourceY < sourceEndY; sourceY++)
                 {
-                    for (uint32_t j = 0; j < 3; j++)
+                    for (int sourceX = sourceBeginX; sourceX < sourceEndX; sourceX++)
                     {
-                        gBufferCbData.m_worldTM.m[i][j] = giMesh.m_meshInstanceInfo.m_transform[j][i];
+                        uint32_t sourceTexel = bakeMeshDesc.m_pBaseColorData[sourceY * sourceSize.x + sourceX];
+                        linearSum = linearSum + Vec3(
+                            SRGBToLinear(float(sourceTexel & 0xFF) / 255.0f),
+                            SRGBToLinear(float((sourceTexel >> 8) & 0xFF) / 255.0f),
+                            SRGBToLinear(float((sourceTexel >> 16) & 0xFF) / 255.0f));
                     }
                 }
-
-                for (uint32_t i = 0; i < 44; i++)
-                {
-                    gBufferCbData.padding[i] = 1.0;
-                }
-
-                gBufferCbData.lightMapScaleAndBias = giMesh.m_lightMapScaleAndBias;
-
-                giMesh.m_hConstantBuffer = CGIBaker::GetDeviceCommand()->CreateBuffer(&gBufferCbData, sizeof(SGbufferGenPerGeoCB), sizeof(SGbufferGenPerGeoCB), EBufferUsage::USAGE_CB);
+                const float sourceTexelNum = float((sourceEndX - sourceBeginX) * (sourceEndY - sourceBeginY));
+                pGiBaker->m_albedoCacheTexels.push_back(PackAlbedo(linearSum * (1.0f / sourceTexelNum)));
             }
         }
-	}
+    }
 
-	void hwrtl::gi::ExecuteLightMapGBufferPass()
-	{
-        CGIBaker::GetGraphicsContext()->BeginRenderPasss();
-        CGIBaker::GetGraphicsContext()->SetGraphicsPipelineState(pGiBaker->m_pLightMapGBufferPSO);
-        for (uint32_t index = 0; index < pGiBaker->m_atlas.size(); index++)
-        {
-            SAtlas& atlas = pGiBaker->m_atlas[index];
+    /***************************************************************************
+    * Opacity Micro Map
+    * 
+    * the triangle is split into 4^level micro triangles on a uniform barycentric grid, each micro triangle is
+    * opaque, transparent or unknown, decided by every alpha mask texel inside its uv bounds
+    * per triangle: one uint with the state of the whole triangle followed by 2 bit per micro triangle
+    * the any hit shader only reads the alpha mask for the unknown micro triangles, see AlphaTestAnyHitMain in hwrtl_gi.hlsl
+    ***************************************************************************/
 
-            std::shared_ptr<CTexture2D> posTex = atlas.m_hPosTexture;
-            std::shared_ptr<CTexture2D> normTex = atlas.m_hNormalTexture;
+    // must match OMM_STATE_* in hwrtl_gi.hlsl
+    enum class EOpacityState : uint32_t
+    {
+        OS_TRANSPARENT = 0,
+        OS_OPAQUE = 1,
+        OS_UNKNOWN = 2,
+    };
 
-            std::vector<std::shared_ptr<CTexture2D>> renderTargets;
-            renderTargets.push_back(posTex);
-            renderTargets.push_back(normTex);
+    static uint32_t GetOpacityMicroMapTriangleStride(uint32_t microMapLevel)
+    {
+        const uint32_t microTriangleNum = 1u << (2 * microMapLevel);
+        return 1 + (microTriangleNum * 2 + 31) / 32;
+    }
 
-            CGIBaker::GetGraphicsContext()->SetRenderTargets(renderTargets, nullptr, true, true);
-            CGIBaker::GetGraphicsContext()->SetViewport(pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y);
+    static Vec2 GetBarycentricTextureUV(const Vec2 textureUVs[3], float barycentricU, float barycentricV)
+    {
+        return textureUVs[0] * (1.0f - barycentricU - barycentricV) + textureUVs[1] * barycentricU + textureUVs[2] * barycentricV;
+    }
 
-            for (uint32_t geoIndex = 0; geoIndex < atlas.m_atlasGeometries.size(); geoIndex++)
+    // the texels are wrapped like the frac in the shader lookup, a micro triangle covering the whole mask tests every texel once
+    static EOpacityState GetMicroTriangleOpacityState(const SBakeMeshDesc& bakeMeshDesc, const Vec2 microTriangleUVs[3], uint32_t alphaCutoff)
+    {
+        const Vec2i maskSize = bakeMeshDesc.m_alphaMaskSize;
+        float uvMinX = std::min(microTriangleUVs[0].x, std::min(microTriangleUVs[1].x, microTriangleUVs[2].x));
+        float uvMinY = std::min(microTriangleUVs[0].y, std::min(microTriangleUVs[1].y, microTriangleUVs[2].y));
+        float uvMaxX = std::max(microTriangleUVs[0].x, std::max(microTriangleUVs[1].x, microTriangleUVs[2].x));
+        float uvMaxY = std::max(microTriangleUVs[0].y, std::max(microTriangleUVs[1].y, microTriangleUVs[2].y));
+
+        int texelMinX = int(std::floor(uvMinX * maskSize.x));
+        int texelMinY = int(std::floor(uvMinY * maskSize.y));
+        int texelMaxX = std::min(int(std::floor(uvMaxX * maskSize.x)), texelMinX + maskSize.x - 1);
+        int texelMaxY = std::min(int(std::floor(uvMaxY * maskSize.y)), texelMinY + maskSize.y - 1);
+
+        bool bAnyOpaque = false;
+        bool bAnyTransparent = false;
+        for (int texelY = texelMinY; texelY <= texelMaxY; texelY++)
+        {
+            const int wrappedY = ((texelY % maskSize.y) + maskSize.y) % maskSize.y;
+            for (int texelX = texelMinX; texelX <= texelMaxX; texelX++)
             {
-                SGIMesh& giMesh = atlas.m_atlasGeometries[geoIndex];
-
-                std::vector<std::shared_ptr<CBuffer>> vertexBuffers;
-                vertexBuffers.push_back(giMesh.m_positionVB);
-                vertexBuffers.push_back(giMesh.m_lightMapUVVB);
-
-                CGIBaker::GetGraphicsContext()->SetConstantBuffer(giMesh.m_hConstantBuffer, 0);
-                CGIBaker::GetGraphicsContext()->SetVertexBuffers(vertexBuffers);
+                const int wrappedX = ((texelX % maskSize.x) + maskSize.x) % maskSize.x;
+                if (bakeMeshDesc.m_pAlphaMaskData[wrappedY * maskSize.x + wrappedX] >= alphaCutoff)
+                {
+                    bAnyOpaque = true;
+                }
+                else
+                {
+                    bAnyTransparent = true;
+                }
 
-                CGIBaker::GetGraphicsContext()->DrawInstanced(giMesh.m_nVertexCount, 1, 0, 0);
+                if (bAnyOpaque && bAnyTransparent)
+                {
+                    return EOpacityState::OS_UNKNOWN;
+                }
             }
         }
-        CGIBaker::GetGraphicsContext()->EndRenderPasss();
-	}
+        return bAnyOpaque ? EOpacityState::OS_OPAQUE : EOpacityState::OS_TRANSPARENT;
+    }
 
-    void hwrtl::gi::PrePareLightMapRayTracingPass()
+    static void AddOpacityMicroMap(const SBakeMeshDesc& bakeMeshDesc, SGIMesh& giMesh)
     {
-        CGIBaker::GetDeviceCommand()->OpenCmdList();
+        if (bakeMeshDesc.m_pAlphaMaskData == nullptr)
+        {
+            return;
+        }
 
-        std::vector<std::shared_ptr<SGpuBlasData>> inoutGpuBlasDataArray;
+        const uint32_t microMapLevel = pGiBaker->m_bakeConfig.m_opacityMicroMapLevel;
+        assert((microMapLevel <= 6) && "opacity micro map level above 6 is not supported");
+        const uint32_t alphaCutoff = uint32_t(std::min(std::max(bakeMeshDesc.m_alphaCutoff, 0.0f), 1.0f) * 255.0f + 0.5f);
+        std::vector<uint32_t>& alphaTestData = pGiBaker->m_alphaTestData;
 
-        for (uint32_t index = 0; index < pGiBaker->m_giMeshes.size(); index++)
+        // alpha mask, 4 texels per uint
+        const Vec2i maskSize = bakeMeshDesc.m_alphaMaskSize;
+        auto maskKey = std::make_tuple((const void*)bakeMeshDesc.m_pAlphaMaskData, maskSize.x, maskSize.y);
+        auto maskIter = pGiBaker->m_alphaMaskOffsets.find(maskKey);
+        if (maskIter == pGiBaker->m_alphaMaskOffsets.end())
         {
-            auto& giMesh = pGiBaker->m_giMeshes[index];
-            inoutGpuBlasDataArray.push_back(giMesh.m_pGpuMeshData);
+            const uint32_t maskTexelNum = uint32_t(maskSize.x * maskSize.y);
+            maskIter = pGiBaker->m_alphaMaskOffsets.emplace(maskKey, uint32_t(alphaTestData.size())).first;
+            alphaTestData.resize(alphaTestData.size() + (maskTexelNum + 3) / 4, 0);
+            for (uint32_t texelIndex = 0; texelIndex < maskTexelNum; texelIndex++)
+            {
+                alphaTestData[maskIter->second + texelIndex / 4] |= uint32_t(bakeMeshDesc.m_pAlphaMaskData[texelIndex]) << ((texelIndex % 4) * 8);
+            }
         }
 
-        CGIBaker::GetDeviceCommand()->BuildBottomLevelAccelerationStructure(inoutGpuBlasDataArray);
+        auto microMapKey = std::make_tuple((const void*)bakeMeshDesc.m_pTextureUVData, (const void*)bakeMeshDesc.m_pAlphaMaskData, maskSize.x, maskSize.y, alphaCutoff);
+        auto microMapIter = pGiBaker->m_opacityMicroMapOffsets.find(microMapKey);
+        if (microMapIter == pGiBaker->m_opacityMicroMapOffsets.end())
         {
-            for (uint32_t indexMesh = 0; indexMesh < inoutGpuBlasDataArray.size(); indexMesh++)
+            microMapIter = pGiBaker->m_opacityMicroMapOffsets.emplace(microMapKey, uint32_t(alphaTestData.size())).first;
+
+            const uint32_t segmentNum = 1u << microMapLevel;
+            const uint32_t triangleStride = GetOpacityMicroMapTriangleStride(microMapLevel);
+            const uint32_t triangleNum = bakeMeshDesc.m_nVertexCount / 3;
+            const float segmentSize = 1.0f / float(segmentNum);
+            for (uint32_t triangleIndex = 0; triangleIndex < triangleNum; triangleIndex++)
             {
-                for (uint32_t indexInstance = 0; indexInstance < inoutGpuBlasDataArray[indexMesh]->instanes.size(); indexInstance++)
+                const Vec2* triangleUVs = bakeMeshDesc.m_pTextureUVData + triangleIndex * 3;
+                const uint32_t triangleEntry = uint32_t(alphaTestData.size());
+                alphaTestData.resize(alphaTestData.size() + triangleStride, 0);
+
+                // micro triangle index: row v, 2 * (segmentNum - v) - 1 micro triangles per row, upright and inverted ones alternate
+                bool bAllOpaque = true;
+                bool bAllTransparent = true;
+                uint32_t microTriangleIndex = 0;
+                for (uint32_t v = 0; v < segmentNum; v++)
                 {
-                    auto& gpuMeshDataIns = inoutGpuBlasDataArray[indexMesh];
-                    SMeshInstanceInfo& meshInstanceInfo = gpuMeshDataIns->instanes[indexInstance];
-                    meshInstanceInfo.m_instanceID = pGiBaker->m_sceneInstanceData.size();
-
-                    SMeshInstanceGpuData meshInstanceGpuData;
+                    for (uint32_t u = 0; u < segmentNum - v; u++)
                     {
-                        meshInstanceGpuData.m_worldTM.SetIdentity();
-                        for (uint32_t i = 0; i < 4; i++)
+                        for (uint32_t inverted = 0; inverted < ((u + v + 1 < segmentNum) ? 2u : 1u); inverted++)
                         {
-                            for (uint32_t j = 0; j < 3; j++)
+                            const float u0 = float(u) * segmentSize;
+                            const float v0 = float(v) * segmentSize;
+                            Vec2 microTriangleUVs[3];
+                            if (inverted == 0)
                             {
-                                meshInstanceGpuData.m_worldTM.m[i][j] = gpuMeshDataIns->instanes[indexInstance].m_transform[j][i];
+                                microTriangleUVs[0] = GetBarycentricTextureUV(triangleUVs, u0, v0);
+                                microTriangleUVs[1] = GetBarycentricTextureUV(triangleUVs, u0 + segmentSize, v0);
+                                microTriangleUVs[2] = GetBarycentricTextureUV(triangleUVs, u0, v0 + segmentSize);
                             }
+                            else
+                            {
+                                microTriangleUVs[0] = GetBarycentricTextureUV(triangleUVs, u0 + segmentSize, v0);
+                                microTriangleUVs[1] = GetBarycentricTextureUV(triangleUVs, u0 + segmentSize, v0 + segmentSize);
+                                microTriangleUVs[2] = GetBarycentricTextureUV(triangleUVs, u0, v0 + segmentSize);
+                            }
+
+                            EOpacityState opacityState = GetMicroTriangleOpacityState(bakeMeshDesc, microTriangleUVs, alphaCutoff);
+                            bAllOpaque = bAllOpaque && (opacityState == EOpacityState::OS_OPAQUE);
+                            bAllTransparent = bAllTransparent && (opacityState == EOpacityState::OS_TRANSPARENT);
+                            alphaTestData[triangleEntry + 1 + microTriangleIndex / 16] |= uint32_t(opacityState) << ((microTriangleIndex % 16) * 2);
+                            microTriangleIndex++;
                         }
-                        meshInstanceGpuData.m_ibStride = gpuMeshDataIns->m_nIndexStride;
-                        if (gpuMeshDataIns->m_nIndexStride > 0)
-                        {
-                            meshInstanceGpuData.m_ibIndex = gpuMeshDataIns->m_pIndexBuffer->GetOrAddByteAddressBindlessIndex();
-                        }
-                        else
-                        {
-                            meshInstanceGpuData.m_ibIndex = 0;
-                        }
-                        meshInstanceGpuData.m_vbIndex = gpuMeshDataIns->m_pVertexBuffer->GetOrAddByteAddressBindlessIndex();
                     }
-                    pGiBaker->m_sceneInstanceData.push_back(meshInstanceGpuData);
                 }
+                assert(microTriangleIndex == segmentNum * segmentNum);
+
+                EOpacityState triangleState = bAllOpaque ? EOpacityState::OS_OPAQUE : (bAllTransparent ? EOpacityState::OS_TRANSPARENT : EOpacityState::OS_UNKNOWN);
+                alphaTestData[triangleEntry] = uint32_t(triangleState);
             }
-            pGiBaker->m_instanceGpuData = CGIBaker::GetDeviceCommand()->CreateBuffer(
-                pGiBaker->m_sceneInstanceData.data(), sizeof(SMeshInstanceGpuData) * pGiBaker->m_sceneInstanceData.size(), 
-                sizeof(SMeshInstanceGpuData), EBufferUsage::USAGE_Structure);
         }
-        pGiBaker->m_pTLAS = CGIBaker::GetDeviceCommand()->BuildTopAccelerationStructure(inoutGpuBlasDataArray);
 
+        giMesh.m_alphaInfo[0] = microMapIter->second;
+        giMesh.m_alphaInfo[1] = maskIter->second;
+        giMesh.m_alphaInfo[2] = uint32_t(bakeMeshDesc.m_alphaMaskSize.x) | (uint32_t(bakeMeshDesc.m_alphaMaskSize.y) << 16);
+        giMesh.m_alphaInfo[3] = microMapLevel | (alphaCutoff << 8);
+    }
 
-        pGiBaker->pRtSceneLight = CGIBaker::GetDeviceCommand()->CreateBuffer(pGiBaker->m_aRayTracingLights.data(), sizeof(SRayTracingLight) * pGiBaker->m_aRayTracingLights.size(), sizeof(SRayTracingLight), EBufferUsage::USAGE_Structure);
+    static std::shared_ptr<CBuffer> GetOrCreateSharedVertexBuffer(const void* pVertexData, uint32_t vertexCount, uint32_t vertexStride)
+    {
+        auto iter = pGiBaker->m_sharedVertexBuffers.find(pVertexData);
+        if (iter != pGiBaker->m_sharedVertexBuffers.end())
+        {
+            return iter->second;
+        }
 
-        SRtGlobalConstantBuffer rtGloablCB;
-        rtGloablCB.m_nRtSceneLightCount = pGiBaker->m_aRayTracingLights.size();
+        std::shared_ptr<CBuffer> vertexBuffer = CGIBaker::GetDeviceCommand()->CreateBuffer(pVertexData, vertexCount * vertexStride, vertexStride, EBufferUsage::USAGE_VB | EBufferUsage::USAGE_BYTE_ADDRESS);
+        pGiBaker->m_sharedVertexBuffers[pVertexData] = vertexBuffer;
+        return vertexBuffer;
+    }
+
+    void hwrtl::gi::AddBakeMeshsAndCreateVB(const std::vector<SBakeMeshDesc>& bakeMeshDescs)
+    {
+        for (uint32_t index = 0; index < bakeMeshDescs.size(); index++)
+        {
+            const SBakeMeshDesc& bakeMeshDesc = bakeMeshDescs[index];
+            SGIMesh giMesh;
+
+            ValidateMeshDesc(bakeMeshDesc);
+
+            giMesh.m_positionVB = GetOrCreateSharedVertexBuffer(bakeMeshDesc.m_pPositionData, bakeMeshDesc.m_nVertexCount, sizeof(Vec3));
+            giMesh.m_lightMapUVVB = GetOrCreateSharedVertexBuffer(bakeMeshDesc.m_pLightMapUVData, bakeMeshDesc.m_nVertexCount, sizeof(Vec2));
+
+            //if (bakeMeshDesc.m_pIndexData)
+            //{
+            //    giMesh.m_indexBuffer = CGIBaker::GetDeviceCommand()->CreateBuffer(bakeMeshDesc.m_pIndexData, bakeMeshDesc.m_nIndexCount * sizeof(Vec3i), sizeof(Vec3i), EBufferUsage::USAGE_IB | EBufferUsage::USAGE_BYTE_ADDRESS);
+            //}
+
+            if (bakeMeshDesc.m_pNormalData)
+            {
+                giMesh.m_normalVB = GetOrCreateSharedVertexBuffer(bakeMeshDesc.m_pNormalData, bakeMeshDesc.m_nVertexCount, sizeof(Vec3));
+            }
+
+            if (bakeMeshDesc.m_pBaseColorData || bakeMeshDesc.m_pAlphaMaskData)
+            {
+                giMesh.m_textureUVVB = GetOrCreateSharedVertexBuffer(bakeMeshDesc.m_pTextureUVData, bakeMeshDesc.m_nVertexCount, sizeof(Vec2));
+            }
+            AddAlbedoCache(bakeMeshDesc, giMesh);
+            AddOpacityMicroMap(bakeMeshDesc, giMesh);
+           
+            giMesh.m_pPositionData = bakeMeshDesc.m_pPositionData;
+            giMesh.m_pTextureUVData = bakeMeshDesc.m_pTextureUVData;
+            giMesh.m_nVertexCount = bakeMeshDesc.m_nVertexCount;
+            giMesh.m_nLightMapSize = bakeMeshDesc.m_nLightMapSize;
+            if (IsPreviewBakeEnabled())
+            {
+                // the light map uvs are normalized, only the texel density of the mesh changes
+                Vec2 previewLightMapSize = Vec2(bakeMeshDesc.m_nLightMapSize) * pGiBaker->m_bakeConfig.m_previewLightMapScale;
+                giMesh.m_nLightMapSize = Vec2i(std::max(int(previewLightMapSize.x), 1), std::max(int(previewLightMapSize.y), 1));
+            }
+            giMesh.m_meshInstanceInfo = bakeMeshDesc.m_meshInstanceInfo;
+
+            auto blasIter = pGiBaker->m_sharedGpuBlasData.find(bakeMeshDesc.m_pPositionData);
+            if (blasIter != pGiBaker->m_sharedGpuBlasData.end())
+            {
+                giMesh.m_pGpuMeshData = blasIter->second;
+                assert((giMesh.m_pGpuMeshData->m_nVertexCount == giMesh.m_nVertexCount) && "instances of the same geometry must have the same vertex count");
+            }
+            else
+            {
+                giMesh.m_pGpuMeshData = std::make_shared<SGpuBlasData>();
+                giMesh.m_pGpuMeshData->m_nVertexCount = giMesh.m_nVertexCount;
+                giMesh.m_pGpuMeshData->m_pVertexBuffer = giMesh.m_positionVB;
+                pGiBaker->m_sharedGpuBlasData[bakeMeshDesc.m_pPositionData] = giMesh.m_pGpuMeshData;
+                pGiBaker->m_uniqueGpuBlasData.push_back(giMesh.m_pGpuMeshData);
+            }
+
+            // opaque instances of an alpha tested geometry return early in the any hit shader
+            if (bakeMeshDesc.m_pAlphaMaskData != nullptr)
+            {
+                giMesh.m_pGpuMeshData->m_bOpaque = false;
+            }
+
+            assert(bakeMeshDesc.m_meshIndex >= 0);
+            giMesh.m_meshIndex = bakeMeshDesc.m_meshIndex;
+
+            // the instance id is the gi mesh index until BuildRayTracingScene assigns the scene instance index
+            SMeshInstanceInfo blasInstanceInfo = giMesh.m_meshInstanceInfo;
+            blasInstanceInfo.m_instanceID = uint32_t(pGiBaker->m_giMeshes.size());
+            giMesh.m_pGpuMeshData->instanes.push_back(blasInstanceInfo);
+            pGiBaker->m_giMeshes.push_back(giMesh);
+        }
+    }
+
+    void hwrtl::gi::AddDirectionalLight(Vec3 color, Vec3 direction, bool isStationary)
+    {
+        pGiBaker->m_aRayTracingLights.push_back(SRayTracingLight{ color ,isStationary ? 1u : 0u,NormalizeVec3(direction) ,ELightType::LT_DIRECTION });
+    }
+
+    void hwrtl::gi::AddSphereLight(Vec3 color, Vec3 worldPosition, bool isStationary, float attenuation, float radius)
+    {
+        pGiBaker->m_aRayTracingLights.push_back(SRayTracingLight{ color ,isStationary ? 1u : 0u,Vec3(0,0,0) ,ELightType::LT_SPHERE,worldPosition ,attenuation ,radius });
+    }
+
+    /***************************************************************************
+    * Mesh Light
+    * 
+    * the triangles of an emissive bake mesh are transformed to world space and sampled by area
+    * the emitted radiance is uniform over the mesh, so the power cdf of the triangles is the area cdf
+    * the light entry stores the bounds for the light picking estimate, the total area and the triangle range
+    ***************************************************************************/
+
+    uint32_t hwrtl::gi::AddMeshLight(int meshIndex, Vec3 emittedRadiance, bool isStationary)
+    {
+        auto meshIter = std::find_if(pGiBaker->m_giMeshes.begin(), pGiBaker->m_giMeshes.end(), [meshIndex](const SGIMesh& giMesh) { return giMesh.m_meshIndex == meshIndex; });
+        assert((meshIter != pGiBaker->m_giMeshes.end()) && "add the bake mesh before the mesh light");
+        assert((meshIter->m_meshLightIndex < 0) && "the bake mesh is already a mesh light");
+        assert((pGiBaker->m_pTLAS == nullptr) && "mesh lights must be added before the ray tracing scene is built");
+
+        SGIMesh& giMesh = *meshIter;
+        const float (*transform)[4] = giMesh.m_meshInstanceInfo.m_transform;
+        assert(giMesh.m_pPositionData != nullptr);
+
+        const uint32_t firstTriangle = uint32_t(pGiBaker->m_meshLightTriangles.size());
+        float totalArea = 0.0f;
+        Vec3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+        Vec3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (uint32_t triangleIndex = 0; triangleIndex < giMesh.m_nVertexCount / 3; triangleIndex++)
+        {
+            Vec3 worldPositions[3];
+            for (uint32_t vertexIndex = 0; vertexIndex < 3; vertexIndex++)
+            {
+                const Vec3& localPosition = giMesh.m_pPositionData[triangleIndex * 3 + vertexIndex];
+                worldPositions[vertexIndex] = Vec3(
+                    transform[0][0] * localPosition.x + transform[0][1] * localPosition.y + transform[0][2] * localPosition.z + transform[0][3],
+                    transform[1][0] * localPosition.x + transform[1][1] * localPosition.y + transform[1][2] * localPosition.z + transform[1][3],
+                    transform[2][0] * localPosition.x + transform[2][1] * localPosition.y + transform[2][2] * localPosition.z + transform[2][3]);
+                boundsMin = Vec3(std::min(boundsMin.x, worldPositions[vertexIndex].x), std::min(boundsMin.y, worldPositions[vertexIndex].y), std::min(boundsMin.z, worldPositions[vertexIndex].z));
+                boundsMax = Vec3(std::max(boundsMax.x, worldPositions[vertexIndex].x), std::max(boundsMax.y, worldPositions[vertexIndex].y), std::max(boundsMax.z, worldPositions[vertexIndex].z));
+            }
+
+            Vec3 unnormalizedNormal = CrossVec3(worldPositions[2] - worldPositions[0], worldPositions[1] - worldPositions[0]);
+            float triangleArea = 0.5f * std::sqrt(unnormalizedNormal.x * unnormalizedNormal.x + unnormalizedNormal.y * unnormalizedNormal.y + unnormalizedNormal.z * unnormalizedNormal.z);
+
+            // degenerated triangles keep a zero width cdf interval and are never picked
+            totalArea += triangleArea;
+            pGiBaker->m_meshLightTriangles.push_back(SMeshLightTriangle{ worldPositions[0], totalArea, worldPositions[1], triangleArea, worldPositions[2], 0.0f });
+        }
+
+        const uint32_t triangleNum = uint32_t(pGiBaker->m_meshLightTriangles.size()) - firstTriangle;
+        assert((triangleNum > 0 && totalArea > 0.0f) && "mesh lights need at least one non degenerated triangle");
+        for (uint32_t triangleIndex = firstTriangle; triangleIndex < firstTriangle + triangleNum; triangleIndex++)
+        {
+            pGiBaker->m_meshLightTriangles[triangleIndex].m_cdf /= totalArea;
+        }
+        pGiBaker->m_meshLightTriangles.back().m_cdf = 1.0f;
+
+        Vec3 boundsExtent = (boundsMax - boundsMin) * 0.5f;
+        SRayTracingLight meshLight = {};
+        meshLight.m_color = emittedRadiance;
+        meshLight.m_isStationary = isStationary ? 1u : 0u;
+        meshLight.m_eLightType = ELightType::LT_MESH;
+        meshLight.m_worldPosition = (boundsMin + boundsMax) * 0.5f;
+        meshLight.m_radius = std::sqrt(boundsExtent.x * boundsExtent.x + boundsExtent.y * boundsExtent.y + boundsExtent.z * boundsExtent.z);
+        meshLight.m_meshLightArea = totalArea;
+        meshLight.m_triangleOffset = firstTriangle;
+        meshLight.m_triangleCount = triangleNum;
+
+        giMesh.m_meshLightIndex = int(pGiBaker->m_aRayTracingLights.size());
+        pGiBaker->m_aRayTracingLights.push_back(meshLight);
+        return uint32_t(giMesh.m_meshLightIndex);
+    }
+
+    bool hwrtl::gi::SampleMeshLight(uint32_t lightIndex, float randomX, float randomY, SMeshLightSample& outSample)
+    {
+        if (lightIndex >= pGiBaker->m_aRayTracingLights.size() || pGiBaker->m_aRayTracingLights[lightIndex].m_eLightType != ELightType::LT_MESH)
+        {
+            return false;
+        }
+
+        const SRayTracingLight& meshLight = pGiBaker->m_aRayTracingLights[lightIndex];
+        const uint32_t firstTriangle = meshLight.m_triangleOffset;
+        const uint32_t triangleNum = meshLight.m_triangleCount;
+
+        // same search as the binary search in SampleMeshLight in hwrtl_gi.hlsl
+        auto triangleBegin = pGiBaker->m_meshLightTriangles.begin() + firstTriangle;
+        auto triangleIter = std::upper_bound(triangleBegin, triangleBegin + triangleNum, randomX, [](float value, const SMeshLightTriangle& lightTriangle) { return value < lightTriangle.m_cdf; });
+        const uint32_t triangleIndex = std::min(uint32_t(triangleIter - triangleBegin), triangleNum - 1);
+        const SMeshLightTriangle& lightTriangle = triangleBegin[triangleIndex];
+
+        float preCdf = triangleIndex > 0 ? triangleBegin[triangleIndex - 1].m_cdf : 0.0f;
+        float barycentricRandom = std::min(std::max((randomX - preCdf) / std::max(lightTriangle.m_cdf - preCdf, 1e-7f), 0.0f), 1.0f);
+
+        float sqrtRandom = std::sqrt(barycentricRandom);
+        float barycentric0 = 1.0f - sqrtRandom;
+        float barycentric1 = randomY * sqrtRandom;
+        outSample.m_position = lightTriangle.m_vertex0 * barycentric0 + lightTriangle.m_vertex1 * barycentric1 + lightTriangle.m_vertex2 * (1.0f - barycentric0 - barycentric1);
+        outSample.m_normal = NormalizeVec3(CrossVec3(lightTriangle.m_vertex2 - lightTriangle.m_vertex0, lightTriangle.m_vertex1 - lightTriangle.m_vertex0));
+        outSample.m_triangleIndex = triangleIndex;
+        outSample.m_areaPdf = 1.0f / meshLight.m_meshLightArea;
+        return true;
+    }
+
+    /***************************************************************************
+    * Environment Light
+    * 
+    * the texels are sampled by a piecewise constant 2d distribution over luminance * sin theta
+    * marginal cdf of the rows and conditional cdf inside every row, see SampleEnvironmentLight in hwrtl_gi.hlsl
+    * the L2 sh projection of the radiance is used for the paths cut at the last bounce
+    ***************************************************************************/
+
+    // see GetEnvironmentDirection in hwrtl_gi.hlsl
+    static Vec3 GetEnvironmentDirection(float u, float v)
+    {
+        const float pi = 3.14159265358979f;
+        float phi = u * 2.0f * pi;
+        float theta = v * pi;
+        return Vec3(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+    }
+
+    // see SHBasisFunctionL2 in hwrtl_gi.hlsl
+    static void GetSHBasisL2(Vec3 direction, float outSHBasis[HWRTL_SH_L2_COEFFICIENT_NUM])
+    {
+        outSHBasis[0] = 0.282095f;
+        outSHBasis[1] = 0.488603f * direction.y;
+        outSHBasis[2] = 0.488603f * direction.z;
+        outSHBasis[3] = 0.488603f * direction.x;
+        outSHBasis[4] = 1.092548f * direction.x * direction.y;
+        outSHBasis[5] = 1.092548f * direction.y * direction.z;
+        outSHBasis[6] = 0.315392f * (3.0f * direction.z * direction.z - 1.0f);
+        outSHBasis[7] = 1.092548f * direction.x * direction.z;
+        outSHBasis[8] = 0.546274f * (direction.x * direction.x - direction.y * direction.y);
+    }
+
+    // normalizes the cdf in [begin, end), a zero distribution becomes uniform
+    static void NormalizeEnvironmentCdf(std::vector<Vec4>::iterator begin, std::vector<Vec4>::iterator end, float cdfSum)
+    {
+        const uint32_t entryNum = uint32_t(end - begin);
+        for (uint32_t entryIndex = 0; entryIndex < entryNum; entryIndex++)
+        {
+            begin[entryIndex].w = cdfSum > 0.0f ? begin[entryIndex].w / cdfSum : float(entryIndex + 1) / float(entryNum);
+        }
+        begin[entryNum - 1].w = 1.0f;
+    }
+
+    uint32_t hwrtl::gi::SetEnvironmentLight(const Vec3* pRadianceData, Vec2i environmentSize, float intensity, bool isStationary)
+    {
+        assert(pRadianceData != nullptr && environmentSize.x > 0 && environmentSize.y > 0);
+        assert((pGiBaker->m_environmentLightIndex < 0) && "only one environment light per bake");
+        assert((pGiBaker->m_pTLAS == nullptr) && "the environment light must be set before the ray tracing scene is built");
+
+        const float pi = 3.14159265358979f;
+        const uint32_t width = environmentSize.x;
+        const uint32_t height = environmentSize.y;
+
+        std::vector<Vec4>& environmentData = pGiBaker->m_environmentLightData;
+        environmentData.assign(height + width * height, Vec4(0, 0, 0, 0));
+
+        Vec3 radianceIntegral(0, 0, 0);
+        for (uint32_t shIndex = 0; shIndex < HWRTL_SH_L2_COEFFICIENT_NUM; shIndex++)
+        {
+            pGiBaker->m_environmentSH[shIndex] = Vec4(0, 0, 0, 0);
+        }
+
+        float marginalSum = 0.0f;
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const float sinTheta = std::sin(pi * (float(y) + 0.5f) / float(height));
+            const float texelSolidAngle = (2.0f * pi / float(width)) * (pi / float(height)) * sinTheta;
+
+            float conditionalSum = 0.0f;
+            for (uint32_t x = 0; x < width; x++)
+            {
+                Vec3 radiance = pRadianceData[y * width + x] * intensity;
+
+                // same weights as Luminance in hwrtl_gi.hlsl
+                conditionalSum += std::max(radiance.x * 0.3f + radiance.y * 0.59f + radiance.z * 0.11f, 0.0f) * sinTheta;
+                environmentData[height + y * width + x] = Vec4(radiance.x, radiance.y, radiance.z, conditionalSum);
+
+                float shBasis[HWRTL_SH_L2_COEFFICIENT_NUM];
+                GetSHBasisL2(GetEnvironmentDirection((float(x) + 0.5f) / float(width), (float(y) + 0.5f) / float(height)), shBasis);
+                for (uint32_t shIndex = 0; shIndex < HWRTL_SH_L2_COEFFICIENT_NUM; shIndex++)
+                {
+                    Vec3 shWeightedRadiance = radiance * (shBasis[shIndex] * texelSolidAngle);
+                    pGiBaker->m_environmentSH[shIndex] = pGiBaker->m_environmentSH[shIndex] + Vec4(shWeightedRadiance.x, shWeightedRadiance.y, shWeightedRadiance.z, 0.0f);
+                }
+                radianceIntegral = radianceIntegral + radiance * texelSolidAngle;
+            }
+
+            auto rowBegin = environmentData.begin() + height + y * width;
+            NormalizeEnvironmentCdf(rowBegin, rowBegin + width, conditionalSum);
+
+            marginalSum += conditionalSum;
+            environmentData[y].w = marginalSum;
+        }
+        NormalizeEnvironmentCdf(environmentData.begin(), environmentData.begin() + height, marginalSum);
+
+        SRayTracingLight environmentLight = {};
+        environmentLight.m_color = radianceIntegral * (1.0f / (4.0f * pi)); // average radiance
+        environmentLight.m_isStationary = isStationary ? 1u : 0u;
+        environmentLight.m_eLightType = ELightType::LT_ENVIRONMENT;
+
+        pGiBaker->m_environmentLightSize = environmentSize;
+        pGiBaker->m_environmentLightIndex = int(pGiBaker->m_aRayTracingLights.size());
+        pGiBaker->m_aRayTracingLights.push_back(environmentLight);
+        return uint32_t(pGiBaker->m_environmentLightIndex);
+    }
+
+    static void SetEnvironmentLightConstants(SRtGlobalConstantBuffer& rtGloablCB)
+    {
+        rtGloablCB.m_environmentLightIndex = uint32_t(pGiBaker->m_environmentLightIndex + 1);
+        rtGloablCB.m_environmentLightSize = pGiBaker->m_environmentLightSize;
+        if (pGiBaker->m_environmentLightIndex >= 0)
+        {
+            for (uint32_t shIndex = 0; shIndex < HWRTL_SH_L2_COEFFICIENT_NUM; shIndex++)
+            {
+                rtGloablCB.m_environmentSH[shIndex] = pGiBaker->m_environmentSH[shIndex];
+            }
+        }
+    }
+
+    static void GetMeshInstanceWorldBounds(const SGIMesh& giMesh, Vec3& outBoundsMin, Vec3& outBoundsMax)
+    {
+        const float (*transform)[4] = giMesh.m_meshInstanceInfo.m_transform;
+        assert(giMesh.m_pPositionData != nullptr);
+
+        outBoundsMin = Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+        outBoundsMax = Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (uint32_t vertexIndex = 0; vertexIndex < giMesh.m_nVertexCount; vertexIndex++)
+        {
+            const Vec3& localPosition = giMesh.m_pPositionData[vertexIndex];
+            Vec3 worldPosition(
+                transform[0][0] * localPosition.x + transform[0][1] * localPosition.y + transform[0][2] * localPosition.z + transform[0][3],
+                transform[1][0] * localPosition.x + transform[1][1] * localPosition.y + transform[1][2] * localPosition.z + transform[1][3],
+                transform[2][0] * localPosition.x + transform[2][1] * localPosition.y + transform[2][2] * localPosition.z + transform[2][3]);
+            outBoundsMin = Vec3(std::min(outBoundsMin.x, worldPosition.x), std::min(outBoundsMin.y, worldPosition.y), std::min(outBoundsMin.z, worldPosition.z));
+            outBoundsMax = Vec3(std::max(outBoundsMax.x, worldPosition.x), std::max(outBoundsMax.y, worldPosition.y), std::max(outBoundsMax.z, worldPosition.z));
+        }
+    }
+
+    static uint32_t PackSnorm2x16(float x, float y)
+    {
+        int32_t quantizedX = int32_t(std::round(std::min(std::max(x, -1.0f), 1.0f) * 32767.0f));
+        int32_t quantizedY = int32_t(std::round(std::min(std::max(y, -1.0f), 1.0f) * 32767.0f));
+        return (uint32_t(quantizedX) & 0xFFFFu) | (uint32_t(quantizedY) << 16);
+    }
+
+    static uint32_t QuantizeUnorm16(float value, float boundsMin, float boundsSize)
+    {
+        float normalized = (value - boundsMin) / std::max(boundsSize, 1e-6f);
+        return uint32_t(std::round(std::min(std::max(normalized, 0.0f), 1.0f) * 65535.0f));
+    }
+
+    SCompactGBufferTexel hwrtl::gi::EncodeCompactGBufferTexel(Vec3 worldPosition, Vec3 worldFaceNormal, Vec3 boundsMin, Vec3 boundsSize, uint32_t instanceIndex)
+    {
+        float normalLength = std::abs(worldFaceNormal.x) + std::abs(worldFaceNormal.y) + std::abs(worldFaceNormal.z);
+        Vec3 octDirection = worldFaceNormal * (1.0f / normalLength);
+        Vec2 octCoord(octDirection.x, octDirection.y);
+        if (octDirection.z < 0.0f)
+        {
+            octCoord = Vec2((1.0f - std::abs(octDirection.y)) * (octDirection.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::abs(octDirection.x)) * (octDirection.y >= 0.0f ? 1.0f : -1.0f));
+        }
+
+        SCompactGBufferTexel texel;
+        texel.m_packedPositionXY = QuantizeUnorm16(worldPosition.x, boundsMin.x, boundsSize.x) | (QuantizeUnorm16(worldPosition.y, boundsMin.y, boundsSize.y) << 16);
+        texel.m_packedPositionZ = QuantizeUnorm16(worldPosition.z, boundsMin.z, boundsSize.z);
+        texel.m_packedNormal = PackSnorm2x16(octCoord.x, octCoord.y);
+        texel.m_instanceIndexPlusOne = instanceIndex + 1;
+        return texel;
+    }
+
+    void hwrtl::gi::DecodeCompactGBufferTexel(const SCompactGBufferTexel& texel, Vec3 boundsMin, Vec3 boundsSize, Vec3& outWorldPosition, Vec3& outWorldFaceNormal)
+    {
+        const float invUnorm16 = 1.0f / 65535.0f;
+        outWorldPosition = Vec3(
+            boundsMin.x + float(texel.m_packedPositionXY & 0xFFFFu) * invUnorm16 * boundsSize.x,
+            boundsMin.y + float(texel.m_packedPositionXY >> 16) * invUnorm16 * boundsSize.y,
+            boundsMin.z + float(texel.m_packedPositionZ & 0xFFFFu) * invUnorm16 * boundsSize.z);
+
+        float octX = std::max(float(int16_t(texel.m_packedNormal & 0xFFFFu)) / 32767.0f, -1.0f);
+        float octY = std::max(float(int16_t(texel.m_packedNormal >> 16)) / 32767.0f, -1.0f);
+        Vec3 direction(octX, octY, 1.0f - std::abs(octX) - std::abs(octY));
+        if (direction.z < 0.0f)
+        {
+            direction = Vec3((1.0f - std::abs(octY)) * (octX >= 0.0f ? 1.0f : -1.0f), (1.0f - std::abs(octX)) * (octY >= 0.0f ? 1.0f : -1.0f), direction.z);
+        }
+        outWorldFaceNormal = NormalizeVec3(direction);
+    }
+
+	void hwrtl::gi::PrePareLightMapGBufferPass()
+	{
+        HWRTL_PROFILE_FUNCTION();
+
+        PrePareGBufferPassPSO();
+        PackMeshIntoAtlas();
+        GenerateAtlas();
+
+        std::vector<SGBufferInstanceGpuData> gbufferInstanceData;
+        for (uint32_t index = 0; index < pGiBaker->m_atlas.size(); index++)
+        {
+            SAtlas& atlas = pGiBaker->m_atlas[index];
+            for (uint32_t geoIndex = 0; geoIndex < atlas.m_atlasGeometries.size(); geoIndex++)
+            {
+                SGIMesh& giMesh = atlas.m_atlasGeometries[geoIndex];
+
+                struct SGbufferGenPerGeoCB
+                {
+                    Matrix44 m_worldTM;
+                    Vec4 lightMapScaleAndBias;
+                    uint32_t m_texelKeyInfo[4];
+                    Vec4 m_positionBoundsMin;
+                    Vec4 m_positionBoundsSize;
+                    uint32_t m_gbufferInstanceInfo[4];
+                    float padding[28];
+                }gBufferCbData;
+                static_assert(sizeof(SGbufferGenPerGeoCB) == 256,"sizeof(SGbufferGenPerGeoCB) == 256");
+
+                gBufferCbData.m_worldTM.SetIdentity();
+
+                for (uint32_t i = 0; i < 4; i++)
+                {
+                    for (uint32_t j = 0; j < 3; j++)
+                    {
+                        gBufferCbData.m_worldTM.m[i][j] = giMesh.m_meshInstanceInfo.m_transform[j][i];
+                    }
+                }
+
+                for (uint32_t i = 0; i < 28; i++)
+                {
+                    gBufferCbData.padding[i] = 1.0;
+                }
+
+                gBufferCbData.lightMapScaleAndBias = giMesh.m_lightMapScaleAndBias;
+                gBufferCbData.m_texelKeyInfo[0] = giMesh.m_nAtlasOffset.x;
+                gBufferCbData.m_texelKeyInfo[1] = giMesh.m_nAtlasOffset.y;
+                gBufferCbData.m_texelKeyInfo[2] = giMesh.m_nLightMapSize.x;
+                gBufferCbData.m_texelKeyInfo[3] = giMesh.m_meshIndex;
+
+                SGBufferInstanceGpuData instanceData = {};
+                if (IsCompactGBufferEnabled())
+                {
+                    Vec3 boundsMin, boundsMax;
+                    GetMeshInstanceWorldBounds(giMesh, boundsMin, boundsMax);
+                    instanceData.m_positionBoundsMin = Vec4(boundsMin.x, boundsMin.y, boundsMin.z, 0.0f);
+                    instanceData.m_positionBoundsSize = Vec4(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y, boundsMax.z - boundsMin.z, 0.0f);
+                    memcpy(instanceData.m_texelKeyInfo, gBufferCbData.m_texelKeyInfo, sizeof(instanceData.m_texelKeyInfo));
+                }
+
+                gBufferCbData.m_positionBoundsMin = instanceData.m_positionBoundsMin;
+                gBufferCbData.m_positionBoundsSize = instanceData.m_positionBoundsSize;
+                gBufferCbData.m_gbufferInstanceInfo[0] = uint32_t(gbufferInstanceData.size());
+                gBufferCbData.m_gbufferInstanceInfo[1] = gBufferCbData.m_gbufferInstanceInfo[2] = gBufferCbData.m_gbufferInstanceInfo[3] = 0;
+                gbufferInstanceData.push_back(instanceData);
+
+                giMesh.m_hConstantBuffer = CGIBaker::GetDeviceCommand()->CreateBuffer(&gBufferCbData, sizeof(SGbufferGenPerGeoCB), sizeof(SGbufferGenPerGeoCB), EBufferUsage::USAGE_CB);
+            }
+        }
+
+        if (IsCompactGBufferEnabled())
+        {
+            pGiBaker->m_gbufferInstanceGpuData = CGIBaker::GetDeviceCommand()->CreateBuffer(
+                gbufferInstanceData.data(), sizeof(SGBufferInstanceGpuData) * gbufferInstanceData.size(),
+                sizeof(SGBufferInstanceGpuData), EBufferUsage::USAGE_Structure);
+        }
+	}
+
+    static void ExecuteGBufferPassForAtlases(uint32_t beginAtlas, uint32_t endAtlas)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        CGIBaker::GetGraphicsContext()->BeginRenderPasss();
+        CGIBaker::GetGraphicsContext()->SetGraphicsPipelineState(pGiBaker->m_pLightMapGBufferPSO);
+        for (uint32_t index = beginAtlas; index < endAtlas; index++)
+        {
+            SAtlas& atlas = pGiBaker->m_atlas[index];
+
+            std::vector<std::shared_ptr<CTexture2D>> renderTargets;
+            if (IsCompactGBufferEnabled())
+            {
+                renderTargets.push_back(atlas.m_hCompactGBufferTexture);
+            }
+            else
+            {
+                renderTargets.push_back(atlas.m_hPosTexture);
+                renderTargets.push_back(atlas.m_hNormalTexture);
+            }
+
+            CGIBaker::GetGraphicsContext()->SetRenderTargets(renderTargets, nullptr, true, true);
+            CGIBaker::GetGraphicsContext()->SetViewport(pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y);
+
+            for (uint32_t geoIndex = 0; geoIndex < atlas.m_atlasGeometries.size(); geoIndex++)
+            {
+                SGIMesh& giMesh = atlas.m_atlasGeometries[geoIndex];
+
+                std::vector<std::shared_ptr<CBuffer>> vertexBuffers;
+                vertexBuffers.push_back(giMesh.m_positionVB);
+                vertexBuffers.push_back(giMesh.m_lightMapUVVB);
+
+                CGIBaker::GetGraphicsContext()->SetConstantBuffer(giMesh.m_hConstantBuffer, 0);
+                CGIBaker::GetGraphicsContext()->SetVertexBuffers(vertexBuffers);
+
+                CGIBaker::GetGraphicsContext()->DrawInstanced(giMesh.m_nVertexCount, 1, 0, 0);
+            }
+        }
+        CGIBaker::GetGraphicsContext()->EndRenderPasss();
+    }
+
+	void hwrtl::gi::ExecuteLightMapGBufferPass()
+	{
+        HWRTL_PROFILE_FUNCTION();
+        ExecuteGBufferPassForAtlases(0, uint32_t(pGiBaker->m_atlas.size()));
+	}
+
+    // the light map pass and the probe pass share the acceleration structures and the light buffer, whichever pass is prepared first builds them
+    static void BuildRayTracingScene()
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        if (pGiBaker->m_pTLAS != nullptr)
+        {
+            return;
+        }
+
+        std::vector<std::shared_ptr<SGpuBlasData>>& inoutGpuBlasDataArray = pGiBaker->m_uniqueGpuBlasData;
+
+        CGIBaker::GetDeviceCommand()->BuildBottomLevelAccelerationStructure(inoutGpuBlasDataArray);
+        {
+            for (uint32_t indexMesh = 0; indexMesh < inoutGpuBlasDataArray.size(); indexMesh++)
+            {
+                for (uint32_t indexInstance = 0; indexInstance < inoutGpuBlasDataArray[indexMesh]->instanes.size(); indexInstance++)
+                {
+                    auto& gpuMeshDataIns = inoutGpuBlasDataArray[indexMesh];
+                    SMeshInstanceInfo& meshInstanceInfo = gpuMeshDataIns->instanes[indexInstance];
+                    const SGIMesh& giMesh = pGiBaker->m_giMeshes[meshInstanceInfo.m_instanceID];
+                    meshInstanceInfo.m_instanceID = pGiBaker->m_sceneInstanceData.size();
+
+                    SMeshInstanceGpuData meshInstanceGpuData;
+                    {
+                        meshInstanceGpuData.m_worldTM.SetIdentity();
+                        for (uint32_t i = 0; i < 4; i++)
+                        {
+                            for (uint32_t j = 0; j < 3; j++)
+                            {
+                                meshInstanceGpuData.m_worldTM.m[i][j] = gpuMeshDataIns->instanes[indexInstance].m_transform[j][i];
+                            }
+                        }
+                        meshInstanceGpuData.m_ibStride = gpuMeshDataIns->m_nIndexStride;
+                        if (gpuMeshDataIns->m_nIndexStride > 0)
+                        {
+                            meshInstanceGpuData.m_ibIndex = gpuMeshDataIns->m_pIndexBuffer->GetOrAddByteAddressBindlessIndex();
+                        }
+                        else
+                        {
+                            meshInstanceGpuData.m_ibIndex = 0;
+                        }
+                        meshInstanceGpuData.m_vbIndex = gpuMeshDataIns->m_pVertexBuffer->GetOrAddByteAddressBindlessIndex();
+                        meshInstanceGpuData.m_meshLightIndexPlusOne = uint32_t(giMesh.m_meshLightIndex + 1);
+
+                        meshInstanceGpuData.m_albedoInfo[0] = giMesh.m_albedoCacheOffset;
+                        meshInstanceGpuData.m_albedoInfo[1] = uint32_t(giMesh.m_albedoCacheSize.x) | (uint32_t(giMesh.m_albedoCacheSize.y) << 16);
+                        meshInstanceGpuData.m_albedoInfo[2] = PackAlbedo(giMesh.m_baseColor);
+                        meshInstanceGpuData.m_albedoInfo[3] = giMesh.m_textureUVVB != nullptr ? giMesh.m_textureUVVB->GetOrAddByteAddressBindlessIndex() : 0;
+                        for (uint32_t index = 0; index < 4; index++)
+                        {
+                            meshInstanceGpuData.m_alphaInfo[index] = giMesh.m_alphaInfo[index];
+                        }
+                    }
+                    pGiBaker->m_sceneInstanceData.push_back(meshInstanceGpuData);
+                }
+            }
+            pGiBaker->m_instanceGpuData = CGIBaker::GetDeviceCommand()->CreateBuffer(
+                pGiBaker->m_sceneInstanceData.data(), sizeof(SMeshInstanceGpuData) * pGiBaker->m_sceneInstanceData.size(), 
+                sizeof(SMeshInstanceGpuData), EBufferUsage::USAGE_Structure);
+        }
+        pGiBaker->m_pTLAS = CGIBaker::GetDeviceCommand()->BuildTopAccelerationStructure(inoutGpuBlasDataArray);
+
+
+        pGiBaker->pRtSceneLight = CGIBaker::GetDeviceCommand()->CreateBuffer(pGiBaker->m_aRayTracingLights.data(), sizeof(SRayTracingLight) * pGiBaker->m_aRayTracingLights.size(), sizeof(SRayTracingLight), EBufferUsage::USAGE_Structure);
+
+        // the triangle buffer is always bound, a placeholder triangle is uploaded if there is no mesh light
+        std::vector<SMeshLightTriangle> meshLightTriangles = pGiBaker->m_meshLightTriangles;
+        if (meshLightTriangles.empty())
+        {
+            meshLightTriangles.push_back(SMeshLightTriangle{});
+        }
+        pGiBaker->m_meshLightTriangleBuffer = CGIBaker::GetDeviceCommand()->CreateBuffer(meshLightTriangles.data(), sizeof(SMeshLightTriangle) * meshLightTriangles.size(), sizeof(SMeshLightTriangle), EBufferUsage::USAGE_Structure);
+
+        std::vector<Vec4> environmentLightData = pGiBaker->m_environmentLightData;
+        if (environmentLightData.empty())
+        {
+            environmentLightData.push_back(Vec4(0, 0, 0, 0));
+        }
+        pGiBaker->m_environmentLightBuffer = CGIBaker::GetDeviceCommand()->CreateBuffer(environmentLightData.data(), sizeof(Vec4) * environmentLightData.size(), sizeof(Vec4), EBufferUsage::USAGE_Structure);
+
+        std::vector<uint32_t> albedoCacheTexels = pGiBaker->m_albedoCacheTexels;
+        if (albedoCacheTexels.empty())
+        {
+            albedoCacheTexels.push_back(0);
+        }
+        pGiBaker->m_albedoCacheBuffer = CGIBaker::GetDeviceCommand()->CreateBuffer(albedoCacheTexels.data(), sizeof(uint32_t) * albedoCacheTexels.size(), sizeof(uint32_t), EBufferUsage::USAGE_Structure);
+
+        std::vector<uint32_t> alphaTestData = pGiBaker->m_alphaTestData;
+        if (alphaTestData.empty())
+        {
+            alphaTestData.push_back(0);
+        }
+        pGiBaker->m_alphaTestBuffer = CGIBaker::GetDeviceCommand()->CreateBuffer(alphaTestData.data(), sizeof(uint32_t) * alphaTestData.size(), sizeof(uint32_t), EBufferUsage::USAGE_Structure);
+    }
+
+    void hwrtl::gi::PrePareLightMapRayTracingPass()
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        CGIBaker::GetDeviceCommand()->OpenCmdList();
+
+        BuildRayTracingScene();
+
+        SRtGlobalConstantBuffer rtGloablCB = {};
+        rtGloablCB.m_bakeSeed = pGiBaker->m_bakeConfig.m_bakeSeed;
+        rtGloablCB.m_nRtSceneLightCount = pGiBaker->m_aRayTracingLights.size();
+        SetEnvironmentLightConstants(rtGloablCB);
         rtGloablCB.m_nAtlasSize = pGiBaker->m_nAtlasSize;
+        rtGloablCB.m_aoMaxDistance = pGiBaker->m_bakeConfig.m_aoMaxDistance;
+
+        pGiBaker->pRtSceneGlobalCB = CGIBaker::GetDeviceCommand()->CreateBuffer(&rtGloablCB, sizeof(SRtGlobalConstantBuffer), sizeof(SRtGlobalConstantBuffer), EBufferUsage::USAGE_CB);
+
+        bool bAmbientOcclusion = (pGiBaker->m_bakeConfig.m_bakeMode == EBakeMode::BM_AMBIENT_OCCLUSION);
+
+        std::vector<SShader>rtShaders;
+        rtShaders.push_back(SShader{ ERayShaderType::RAY_RGS,bAmbientOcclusion ? L"LightMapAORayGen" : L"LightMapRayTracingRayGen" });
+        rtShaders.push_back(SShader{ ERayShaderType::RAY_CHS,L"MaterialClosestHitMain",L"AlphaTestAnyHitMain" });
+        rtShaders.push_back(SShader{ ERayShaderType::RAY_CHS,L"ShadowClosestHitMain",L"AlphaTestAnyHitMain" });
+        rtShaders.push_back(SShader{ ERayShaderType::RAY_MIH,L"RayMiassMain" });
+
+        std::size_t dirPos = WstringConverter().from_bytes(__FILE__).find(L"hwrtl_gi.cpp");
+        std::wstring shaderPath = WstringConverter().from_bytes(__FILE__).substr(0, dirPos) + L"hwrtl_gi.hlsl";
+
+        SShaderDefine shaderDefines[7];
+        shaderDefines[0].m_defineName = std::wstring(L"RT_DEBUG_OUTPUT");
+        if (pGiBaker->m_bakeConfig.m_bDebugRayTracing)
+        {
+            shaderDefines[0].m_defineValue = std::wstring(L"1");
+        }
+        else
+        {
+            shaderDefines[0].m_defineValue = std::wstring(L"0");
+        }
+        shaderDefines[1].m_defineName = std::wstring(L"RT_AO_PASS");
+        shaderDefines[1].m_defineValue = std::wstring(bAmbientOcclusion ? L"1" : L"0");
+        shaderDefines[2].m_defineName = std::wstring(L"RT_SH_L2");
+        shaderDefines[2].m_defineValue = std::wstring(IsSHL2DirectionalityEnabled() ? L"1" : L"0");
+        shaderDefines[3].m_defineName = std::wstring(L"RT_RAY_STATS");
+        shaderDefines[3].m_defineValue = std::wstring(pGiBaker->m_bakeConfig.m_bCollectRayStats ? L"1" : L"0");
+        shaderDefines[4].m_defineName = std::wstring(L"RT_COST_OUTPUT");
+        shaderDefines[4].m_defineValue = std::wstring(pGiBaker->m_bakeConfig.m_bTraversalCostOutput ? L"1" : L"0");
+        shaderDefines[5] = GetCompactGBufferDefine();
+        shaderDefines[6].m_defineName = std::wstring(L"RT_PREVIEW_BAKE");
+        shaderDefines[6].m_defineValue = std::wstring(IsPreviewBakeEnabled() ? L"1" : L"0");
+
+        // the ray stats buffer is always bound, it is only written if RT_RAY_STATS is enabled
+        std::vector<uint32_t> rayStatsInitData(uint32_t(ERayStatsCounter::RSC_NUM) * 2, 0);
+        pGiBaker->pRtRayStats = CGIBaker::GetDeviceCommand()->CreateBuffer(rayStatsInitData.data(), sizeof(uint32_t) * rayStatsInitData.size(), sizeof(uint32_t), EBufferUsage::USAGE_UAV);
+
+        if (!pGiBaker->m_bakeConfig.m_bTraversalCostOutput)
+        {
+            STextureCreateDesc placeholderTexCreateDesc{ ETexUsage::USAGE_UAV,ETexFormat::FT_RGBA32_FLOAT,1,1 };
+            pGiBaker->m_placeholderUAVTexture = CGIBaker::GetDeviceCommand()->CreateTexture2D(placeholderTexCreateDesc);
+        }
+        
+        uint32_t uavNum = IsSHL2DirectionalityEnabled() ? 6 : 4;
+        SRayTracingPSOCreateDesc rtPsoCreateDesc = { shaderPath, rtShaders, 1, SShaderResources{ 9,uavNum,1,0 ,1,false,true} ,shaderDefines,7 };
+        pGiBaker->m_pRayTracingPSO = CGIBaker::GetDeviceCommand()->CreateRTPipelineStateAndShaderTable(rtPsoCreateDesc);
+
+        CGIBaker::GetDeviceCommand()->CloseAndExecuteCmdList();
+        CGIBaker::GetDeviceCommand()->WaitGPUCmdListFinish();
+    }
+
+    // returns the pass time in seconds, see SRayTracingStats::m_passSeconds
+    static double ExecuteRayTracingPassForAtlases(uint32_t beginAtlas, uint32_t endAtlas)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        std::chrono::steady_clock::time_point passBeginTime = std::chrono::steady_clock::now();
+        CGIBaker::GetRayTracingContext()->BeginRayTacingPasss();
+        CGIBaker::GetRayTracingContext()->SetRayTracingPipelineState(pGiBaker->m_pRayTracingPSO);
+        
+        for (uint32_t index = beginAtlas; index < endAtlas; index++)
+        {
+            SAtlas& atlas = pGiBaker->m_atlas[index];
+
+            CGIBaker::GetRayTracingContext()->SetConstantBuffer(pGiBaker->pRtSceneGlobalCB,0);
+            CGIBaker::GetRayTracingContext()->SetShaderUAV(atlas.m_irradianceAndSampleCount, 0);
+            CGIBaker::GetRayTracingContext()->SetShaderUAV(atlas.m_shDirectionality, 1);
+            CGIBaker::GetRayTracingContext()->SetShaderUAV(pGiBaker->pRtRayStats, 2);
+            CGIBaker::GetRayTracingContext()->SetShaderUAV(pGiBaker->m_bakeConfig.m_bTraversalCostOutput ? atlas.m_traversalCost : pGiBaker->m_placeholderUAVTexture, 3);
+            if (IsSHL2DirectionalityEnabled())
+            {
+                CGIBaker::GetRayTracingContext()->SetShaderUAV(atlas.m_shDirectionalityL2Part0, 4);
+                CGIBaker::GetRayTracingContext()->SetShaderUAV(atlas.m_shDirectionalityL2Part1, 5);
+            }
+            CGIBaker::GetRayTracingContext()->SetTLAS(pGiBaker->m_pTLAS,0);
+            if (IsCompactGBufferEnabled())
+            {
+                CGIBaker::GetRayTracingContext()->SetShaderSRV(atlas.m_hCompactGBufferTexture, 1);
+                CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_gbufferInstanceGpuData, 2);
+            }
+            else
+            {
+                CGIBaker::GetRayTracingContext()->SetShaderSRV(atlas.m_hPosTexture, 1);
+                CGIBaker::GetRayTracingContext()->SetShaderSRV(atlas.m_hNormalTexture, 2);
+            }
+            CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->pRtSceneLight, 3);
+            CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_instanceGpuData, 4);
+            CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_meshLightTriangleBuffer, 5);
+            CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_environmentLightBuffer, 6);
+            CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_albedoCacheBuffer, 7);
+            CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_alphaTestBuffer, 8);
+            uint32_t dispatchNum = IsPreviewBakeEnabled() ? 1 : pGiBaker->m_bakeConfig.m_bakerSamples + 1;
+            for (uint32_t sampleIndex = 0; sampleIndex < dispatchNum; sampleIndex++)
+            {
+                SRtRenderPassInfo rtRpInfo;
+                rtRpInfo.m_rpIndex = sampleIndex;
+                CGIBaker::GetRayTracingContext()->SetRootConstants(0, sizeof(SRtRenderPassInfo) / sizeof(uint32_t), &rtRpInfo, 0);
+                CGIBaker::GetRayTracingContext()->DispatchRayTracicing(pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y);
+            }
+        }
+        CGIBaker::GetRayTracingContext()->EndRayTacingPasss();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - passBeginTime).count();
+    }
+
+    void hwrtl::gi::ExecuteLightMapRayTracingPass()
+    {
+        HWRTL_PROFILE_FUNCTION();
+        pGiBaker->m_rayTracingPassSeconds = ExecuteRayTracingPassForAtlases(0, uint32_t(pGiBaker->m_atlas.size()));
+    }
+
+    void hwrtl::gi::GetLightMapRayTracingStats(SRayTracingStats& outStats)
+    {
+        assert(pGiBaker->m_bakeConfig.m_bCollectRayStats);
+
+        const uint32_t* lockedStatsData = (const uint32_t*)CGIBaker::GetDeviceCommand()->LockBufferForRead(pGiBaker->pRtRayStats);
+        auto getCounter = [lockedStatsData](uint32_t counterIndex)
+        {
+            return uint64_t(lockedStatsData[counterIndex * 2 + 0]) | (uint64_t(lockedStatsData[counterIndex * 2 + 1]) << 32);
+        };
+
+        outStats = SRayTracingStats();
+        outStats.m_primaryRayCount = getCounter(uint32_t(ERayStatsCounter::RSC_PRIMARY_RAY));
+        outStats.m_bounceRayCount = getCounter(uint32_t(ERayStatsCounter::RSC_BOUNCE_RAY));
+        outStats.m_shadowRayCount = getCounter(uint32_t(ERayStatsCounter::RSC_SHADOW_RAY));
+        outStats.m_occlusionRayCount = getCounter(uint32_t(ERayStatsCounter::RSC_OCCLUSION_RAY));
+        outStats.m_hitCount = getCounter(uint32_t(ERayStatsCounter::RSC_RAY_HIT));
+        outStats.m_missCount = getCounter(uint32_t(ERayStatsCounter::RSC_RAY_MISS));
+        for (uint32_t bounce = 0; bounce <= HWRTL_RAY_STATS_MAX_BOUNCES; bounce++)
+        {
+            outStats.m_pathLengthHistogram[bounce] = getCounter(uint32_t(ERayStatsCounter::RSC_PATH_LENGTH) + bounce);
+        }
+        outStats.m_passSeconds = pGiBaker->m_rayTracingPassSeconds;
+
+        CGIBaker::GetDeviceCommand()->UnLockBuffer(pGiBaker->pRtRayStats);
+    }
+
+    void hwrtl::gi::AddProbeVolume(Vec3 volumeMin, Vec3 volumeMax, Vec3i probeResolution)
+    {
+        assert(probeResolution.x > 0 && probeResolution.y > 0 && probeResolution.z > 0);
+
+        SProbeVolume probeVolume;
+        probeVolume.m_volumeMin = volumeMin;
+        probeVolume.m_volumeMax = volumeMax;
+        probeVolume.m_probeResolution = probeResolution;
+
+        for (int z = 0; z < probeResolution.z; z++)
+        {
+            for (int y = 0; y < probeResolution.y; y++)
+            {
+                for (int x = 0; x < probeResolution.x; x++)
+                {
+                    // a single probe along an axis is placed at the center of the volume
+                    Vec3 gridPosition(
+                        probeResolution.x > 1 ? float(x) / float(probeResolution.x - 1) : 0.5f,
+                        probeResolution.y > 1 ? float(y) / float(probeResolution.y - 1) : 0.5f,
+                        probeResolution.z > 1 ? float(z) / float(probeResolution.z - 1) : 0.5f);
+                    Vec3 probePosition = volumeMin + (volumeMax - volumeMin) * gridPosition;
+                    probeVolume.m_probePositions.push_back(Vec4(probePosition.x, probePosition.y, probePosition.z, 1.0f));
+                }
+            }
+        }
+
+        pGiBaker->m_probeVolumes.push_back(probeVolume);
+    }
+
+    static std::shared_ptr<CRayTracingPipelineState> CreateProbeRayTracingPSO(const std::wstring& rayGenEntryPoint, bool bInsideTest)
+    {
+        std::vector<SShader>rtShaders;
+        rtShaders.push_back(SShader{ ERayShaderType::RAY_RGS,rayGenEntryPoint });
+        rtShaders.push_back(SShader{ ERayShaderType::RAY_CHS,L"MaterialClosestHitMain",L"AlphaTestAnyHitMain" });
+        rtShaders.push_back(SShader{ ERayShaderType::RAY_CHS,L"ShadowClosestHitMain",L"AlphaTestAnyHitMain" });
+        rtShaders.push_back(SShader{ ERayShaderType::RAY_MIH,L"RayMiassMain" });
+
+        std::size_t dirPos = WstringConverter().from_bytes(__FILE__).find(L"hwrtl_gi.cpp");
+        std::wstring shaderPath = WstringConverter().from_bytes(__FILE__).substr(0, dirPos) + L"hwrtl_gi.hlsl";
+
+        SShaderDefine shaderDefines[3];
+        shaderDefines[0].m_defineName = std::wstring(L"RT_DEBUG_OUTPUT");
+        shaderDefines[0].m_defineValue = std::wstring(L"0");
+        shaderDefines[1].m_defineName = std::wstring(L"RT_PROBE_PASS");
+        shaderDefines[1].m_defineValue = std::wstring(L"1");
+        shaderDefines[2].m_defineName = std::wstring(L"RT_PROBE_INSIDE_TEST");
+        shaderDefines[2].m_defineValue = std::wstring(bInsideTest ? L"1" : L"0");
+
+        // the inside test only writes the backface hit count, the probe pass writes the sh and the depth moments
+        uint32_t uavNum = bInsideTest ? 1 : 2;
+        SRayTracingPSOCreateDesc rtPsoCreateDesc = { shaderPath, rtShaders, 1, SShaderResources{ 8,uavNum,1,0 ,1,false,true} ,shaderDefines,3 };
+        return CGIBaker::GetDeviceCommand()->CreateRTPipelineStateAndShaderTable(rtPsoCreateDesc);
+    }
+
+    /***************************************************************************
+    * Adaptive Probe Placement
+    * 
+    * the volume is split by an octree that is only refined near the scene triangles, every leaf is a brick with a probe at each corner
+    * the corners shared by neighbor leaves share one probe, the probes inside the geometry are culled by a ray traced backface test
+    ***************************************************************************/
+
+    static constexpr uint32_t ProbeInsideTestRayCount = 64;
+    static constexpr float ProbeInsideTestBackfaceRatio = 0.25f; // a probe is inside the geometry if more than 25% rays hit back faces
+
+    struct SProbeOctreeBuildContext
+    {
+        SProbeVolume* m_pProbeVolume;
+        Vec3 m_finestCellExtent;
+        uint32_t m_finestCellNum; // per axis
+
+        std::vector<Vec3> m_triangleMin;
+        std::vector<Vec3> m_triangleMax;
+
+        std::unordered_map<uint64_t, uint32_t> m_cornerProbeIndices;
+    };
+
+    static void GatherSceneTriangleBounds(SProbeOctreeBuildContext& buildContext)
+    {
+        for (uint32_t meshIndex = 0; meshIndex < pGiBaker->m_giMeshes.size(); meshIndex++)
+        {
+            const SGIMesh& giMesh = pGiBaker->m_giMeshes[meshIndex];
+            const float (*transform)[4] = giMesh.m_meshInstanceInfo.m_transform;
+            assert(giMesh.m_pPositionData != nullptr);
+
+            for (uint32_t triangleIndex = 0; triangleIndex < giMesh.m_nVertexCount / 3; triangleIndex++)
+            {
+                Vec3 triangleMin(FLT_MAX, FLT_MAX, FLT_MAX);
+                Vec3 triangleMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+                for (uint32_t vertexIndex = 0; vertexIndex < 3; vertexIndex++)
+                {
+                    const Vec3& localPosition = giMesh.m_pPositionData[triangleIndex * 3 + vertexIndex];
+                    Vec3 worldPosition(
+                        transform[0][0] * localPosition.x + transform[0][1] * localPosition.y + transform[0][2] * localPosition.z + transform[0][3],
+                        transform[1][0] * localPosition.x + transform[1][1] * localPosition.y + transform[1][2] * localPosition.z + transform[1][3],
+                        transform[2][0] * localPosition.x + transform[2][1] * localPosition.y + transform[2][2] * localPosition.z + transform[2][3]);
+                    triangleMin = Vec3(std::min(triangleMin.x, worldPosition.x), std::min(triangleMin.y, worldPosition.y), std::min(triangleMin.z, worldPosition.z));
+                    triangleMax = Vec3(std::max(triangleMax.x, worldPosition.x), std::max(triangleMax.y, worldPosition.y), std::max(triangleMax.z, worldPosition.z));
+                }
+                buildContext.m_triangleMin.push_back(triangleMin);
+                buildContext.m_triangleMax.push_back(triangleMax);
+            }
+        }
+    }
+
+    static uint32_t GetOrAddCornerProbe(SProbeOctreeBuildContext& buildContext, Vec3i corner)
+    {
+        uint64_t cornerNum = buildContext.m_finestCellNum + 1;
+        uint64_t cornerKey = (uint64_t(corner.z) * cornerNum + uint64_t(corner.y)) * cornerNum + uint64_t(corner.x);
+
+        auto iter = buildContext.m_cornerProbeIndices.find(cornerKey);
+        if (iter != buildContext.m_cornerProbeIndices.end())
+        {
+            return iter->second;
+        }
+
+        SProbeVolume* pProbeVolume = buildContext.m_pProbeVolume;
+        Vec3 probePosition = pProbeVolume->m_volumeMin + buildContext.m_finestCellExtent * Vec3(corner);
+
+        uint32_t probeIndex = pProbeVolume->m_probePositions.size();
+        pProbeVolume->m_probePositions.push_back(Vec4(probePosition.x, probePosition.y, probePosition.z, 1.0f));
+        buildContext.m_cornerProbeIndices[cornerKey] = probeIndex;
+        return probeIndex;
+    }
+
+    static void BuildProbeOctree(SProbeOctreeBuildContext& buildContext, Vec3i cellMin, uint32_t cellSize, const std::vector<uint32_t>& triangleIndices)
+    {
+        // refine the cells that overlap a triangle, the cell is extended by half of its size so that the refinement doesn't stop right at the surface
+        Vec3 cellExtent = buildContext.m_finestCellExtent * float(cellSize);
+        Vec3 cellWorldMin = buildContext.m_pProbeVolume->m_volumeMin + buildContext.m_finestCellExtent * Vec3(cellMin) - cellExtent * 0.5f;
+        Vec3 cellWorldMax = cellWorldMin + cellExtent * 2.0f;
+
+        std::vector<uint32_t> overlapTriangles;
+        for (uint32_t index = 0; index < triangleIndices.size(); index++)
+        {
+            const Vec3& triangleMin = buildContext.m_triangleMin[triangleIndices[index]];
+            const Vec3& triangleMax = buildContext.m_triangleMax[triangleIndices[index]];
+            if (triangleMin.x <= cellWorldMax.x && triangleMax.x >= cellWorldMin.x &&
+                triangleMin.y <= cellWorldMax.y && triangleMax.y >= cellWorldMin.y &&
+                triangleMin.z <= cellWorldMax.z && triangleMax.z >= cellWorldMin.z)
+            {
+                overlapTriangles.push_back(triangleIndices[index]);
+            }
+        }
+
+        if (cellSize > 1 && overlapTriangles.size() > 0)
+        {
+            uint32_t childSize = cellSize / 2;
+            for (uint32_t childIndex = 0; childIndex < 8; childIndex++)
+            {
+                Vec3i childOffset((childIndex & 1) * childSize, ((childIndex >> 1) & 1) * childSize, ((childIndex >> 2) & 1) * childSize);
+                BuildProbeOctree(buildContext, cellMin + childOffset, childSize, overlapTriangles);
+            }
+            return;
+        }
+
+        SProbeBrick probeBrick;
+        probeBrick.m_cellMin = cellMin;
+        probeBrick.m_cellSize = cellSize;
+        for (uint32_t cornerIndex = 0; cornerIndex < 8; cornerIndex++)
+        {
+            Vec3i cornerOffset((cornerIndex & 1) * cellSize, ((cornerIndex >> 1) & 1) * cellSize, ((cornerIndex >> 2) & 1) * cellSize);
+            probeBrick.m_probeIndices[cornerIndex] = GetOrAddCornerProbe(buildContext, cellMin + cornerOffset);
+        }
+        buildContext.m_pProbeVolume->m_bricks.push_back(probeBrick);
+    }
+
+    void hwrtl::gi::AddAdaptiveProbeVolume(Vec3 volumeMin, Vec3 volumeMax, uint32_t maxOctreeDepth)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        assert(maxOctreeDepth <= 8 && "the indirection table has (2^maxOctreeDepth)^3 entries");
+
+        pGiBaker->m_probeVolumes.push_back(SProbeVolume());
+        SProbeVolume& probeVolume = pGiBaker->m_probeVolumes.back();
+        probeVolume.m_volumeMin = volumeMin;
+        probeVolume.m_volumeMax = volumeMax;
+        probeVolume.m_bAdaptive = true;
+
+        SProbeOctreeBuildContext buildContext;
+        buildContext.m_pProbeVolume = &probeVolume;
+        buildContext.m_finestCellNum = 1u << maxOctreeDepth;
+        buildContext.m_finestCellExtent = (volumeMax - volumeMin) * (1.0f / float(buildContext.m_finestCellNum));
+        GatherSceneTriangleBounds(buildContext);
+
+        std::vector<uint32_t> triangleIndices;
+        triangleIndices.resize(buildContext.m_triangleMin.size());
+        for (uint32_t index = 0; index < triangleIndices.size(); index++)
+        {
+            triangleIndices[index] = index;
+        }
+
+        BuildProbeOctree(buildContext, Vec3i(0, 0, 0), buildContext.m_finestCellNum, triangleIndices);
+
+        // every finest cell points to the leaf that contains it
+        int cellNum = buildContext.m_finestCellNum;
+        probeVolume.m_indirectionSize = Vec3i(cellNum, cellNum, cellNum);
+        probeVolume.m_indirection.resize(cellNum * cellNum * cellNum);
+        for (uint32_t brickIndex = 0; brickIndex < probeVolume.m_bricks.size(); brickIndex++)
+        {
+            const SProbeBrick& probeBrick = probeVolume.m_bricks[brickIndex];
+            for (int z = probeBrick.m_cellMin.z; z < probeBrick.m_cellMin.z + int(probeBrick.m_cellSize); z++)
+            {
+                for (int y = probeBrick.m_cellMin.y; y < probeBrick.m_cellMin.y + int(probeBrick.m_cellSize); y++)
+                {
+                    for (int x = probeBrick.m_cellMin.x; x < probeBrick.m_cellMin.x + int(probeBrick.m_cellSize); x++)
+                    {
+                        probeVolume.m_indirection[(z * cellNum + y) * cellNum + x] = brickIndex;
+                    }
+                }
+            }
+        }
+    }
+
+    static void CullEmbeddedProbes()
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        std::vector<Vec4> candidatePositions;
+        for (uint32_t volumeIndex = 0; volumeIndex < pGiBaker->m_probeVolumes.size(); volumeIndex++)
+        {
+            SProbeVolume& probeVolume = pGiBaker->m_probeVolumes[volumeIndex];
+            if (probeVolume.m_bAdaptive)
+            {
+                probeVolume.m_firstProbe = candidatePositions.size();
+                candidatePositions.insert(candidatePositions.end(), probeVolume.m_probePositions.begin(), probeVolume.m_probePositions.end());
+            }
+        }
+
+        if (candidatePositions.size() == 0)
+        {
+            return;
+        }
+
+        std::shared_ptr<CBuffer> candidatePositionBuffer = CGIBaker::GetDeviceCommand()->CreateBuffer(candidatePositions.data(), sizeof(Vec4) * candidatePositions.size(), sizeof(Vec4), EBufferUsage::USAGE_Structure);
+
+        std::vector<uint32_t> backfaceHitInitData;
+        backfaceHitInitData.resize(candidatePositions.size());
+        std::shared_ptr<CBuffer> backfaceHitBuffer = CGIBaker::GetDeviceCommand()->CreateBuffer(backfaceHitInitData.data(), sizeof(uint32_t) * backfaceHitInitData.size(), sizeof(uint32_t), EBufferUsage::USAGE_UAV);
+
+        SRtGlobalConstantBuffer rtGloablCB = {};
+        rtGloablCB.m_bakeSeed = pGiBaker->m_bakeConfig.m_bakeSeed;
+        rtGloablCB.m_nRtSceneLightCount = pGiBaker->m_aRayTracingLights.size();
+        SetEnvironmentLightConstants(rtGloablCB);
+        rtGloablCB.m_nProbeCount = candidatePositions.size();
+        rtGloablCB.m_nProbeRayCount = ProbeInsideTestRayCount;
+        std::shared_ptr<CBuffer> insideTestGlobalCB = CGIBaker::GetDeviceCommand()->CreateBuffer(&rtGloablCB, sizeof(SRtGlobalConstantBuffer), sizeof(SRtGlobalConstantBuffer), EBufferUsage::USAGE_CB);
+
+        std::shared_ptr<CRayTracingPipelineState> insideTestPSO = CreateProbeRayTracingPSO(L"ProbeInsideTestRayGen", true);
+
+        CGIBaker::GetDeviceCommand()->CloseAndExecuteCmdList();
+        CGIBaker::GetDeviceCommand()->WaitGPUCmdListFinish();
+
+        CGIBaker::GetRayTracingContext()->BeginRayTacingPasss();
+        CGIBaker::GetRayTracingContext()->SetRayTracingPipelineState(insideTestPSO);
+        CGIBaker::GetRayTracingContext()->SetConstantBuffer(insideTestGlobalCB, 0);
+        CGIBaker::GetRayTracingContext()->SetShaderUAV(backfaceHitBuffer, 0);
+        CGIBaker::GetRayTracingContext()->SetTLAS(pGiBaker->m_pTLAS, 0);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->pRtSceneLight, 1);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_instanceGpuData, 2);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(candidatePositionBuffer, 3);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_meshLightTriangleBuffer, 4);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_environmentLightBuffer, 5);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_albedoCacheBuffer, 6);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_alphaTestBuffer, 7);
+
+        SRtRenderPassInfo rtRpInfo = {};
+        CGIBaker::GetRayTracingContext()->SetRootConstants(0, sizeof(SRtRenderPassInfo) / sizeof(uint32_t), &rtRpInfo, 0);
+        CGIBaker::GetRayTracingContext()->DispatchRayTracicing(candidatePositions.size(), 1);
+        CGIBaker::GetRayTracingContext()->EndRayTacingPasss();
+
+        const uint32_t* backfaceHitCounts = (const uint32_t*)CGIBaker::GetDeviceCommand()->LockBufferForRead(backfaceHitBuffer);
+        const uint32_t maxBackfaceHitCount = uint32_t(ProbeInsideTestRayCount * ProbeInsideTestBackfaceRatio);
+
+        for (uint32_t volumeIndex = 0; volumeIndex < pGiBaker->m_probeVolumes.size(); volumeIndex++)
+        {
+            SProbeVolume& probeVolume = pGiBaker->m_probeVolumes[volumeIndex];
+            if (!probeVolume.m_bAdaptive)
+            {
+                continue;
+            }
+
+            // compact the probes and remap the brick corners
+            std::vector<uint32_t> probeRemap;
+            std::vector<Vec4> keptProbePositions;
+            probeRemap.resize(probeVolume.m_probePositions.size());
+            for (uint32_t probeIndex = 0; probeIndex < probeVolume.m_probePositions.size(); probeIndex++)
+            {
+                if (backfaceHitCounts[probeVolume.m_firstProbe + probeIndex] > maxBackfaceHitCount)
+                {
+                    probeRemap[probeIndex] = HWRTL_INVALID_PROBE_INDEX;
+                }
+                else
+                {
+                    probeRemap[probeIndex] = keptProbePositions.size();
+                    keptProbePositions.push_back(probeVolume.m_probePositions[probeIndex]);
+                }
+            }
+
+            for (uint32_t brickIndex = 0; brickIndex < probeVolume.m_bricks.size(); brickIndex++)
+            {
+                SProbeBrick& probeBrick = probeVolume.m_bricks[brickIndex];
+                for (uint32_t cornerIndex = 0; cornerIndex < 8; cornerIndex++)
+                {
+                    probeBrick.m_probeIndices[cornerIndex] = probeRemap[probeBrick.m_probeIndices[cornerIndex]];
+                }
+            }
+
+            probeVolume.m_probePositions = keptProbePositions;
+        }
+
+        CGIBaker::GetDeviceCommand()->UnLockBuffer(backfaceHitBuffer);
+    }
+
+    /***************************************************************************
+    * Cpu Wavefront Probe Tracing
+    * 
+    * cpu ray tracing backend of the probe pass, enabled by SBakeConfig::m_bCpuProbeRayTracing
+    * the world space triangles of every instance are stored in a binned sah bvh, the paths of a wavefront are advanced stage by stage:
+    *		extension queue: closest hit of the path rays, in batches of CpuWavefrontBatchSize rays per task
+    *		shading: light sample + shadow ray request, material sample + russian roulette
+    *		shadow queue: occlusion test of the light samples, stream compacted from the shaded paths
+    *		the extension queue of the next bounce is stream compacted from the paths that are still alive
+    * with SBakeConfig::m_bCpuRayReordering the bounce and shadow queues are radix sorted by direction octant and origin morton code
+    * in chunks of CpuRayReorderChunkSize rays, the rays of a batch then share the upper bvh nodes
+    * next event estimation of the directional, sphere and mesh lights, the environment is only added by the rays that miss
+    * the result converges to the gpu probe pass but isn't bit identical, alpha masks are ignored
+    ***************************************************************************/
+
+    static constexpr uint32_t CpuWavefrontBatchSize = 256;
+    static constexpr uint32_t CpuBvhLeafSize = 4;
+    static constexpr uint32_t CpuBvhBinNum = 16;
+    static constexpr uint32_t CpuBvhMaxDepth = 64;
+    static constexpr uint32_t CpuRayReorderChunkSize = 1 << 14;
+    static constexpr uint32_t CpuMaxBounces = 32; // path depth of the cpu integrator, must match maxBounces in hwrtl_gi.hlsl
+
+    static bool IsCpuProbeRayTracingEnabled()
+    {
+        return pGiBaker->m_bakeConfig.m_bCpuProbeRayTracing;
+    }
+
+    static void GrowBounds(Vec3& inoutBoundsMin, Vec3& inoutBoundsMax, Vec3 position)
+    {
+        inoutBoundsMin = Vec3(std::min(inoutBoundsMin.x, position.x), std::min(inoutBoundsMin.y, position.y), std::min(inoutBoundsMin.z, position.z));
+        inoutBoundsMax = Vec3(std::max(inoutBoundsMax.x, position.x), std::max(inoutBoundsMax.y, position.y), std::max(inoutBoundsMax.z, position.z));
+    }
+
+    static float GetBoundsHalfArea(Vec3 boundsMin, Vec3 boundsMax)
+    {
+        Vec3 extent = boundsMax - boundsMin;
+        return (extent.x < 0.0f) ? 0.0f : extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+
+    struct SCpuBvhBuildTask
+    {
+        uint32_t m_nodeIndex;
+        uint32_t m_depth;
+    };
+
+    static void BuildCpuBvh()
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        SCpuBvh& cpuBvh = pGiBaker->m_cpuBvh;
+        cpuBvh.m_nodes.clear();
+        cpuBvh.m_triangles.clear();
+
+        std::vector<SCpuBvhTriangle> sceneTriangles;
+        std::vector<Vec3> triangleCentroids;
+        for (uint32_t giMeshIndex = 0; giMeshIndex < pGiBaker->m_giMeshes.size(); giMeshIndex++)
+        {
+            const SGIMesh& giMesh = pGiBaker->m_giMeshes[giMeshIndex];
+            const float (*transform)[4] = giMesh.m_meshInstanceInfo.m_transform;
+            assert((giMesh.m_pPositionData != nullptr) && "the cpu probe pass reads the mesh position data in PrePareProbeRayTracingPass");
+            for (uint32_t triangleIndex = 0; triangleIndex < giMesh.m_nVertexCount / 3; triangleIndex++)
+            {
+                Vec3 worldPositions[3];
+                for (uint32_t vertexIndex = 0; vertexIndex < 3; vertexIndex++)
+                {
+                    const Vec3& localPosition = giMesh.m_pPositionData[triangleIndex * 3 + vertexIndex];
+                    worldPositions[vertexIndex] = Vec3(
+                        transform[0][0] * localPosition.x + transform[0][1] * localPosition.y + transform[0][2] * localPosition.z + transform[0][3],
+                        transform[1][0] * localPosition.x + transform[1][1] * localPosition.y + transform[1][2] * localPosition.z + transform[1][3],
+                        transform[2][0] * localPosition.x + transform[2][1] * localPosition.y + transform[2][2] * localPosition.z + transform[2][3]);
+                }
+                sceneTriangles.push_back(SCpuBvhTriangle{ worldPositions[0], worldPositions[1] - worldPositions[0], worldPositions[2] - worldPositions[0], giMeshIndex, triangleIndex });
+                triangleCentroids.push_back((worldPositions[0] + worldPositions[1] + worldPositions[2]) * (1.0f / 3.0f));
+            }
+        }
+        assert(sceneTriangles.size() > 0);
+
+        std::vector<uint32_t> triangleIndices(sceneTriangles.size());
+        for (uint32_t index = 0; index < triangleIndices.size(); index++)
+        {
+            triangleIndices[index] = index;
+        }
+
+        auto getTriangleBounds = [&](uint32_t triangleIndex, Vec3& inoutBoundsMin, Vec3& inoutBoundsMax)
+        {
+            const SCpuBvhTriangle& triangle = sceneTriangles[triangleIndex];
+            GrowBounds(inoutBoundsMin, inoutBoundsMax, triangle.m_vertex0);
+            GrowBounds(inoutBoundsMin, inoutBoundsMax, triangle.m_vertex0 + triangle.m_edge1);
+            GrowBounds(inoutBoundsMin, inoutBoundsMax, triangle.m_vertex0 + triangle.m_edge2);
+        };
+
+        // leaf nodes reference [m_firstChildOrTriangle, m_firstChildOrTriangle + m_triangleNum) of triangleIndices during the build
+        cpuBvh.m_nodes.reserve(sceneTriangles.size() * 2);
+        cpuBvh.m_nodes.push_back(SCpuBvhNode{ Vec3(FLT_MAX, FLT_MAX, FLT_MAX), 0, Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX), uint32_t(sceneTriangles.size()) });
+
+        std::vector<SCpuBvhBuildTask> buildTasks;
+        buildTasks.push_back(SCpuBvhBuildTask{ 0, 0 });
+        while (!buildTasks.empty())
+        {
+            SCpuBvhBuildTask buildTask = buildTasks.back();
+            buildTasks.pop_back();
+
+            SCpuBvhNode& node = cpuBvh.m_nodes[buildTask.m_nodeIndex];
+            const uint32_t firstTriangle = node.m_firstChildOrTriangle;
+            const uint32_t triangleNum = node.m_triangleNum;
+
+            Vec3 centroidMin(FLT_MAX, FLT_MAX, FLT_MAX);
+            Vec3 centroidMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+            for (uint32_t index = firstTriangle; index < firstTriangle + triangleNum; index++)
+            {
+                getTriangleBounds(triangleIndices[index], node.m_boundsMin, node.m_boundsMax);
+                GrowBounds(centroidMin, centroidMax, triangleCentroids[triangleIndices[index]]);
+            }
+
+            if (triangleNum <= CpuBvhLeafSize || buildTask.m_depth + 1 >= CpuBvhMaxDepth)
+            {
+                continue;
+            }
+
+            // binned sah over the centroid bounds of every axis
+            float bestCost = GetBoundsHalfArea(node.m_boundsMin, node.m_boundsMax) * float(triangleNum);
+            int bestAxis = -1;
+            uint32_t bestSplitBin = 0;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const float axisMin = centroidMin[axis];
+                const float axisExtent = centroidMax[axis] - axisMin;
+                if (axisExtent <= 0.0f)
+                {
+                    continue;
+                }
+
+                uint32_t binCounts[CpuBvhBinNum] = {};
+                Vec3 binBoundsMin[CpuBvhBinNum];
+                Vec3 binBoundsMax[CpuBvhBinNum];
+                for (uint32_t binIndex = 0; binIndex < CpuBvhBinNum; binIndex++)
+                {
+                    binBoundsMin[binIndex] = Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+                    binBoundsMax[binIndex] = Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+                }
+
+                const float binScale = float(CpuBvhBinNum) / axisExtent;
+                for (uint32_t index = firstTriangle; index < firstTriangle + triangleNum; index++)
+                {
+                    uint32_t binIndex = std::min(uint32_t((triangleCentroids[triangleIndices[index]][axis] - axisMin) * binScale), CpuBvhBinNum - 1);
+                    binCounts[binIndex]++;
+                    getTriangleBounds(triangleIndices[index], binBoundsMin[binIndex], binBoundsMax[binIndex]);
+                }
+
+                // right to left sweep, then left to right sweep
+                float rightCosts[CpuBvhBinNum] = {};
+                Vec3 sweepMin(FLT_MAX, FLT_MAX, FLT_MAX);
+                Vec3 sweepMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+                uint32_t sweepCount = 0;
+                for (uint32_t binIndex = CpuBvhBinNum - 1; binIndex > 0; binIndex--)
+                {
+                    GrowBounds(sweepMin, sweepMax, binBoundsMin[binIndex]);
+                    GrowBounds(sweepMin, sweepMax, binBoundsMax[binIndex]);
+                    sweepCount += binCounts[binIndex];
+                    rightCosts[binIndex] = GetBoundsHalfArea(sweepMin, sweepMax) * float(sweepCount);
+                }
+
+                sweepMin = Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+                sweepMax = Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+                sweepCount = 0;
+                for (uint32_t binIndex = 0; binIndex < CpuBvhBinNum - 1; binIndex++)
+                {
+                    GrowBounds(sweepMin, sweepMax, binBoundsMin[binIndex]);
+                    GrowBounds(sweepMin, sweepMax, binBoundsMax[binIndex]);
+                    sweepCount += binCounts[binIndex];
+                    if (sweepCount == 0 || sweepCount == triangleNum)
+                    {
+                        continue;
+                    }
+
+                    float splitCost = GetBoundsHalfArea(sweepMin, sweepMax) * float(sweepCount) + rightCosts[binIndex + 1];
+                    if (splitCost < bestCost)
+                    {
+                        bestCost = splitCost;
+                        bestAxis = axis;
+                        bestSplitBin = binIndex;
+                    }
+                }
+            }
+
+            if (bestAxis < 0)
+            {
+                continue;
+            }
+
+            const float splitAxisMin = centroidMin[bestAxis];
+            const float splitBinScale = float(CpuBvhBinNum) / (centroidMax[bestAxis] - splitAxisMin);
+            auto splitIter = std::partition(triangleIndices.begin() + firstTriangle, triangleIndices.begin() + firstTriangle + triangleNum, [&](uint32_t triangleIndex)
+            {
+                return std::min(uint32_t((triangleCentroids[triangleIndex][bestAxis] - splitAxisMin) * splitBinScale), CpuBvhBinNum - 1) <= bestSplitBin;
+            });
+            const uint32_t leftTriangleNum = uint32_t(splitIter - triangleIndices.begin()) - firstTriangle;
+
+            const uint32_t leftChildIndex = uint32_t(cpuBvh.m_nodes.size());
+            node.m_firstChildOrTriangle = leftChildIndex;
+            node.m_triangleNum = 0;
+
+            // node is invalid after the push back
+            cpuBvh.m_nodes.push_back(SCpuBvhNode{ Vec3(FLT_MAX, FLT_MAX, FLT_MAX), firstTriangle, Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX), leftTriangleNum });
+            cpuBvh.m_nodes.push_back(SCpuBvhNode{ Vec3(FLT_MAX, FLT_MAX, FLT_MAX), firstTriangle + leftTriangleNum, Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX), triangleNum - leftTriangleNum });
+            buildTasks.push_back(SCpuBvhBuildTask{ leftChildIndex, buildTask.m_depth + 1 });
+            buildTasks.push_back(SCpuBvhBuildTask{ leftChildIndex + 1, buildTask.m_depth + 1 });
+        }
+
+        cpuBvh.m_triangles.resize(sceneTriangles.size());
+        for (uint32_t index = 0; index < triangleIndices.size(); index++)
+        {
+            cpuBvh.m_triangles[index] = sceneTriangles[triangleIndices[index]];
+        }
+    }
+
+    static bool IntersectCpuBvhBounds(const SCpuBvhNode& node, const SCpuRay& ray, Vec3 invDirection, float tMax, float& outTEnter)
+    {
+        float tEnter = ray.m_tMin;
+        float tExit = tMax;
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            float t0 = (node.m_boundsMin[axis] - ray.m_origin[axis]) * invDirection[axis];
+            float t1 = (node.m_boundsMax[axis] - ray.m_origin[axis]) * invDirection[axis];
+            tEnter = std::max(tEnter, std::min(t0, t1));
+            tExit = std::min(tExit, std::max(t0, t1));
+        }
+        outTEnter = tEnter;
+        return tEnter <= tExit;
+    }
+
+    // moller trumbore, both faces
+    static bool IntersectCpuBvhTriangle(const SCpuBvhTriangle& triangle, const SCpuRay& ray, float tMax, SCpuRayHit& outHit)
+    {
+        Vec3 pVec = CrossVec3(ray.m_direction, triangle.m_edge2);
+        float determinant = triangle.m_edge1.Dot(pVec);
+        if (std::abs(determinant) < 1e-12f)
+        {
+            return false;
+        }
+
+        float invDeterminant = 1.0f / determinant;
+        Vec3 tVec = ray.m_origin - triangle.m_vertex0;
+        float barycentricU = tVec.Dot(pVec) * invDeterminant;
+        if (barycentricU < 0.0f || barycentricU > 1.0f)
+        {
+            return false;
+        }
+
+        Vec3 qVec = CrossVec3(tVec, triangle.m_edge1);
+        float barycentricV = ray.m_direction.Dot(qVec) * invDeterminant;
+        if (barycentricV < 0.0f || barycentricU + barycentricV > 1.0f)
+        {
+            return false;
+        }
+
+        float hitT = triangle.m_edge2.Dot(qVec) * invDeterminant;
+        if (hitT <= ray.m_tMin || hitT >= tMax)
+        {
+            return false;
+        }
+
+        outHit.m_hitT = hitT;
+        outHit.m_barycentricU = barycentricU;
+        outHit.m_barycentricV = barycentricV;
+        return true;
+    }
+
+    struct SCpuTraversalCounters
+    {
+        uint64_t m_rayCount = 0;
+        uint64_t m_nodeVisitCount = 0;
+        uint64_t m_triangleTestCount = 0;
+    };
+
+    // closest hit, or any hit if bAnyHit is true, outHit.m_hitT is negative if the ray misses
+    static void TraceCpuRay(const SCpuBvh& cpuBvh, const SCpuRay& ray, bool bAnyHit, SCpuRayHit& outHit, SCpuTraversalCounters& inoutCounters)
+    {
+        inoutCounters.m_rayCount++;
+        outHit.m_hitT = -1.0f;
+        float closestT = ray.m_tMax;
+
+        const Vec3 invDirection(1.0f / ray.m_direction.x, 1.0f / ray.m_direction.y, 1.0f / ray.m_direction.z);
+        uint32_t nodeStack[CpuBvhMaxDepth * 2];
+        uint32_t stackSize = 0;
+        nodeStack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            const SCpuBvhNode& node = cpuBvh.m_nodes[nodeStack[--stackSize]];
+            inoutCounters.m_nodeVisitCount++;
+            float tEnter;
+            if (!IntersectCpuBvhBounds(node, ray, invDirection, closestT, tEnter))
+            {
+                continue;
+            }
+
+            if (node.m_triangleNum > 0)
+            {
+                inoutCounters.m_triangleTestCount += node.m_triangleNum;
+                for (uint32_t triangleIndex = node.m_firstChildOrTriangle; triangleIndex < node.m_firstChildOrTriangle + node.m_triangleNum; triangleIndex++)
+                {
+                    if (IntersectCpuBvhTriangle(cpuBvh.m_triangles[triangleIndex], ray, closestT, outHit))
+                    {
+                        closestT = outHit.m_hitT;
+                        outHit.m_triangleIndex = triangleIndex;
+                        if (bAnyHit)
+                        {
+                            return;
+                        }
+                    }
+                }
+                continue;
+            }
+
+            // visit the nearer child first
+            const uint32_t leftChildIndex = node.m_firstChildOrTriangle;
+            float leftTEnter, rightTEnter;
+            bool bHitLeft = IntersectCpuBvhBounds(cpuBvh.m_nodes[leftChildIndex], ray, invDirection, closestT, leftTEnter);
+            bool bHitRight = IntersectCpuBvhBounds(cpuBvh.m_nodes[leftChildIndex + 1], ray, invDirection, closestT, rightTEnter);
+            if (bHitLeft && bHitRight)
+            {
+                bool bLeftFirst = leftTEnter <= rightTEnter;
+                nodeStack[stackSize++] = bLeftFirst ? leftChildIndex + 1 : leftChildIndex;
+                nodeStack[stackSize++] = bLeftFirst ? leftChildIndex : leftChildIndex + 1;
+            }
+            else if (bHitLeft || bHitRight)
+            {
+                nodeStack[stackSize++] = bHitLeft ? leftChildIndex : leftChildIndex + 1;
+            }
+        }
+    }
+
+    // see StrongIntegerHash in hwrtl_gi.hlsl
+    static uint32_t StrongIntegerHash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0xa812d533;
+        x ^= x >> 15;
+        x *= 0xb278e4ad;
+        x ^= x >> 17;
+        return x;
+    }
+
+    // pcg hash, one random state per path
+    static float GetCpuRandomFloat(uint32_t& inoutRandomState)
+    {
+        inoutRandomState = inoutRandomState * 747796405u + 2891336453u;
+        uint32_t word = ((inoutRandomState >> ((inoutRandomState >> 28u) + 4u)) ^ inoutRandomState) * 277803737u;
+        return float(((word >> 22u) ^ word) >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // see GetTangentBasis in hwrtl_gi.hlsl
+    static Vec3 TangentToWorld(Vec3 inputVector, Vec3 tangentZ)
+    {
+        const float sign = tangentZ.z >= 0.0f ? 1.0f : -1.0f;
+        const float a = -1.0f / (sign + tangentZ.z);
+        const float b = tangentZ.x * tangentZ.y * a;
+        Vec3 tangentX(1.0f + sign * a * tangentZ.x * tangentZ.x, sign * b, -sign * tangentZ.x);
+        Vec3 tangentY(b, sign + a * tangentZ.y * tangentZ.y, -tangentZ.y);
+        return tangentX * inputVector.x + tangentY * inputVector.y + tangentZ * inputVector.z;
+    }
+
+    // see SphericalFibonacci and GetRandomRotation in hwrtl_gi.hlsl
+    static Vec3 GetProbeRayDirection(uint32_t rayIndex, uint32_t rayCount, Vec3 rotationSample)
+    {
+        const float pi = 3.14159265358979f;
+        const float goldenRatio = 1.61803398875f;
+        float fibonacciPhi = 2.0f * pi * std::fmod(float(rayIndex) * (goldenRatio - 1.0f), 1.0f);
+        float fibonacciCosTheta = 1.0f - (2.0f * float(rayIndex) + 1.0f) / float(rayCount);
+        float fibonacciSinTheta = std::sqrt(std::max(1.0f - fibonacciCosTheta * fibonacciCosTheta, 0.0f));
+
+        float spin = 2.0f * pi * rotationSample.z + fibonacciPhi;
+        Vec3 localDirection(std::cos(spin) * fibonacciSinTheta, std::sin(spin) * fibonacciSinTheta, fibonacciCosTheta);
+
+        float axisCosTheta = 1.0f - 2.0f * rotationSample.x;
+        float axisSinTheta = std::sqrt(std::max(1.0f - axisCosTheta * axisCosTheta, 0.0f));
+        float axisPhi = 2.0f * pi * rotationSample.y;
+        return NormalizeVec3(TangentToWorld(localDirection, Vec3(std::cos(axisPhi) * axisSinTheta, std::sin(axisPhi) * axisSinTheta, axisCosTheta)));
+    }
+
+    // see OctahedronEncode in hwrtl_gi.hlsl
+    static uint32_t GetProbeDepthTexel(Vec3 direction)
+    {
+        float invLength = 1.0f / (std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z));
+        float octX = direction.x * invLength;
+        float octY = direction.y * invLength;
+        if (direction.z < 0.0f)
+        {
+            float foldedX = (1.0f - std::abs(octY)) * (octX >= 0.0f ? 1.0f : -1.0f);
+            float foldedY = (1.0f - std::abs(octX)) * (octY >= 0.0f ? 1.0f : -1.0f);
+            octX = foldedX;
+            octY = foldedY;
+        }
+        uint32_t texelX = std::min(uint32_t((octX * 0.5f + 0.5f) * HWRTL_PROBE_DEPTH_OCT_SIZE), uint32_t(HWRTL_PROBE_DEPTH_OCT_SIZE - 1));
+        uint32_t texelY = std::min(uint32_t((octY * 0.5f + 0.5f) * HWRTL_PROBE_DEPTH_OCT_SIZE), uint32_t(HWRTL_PROBE_DEPTH_OCT_SIZE - 1));
+        return texelY * HWRTL_PROBE_DEPTH_OCT_SIZE + texelX;
+    }
+
+    // see GetEnvironmentRadiance in hwrtl_gi.hlsl
+    static Vec3 GetCpuEnvironmentRadiance(Vec3 direction)
+    {
+        const float pi = 3.14159265358979f;
+        const uint32_t environmentWidth = uint32_t(pGiBaker->m_environmentLightSize.x);
+        const uint32_t environmentHeight = uint32_t(pGiBaker->m_environmentLightSize.y);
+
+        float phi = std::atan2(direction.y, direction.x);
+        phi = phi < 0.0f ? phi + 2.0f * pi : phi;
+        uint32_t texelX = std::min(uint32_t(phi / (2.0f * pi) * environmentWidth), environmentWidth - 1);
+        uint32_t texelY = std::min(uint32_t(std::acos(std::min(std::max(direction.z, -1.0f), 1.0f)) / pi * environmentHeight), environmentHeight - 1);
+        const Vec4& texelData = pGiBaker->m_environmentLightData[environmentHeight + texelY * environmentWidth + texelX];
+        return Vec3(texelData.x, texelData.y, texelData.z);
+    }
+
+    // see GetHitAlbedo in hwrtl_gi.hlsl
+    static Vec3 GetCpuHitAlbedo(const SCpuBvhTriangle& triangle, const SCpuRayHit& hit)
+    {
+        const SGIMesh& giMesh = pGiBaker->m_giMeshes[triangle.m_giMeshIndex];
+        if (giMesh.m_albedoCacheSize.x == 0)
+        {
+            return giMesh.m_baseColor;
+        }
+
+        const Vec2* triangleUVs = giMesh.m_pTextureUVData + triangle.m_primitiveIndex * 3;
+        Vec2 textureUV = triangleUVs[0] * (1.0f - hit.m_barycentricU - hit.m_barycentricV) + triangleUVs[1] * hit.m_barycentricU + triangleUVs[2] * hit.m_barycentricV;
+        float wrappedU = textureUV.x - std::floor(textureUV.x);
+        float wrappedV = textureUV.y - std::floor(textureUV.y);
+
+        uint32_t texelX = std::min(uint32_t(wrappedU * giMesh.m_albedoCacheSize.x), uint32_t(giMesh.m_albedoCacheSize.x - 1));
+        uint32_t texelY = std::min(uint32_t(wrappedV * giMesh.m_albedoCacheSize.y), uint32_t(giMesh.m_albedoCacheSize.y - 1));
+        uint32_t packedAlbedo = pGiBaker->m_albedoCacheTexels[giMesh.m_albedoCacheOffset + texelY * giMesh.m_albedoCacheSize.x + texelX];
+        return Vec3(SRGBToLinear(float(packedAlbedo & 0xFF) / 255.0f), SRGBToLinear(float((packedAlbedo >> 8) & 0xFF) / 255.0f), SRGBToLinear(float((packedAlbedo >> 16) & 0xFF) / 255.0f));
+    }
+
+    // light direction, distance and radiance over the solid angle pdf, see SampleLight in hwrtl_gi.hlsl
+    static bool SampleCpuLight(uint32_t lightIndex, Vec3 worldPosition, float randomX, float randomY, Vec3& outDirection, float& outDistance, Vec3& outRadianceOverPdf)
+    {
+        const float pi = 3.14159265358979f;
+        const SRayTracingLight& light = pGiBaker->m_aRayTracingLights[lightIndex];
+        if (light.m_eLightType == ELightType::LT_DIRECTION)
+        {
+            outDirection = light.m_lightDirectional;
+            outDistance = FLT_MAX;
+            outRadianceOverPdf = light.m_color;
+            return true;
+        }
+
+        if (light.m_eLightType == ELightType::LT_SPHERE)
+        {
+            Vec3 lightDirection = light.m_worldPosition - worldPosition;
+            float lightDistanceSquared = lightDirection.Dot(lightDirection);
+            float radiusSquared = light.m_radius * light.m_radius;
+            float sinThetaMax2 = std::min(radiusSquared / lightDistanceSquared, 1.0f);
+            float oneMinusCosThetaMax = sinThetaMax2 < 0.01f ? sinThetaMax2 * (0.5f + 0.125f * sinThetaMax2) : 1.0f - std::sqrt(1.0f - sinThetaMax2);
+
+            float cosTheta = 1.0f - oneMinusCosThetaMax * randomY;
+            float sinTheta2 = 1.0f - cosTheta * cosTheta;
+            float sinTheta = std::sqrt(std::max(sinTheta2, 0.0f));
+            float conePdf = 1.0f / (2.0f * pi * oneMinusCosThetaMax);
+
+            Vec3 localDirection(sinTheta * std::cos(2.0f * pi * randomX), sinTheta * std::sin(2.0f * pi * randomX), cosTheta);
+            outDirection = NormalizeVec3(TangentToWorld(localDirection, NormalizeVec3(lightDirection)));
+            outDistance = std::sqrt(lightDistanceSquared) * (cosTheta - std::sqrt(std::max(sinThetaMax2 - sinTheta2, 0.0f)));
+            outRadianceOverPdf = sinThetaMax2 < 0.001f ? light.m_color * (1.0f / lightDistanceSquared) : light.m_color * (1.0f / (pi * radiusSquared * conePdf));
+            return true;
+        }
+
+        if (light.m_eLightType == ELightType::LT_MESH)
+        {
+            SMeshLightSample meshLightSample;
+            SampleMeshLight(lightIndex, randomX, randomY, meshLightSample);
+
+            Vec3 lightDirection = meshLightSample.m_position - worldPosition;
+            float lightDistanceSquared = lightDirection.Dot(lightDirection);
+            float lightDistance = std::sqrt(lightDistanceSquared);
+            outDirection = lightDirection * (1.0f / std::max(lightDistance, 1e-7f));
+
+            float cosLight = -meshLightSample.m_normal.Dot(outDirection);
+            if (cosLight <= 0.0f || lightDistanceSquared <= 0.0f)
+            {
+                return false;
+            }
+
+            // the shadow ray must not hit the emitter itself
+            outDistance = lightDistance * 0.999f;
+            outRadianceOverPdf = light.m_color * (cosLight / (lightDistanceSquared * meshLightSample.m_areaPdf));
+            return true;
+        }
+
+        return false;
+    }
+
+    // worker threads of the cpu probe pass, created once per pass, the calling thread is worker 0
+    // every Run hands out batches of items through an atomic counter, so the short queues of the late bounces stay balanced
+    class CCpuWorkerPool
+    {
+    public:
+        CCpuWorkerPool()
+        {
+            uint32_t workerNum = std::max(std::thread::hardware_concurrency(), 1u);
+            for (uint32_t workerIndex = 1; workerIndex < workerNum; workerIndex++)
+            {
+                m_workerThreads.emplace_back([this, workerIndex]() { WorkerMain(workerIndex); });
+            }
+        }
+
+        ~CCpuWorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_bExit = true;
+            }
+            m_wakeCondition.notify_all();
+            for (uint32_t index = 0; index < m_workerThreads.size(); index++)
+            {
+                m_workerThreads[index].join();
+            }
+        }
+
+        uint32_t GetWorkerNum() const { return uint32_t(m_workerThreads.size()) + 1; }
+
+        // func(batchIndex, beginIndex, endIndex, workerIndex) for every batch of [0, count), returns when all batches are done
+        template<typename FUNC>
+        void Run(uint32_t count, uint32_t batchSize, const FUNC& func)
+        {
+            const uint32_t batchNum = (count + batchSize - 1) / batchSize;
+            if (batchNum == 0)
+            {
+                return;
+            }
+
+            m_nextBatch.store(0, std::memory_order_relaxed);
+            m_job = [this, count, batchSize, batchNum, &func](uint32_t workerIndex)
+            {
+                for (uint32_t batchIndex = m_nextBatch.fetch_add(1); batchIndex < batchNum; batchIndex = m_nextBatch.fetch_add(1))
+                {
+                    func(batchIndex, batchIndex * batchSize, std::min((batchIndex + 1) * batchSize, count), workerIndex);
+                }
+            };
+
+            // a single batch isn't worth waking the workers
+            uint32_t wakeNum = std::min(batchNum - 1, uint32_t(m_workerThreads.size()));
+            if (wakeNum > 0)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_jobGeneration++;
+                m_busyWorkerNum = uint32_t(m_workerThreads.size());
+            }
+            if (wakeNum > 0)
+            {
+                m_wakeCondition.notify_all();
+            }
+
+            m_job(0);
+
+            if (wakeNum > 0)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_doneCondition.wait(lock, [this]() { return m_busyWorkerNum == 0; });
+            }
+        }
+
+    private:
+        void WorkerMain(uint32_t workerIndex)
+        {
+            uint64_t jobGeneration = 0;
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_wakeCondition.wait(lock, [&]() { return m_bExit || m_jobGeneration != jobGeneration; });
+                    if (m_bExit)
+                    {
+                        return;
+                    }
+                    jobGeneration = m_jobGeneration;
+                }
+
+                m_job(workerIndex);
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (--m_busyWorkerNum == 0)
+                {
+                    m_doneCondition.notify_one();
+                }
+            }
+        }
+
+        std::vector<std::thread> m_workerThreads;
+        std::mutex m_mutex;
+        std::condition_variable m_wakeCondition;
+        std::condition_variable m_doneCondition;
+        std::function<void(uint32_t)> m_job;
+        std::atomic<uint32_t> m_nextBatch{ 0 };
+        uint64_t m_jobGeneration = 0;
+        uint32_t m_busyWorkerNum = 0;
+        bool m_bExit = false;
+    };
+
+    struct SCpuPathState
+    {
+        SCpuRay m_ray;
+        SCpuRayHit m_hit;
+
+        SCpuRay m_shadowRay;
+        Vec3 m_shadowRadiance; // added to m_radiance if the shadow ray isn't occluded
+
+        Vec3 m_pathThroughput;
+        Vec3 m_radiance;
+
+        Vec3 m_probeRayDirection;
+        float m_probeRayHitT;
+
+        uint32_t m_randomState;
+        uint32_t m_bounce;
+        bool m_bAlive;
+        bool m_bValid;
+        bool m_bShadowRayPending;
+    };
+
+    // order preserving stream compaction of the path queue, batches are counted and written in parallel
+    template<typename PREDICATE>
+    static void CompactCpuPathQueue(CCpuWorkerPool& workerPool, const std::vector<uint32_t>& inputQueue, std::vector<uint32_t>& outputQueue, const PREDICATE& predicate)
+    {
+        const uint32_t batchNum = (uint32_t(inputQueue.size()) + CpuWavefrontBatchSize - 1) / CpuWavefrontBatchSize;
+        std::vector<uint32_t> batchOffsets(batchNum + 1, 0);
+        workerPool.Run(uint32_t(inputQueue.size()), CpuWavefrontBatchSize, [&](uint32_t batchIndex, uint32_t beginIndex, uint32_t endIndex, uint32_t)
+        {
+            uint32_t batchCount = 0;
+            for (uint32_t index = beginIndex; index < endIndex; index++)
+            {
+                batchCount += predicate(inputQueue[index]) ? 1 : 0;
+            }
+            batchOffsets[batchIndex + 1] = batchCount;
+        });
+
+        for (uint32_t batchIndex = 0; batchIndex < batchNum; batchIndex++)
+        {
+            batchOffsets[batchIndex + 1] += batchOffsets[batchIndex];
+        }
+
+        outputQueue.resize(batchOffsets[batchNum]);
+        workerPool.Run(uint32_t(inputQueue.size()), CpuWavefrontBatchSize, [&](uint32_t batchIndex, uint32_t beginIndex, uint32_t endIndex, uint32_t)
+        {
+            uint32_t outputIndex = batchOffsets[batchIndex];
+            for (uint32_t index = beginIndex; index < endIndex; index++)
+            {
+                if (predicate(inputQueue[index]))
+                {
+                    outputQueue[outputIndex++] = inputQueue[index];
+                }
+            }
+        });
+    }
+
+    template<typename FUNC>
+    static void ProcessCpuPathQueue(CCpuWorkerPool& workerPool, const std::vector<uint32_t>& pathQueue, const FUNC& func)
+    {
+        workerPool.Run(uint32_t(pathQueue.size()), CpuWavefrontBatchSize, [&](uint32_t, uint32_t beginIndex, uint32_t endIndex, uint32_t)
+        {
+            for (uint32_t index = beginIndex; index < endIndex; index++)
+            {
+                func(pathQueue[index]);
+            }
+        });
+    }
+
+    // the traversal counters are summed per worker and merged once
+    static void TraceCpuPathQueue(CCpuWorkerPool& workerPool, const std::vector<uint32_t>& pathQueue, std::vector<SCpuPathState>& pathStates, bool bShadowRays, SCpuTraversalCounters& inoutCounters)
+    {
+        const SCpuBvh& cpuBvh = pGiBaker->m_cpuBvh;
+        std::vector<SCpuTraversalCounters> workerCounters(workerPool.GetWorkerNum());
+        workerPool.Run(uint32_t(pathQueue.size()), CpuWavefrontBatchSize, [&](uint32_t, uint32_t beginIndex, uint32_t endIndex, uint32_t workerIndex)
+        {
+            SCpuTraversalCounters& batchCounters = workerCounters[workerIndex];
+            for (uint32_t index = beginIndex; index < endIndex; index++)
+            {
+                SCpuPathState& pathState = pathStates[pathQueue[index]];
+                if (bShadowRays)
+                {
+                    SCpuRayHit shadowHit;
+                    TraceCpuRay(cpuBvh, pathState.m_shadowRay, true, shadowHit, batchCounters);
+                    if (shadowHit.m_hitT < 0.0f)
+                    {
+                        pathState.m_radiance = pathState.m_radiance + pathState.m_shadowRadiance;
+                    }
+                }
+                else
+                {
+                    TraceCpuRay(cpuBvh, pathState.m_ray, false, pathState.m_hit, batchCounters);
+                }
+            }
+        });
+
+        for (uint32_t workerIndex = 0; workerIndex < workerCounters.size(); workerIndex++)
+        {
+            inoutCounters.m_rayCount += workerCounters[workerIndex].m_rayCount;
+            inoutCounters.m_nodeVisitCount += workerCounters[workerIndex].m_nodeVisitCount;
+            inoutCounters.m_triangleTestCount += workerCounters[workerIndex].m_triangleTestCount;
+        }
+    }
+
+    // 3 bit direction octant, 27 bit morton code of the origin quantized to 512^3 cells inside the scene bounds
+    static uint32_t GetCpuRaySortKey(const SCpuRay& ray, Vec3 sceneBoundsMin, Vec3 cellScale)
+    {
+        auto expandBits = [](uint32_t value)
+        {
+            value = (value | (value << 16)) & 0x030000FF;
+            value = (value | (value << 8)) & 0x0300F00F;
+            value = (value | (value << 4)) & 0x030C30C3;
+            value = (value | (value << 2)) & 0x09249249;
+            return value;
+        };
+
+        uint32_t cellX = uint32_t(std::min(std::max((ray.m_origin.x - sceneBoundsMin.x) * cellScale.x, 0.0f), 511.0f));
+        uint32_t cellY = uint32_t(std::min(std::max((ray.m_origin.y - sceneBoundsMin.y) * cellScale.y, 0.0f), 511.0f));
+        uint32_t cellZ = uint32_t(std::min(std::max((ray.m_origin.z - sceneBoundsMin.z) * cellScale.z, 0.0f), 511.0f));
+        uint32_t octant = (ray.m_direction.x < 0.0f ? 1u : 0u) | (ray.m_direction.y < 0.0f ? 2u : 0u) | (ray.m_direction.z < 0.0f ? 4u : 0u);
+        return (octant << 27) | (expandBits(cellX) << 2) | (expandBits(cellY) << 1) | expandBits(cellZ);
+    }
+
+    // ping pong buffers of the chunk sort, one per worker, sized to CpuRayReorderChunkSize once per pass
+    struct SCpuRaySortScratch
+    {
+        std::vector<uint32_t> m_sortKeys[2];
+        std::vector<uint32_t> m_sortValues[2];
+    };
+
+    // lsd radix sort of every chunk of the queue, 8 bit digits, the digits shared by all keys of the chunk are skipped
+    static void ReorderCpuPathQueue(CCpuWorkerPool& workerPool, std::vector<SCpuRaySortScratch>& workerSortScratch, std::vector<uint32_t>& pathQueue, const std::vector<SCpuPathState>& pathStates, bool bShadowRays)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        const SCpuBvhNode& rootNode = pGiBaker->m_cpuBvh.m_nodes[0];
+        const Vec3 sceneExtent = rootNode.m_boundsMax - rootNode.m_boundsMin;
+        const Vec3 cellScale(512.0f / std::max(sceneExtent.x, 1e-6f), 512.0f / std::max(sceneExtent.y, 1e-6f), 512.0f / std::max(sceneExtent.z, 1e-6f));
+
+        workerPool.Run(uint32_t(pathQueue.size()), CpuRayReorderChunkSize, [&](uint32_t, uint32_t firstIndex, uint32_t endIndex, uint32_t workerIndex)
+        {
+            std::vector<uint32_t>* sortKeys = workerSortScratch[workerIndex].m_sortKeys;
+            std::vector<uint32_t>* sortValues = workerSortScratch[workerIndex].m_sortValues;
+
+            const uint32_t chunkSize = endIndex - firstIndex;
+
+            uint32_t keyAnd = 0xFFFFFFFF;
+            uint32_t keyOr = 0;
+            for (uint32_t index = 0; index < chunkSize; index++)
+            {
+                const uint32_t pathIndex = pathQueue[firstIndex + index];
+                const SCpuPathState& pathState = pathStates[pathIndex];
+                uint32_t sortKey = GetCpuRaySortKey(bShadowRays ? pathState.m_shadowRay : pathState.m_ray, rootNode.m_boundsMin, cellScale);
+                sortKeys[0][index] = sortKey;
+                sortValues[0][index] = pathIndex;
+                keyAnd &= sortKey;
+                keyOr |= sortKey;
+            }
+
+            uint32_t sourceBuffer = 0;
+            for (uint32_t digitShift = 0; digitShift < 32; digitShift += 8)
+            {
+                if ((((keyAnd ^ keyOr) >> digitShift) & 0xFF) == 0)
+                {
+                    continue;
+                }
+
+                uint32_t digitOffsets[256] = {};
+                for (uint32_t index = 0; index < chunkSize; index++)
+                {
+                    digitOffsets[(sortKeys[sourceBuffer][index] >> digitShift) & 0xFF]++;
+                }
+
+                uint32_t digitSum = 0;
+                for (uint32_t digit = 0; digit < 256; digit++)
+                {
+                    uint32_t digitCount = digitOffsets[digit];
+                    digitOffsets[digit] = digitSum;
+                    digitSum += digitCount;
+                }
+
+                const uint32_t destBuffer = sourceBuffer ^ 1;
+                for (uint32_t index = 0; index < chunkSize; index++)
+                {
+                    uint32_t destIndex = digitOffsets[(sortKeys[sourceBuffer][index] >> digitShift) & 0xFF]++;
+                    sortKeys[destBuffer][destIndex] = sortKeys[sourceBuffer][index];
+                    sortValues[destBuffer][destIndex] = sortValues[sourceBuffer][index];
+                }
+                sourceBuffer = destBuffer;
+            }
+
+            std::copy(sortValues[sourceBuffer].begin(), sortValues[sourceBuffer].begin() + chunkSize, pathQueue.begin() + firstIndex);
+        });
+    }
+
+    // lambert surface at the hit point: emission seen by the probe ray, light sample, material sample and russian roulette
+    static void ShadeCpuPath(SCpuPathState& pathState, const std::vector<uint32_t>& sampledLights)
+    {
+        const float pi = 3.14159265358979f;
+        const SCpuBvh& cpuBvh = pGiBaker->m_cpuBvh;
+        pathState.m_bAlive = false;
+        pathState.m_bShadowRayPending = false;
+
+        if (pathState.m_bounce == 0)
+        {
+            pathState.m_probeRayHitT = pathState.m_hit.m_hitT;
+        }
+
+        if (pathState.m_hit.m_hitT < 0.0f)
+        {
+            if (pGiBaker->m_environmentLightIndex >= 0)
+            {
+                pathState.m_radiance = pathState.m_radiance + pathState.m_pathThroughput * GetCpuEnvironmentRadiance(pathState.m_ray.m_direction);
+            }
+            return;
+        }
+
+        const SCpuBvhTriangle& triangle = cpuBvh.m_triangles[pathState.m_hit.m_triangleIndex];
+        const SGIMesh& giMesh = pGiBaker->m_giMeshes[triangle.m_giMeshIndex];
+
+        // same orientation as the face normal in MaterialClosestHitMain
+        Vec3 worldNormal = NormalizeVec3(CrossVec3(triangle.m_edge2, triangle.m_edge1));
+        if (worldNormal.Dot(pathState.m_ray.m_direction) >= 0.0f)
+        {
+            pathState.m_bValid = false;
+            return;
+        }
+
+        if (pathState.m_bounce == 0 && giMesh.m_meshLightIndex >= 0)
+        {
+            pathState.m_radiance = pathState.m_radiance + pathState.m_pathThroughput * pGiBaker->m_aRayTracingLights[giMesh.m_meshLightIndex].m_color;
+        }
+
+        pathState.m_bounce++;
+        if (pathState.m_bounce > CpuMaxBounces)
+        {
+            return;
+        }
+
+        const Vec3 hitPosition = pathState.m_ray.m_origin + pathState.m_ray.m_direction * pathState.m_hit.m_hitT;
+        const Vec3 hitAlbedo = GetCpuHitAlbedo(triangle, pathState.m_hit);
+        const Vec3 rayOrigin = hitPosition + Vec3(std::abs(hitPosition.x) + 0.5f, std::abs(hitPosition.y) + 0.5f, std::abs(hitPosition.z) + 0.5f) * worldNormal * 0.001f;
+
+        // light sample, the light is picked uniformly
+        if (sampledLights.size() > 0)
+        {
+            uint32_t lightIndex = sampledLights[std::min(uint32_t(GetCpuRandomFloat(pathState.m_randomState) * sampledLights.size()), uint32_t(sampledLights.size() - 1))];
+            float randomX = GetCpuRandomFloat(pathState.m_randomState);
+            float randomY = GetCpuRandomFloat(pathState.m_randomState);
+
+            Vec3 lightDirection;
+            float lightDistance;
+            Vec3 radianceOverPdf;
+            if (SampleCpuLight(lightIndex, hitPosition, randomX, randomY, lightDirection, lightDistance, radianceOverPdf))
+            {
+                float NoL = worldNormal.Dot(lightDirection);
+                if (NoL > 0.0f)
+                {
+                    pathState.m_shadowRay = SCpuRay{ rayOrigin, 0.0f, lightDirection, lightDistance };
+                    pathState.m_shadowRadiance = pathState.m_pathThroughput * radianceOverPdf * hitAlbedo * (NoL / pi * float(sampledLights.size()));
+                    pathState.m_bShadowRayPending = true;
+                }
+            }
+        }
+
+        // cosine weighted material sample, the lambert weight is the albedo
+        float phi = 2.0f * pi * GetCpuRandomFloat(pathState.m_randomState);
+        float cosTheta = std::sqrt(GetCpuRandomFloat(pathState.m_randomState));
+        float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+        Vec3 bounceDirection = NormalizeVec3(TangentToWorld(Vec3(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta), worldNormal));
+
+        Vec3 nextPathThroughput = pathState.m_pathThroughput * hitAlbedo;
+        float maxNextPathThroughput = std::max(std::max(nextPathThroughput.x, nextPathThroughput.y), nextPathThroughput.z);
+        float maxPathThroughput = std::max(std::max(pathState.m_pathThroughput.x, pathState.m_pathThroughput.y), pathState.m_pathThroughput.z);
+        if (maxNextPathThroughput <= 0.0f)
+        {
+            return;
+        }
+
+        // the first surface of the probe ray is the camera vertex of the gpu path, see DoRayTracing
+        float continuationProbability = std::sqrt(std::min(maxNextPathThroughput / maxPathThroughput, 1.0f));
+        if (continuationProbability < 1.0f && pathState.m_bounce > 1)
+        {
+            if (GetCpuRandomFloat(pathState.m_randomState) >= continuationProbability)
+            {
+                return;
+            }
+            nextPathThroughput = nextPathThroughput * (1.0f / continuationProbability);
+        }
+
+        pathState.m_pathThroughput = nextPathThroughput;
+        pathState.m_ray = SCpuRay{ rayOrigin, 0.0f, bounceDirection, FLT_MAX };
+        pathState.m_bAlive = true;
+    }
+
+    static void ExecuteCpuProbeRayTracingPass()
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        auto passBeginTime = std::chrono::steady_clock::now();
+        double reorderSeconds = 0.0;
+        SCpuTraversalCounters extensionCounters;
+        SCpuTraversalCounters shadowCounters;
+
+        const bool bRayReordering = pGiBaker->m_bakeConfig.m_bCpuRayReordering;
+        const uint32_t probeCount = uint32_t(pGiBaker->m_probePositions.size());
+        const uint32_t probeRayCount = pGiBaker->m_bakeConfig.m_probeRayCount;
+        const uint32_t probeNumPerWavefront = std::max(pGiBaker->m_bakeConfig.m_cpuWavefrontSize / probeRayCount, 1u);
+        const uint32_t depthTexelNumPerProbe = HWRTL_PROBE_DEPTH_OCT_SIZE * HWRTL_PROBE_DEPTH_OCT_SIZE;
+
+        // the environment light isn't sampled, it is added by the rays that miss
+        std::vector<uint32_t> sampledLights;
+        for (uint32_t lightIndex = 0; lightIndex < pGiBaker->m_aRayTracingLights.size(); lightIndex++)
+        {
+            if (pGiBaker->m_aRayTracingLights[lightIndex].m_eLightType != ELightType::LT_ENVIRONMENT)
+            {
+                sampledLights.push_back(lightIndex);
+            }
+        }
+
+        // batches of whole probes with about CpuWavefrontBatchSize rays
+        CCpuWorkerPool workerPool;
+        const uint32_t probeBatchSize = std::max(CpuWavefrontBatchSize / probeRayCount, 1u);
+
+        std::vector<SCpuRaySortScratch> workerSortScratch(bRayReordering ? workerPool.GetWorkerNum() : 0);
+        for (uint32_t workerIndex = 0; workerIndex < workerSortScratch.size(); workerIndex++)
+        {
+            for (uint32_t bufferIndex = 0; bufferIndex < 2; bufferIndex++)
+            {
+                workerSortScratch[workerIndex].m_sortKeys[bufferIndex].resize(CpuRayReorderChunkSize);
+                workerSortScratch[workerIndex].m_sortValues[bufferIndex].resize(CpuRayReorderChunkSize);
+            }
+        }
+
+        std::vector<SCpuPathState> pathStates;
+        std::vector<uint32_t> extensionQueue;
+        std::vector<uint32_t> shadowQueue;
+        std::vector<uint32_t> nextExtensionQueue;
+        for (uint32_t sampleIndex = 0; sampleIndex < pGiBaker->m_bakeConfig.m_bakerSamples; sampleIndex++)
+        {
+            for (uint32_t firstProbe = 0; firstProbe < probeCount; firstProbe += probeNumPerWavefront)
+            {
+                const uint32_t wavefrontProbeNum = std::min(probeNumPerWavefront, probeCount - firstProbe);
+                const uint32_t pathNum = wavefrontProbeNum * probeRayCount;
+
+                pathStates.resize(pathNum);
+                extensionQueue.resize(pathNum);
+                workerPool.Run(wavefrontProbeNum, probeBatchSize, [&](uint32_t, uint32_t beginProbe, uint32_t endProbe, uint32_t)
+                {
+                    for (uint32_t wavefrontProbeIndex = beginProbe; wavefrontProbeIndex < endProbe; wavefrontProbeIndex++)
+                    {
+                        const uint32_t probeIndex = firstProbe + wavefrontProbeIndex;
+                        const Vec4& probePosition = pGiBaker->m_probePositions[probeIndex];
+
+                        uint32_t probeRandomState = StrongIntegerHash(probeIndex ^ StrongIntegerHash(pGiBaker->m_bakeConfig.m_bakeSeed)) + sampleIndex;
+                        Vec3 rotationSample(GetCpuRandomFloat(probeRandomState), GetCpuRandomFloat(probeRandomState), GetCpuRandomFloat(probeRandomState));
+                        for (uint32_t rayIndex = 0; rayIndex < probeRayCount; rayIndex++)
+                        {
+                            const uint32_t pathIndex = wavefrontProbeIndex * probeRayCount + rayIndex;
+                            SCpuPathState& pathState = pathStates[pathIndex];
+                            pathState = SCpuPathState{};
+                            pathState.m_probeRayDirection = GetProbeRayDirection(rayIndex, probeRayCount, rotationSample);
+                            pathState.m_ray = SCpuRay{ Vec3(probePosition.x, probePosition.y, probePosition.z), 0.0f, pathState.m_probeRayDirection, FLT_MAX };
+                            pathState.m_pathThroughput = Vec3(1.0f, 1.0f, 1.0f);
+                            pathState.m_randomState = StrongIntegerHash(probeRandomState ^ StrongIntegerHash(rayIndex));
+                            pathState.m_bValid = true;
+                            extensionQueue[pathIndex] = pathIndex;
+                        }
+                    }
+                });
+
+                // the probe rays of a probe are already coherent, only the bounce rays are reordered
+                for (bool bProbeRays = true; !extensionQueue.empty(); bProbeRays = false)
+                {
+                    if (bRayReordering && !bProbeRays)
+                    {
+                        auto reorderBeginTime = std::chrono::steady_clock::now();
+                        ReorderCpuPathQueue(workerPool, workerSortScratch, extensionQueue, pathStates, false);
+                        reorderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - reorderBeginTime).count();
+                    }
+                    TraceCpuPathQueue(workerPool, extensionQueue, pathStates, false, extensionCounters);
+
+                    ProcessCpuPathQueue(workerPool, extensionQueue, [&](uint32_t pathIndex)
+                    {
+                        ShadeCpuPath(pathStates[pathIndex], sampledLights);
+                    });
+
+                    CompactCpuPathQueue(workerPool, extensionQueue, shadowQueue, [&](uint32_t pathIndex) { return pathStates[pathIndex].m_bShadowRayPending; });
+                    if (bRayReordering)
+                    {
+                        auto reorderBeginTime = std::chrono::steady_clock::now();
+                        ReorderCpuPathQueue(workerPool, workerSortScratch, shadowQueue, pathStates, true);
+                        reorderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - reorderBeginTime).count();
+                    }
+                    TraceCpuPathQueue(workerPool, shadowQueue, pathStates, true, shadowCounters);
+
+                    CompactCpuPathQueue(workerPool, extensionQueue, nextExtensionQueue, [&](uint32_t pathIndex) { return pathStates[pathIndex].m_bAlive && pathStates[pathIndex].m_bValid; });
+                    std::swap(extensionQueue, nextExtensionQueue);
+                }
+
+                // same accumulation as ProbeRayTracingRayGen
+                workerPool.Run(wavefrontProbeNum, probeBatchSize, [&](uint32_t, uint32_t beginProbe, uint32_t endProbe, uint32_t)
+                {
+                    for (uint32_t wavefrontProbeIndex = beginProbe; wavefrontProbeIndex < endProbe; wavefrontProbeIndex++)
+                    {
+                        const uint32_t probeIndex = firstProbe + wavefrontProbeIndex;
+                        float* probeSHData = &pGiBaker->m_cpuProbeSHAndSampleCount[probeIndex * 7].x;
+                        Vec4* probeDepthSums = pGiBaker->m_cpuProbeDepthMoments.data() + probeIndex * depthTexelNumPerProbe;
+                        for (uint32_t rayIndex = 0; rayIndex < probeRayCount; rayIndex++)
+                        {
+                            const SCpuPathState& pathState = pathStates[wavefrontProbeIndex * probeRayCount + rayIndex];
+
+                            float hitDistance = pathState.m_probeRayHitT > 0.0f ? std::min(pathState.m_probeRayHitT, pGiBaker->m_probeMaxDepth) : pGiBaker->m_probeMaxDepth;
+                            Vec4& depthSum = probeDepthSums[GetProbeDepthTexel(pathState.m_probeRayDirection)];
+                            depthSum = depthSum + Vec4(hitDistance, hitDistance * hitDistance, 1.0f, 0.0f);
+
+                            const Vec3& radiance = pathState.m_radiance;
+                            if (!pathState.m_bValid || !std::isfinite(radiance.x + radiance.y + radiance.z) || radiance.x < 0.0f || radiance.y < 0.0f || radiance.z < 0.0f)
+                            {
+                                continue;
+                            }
+
+                            float shBasis[HWRTL_SH_L2_COEFFICIENT_NUM];
+                            GetSHBasisL2(pathState.m_probeRayDirection, shBasis);
+                            for (uint32_t shIndex = 0; shIndex < HWRTL_SH_L2_COEFFICIENT_NUM; shIndex++)
+                            {
+                                probeSHData[shIndex * 3 + 0] += radiance.x * shBasis[shIndex];
+                                probeSHData[shIndex * 3 + 1] += radiance.y * shBasis[shIndex];
+                                probeSHData[shIndex * 3 + 2] += radiance.z * shBasis[shIndex];
+                            }
+                            probeSHData[HWRTL_SH_L2_COEFFICIENT_NUM * 3] += 1.0f;
+                        }
+                    }
+                });
+            }
+        }
+
+        SCpuRayTracingStats& stats = pGiBaker->m_cpuRayTracingStats;
+        stats = SCpuRayTracingStats();
+        stats.m_extensionRayCount = extensionCounters.m_rayCount;
+        stats.m_shadowRayCount = shadowCounters.m_rayCount;
+        stats.m_nodeVisitCount = extensionCounters.m_nodeVisitCount + shadowCounters.m_nodeVisitCount;
+        stats.m_triangleTestCount = extensionCounters.m_triangleTestCount + shadowCounters.m_triangleTestCount;
+        stats.m_passSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - passBeginTime).count();
+        stats.m_reorderSeconds = reorderSeconds;
+    }
+
+    void hwrtl::gi::PrePareProbeRayTracingPass()
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        assert(pGiBaker->m_probeVolumes.size() > 0);
+
+        CGIBaker::GetDeviceCommand()->OpenCmdList();
+
+        BuildRayTracingScene();
+        CullEmbeddedProbes();
+
+        CGIBaker::GetDeviceCommand()->OpenCmdList();
+
+        pGiBaker->m_probePositions.clear();
+        for (uint32_t volumeIndex = 0; volumeIndex < pGiBaker->m_probeVolumes.size(); volumeIndex++)
+        {
+            SProbeVolume& probeVolume = pGiBaker->m_probeVolumes[volumeIndex];
+            probeVolume.m_firstProbe = pGiBaker->m_probePositions.size();
+            pGiBaker->m_probePositions.insert(pGiBaker->m_probePositions.end(), probeVolume.m_probePositions.begin(), probeVolume.m_probePositions.end());
+        }
+        assert(pGiBaker->m_probePositions.size() > 0);
+
+        // the hit distances are clamped to the largest volume diagonal, the misses are stored as this distance
+        pGiBaker->m_probeMaxDepth = 0.0f;
+        for (uint32_t volumeIndex = 0; volumeIndex < pGiBaker->m_probeVolumes.size(); volumeIndex++)
+        {
+            Vec3 volumeExtent = pGiBaker->m_probeVolumes[volumeIndex].m_volumeMax - pGiBaker->m_probeVolumes[volumeIndex].m_volumeMin;
+            pGiBaker->m_probeMaxDepth = std::max(pGiBaker->m_probeMaxDepth, std::sqrt(volumeExtent.Dot(volumeExtent)));
+        }
+
+        uint32_t probeCount = pGiBaker->m_probePositions.size();
+        if (IsCpuProbeRayTracingEnabled())
+        {
+            BuildCpuBvh();
+            pGiBaker->m_cpuProbeSHAndSampleCount.assign(probeCount * 7, Vec4(0, 0, 0, 0));
+            pGiBaker->m_cpuProbeDepthMoments.assign(probeCount * HWRTL_PROBE_DEPTH_OCT_SIZE * HWRTL_PROBE_DEPTH_OCT_SIZE, Vec4(0, 0, 0, 0));
+
+            CGIBaker::GetDeviceCommand()->CloseAndExecuteCmdList();
+            CGIBaker::GetDeviceCommand()->WaitGPUCmdListFinish();
+            return;
+        }
+
+        pGiBaker->m_probePositionBuffer = CGIBaker::GetDeviceCommand()->CreateBuffer(pGiBaker->m_probePositions.data(), sizeof(Vec4) * probeCount, sizeof(Vec4), EBufferUsage::USAGE_Structure);
+
+        // 9 rgb sh coefficients + valid sample count
+        std::vector<Vec4> probeSHInitData;
+        probeSHInitData.resize(probeCount * 7);
+        pGiBaker->m_probeSHAndSampleCount = CGIBaker::GetDeviceCommand()->CreateBuffer(probeSHInitData.data(), sizeof(Vec4) * probeSHInitData.size(), sizeof(Vec4), EBufferUsage::USAGE_UAV);
+
+        // sum of hit distance, sum of squared hit distance, ray count
+        std::vector<Vec4> probeDepthInitData;
+        probeDepthInitData.resize(probeCount * HWRTL_PROBE_DEPTH_OCT_SIZE * HWRTL_PROBE_DEPTH_OCT_SIZE);
+        pGiBaker->m_probeDepthMoments = CGIBaker::GetDeviceCommand()->CreateBuffer(probeDepthInitData.data(), sizeof(Vec4) * probeDepthInitData.size(), sizeof(Vec4), EBufferUsage::USAGE_UAV);
+
+        SRtGlobalConstantBuffer rtGloablCB = {};
+        rtGloablCB.m_bakeSeed = pGiBaker->m_bakeConfig.m_bakeSeed;
+        rtGloablCB.m_nRtSceneLightCount = pGiBaker->m_aRayTracingLights.size();
+        SetEnvironmentLightConstants(rtGloablCB);
+        rtGloablCB.m_nProbeCount = probeCount;
+        rtGloablCB.m_nProbeRayCount = pGiBaker->m_bakeConfig.m_probeRayCount;
+        rtGloablCB.m_probeMaxDepth = pGiBaker->m_probeMaxDepth;
+        pGiBaker->pProbeGlobalCB = CGIBaker::GetDeviceCommand()->CreateBuffer(&rtGloablCB, sizeof(SRtGlobalConstantBuffer), sizeof(SRtGlobalConstantBuffer), EBufferUsage::USAGE_CB);
+
+        pGiBaker->m_pProbeRayTracingPSO = CreateProbeRayTracingPSO(L"ProbeRayTracingRayGen", false);
+
+        CGIBaker::GetDeviceCommand()->CloseAndExecuteCmdList();
+        CGIBaker::GetDeviceCommand()->WaitGPUCmdListFinish();
+    }
+
+    void hwrtl::gi::ExecuteProbeRayTracingPass()
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        if (IsCpuProbeRayTracingEnabled())
+        {
+            ExecuteCpuProbeRayTracingPass();
+            return;
+        }
+
+        CGIBaker::GetRayTracingContext()->BeginRayTacingPasss();
+        CGIBaker::GetRayTracingContext()->SetRayTracingPipelineState(pGiBaker->m_pProbeRayTracingPSO);
+
+        CGIBaker::GetRayTracingContext()->SetConstantBuffer(pGiBaker->pProbeGlobalCB, 0);
+        CGIBaker::GetRayTracingContext()->SetShaderUAV(pGiBaker->m_probeSHAndSampleCount, 0);
+        CGIBaker::GetRayTracingContext()->SetShaderUAV(pGiBaker->m_probeDepthMoments, 1);
+        CGIBaker::GetRayTracingContext()->SetTLAS(pGiBaker->m_pTLAS, 0);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->pRtSceneLight, 1);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_instanceGpuData, 2);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_probePositionBuffer, 3);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_meshLightTriangleBuffer, 4);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_environmentLightBuffer, 5);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_albedoCacheBuffer, 6);
+        CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_alphaTestBuffer, 7);
+
+        // one thread per probe, each thread traces m_probeRayCount rays per sample
+        for (uint32_t sampleIndex = 0; sampleIndex < pGiBaker->m_bakeConfig.m_bakerSamples; sampleIndex++)
+        {
+            SRtRenderPassInfo rtRpInfo = {};
+            rtRpInfo.m_rpIndex = sampleIndex;
+            CGIBaker::GetRayTracingContext()->SetRootConstants(0, sizeof(SRtRenderPassInfo) / sizeof(uint32_t), &rtRpInfo, 0);
+            CGIBaker::GetRayTracingContext()->DispatchRayTracicing(pGiBaker->m_probePositions.size(), 1);
+        }
+        CGIBaker::GetRayTracingContext()->EndRayTacingPasss();
+    }
+
+    static uint16_t FloatToHalf(float value)
+    {
+        uint32_t floatBits;
+        memcpy(&floatBits, &value, sizeof(float));
+
+        uint32_t sign = (floatBits >> 16) & 0x8000;
+        int32_t exponent = int32_t((floatBits >> 23) & 0xFF) - 127 + 15;
+        uint32_t mantissa = floatBits & 0x7FFFFF;
+
+        if (exponent <= 0)
+        {
+            // denormalized half
+            if (exponent < -10)
+            {
+                return uint16_t(sign);
+            }
+            mantissa |= 0x800000;
+            uint32_t shift = uint32_t(14 - exponent);
+            return uint16_t(sign | ((mantissa + (1u << (shift - 1))) >> shift));
+        }
+
+        if (exponent >= 31)
+        {
+            return uint16_t(sign | 0x7C00);
+        }
+
+        // round to nearest, the mantissa overflow carries into the exponent
+        return uint16_t(sign | (uint32_t(exponent) << 10) | ((mantissa + 0x1000) >> 13));
+    }
+
+    // inverse of OctahedronEncode in hwrtl_gi.hlsl
+    static Vec3 OctahedronDecode(float u, float v)
+    {
+        float x = u * 2.0f - 1.0f;
+        float y = v * 2.0f - 1.0f;
+        float z = 1.0f - std::abs(x) - std::abs(y);
+        if (z < 0.0f)
+        {
+            float octX = x;
+            x = (1.0f - std::abs(y)) * (octX >= 0.0f ? 1.0f : -1.0f);
+            y = (1.0f - std::abs(octX)) * (y >= 0.0f ? 1.0f : -1.0f);
+        }
+        float length = std::sqrt(x * x + y * y + z * z);
+        return Vec3(x / length, y / length, z / length);
+    }
+
+    // the gpu accumulates every ray into a single texel, the cosine power filter spreads the rays over the neighbor texels like DDGI does
+    static void PrefilterAndPackProbeDepthMoments(const Vec4* depthSums, float maxDepth, uint16_t* outDepthMoments)
+    {
+        const uint32_t texelNum = HWRTL_PROBE_DEPTH_OCT_SIZE * HWRTL_PROBE_DEPTH_OCT_SIZE;
+        const float depthSharpness = 50.0f;
+
+        Vec3 texelDirections[texelNum];
+        for (uint32_t texelIndex = 0; texelIndex < texelNum; texelIndex++)
+        {
+            float u = ((texelIndex % HWRTL_PROBE_DEPTH_OCT_SIZE) + 0.5f) / HWRTL_PROBE_DEPTH_OCT_SIZE;
+            float v = ((texelIndex / HWRTL_PROBE_DEPTH_OCT_SIZE) + 0.5f) / HWRTL_PROBE_DEPTH_OCT_SIZE;
+            texelDirections[texelIndex] = OctahedronDecode(u, v);
+        }
+
+        for (uint32_t destTexel = 0; destTexel < texelNum; destTexel++)
+        {
+            float distanceSum = 0.0f;
+            float squaredDistanceSum = 0.0f;
+            float weightSum = 0.0f;
+            for (uint32_t srcTexel = 0; srcTexel < texelNum; srcTexel++)
+            {
+                float cosTheta = texelDirections[destTexel].Dot(texelDirections[srcTexel]);
+                if (cosTheta <= 0.0f || depthSums[srcTexel].z <= 0.0f)
+                {
+                    continue;
+                }
+
+                float weight = std::pow(cosTheta, depthSharpness);
+                distanceSum += depthSums[srcTexel].x * weight;
+                squaredDistanceSum += depthSums[srcTexel].y * weight;
+                weightSum += depthSums[srcTexel].z * weight;
+            }
+
+            float meanDistance = weightSum > 0.0f ? distanceSum / weightSum : maxDepth;
+            float meanSquaredDistance = weightSum > 0.0f ? squaredDistanceSum / weightSum : maxDepth * maxDepth;
+            outDepthMoments[destTexel * 2 + 0] = FloatToHalf(meanDistance / maxDepth);
+            outDepthMoments[destTexel * 2 + 1] = FloatToHalf(meanSquaredDistance / (maxDepth * maxDepth));
+        }
+    }
+
+    void hwrtl::gi::GetCpuProbeRayTracingStats(SCpuRayTracingStats& outStats)
+    {
+        assert(IsCpuProbeRayTracingEnabled() && "the ray tracing stats are only collected by the cpu probe pass");
+        outStats = pGiBaker->m_cpuRayTracingStats;
+    }
+
+    void hwrtl::gi::GetProbeVolumeData(std::vector<SOutputProbeVolumeInfo>& outputProbeVolumes)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        const uint32_t floatNumPerProbe = 7 * 4;
+        const uint32_t shFloatNumPerProbe = HWRTL_PROBE_SH_COEFFICIENT_NUM * 3;
+        const uint32_t depthTexelNumPerProbe = HWRTL_PROBE_DEPTH_OCT_SIZE * HWRTL_PROBE_DEPTH_OCT_SIZE;
+        const bool bCpuProbeRayTracing = IsCpuProbeRayTracingEnabled();
+        const float* lockedSHData = bCpuProbeRayTracing ? &pGiBaker->m_cpuProbeSHAndSampleCount[0].x : (const float*)CGIBaker::GetDeviceCommand()->LockBufferForRead(pGiBaker->m_probeSHAndSampleCount);
+        const Vec4* lockedDepthData = bCpuProbeRayTracing ? pGiBaker->m_cpuProbeDepthMoments.data() : (const Vec4*)CGIBaker::GetDeviceCommand()->LockBufferForRead(pGiBaker->m_probeDepthMoments);
+
+        outputProbeVolumes.resize(pGiBaker->m_probeVolumes.size());
+        for (uint32_t volumeIndex = 0; volumeIndex < pGiBaker->m_probeVolumes.size(); volumeIndex++)
+        {
+            const SProbeVolume& probeVolume = pGiBaker->m_probeVolumes[volumeIndex];
+            SOutputProbeVolumeInfo& outputVolume = outputProbeVolumes[volumeIndex];
+
+            uint32_t probeNum = probeVolume.m_probePositions.size();
+            outputVolume.m_volumeMin = probeVolume.m_volumeMin;
+            outputVolume.m_volumeMax = probeVolume.m_volumeMax;
+            outputVolume.m_probeResolution = probeVolume.m_probeResolution;
+            outputVolume.m_indirectionSize = probeVolume.m_indirectionSize;
+            outputVolume.m_indirection = probeVolume.m_indirection;
+            outputVolume.m_bricks = probeVolume.m_bricks;
+            outputVolume.m_probePositions.resize(probeNum);
+            outputVolume.m_shCoefficients.resize(probeNum * shFloatNumPerProbe);
+            outputVolume.m_probeMaxDepth = pGiBaker->m_probeMaxDepth;
+            outputVolume.m_depthMoments.resize(probeNum * depthTexelNumPerProbe * 2);
+
+            ParallelFor(probeNum, [&](uint32_t probeIndex)
+            {
+                const Vec4* probeDepthSums = lockedDepthData + (probeVolume.m_firstProbe + probeIndex) * depthTexelNumPerProbe;
+                PrefilterAndPackProbeDepthMoments(probeDepthSums, pGiBaker->m_probeMaxDepth, outputVolume.m_depthMoments.data() + probeIndex * depthTexelNumPerProbe * 2);
+            });
+
+            for (uint32_t probeIndex = 0; probeIndex < probeNum; probeIndex++)
+            {
+                const Vec4& probePosition = probeVolume.m_probePositions[probeIndex];
+                outputVolume.m_probePositions[probeIndex] = Vec3(probePosition.x, probePosition.y, probePosition.z);
+
+                const float* probeData = lockedSHData + (probeVolume.m_firstProbe + probeIndex) * floatNumPerProbe;
+
+                // monte carlo estimator of the uniform sphere distribution: 4 * pi / N * sum(L * Y)
+                float validSampleCount = probeData[shFloatNumPerProbe];
+                float normalizeFactor = validSampleCount > 0.0f ? 4.0f * 3.14159265358979f / validSampleCount : 0.0f;
+                for (uint32_t floatIndex = 0; floatIndex < shFloatNumPerProbe; floatIndex++)
+                {
+                    outputVolume.m_shCoefficients[probeIndex * shFloatNumPerProbe + floatIndex] = probeData[floatIndex] * normalizeFactor;
+                }
+            }
+        }
+
+        if (!bCpuProbeRayTracing)
+        {
+            CGIBaker::GetDeviceCommand()->UnLockBuffer(pGiBaker->m_probeSHAndSampleCount);
+            CGIBaker::GetDeviceCommand()->UnLockBuffer(pGiBaker->m_probeDepthMoments);
+        }
+    }
+
+    struct SDenoiseAndDilateParams
+    {
+        float m_spatialBandWidth;
+        float m_resultBandWidth;
+        float m_normalBandWidth;
+        float m_filterStrength;
+
+        Vec4 m_inputTexSizeAndInvSize;
+
+        float padding[56];
+    };
+    static_assert(sizeof(SDenoiseAndDilateParams) == 256 , "sizeof(SDenoiseParams) == 256");
+
+    static void PrePareDenoiseLightMapPass()
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        CGIBaker::GetDeviceCommand()->OpenCmdList();
+
+        std::vector<SShader>rsShaders;
+        rsShaders.push_back(SShader{ ERayShaderType::RS_VS,L"DenoiseLightMapVS" });
+        rsShaders.push_back(SShader{ ERayShaderType::RS_PS,IsPreviewBakeEnabled() ? L"PreviewBlurLightMapPS" : L"DenoiseLightMapPS" });
+
+        SShaderResources rasterizationResources = { IsSHL2DirectionalityEnabled() ? 5u : 3u,0,1,0 };
+
+        std::vector<EVertexFormat>vertexLayouts;
+        vertexLayouts.push_back(EVertexFormat::FT_FLOAT3);
+        vertexLayouts.push_back(EVertexFormat::FT_FLOAT2);
+
+        std::vector<ETexFormat>rtFormats;
+        rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+        rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+        if (IsSHL2DirectionalityEnabled())
+        {
+            rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+            rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+        }
+
+        std::size_t dirPos = WstringConverter().from_bytes(__FILE__).find(L"hwrtl_gi.cpp");
+        std::wstring shaderPath = WstringConverter().from_bytes(__FILE__).substr(0, dirPos) + L"hwrtl_gi.hlsl";
+
+        SRasterizationPSOCreateDesc rsPsoCreateDesc = { shaderPath, rsShaders, rasterizationResources, vertexLayouts, rtFormats, ETexFormat::FT_None,
+            { GetCompactGBufferDefine(), SShaderDefine{ L"DENOISE_SH_L2", IsSHL2DirectionalityEnabled() ? L"1" : L"0" } } };
+        pGiBaker->m_pDenoisePSO = CGIBaker::GetDeviceCommand()->CreateRSPipelineState(rsPsoCreateDesc);
+
+        SDenoiseAndDilateParams denoiseAndDilateParams;
+        denoiseAndDilateParams.m_spatialBandWidth = 5.0f;
+        denoiseAndDilateParams.m_resultBandWidth = 0.2f;
+        denoiseAndDilateParams.m_normalBandWidth = 0.1f;
+        denoiseAndDilateParams.m_filterStrength = 10.0f;
+        denoiseAndDilateParams.m_inputTexSizeAndInvSize = Vec4(pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y, 1.0 / pGiBaker->m_nAtlasSize.x, 1.0 / pGiBaker->m_nAtlasSize.y);
+        pGiBaker->pDenoiseGlobalCB = CGIBaker::GetDeviceCommand()->CreateBuffer(&denoiseAndDilateParams, sizeof(SDenoiseAndDilateParams), sizeof(SDenoiseAndDilateParams), EBufferUsage::USAGE_CB);
+
+        if (!pGiBaker->m_bStreamingBake)
+        {
+            for (uint32_t index = 0; index < pGiBaker->m_atlas.size(); index++)
+            {
+                CreateAtlasDenoiseTextures(pGiBaker->m_atlas[index]);
+            }
+        }
+
+        Vec3 fullScreenPositionData[6] = { Vec3(1,-1,0),Vec3(-1,-1,0),Vec3(-1,1,0),Vec3(1,-1,0),Vec3(-1,1,0),Vec3(1,1,0) };
+        Vec2 fullScreenUVData[6] = { Vec2(1,1),Vec2(0,1),Vec2(0,0),Vec2(1,1),Vec2(0,0),Vec2(1,0), };
+        pGiBaker->pFullScreenVB = CGIBaker::GetDeviceCommand()->CreateBuffer(fullScreenPositionData, sizeof(Vec3) * 6, sizeof(Vec3), EBufferUsage::USAGE_VB);
+        pGiBaker->pFullScreenUV = CGIBaker::GetDeviceCommand()->CreateBuffer(fullScreenUVData, sizeof(Vec2) * 6, sizeof(Vec2), EBufferUsage::USAGE_VB);
+
+        CGIBaker::GetDeviceCommand()->CloseAndExecuteCmdList();
+        CGIBaker::GetDeviceCommand()->WaitGPUCmdListFinish();
+    }
+
+    static void ExecuteDenoiseLightMapPass(uint32_t beginAtlas, uint32_t endAtlas)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        CGIBaker::GetGraphicsContext()->BeginRenderPasss();
+        CGIBaker::GetGraphicsContext()->SetGraphicsPipelineState(pGiBaker->m_pDenoisePSO);
+
+        for (uint32_t atlasIndex = beginAtlas; atlasIndex < endAtlas; atlasIndex++)
+        {
+            SAtlas& altas = pGiBaker->m_atlas[atlasIndex];
+
+            std::vector<std::shared_ptr<CTexture2D>>renderTargets;
+            renderTargets.push_back(altas.m_irradianceAndSampleCountPingPongTex);
+            renderTargets.push_back(altas.m_shDirectionalityPingPongTex);
+            if (IsSHL2DirectionalityEnabled())
+            {
+                renderTargets.push_back(altas.m_shDirectionalityL2Part0PingPongTex);
+                renderTargets.push_back(altas.m_shDirectionalityL2Part1PingPongTex);
+            }
+
+            CGIBaker::GetGraphicsContext()->SetRenderTargets(renderTargets, nullptr);
+            CGIBaker::GetGraphicsContext()->SetViewport(pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y);
+            CGIBaker::GetGraphicsContext()->SetConstantBuffer(pGiBaker->pDenoiseGlobalCB, 0);
+
+            CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_irradianceAndSampleCount, 0);
+            CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_shDirectionality, 1);
+            CGIBaker::GetGraphicsContext()->SetShaderSRV(IsCompactGBufferEnabled() ? altas.m_hCompactGBufferTexture : altas.m_hNormalTexture, 2);
+            if (IsSHL2DirectionalityEnabled())
+            {
+                CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_shDirectionalityL2Part0, 3);
+                CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_shDirectionalityL2Part1, 4);
+            }
+            
+            std::vector<std::shared_ptr<CBuffer>>vertexBuffers;
+            vertexBuffers.push_back(pGiBaker->pFullScreenVB);
+            vertexBuffers.push_back(pGiBaker->pFullScreenUV);
+            CGIBaker::GetGraphicsContext()->SetVertexBuffers(vertexBuffers);
+            CGIBaker::GetGraphicsContext()->DrawInstanced(6, 1, 0, 0);
+        }
+
+        CGIBaker::GetGraphicsContext()->EndRenderPasss();
+    }
+
+    static void PrePareDilateLightMapPass()
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        CGIBaker::GetDeviceCommand()->OpenCmdList();
+
+        std::vector<SShader>rsShaders;
+        rsShaders.push_back(SShader{ ERayShaderType::RS_VS,L"DilateLightMapVS" });
+        rsShaders.push_back(SShader{ ERayShaderType::RS_PS,L"DilateeLightMapPS" });
+
+        SShaderResources rasterizationResources = { IsSHL2DirectionalityEnabled() ? 4u : 2u,0,1,0 };
+
+        std::vector<EVertexFormat>vertexLayouts;
+        vertexLayouts.push_back(EVertexFormat::FT_FLOAT3);
+        vertexLayouts.push_back(EVertexFormat::FT_FLOAT2);
+
+        std::vector<ETexFormat>rtFormats;
+        rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+        rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+        if (IsSHL2DirectionalityEnabled())
+        {
+            rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+            rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+        }
+
+        std::size_t dirPos = WstringConverter().from_bytes(__FILE__).find(L"hwrtl_gi.cpp");
+        std::wstring shaderPath = WstringConverter().from_bytes(__FILE__).substr(0, dirPos) + L"hwrtl_gi.hlsl";
+
+        bool bAmbientOcclusion = (pGiBaker->m_bakeConfig.m_bakeMode == EBakeMode::BM_AMBIENT_OCCLUSION);
+        SRasterizationPSOCreateDesc rsPsoCreateDesc = { shaderPath, rsShaders, rasterizationResources, vertexLayouts, rtFormats, ETexFormat::FT_None,
+            { SShaderDefine{ L"DILATE_AO", bAmbientOcclusion ? L"1" : L"0" }, SShaderDefine{ L"DILATE_SH_L2", IsSHL2DirectionalityEnabled() ? L"1" : L"0" } } };
+        pGiBaker->m_pDilatePSO = CGIBaker::GetDeviceCommand()->CreateRSPipelineState(rsPsoCreateDesc);
+
+        CGIBaker::GetDeviceCommand()->CloseAndExecuteCmdList();
+        CGIBaker::GetDeviceCommand()->WaitGPUCmdListFinish();
+    }
+
+    static void ExecuteDilateLightMapPass(uint32_t beginAtlas, uint32_t endAtlas)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        CGIBaker::GetGraphicsContext()->BeginRenderPasss();
+        CGIBaker::GetGraphicsContext()->SetGraphicsPipelineState(pGiBaker->m_pDilatePSO);
+
+        for (uint32_t atlasIndex = beginAtlas; atlasIndex < endAtlas; atlasIndex++)
+        {
+            SAtlas& altas = pGiBaker->m_atlas[atlasIndex];
+
+            std::vector<std::shared_ptr<CTexture2D>>renderTargets;
+            renderTargets.push_back(altas.m_irradianceAndSampleCount);
+            renderTargets.push_back(altas.m_shDirectionality);
+            if (IsSHL2DirectionalityEnabled())
+            {
+                renderTargets.push_back(altas.m_shDirectionalityL2Part0);
+                renderTargets.push_back(altas.m_shDirectionalityL2Part1);
+            }
+
+            CGIBaker::GetGraphicsContext()->SetRenderTargets(renderTargets, nullptr);
+            CGIBaker::GetGraphicsContext()->SetViewport(pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y);
+            CGIBaker::GetGraphicsContext()->SetConstantBuffer(pGiBaker->pDenoiseGlobalCB, 0);
+
+            CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_irradianceAndSampleCountPingPongTex, 0);
+            CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_shDirectionalityPingPongTex, 1);
+            if (IsSHL2DirectionalityEnabled())
+            {
+                CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_shDirectionalityL2Part0PingPongTex, 2);
+                CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_shDirectionalityL2Part1PingPongTex, 3);
+            }
+
+            std::vector<std::shared_ptr<CBuffer>>vertexBuffers;
+            vertexBuffers.push_back(pGiBaker->pFullScreenVB);
+            vertexBuffers.push_back(pGiBaker->pFullScreenUV);
+            CGIBaker::GetGraphicsContext()->SetVertexBuffers(vertexBuffers);
+            CGIBaker::GetGraphicsContext()->DrawInstanced(6, 1, 0, 0);
+        }
+
+        CGIBaker::GetGraphicsContext()->EndRenderPasss();
+    }
+
+    void hwrtl::gi::DenoiseAndDilateLightMap()
+    {
+        uint32_t atlasNum = uint32_t(pGiBaker->m_atlas.size());
+        PrePareDenoiseLightMapPass();
+        ExecuteDenoiseLightMapPass(0, atlasNum);
+        PrePareDilateLightMapPass();
+        ExecuteDilateLightMapPass(0, atlasNum);
+    }
+
+    static void PrePareEncodeLightMapPass()
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        CGIBaker::GetDeviceCommand()->OpenCmdList();
+
+        std::vector<SShader>rsShaders;
+        bool bAmbientOcclusion = (pGiBaker->m_bakeConfig.m_bakeMode == EBakeMode::BM_AMBIENT_OCCLUSION);
+        rsShaders.push_back(SShader{ ERayShaderType::RS_VS,L"EncodeLightMapVS" });
+        rsShaders.push_back(SShader{ ERayShaderType::RS_PS,bAmbientOcclusion ? L"EncodeAOLightMapPS" : L"EncodeLightMapPS" });
+
+        SShaderResources rasterizationResources = { 2,0,1,0 };
+
+        std::vector<EVertexFormat>vertexLayouts;
+        vertexLayouts.push_back(EVertexFormat::FT_FLOAT3);
+        vertexLayouts.push_back(EVertexFormat::FT_FLOAT2);
+
+        std::vector<ETexFormat>rtFormats;
+        rtFormats.push_back(ETexFormat::FT_RGBA8_UNORM);
+        rtFormats.push_back(ETexFormat::FT_RGBA8_UNORM);
+
+        std::size_t dirPos = WstringConverter().from_bytes(__FILE__).find(L"hwrtl_gi.cpp");
+        std::wstring shaderPath = WstringConverter().from_bytes(__FILE__).substr(0, dirPos) + L"hwrtl_gi.hlsl";
+
+        SRasterizationPSOCreateDesc rsPsoCreateDesc = { shaderPath, rsShaders, rasterizationResources, vertexLayouts, rtFormats, ETexFormat::FT_None };
+        pGiBaker->m_pEncodeLightMapPSO = CGIBaker::GetDeviceCommand()->CreateRSPipelineState(rsPsoCreateDesc);
+
+        if (!pGiBaker->m_bStreamingBake)
+        {
+            for (uint32_t index = 0; index < pGiBaker->m_atlas.size(); index++)
+            {
+                CreateAtlasEncodeTextures(pGiBaker->m_atlas[index]);
+            }
+        }
+
+        CGIBaker::GetDeviceCommand()->CloseAndExecuteCmdList();
+        CGIBaker::GetDeviceCommand()->WaitGPUCmdListFinish();
+    }
+
+    static void ExecuteEncodeLightMapPass(uint32_t beginAtlas, uint32_t endAtlas)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        CGIBaker::GetGraphicsContext()->BeginRenderPasss();
+        CGIBaker::GetGraphicsContext()->SetGraphicsPipelineState(pGiBaker->m_pEncodeLightMapPSO);
+
+        for (uint32_t atlasIndex = beginAtlas; atlasIndex < endAtlas; atlasIndex++)
+        {
+            SAtlas& altas = pGiBaker->m_atlas[atlasIndex];
+
+            std::vector<std::shared_ptr<CTexture2D>>renderTargets;
+            renderTargets.push_back(altas.m_irradianceAndSampleCountEncoded);
+            renderTargets.push_back(altas.m_shDirectionalityEncoded);
+
+            CGIBaker::GetGraphicsContext()->SetRenderTargets(renderTargets, nullptr);
+            CGIBaker::GetGraphicsContext()->SetViewport(pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y);
+            CGIBaker::GetGraphicsContext()->SetConstantBuffer(pGiBaker->pDenoiseGlobalCB, 0);
+
+            CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_irradianceAndSampleCount, 0);
+            CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_shDirectionality, 1);
+
+            std::vector<std::shared_ptr<CBuffer>>vertexBuffers;
+            vertexBuffers.push_back(pGiBaker->pFullScreenVB);
+            vertexBuffers.push_back(pGiBaker->pFullScreenUV);
+            CGIBaker::GetGraphicsContext()->SetVertexBuffers(vertexBuffers);
+            CGIBaker::GetGraphicsContext()->DrawInstanced(6, 1, 0, 0);
+        }
+
+        CGIBaker::GetGraphicsContext()->EndRenderPasss();
+    }
+
+    void hwrtl::gi::EncodeResulttLightMap()
+    {
+        PrePareEncodeLightMapPass();
+        ExecuteEncodeLightMapPass(0, uint32_t(pGiBaker->m_atlas.size()));
+    }
+
+    static uint8_t QuantizeSHRatio(float ratio)
+    {
+        float unorm = std::min(std::max(ratio * 0.5f + 0.5f, 0.0f), 1.0f);
+        return uint8_t(unorm * 255.0f + 0.5f);
+    }
+
+    // the sh coefficients are processed 4 at a time, coefficient 0 - 3 come from the (denoised and dilated) l1 directionality,
+    // coefficient 4 - 8 are not denoised but dilated from the same texels as the l1 directionality, texels without directionality are stored as zero like the other atlases
+    static void PackSHL2Directionality(const Vec4* shL1, const Vec4* shL2Part0, const Vec4* shL2Part1, uint32_t texelNum, uint8_t* outData0, uint8_t* outData1)
+    {
+        const Vec4 invRange0(1.0f / SHL2PackRange[1], 1.0f / SHL2PackRange[2], 1.0f / SHL2PackRange[3], 1.0f / SHL2PackRange[4]);
+        const Vec4 invRange1(1.0f / SHL2PackRange[5], 1.0f / SHL2PackRange[6], 1.0f / SHL2PackRange[7], 1.0f / SHL2PackRange[8]);
+
+        ParallelFor(texelNum, [&](uint32_t texelIndex)
+        {
+            const Vec4& l1 = shL1[texelIndex];
+            uint8_t* dest0 = outData0 + texelIndex * 4;
+            uint8_t* dest1 = outData1 + texelIndex * 4;
+
+            if (l1.x <= 0.0f)
+            {
+                memset(dest0, 0, 4);
+                memset(dest1, 0, 4);
+                return;
+            }
+
+            float invDC = 1.0f / l1.x;
+            Vec4 ratio0 = Vec4(l1.y, l1.z, l1.w, shL2Part0[texelIndex].x) * invDC * invRange0;
+            Vec4 ratio1 = Vec4(shL2Part0[texelIndex].y, shL2Part0[texelIndex].z, shL2Part0[texelIndex].w, shL2Part1[texelIndex].x) * invDC * invRange1;
+            for (uint32_t index = 0; index < 4; index++)
+            {
+                dest0[index] = QuantizeSHRatio(ratio0[index]);
+                dest1[index] = QuantizeSHRatio(ratio1[index]);
+            }
+        });
+    }
+
+    // the readback data of the atlas is owned by the baker until FreeLightMapCpuData
+    static void ReadBackEncodedAtlas(uint32_t atlasIndex, SOutputAtlasInfo& outAtlasInfo)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        uint32_t imageSize = pGiBaker->m_nAtlasSize.x * pGiBaker->m_nAtlasSize.y * sizeof(uint8_t) * 4;
+        SAtlas& altas = pGiBaker->m_atlas[atlasIndex];
+        pGiBaker->m_irradianceReadBackData[atlasIndex] = malloc(imageSize);
+        pGiBaker->m_directionalityReadBackData[atlasIndex] = malloc(imageSize);
+
+        void* lockedIrradianceData = CGIBaker::GetDeviceCommand()->LockTextureForRead(altas.m_irradianceAndSampleCountEncoded);
+        void* lockedDirectionalityData = CGIBaker::GetDeviceCommand()->LockTextureForRead(altas.m_shDirectionalityEncoded);
+
+        memcpy(pGiBaker->m_irradianceReadBackData[atlasIndex], lockedIrradianceData, imageSize);
+        memcpy(pGiBaker->m_directionalityReadBackData[atlasIndex], lockedDirectionalityData, imageSize);
+
+        CGIBaker::GetDeviceCommand()->UnLockTexture(altas.m_irradianceAndSampleCountEncoded);
+        CGIBaker::GetDeviceCommand()->UnLockTexture(altas.m_shDirectionalityEncoded);
+
+        // gbuffer normal w and the compact gbuffer instance index are non zero for the texels rasterized by a mesh
+        outAtlasInfo.m_coverage.resize(pGiBaker->m_nAtlasSize.x * pGiBaker->m_nAtlasSize.y);
+        if (IsCompactGBufferEnabled())
+        {
+            const SCompactGBufferTexel* lockedGBufferData = (const SCompactGBufferTexel*)CGIBaker::GetDeviceCommand()->LockTextureForRead(altas.m_hCompactGBufferTexture);
+            for (uint32_t texelIndex = 0; texelIndex < outAtlasInfo.m_coverage.size(); texelIndex++)
+            {
+                outAtlasInfo.m_coverage[texelIndex] = lockedGBufferData[texelIndex].m_instanceIndexPlusOne != 0 ? 1 : 0;
+            }
+            CGIBaker::GetDeviceCommand()->UnLockTexture(altas.m_hCompactGBufferTexture);
+        }
+        else
+        {
+            const Vec4* lockedNormalData = (const Vec4*)CGIBaker::GetDeviceCommand()->LockTextureForRead(altas.m_hNormalTexture);
+            for (uint32_t texelIndex = 0; texelIndex < outAtlasInfo.m_coverage.size(); texelIndex++)
+            {
+                outAtlasInfo.m_coverage[texelIndex] = lockedNormalData[texelIndex].w > 0.0f ? 1 : 0;
+            }
+            CGIBaker::GetDeviceCommand()->UnLockTexture(altas.m_hNormalTexture);
+        }
+
+        if (IsSHL2DirectionalityEnabled())
+        {
+            uint32_t texelNum = pGiBaker->m_nAtlasSize.x * pGiBaker->m_nAtlasSize.y;
+            outAtlasInfo.m_shL2DirectionalityData[0].resize(texelNum * 4);
+            outAtlasInfo.m_shL2DirectionalityData[1].resize(texelNum * 4);
+
+            const Vec4* lockedSHL1Data = (const Vec4*)CGIBaker::GetDeviceCommand()->LockTextureForRead(altas.m_shDirectionality);
+            const Vec4* lockedSHL2Part0Data = (const Vec4*)CGIBaker::GetDeviceCommand()->LockTextureForRead(altas.m_shDirectionalityL2Part0);
+            const Vec4* lockedSHL2Part1Data = (const Vec4*)CGIBaker::GetDeviceCommand()->LockTextureForRead(altas.m_shDirectionalityL2Part1);
+            PackSHL2Directionality(lockedSHL1Data, lockedSHL2Part0Data, lockedSHL2Part1Data, texelNum, 
+                outAtlasInfo.m_shL2DirectionalityData[0].data(), outAtlasInfo.m_shL2DirectionalityData[1].data());
+            CGIBaker::GetDeviceCommand()->UnLockTexture(altas.m_shDirectionality);
+            CGIBaker::GetDeviceCommand()->UnLockTexture(altas.m_shDirectionalityL2Part0);
+            CGIBaker::GetDeviceCommand()->UnLockTexture(altas.m_shDirectionalityL2Part1);
+        }
+
+        if (pGiBaker->m_bakeConfig.m_bTraversalCostOutput)
+        {
+            std::vector<Vec2>& traversalCost = outAtlasInfo.m_traversalCost;
+            traversalCost.resize(pGiBaker->m_nAtlasSize.x * pGiBaker->m_nAtlasSize.y);
+
+            const Vec4* lockedCostData = (const Vec4*)CGIBaker::GetDeviceCommand()->LockTextureForRead(altas.m_traversalCost);
+            for (uint32_t texelIndex = 0; texelIndex < traversalCost.size(); texelIndex++)
+            {
+                const Vec4& texelCost = lockedCostData[texelIndex];
+                traversalCost[texelIndex] = texelCost.w > 0.0f ? Vec2(texelCost.x / texelCost.w, texelCost.y / texelCost.w) : Vec2(0.0f, 0.0f);
+            }
+            CGIBaker::GetDeviceCommand()->UnLockTexture(altas.m_traversalCost);
+        }
+
+        outAtlasInfo.destIrradianceOutputData= pGiBaker->m_irradianceReadBackData[atlasIndex];
+        outAtlasInfo.destDirectionalityOutputData = pGiBaker->m_directionalityReadBackData[atlasIndex];
+        outAtlasInfo.m_lightMapByteSize = imageSize;
+        outAtlasInfo.m_pixelStride = sizeof(uint8_t) * 4;
+        outAtlasInfo.m_lightMapSize = pGiBaker->m_nAtlasSize;
+        outAtlasInfo.m_bakeMode = pGiBaker->m_bakeConfig.m_bakeMode;
+        outAtlasInfo.m_orginalMeshIndex.resize(altas.m_atlasGeometries.size());
+        outAtlasInfo.m_lightMapScaleAndBias.resize(altas.m_atlasGeometries.size());
+        for (uint32_t geoIndex = 0; geoIndex < altas.m_atlasGeometries.size(); geoIndex++)
+        {
+            SGIMesh& giMesh = altas.m_atlasGeometries[geoIndex];
+            outAtlasInfo.m_orginalMeshIndex[geoIndex] = giMesh.m_meshIndex;
+            outAtlasInfo.m_lightMapScaleAndBias[geoIndex] = giMesh.m_lightMapScaleAndBias;
+        }
+    }
+
+    void hwrtl::gi::GetEncodedLightMapTexture(std::vector<SOutputAtlasInfo>& outputAtlas)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        outputAtlas.resize(pGiBaker->m_atlas.size());
+        pGiBaker->m_irradianceReadBackData.resize(pGiBaker->m_atlas.size());
+        pGiBaker->m_directionalityReadBackData.resize(pGiBaker->m_atlas.size());
+
+        for (uint32_t atlasIndex = 0; atlasIndex < pGiBaker->m_atlas.size(); atlasIndex++)
+        {
+            ReadBackEncodedAtlas(atlasIndex, outputAtlas[atlasIndex]);
+        }
+    }
+
+    void hwrtl::gi::BakeLightMapStreaming(std::vector<SOutputAtlasInfo>& outputAtlas, uint32_t atlasWindowSize)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        assert(atlasWindowSize > 0);
+        pGiBaker->m_bStreamingBake = true;
+
+        // pipeline states and scene wide buffers only, the atlas textures are created per window below
+        PrePareLightMapGBufferPass();
+        PrePareLightMapRayTracingPass();
+        PrePareDenoiseLightMapPass();
+        PrePareDilateLightMapPass();
+        PrePareEncodeLightMapPass();
+
+        uint32_t atlasNum = uint32_t(pGiBaker->m_atlas.size());
+        outputAtlas.resize(atlasNum);
+        pGiBaker->m_irradianceReadBackData.resize(atlasNum);
+        pGiBaker->m_directionalityReadBackData.resize(atlasNum);
+        pGiBaker->m_rayTracingPassSeconds = 0.0;
+
+        for (uint32_t beginAtlas = 0; beginAtlas < atlasNum; beginAtlas += atlasWindowSize)
+        {
+            uint32_t endAtlas = std::min(beginAtlas + atlasWindowSize, atlasNum);
+
+            for (uint32_t atlasIndex = beginAtlas; atlasIndex < endAtlas; atlasIndex++)
+            {
+                CreateAtlasGBufferTextures(pGiBaker->m_atlas[atlasIndex]);
+            }
+            ExecuteGBufferPassForAtlases(beginAtlas, endAtlas);
+            pGiBaker->m_rayTracingPassSeconds += ExecuteRayTracingPassForAtlases(beginAtlas, endAtlas);
+
+            for (uint32_t atlasIndex = beginAtlas; atlasIndex < endAtlas; atlasIndex++)
+            {
+                CreateAtlasDenoiseTextures(pGiBaker->m_atlas[atlasIndex]);
+            }
+            ExecuteDenoiseLightMapPass(beginAtlas, endAtlas);
+            ExecuteDilateLightMapPass(beginAtlas, endAtlas);
+
+            // the ping pong textures are dead after the dilate pass, release them before the encoded textures are created
+            for (uint32_t atlasIndex = beginAtlas; atlasIndex < endAtlas; atlasIndex++)
+            {
+                SAtlas& atlas = pGiBaker->m_atlas[atlasIndex];
+                atlas.m_irradianceAndSampleCountPingPongTex = nullptr;
+                atlas.m_shDirectionalityPingPongTex = nullptr;
+                atlas.m_shDirectionalityL2Part0PingPongTex = nullptr;
+                atlas.m_shDirectionalityL2Part1PingPongTex = nullptr;
+                CreateAtlasEncodeTextures(atlas);
+            }
+            ExecuteEncodeLightMapPass(beginAtlas, endAtlas);
+
+            for (uint32_t atlasIndex = beginAtlas; atlasIndex < endAtlas; atlasIndex++)
+            {
+                ReadBackEncodedAtlas(atlasIndex, outputAtlas[atlasIndex]);
+                ReleaseAtlasTextures(pGiBaker->m_atlas[atlasIndex]);
+            }
+        }
+    }
+
+    void hwrtl::gi::FreeLightMapCpuData()
+    {
+        for (uint32_t atlasIndex = 0; atlasIndex < pGiBaker->m_atlas.size(); atlasIndex++)
+        {
+            free(pGiBaker->m_irradianceReadBackData[atlasIndex]);
+            free(pGiBaker->m_directionalityReadBackData[atlasIndex]);
+        }
+    }
+
+    void hwrtl::gi::PrePareVisualizeResultPass()
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        assert(!pGiBaker->m_bStreamingBake); // the encoded textures are released by BakeLightMapStreaming
+
+        CGIBaker::GetDeviceCommand()->OpenCmdList();
+
+        {
+            Vec2i visualTex(1024, 1024);
+            Vec3 eyePosition = Vec3(0, -12, 6);
+            Vec3 eyeDirection = Vec3(0, 1, 0); // focus - eyePos
+            Vec3 upDirection = Vec3(0, 0, 1);
+
+            struct SViewCB
+            {
+                Matrix44 vpMat;
+                float padding[48];
+            }viewCB;
+            static_assert(sizeof(SViewCB) == 256, "sizeof(SViewCB) == 256");
+
+            float fovAngleY = 90;
+            float aspectRatio = float(visualTex.y) / float(visualTex.x);
+            viewCB.vpMat = GetViewProjectionMatrixRightHand(eyePosition, eyeDirection, upDirection, fovAngleY, aspectRatio, 0.1, 100.0).GetTrasnpose();
+            pGiBaker->pVisualizeViewCB = CGIBaker::GetDeviceCommand()->CreateBuffer(&viewCB, sizeof(SViewCB), sizeof(SViewCB), EBufferUsage::USAGE_CB);
+        }
+
+        std::size_t dirPos = WstringConverter().from_bytes(__FILE__).find(L"hwrtl_gi.cpp");
+        std::wstring shaderPath = WstringConverter().from_bytes(__FILE__).substr(0, dirPos) + L"hwrtl_gi.hlsl";
+
+        std::vector<SShader>rsShaders;
+        rsShaders.push_back(SShader{ ERayShaderType::RS_VS,L"VisualizeGIResultVS" });
+        rsShaders.push_back(SShader{ ERayShaderType::RS_PS,L"VisualizeGIResultPS" });
+
+        SShaderResources rasterizationResources = { 2,0,2,0 };
+
+        std::vector<EVertexFormat>vertexLayouts;
+        vertexLayouts.push_back(EVertexFormat::FT_FLOAT3);
+        vertexLayouts.push_back(EVertexFormat::FT_FLOAT2);
+        vertexLayouts.push_back(EVertexFormat::FT_FLOAT3);
+
+        std::vector<ETexFormat>rtFormats;
+        rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+
+        SRasterizationPSOCreateDesc rsPsoCreateDesc = { shaderPath, rsShaders, rasterizationResources, vertexLayouts, rtFormats, ETexFormat::FT_DepthStencil };
+        pGiBaker->m_pVisualizeGIPSO = CGIBaker::GetDeviceCommand()->CreateRSPipelineState(rsPsoCreateDesc);
+
+        CGIBaker::GetDeviceCommand()->CloseAndExecuteCmdList();
+        CGIBaker::GetDeviceCommand()->WaitGPUCmdListFinish();
+    }
+
+    void hwrtl::gi::ExecuteVisualizeResultPass()
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        Vec2i visualTex(1024,1024);
+        STextureCreateDesc texCreateDesc{ ETexUsage::USAGE_RTV,ETexFormat::FT_RGBA32_FLOAT,visualTex.x,visualTex.y };
+        STextureCreateDesc dsCreateDesc{ ETexUsage::USAGE_DSV,ETexFormat::FT_DepthStencil,visualTex.x,visualTex.y };
+        std::shared_ptr<CTexture2D> renderTarget = CGIBaker::GetDeviceCommand()->CreateTexture2D(texCreateDesc);
+        std::shared_ptr<CTexture2D> dsTarget = CGIBaker::GetDeviceCommand()->CreateTexture2D(dsCreateDesc);
+ 
+        CGIBaker::GetGraphicsContext()->BeginRenderPasss();
+        CGIBaker::GetGraphicsContext()->SetGraphicsPipelineState(pGiBaker->m_pVisualizeGIPSO);
+
+        std::vector<std::shared_ptr<CTexture2D>>renderTargets;
+        renderTargets.push_back(renderTarget);
+        CGIBaker::GetGraphicsContext()->SetRenderTargets(renderTargets, dsTarget);
+        CGIBaker::GetGraphicsContext()->SetViewport(visualTex.x, visualTex.y);
+        CGIBaker::GetGraphicsContext()->SetConstantBuffer(pGiBaker->pVisualizeViewCB,1);
+
+        for (uint32_t index = 0; index < pGiBaker->m_atlas.size(); index++)
+        {
+            SAtlas& atlas = pGiBaker->m_atlas[index];
+            CGIBaker::GetGraphicsContext()->SetShaderSRV(atlas.m_irradianceAndSampleCountEncoded, 0);
+            CGIBaker::GetGraphicsContext()->SetShaderSRV(atlas.m_shDirectionalityEncoded, 1);
+            for (uint32_t geoIndex = 0; geoIndex < atlas.m_atlasGeometries.size(); geoIndex++)
+            {
+                SGIMesh& giMesh = atlas.m_atlasGeometries[geoIndex];
+                CGIBaker::GetGraphicsContext()->SetConstantBuffer(giMesh.m_hConstantBuffer, 0);
+                std::vector<std::shared_ptr<CBuffer>>vertexBuffers;
+                vertexBuffers.push_back(giMesh.m_positionVB);
+                vertexBuffers.push_back(giMesh.m_lightMapUVVB);
+                vertexBuffers.push_back(giMesh.m_normalVB);
+                CGIBaker::GetGraphicsContext()->SetVertexBuffers(vertexBuffers);
+                CGIBaker::GetGraphicsContext()->DrawInstanced(giMesh.m_nVertexCount, 1, 0, 0);
+            }
+        }
+        CGIBaker::GetGraphicsContext()->EndRenderPasss();
+    }
 
-        pGiBaker->pRtSceneGlobalCB = CGIBaker::GetDeviceCommand()->CreateBuffer(&rtGloablCB, sizeof(SRtGlobalConstantBuffer), sizeof(SRtGlobalConstantBuffer), EBufferUsage::USAGE_CB);
+	void hwrtl::gi::DeleteGIBaker()
+	{
+		delete pGiBaker;
+        Shutdown();
+	}
 
-        std::vector<SShader>rtShaders;
-        rtShaders.push_back(SShader{ ERayShaderType::RAY_RGS,L"LightMapRayTracingRayGen" });
-        rtShaders.push_back(SShader{ ERayShaderType::RAY_CHS,L"MaterialClosestHitMain" });
-        rtShaders.push_back(SShader{ ERayShaderType::RAY_CHS,L"ShadowClosestHitMain" });
-        rtShaders.push_back(SShader{ ERayShaderType::RAY_MIH,L"RayMiassMain" });
+    /***************************************************************************
+    * LightMap Mip Generation
+    * 
+    * every texel has a chart index (the mesh rectangle it belongs to, -1 for the atlas padding) and a coverage weight
+    * a child texel takes the chart with the largest coverage among its 2x2 parents and only filters the parents of that chart,
+    * so the gutter texels don't bleed into the coarser mips and the charts never bleed into each other
+    ***************************************************************************/
 
-        std::size_t dirPos = WstringConverter().from_bytes(__FILE__).find(L"hwrtl_gi.cpp");
-        std::wstring shaderPath = WstringConverter().from_bytes(__FILE__).substr(0, dirPos) + L"hwrtl_gi.hlsl";
+    struct SLightMapMipCoverage
+    {
+        uint32_t m_width;
+        uint32_t m_height;
+        std::vector<int> m_chartIndex;
+        std::vector<float> m_coverage;
+    };
 
-        SShaderDefine shaderDefines;
-        shaderDefines.m_defineName = std::wstring(L"RT_DEBUG_OUTPUT");
-        if (pGiBaker->m_bakeConfig.m_bDebugRayTracing)
+    static void GenerateChartCoverage(const SOutputAtlasInfo& atlasInfo, SLightMapMipCoverage& outCoverage)
+    {
+        outCoverage.m_width = atlasInfo.m_lightMapSize.x;
+        outCoverage.m_height = atlasInfo.m_lightMapSize.y;
+        outCoverage.m_chartIndex.assign(outCoverage.m_width * outCoverage.m_height, -1);
+        outCoverage.m_coverage.resize(outCoverage.m_width * outCoverage.m_height);
+
+        for (uint32_t geoIndex = 0; geoIndex < atlasInfo.m_lightMapScaleAndBias.size(); geoIndex++)
         {
-            shaderDefines.m_defineValue = std::wstring(L"1");
+            const Vec4& scaleAndBias = atlasInfo.m_lightMapScaleAndBias[geoIndex];
+            uint32_t beginX = uint32_t(scaleAndBias.z * outCoverage.m_width + 0.5f);
+            uint32_t beginY = uint32_t(scaleAndBias.w * outCoverage.m_height + 0.5f);
+            uint32_t endX = std::min(beginX + uint32_t(scaleAndBias.x * outCoverage.m_width + 0.5f), outCoverage.m_width);
+            uint32_t endY = std::min(beginY + uint32_t(scaleAndBias.y * outCoverage.m_height + 0.5f), outCoverage.m_height);
+
+            for (uint32_t y = beginY; y < endY; y++)
+            {
+                for (uint32_t x = beginX; x < endX; x++)
+                {
+                    outCoverage.m_chartIndex[y * outCoverage.m_width + x] = geoIndex;
+                }
+            }
         }
-        else
+
+        for (uint32_t texelIndex = 0; texelIndex < outCoverage.m_coverage.size(); texelIndex++)
         {
-            shaderDefines.m_defineValue = std::wstring(L"0");
+            bool bCovered = atlasInfo.m_coverage.size() > 0 ? (atlasInfo.m_coverage[texelIndex] != 0) : (outCoverage.m_chartIndex[texelIndex] >= 0);
+            outCoverage.m_coverage[texelIndex] = bCovered ? 1.0f : 0.0f;
         }
-        
-        SRayTracingPSOCreateDesc rtPsoCreateDesc = { shaderPath, rtShaders, 1, SShaderResources{ 5,2,1,0 ,1,false,true} ,&shaderDefines,1 };
-        pGiBaker->m_pRayTracingPSO = CGIBaker::GetDeviceCommand()->CreateRTPipelineStateAndShaderTable(rtPsoCreateDesc);
-
-        CGIBaker::GetDeviceCommand()->CloseAndExecuteCmdList();
-        CGIBaker::GetDeviceCommand()->WaitGPUCmdListFinish();
     }
 
-    void hwrtl::gi::ExecuteLightMapRayTracingPass()
+    void hwrtl::gi::GetMostExpensiveMeshes(const std::vector<SOutputAtlasInfo>& outputAtlas, uint32_t topN, std::vector<SMeshTraversalCost>& outMeshCosts)
     {
-        CGIBaker::GetRayTracingContext()->BeginRayTacingPasss();
-        CGIBaker::GetRayTracingContext()->SetRayTracingPipelineState(pGiBaker->m_pRayTracingPSO);
-        
-        for (uint32_t index = 0; index < pGiBaker->m_atlas.size(); index++)
+        outMeshCosts.clear();
+        for (uint32_t atlasIndex = 0; atlasIndex < outputAtlas.size(); atlasIndex++)
         {
-            SAtlas& atlas = pGiBaker->m_atlas[index];
+            const SOutputAtlasInfo& atlasInfo = outputAtlas[atlasIndex];
+            assert(atlasInfo.m_traversalCost.size() > 0 && "SBakeConfig::m_bTraversalCostOutput must be enabled");
 
-            CGIBaker::GetRayTracingContext()->SetConstantBuffer(pGiBaker->pRtSceneGlobalCB,0);
-            CGIBaker::GetRayTracingContext()->SetShaderUAV(atlas.m_irradianceAndSampleCount, 0);
-            CGIBaker::GetRayTracingContext()->SetShaderUAV(atlas.m_shDirectionality, 1);
-            CGIBaker::GetRayTracingContext()->SetTLAS(pGiBaker->m_pTLAS,0);
-            CGIBaker::GetRayTracingContext()->SetShaderSRV(atlas.m_hPosTexture, 1);
-            CGIBaker::GetRayTracingContext()->SetShaderSRV(atlas.m_hNormalTexture, 2);
-            CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->pRtSceneLight, 3);
-            CGIBaker::GetRayTracingContext()->SetShaderSRV(pGiBaker->m_instanceGpuData, 4);
-            for (uint32_t sampleIndex = 0; sampleIndex <= pGiBaker->m_bakeConfig.m_bakerSamples; sampleIndex++)
+            SLightMapMipCoverage chartCoverage;
+            GenerateChartCoverage(atlasInfo, chartCoverage);
+
+            uint32_t firstMeshCost = outMeshCosts.size();
+            for (uint32_t geoIndex = 0; geoIndex < atlasInfo.m_orginalMeshIndex.size(); geoIndex++)
             {
-                SRtRenderPassInfo rtRpInfo;
-                rtRpInfo.m_rpIndex = sampleIndex;
-                CGIBaker::GetRayTracingContext()->SetRootConstants(0, sizeof(SRtRenderPassInfo) / sizeof(uint32_t), &rtRpInfo, 0);
-                CGIBaker::GetRayTracingContext()->DispatchRayTracicing(pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y);
+                outMeshCosts.push_back(SMeshTraversalCost{ atlasInfo.m_orginalMeshIndex[geoIndex], 0, 0.0 });
+            }
+
+            for (uint32_t texelIndex = 0; texelIndex < chartCoverage.m_chartIndex.size(); texelIndex++)
+            {
+                int chartIndex = chartCoverage.m_chartIndex[texelIndex];
+                if (chartIndex >= 0 && chartCoverage.m_coverage[texelIndex] > 0.0f)
+                {
+                    SMeshTraversalCost& meshCost = outMeshCosts[firstMeshCost + chartIndex];
+                    meshCost.m_texelNum++;
+                    meshCost.m_totalCost += atlasInfo.m_traversalCost[texelIndex].x;
+                }
             }
         }
-        CGIBaker::GetRayTracingContext()->EndRayTacingPasss();
+
+        std::sort(outMeshCosts.begin(), outMeshCosts.end(), [](const SMeshTraversalCost& a, const SMeshTraversalCost& b) { return a.m_totalCost > b.m_totalCost; });
+        if (outMeshCosts.size() > topN)
+        {
+            outMeshCosts.resize(topN);
+        }
     }
 
-    struct SDenoiseAndDilateParams
+    static void GenerateCoverageAwareMip(
+        const SLightMapMipCoverage& parentCoverage, const uint8_t* pParentIrradiance, const uint8_t* pParentDirectionality, uint32_t pixelStride, EBakeMode bakeMode,
+        SLightMapMipCoverage& outChildCoverage, SOutputMipInfo& outChildMip)
     {
-        float m_spatialBandWidth;
-        float m_resultBandWidth;
-        float m_normalBandWidth;
-        float m_filterStrength;
+        const uint32_t childWidth = std::max(parentCoverage.m_width / 2, 1u);
+        const uint32_t childHeight = std::max(parentCoverage.m_height / 2, 1u);
 
-        Vec4 m_inputTexSizeAndInvSize;
+        outChildCoverage.m_width = childWidth;
+        outChildCoverage.m_height = childHeight;
+        outChildCoverage.m_chartIndex.resize(childWidth * childHeight);
+        outChildCoverage.m_coverage.resize(childWidth * childHeight);
 
-        float padding[56];
+        outChildMip.m_mipSize = Vec2i(childWidth, childHeight);
+        outChildMip.m_irradianceData.resize(childWidth * childHeight * pixelStride);
+        outChildMip.m_directionalityData.resize(childWidth * childHeight * pixelStride);
+
+        ParallelFor(childHeight, [&](uint32_t y)
+        {
+            for (uint32_t x = 0; x < childWidth; x++)
+            {
+                uint32_t parentIndices[4];
+                for (uint32_t subIndex = 0; subIndex < 4; subIndex++)
+                {
+                    uint32_t parentX = std::min(x * 2 + (subIndex & 1), parentCoverage.m_width - 1);
+                    uint32_t parentY = std::min(y * 2 + (subIndex >> 1), parentCoverage.m_height - 1);
+                    parentIndices[subIndex] = parentY * parentCoverage.m_width + parentX;
+                }
+
+                // dominant chart
+                int chartIndex = -1;
+                float chartWeight = -1.0f;
+                for (uint32_t subIndex = 0; subIndex < 4; subIndex++)
+                {
+                    int candidateChart = parentCoverage.m_chartIndex[parentIndices[subIndex]];
+                    float candidateWeight = 0.0f;
+                    for (uint32_t otherIndex = 0; otherIndex < 4; otherIndex++)
+                    {
+                        if (parentCoverage.m_chartIndex[parentIndices[otherIndex]] == candidateChart)
+                        {
+                            candidateWeight += parentCoverage.m_coverage[parentIndices[otherIndex]];
+                        }
+                    }
+
+                    // prefer a mesh chart over the atlas padding when neither of them is covered
+                    bool bBetter = candidateWeight > chartWeight || (candidateWeight == chartWeight && chartIndex < 0 && candidateChart >= 0);
+                    if (bBetter)
+                    {
+                        chartIndex = candidateChart;
+                        chartWeight = candidateWeight;
+                    }
+                }
+
+                // pure gutter texels fall back to an unweighted average so that the dilated border is kept for bilinear filtering
+                float weights[4];
+                float totalWeight = 0.0f;
+                for (uint32_t subIndex = 0; subIndex < 4; subIndex++)
+                {
+                    bool bSameChart = parentCoverage.m_chartIndex[parentIndices[subIndex]] == chartIndex;
+                    weights[subIndex] = bSameChart ? (chartWeight > 0.0f ? parentCoverage.m_coverage[parentIndices[subIndex]] : 1.0f) : 0.0f;
+                    totalWeight += weights[subIndex];
+                }
+
+                const uint32_t childIndex = y * childWidth + x;
+                outChildCoverage.m_chartIndex[childIndex] = chartIndex;
+                outChildCoverage.m_coverage[childIndex] = std::max(chartWeight, 0.0f) * 0.25f;
+
+                for (uint32_t channel = 0; channel < pixelStride; channel++)
+                {
+                    // irradiance rgb is stored as sqrt(irradiance), filter it in linear space, ambient occlusion is stored linearly
+                    bool bSqrtEncoded = channel < 3 && bakeMode == EBakeMode::BM_LIGHTING;
+
+                    float irradianceSum = 0.0f;
+                    float directionalitySum = 0.0f;
+                    for (uint32_t subIndex = 0; subIndex < 4; subIndex++)
+                    {
+                        float irradiance = pParentIrradiance[parentIndices[subIndex] * pixelStride + channel] / 255.0f;
+                        float directionality = pParentDirectionality[parentIndices[subIndex] * pixelStride + channel] / 255.0f;
+                        irradianceSum += weights[subIndex] * (bSqrtEncoded ? irradiance * irradiance : irradiance);
+                        directionalitySum += weights[subIndex] * directionality;
+                    }
+
+                    float irradiance = irradianceSum / totalWeight;
+                    irradiance = bSqrtEncoded ? std::sqrt(irradiance) : irradiance;
+                    float directionality = directionalitySum / totalWeight;
+
+                    outChildMip.m_irradianceData[childIndex * pixelStride + channel] = uint8_t(std::min(irradiance * 255.0f + 0.5f, 255.0f));
+                    outChildMip.m_directionalityData[childIndex * pixelStride + channel] = uint8_t(std::min(directionality * 255.0f + 0.5f, 255.0f));
+                }
+            }
+        });
+    }
+
+    void hwrtl::gi::GenerateLightMapMipChain(std::vector<SOutputAtlasInfo>& outputAtlas)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        for (uint32_t atlasIndex = 0; atlasIndex < outputAtlas.size(); atlasIndex++)
+        {
+            SOutputAtlasInfo& atlasInfo = outputAtlas[atlasIndex];
+            assert(atlasInfo.m_pixelStride == 4);
+
+            SLightMapMipCoverage parentCoverage;
+            GenerateChartCoverage(atlasInfo, parentCoverage);
+
+            const uint8_t* pParentIrradiance = (const uint8_t*)atlasInfo.destIrradianceOutputData;
+            const uint8_t* pParentDirectionality = (const uint8_t*)atlasInfo.destDirectionalityOutputData;
+
+            atlasInfo.m_mips.clear();
+            atlasInfo.m_mips.reserve(32);
+            while (parentCoverage.m_width > 1 || parentCoverage.m_height > 1)
+            {
+                SLightMapMipCoverage childCoverage;
+                atlasInfo.m_mips.push_back(SOutputMipInfo());
+                GenerateCoverageAwareMip(parentCoverage, pParentIrradiance, pParentDirectionality, atlasInfo.m_pixelStride, atlasInfo.m_bakeMode, childCoverage, atlasInfo.m_mips.back());
+
+                parentCoverage = std::move(childCoverage);
+                pParentIrradiance = atlasInfo.m_mips.back().m_irradianceData.data();
+                pParentDirectionality = atlasInfo.m_mips.back().m_directionalityData.data();
+            }
+        }
+    }
+
+    /***************************************************************************
+    * LightMap Container
+    ***************************************************************************/
+
+    static constexpr uint64_t LightMapContainerTileAlignment = 64 * 1024; // windows allocation granularity, tiles can be mapped individually
+    static constexpr uint64_t LightMapContainerStagingSize = 8 * 1024 * 1024;
+
+    struct SLightMapMip
+    {
+        uint32_t m_width;
+        uint32_t m_height;
+        const uint8_t* m_pData;
     };
-    static_assert(sizeof(SDenoiseAndDilateParams) == 256 , "sizeof(SDenoiseParams) == 256");
 
-    static void PrePareDenoiseLightMapPass()
+    static uint64_t AlignUp(uint64_t value, uint64_t alignment)
     {
-        CGIBaker::GetDeviceCommand()->OpenCmdList();
+        return ((value + alignment - 1) / alignment) * alignment;
+    }
 
-        std::vector<SShader>rsShaders;
-        rsShaders.push_back(SShader{ ERayShaderType::RS_VS,L"DenoiseLightMapVS" });
-        rsShaders.push_back(SShader{ ERayShaderType::RS_PS,L"DenoiseLightMapPS" });
+    static bool IsLightMapTileEmpty(const SLightMapMip& mip, uint32_t pixelStride, uint32_t tileSize, uint32_t tileX, uint32_t tileY)
+    {
+        uint32_t beginX = tileX * tileSize;
+        uint32_t beginY = tileY * tileSize;
+        uint32_t rowWidth = std::min(tileSize, mip.m_width - beginX);
+        uint32_t rowNum = std::min(tileSize, mip.m_height - beginY);
+
+        for (uint32_t row = 0; row < rowNum; row++)
+        {
+            const uint8_t* pRow = mip.m_pData + (uint64_t(beginY + row) * mip.m_width + beginX) * pixelStride;
+            for (uint32_t byteIndex = 0; byteIndex < rowWidth * pixelStride; byteIndex++)
+            {
+                if (pRow[byteIndex] != 0)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
 
-        SShaderResources rasterizationResources = { 3,0,1,0 };
+    // copy a tile into the staging buffer, texels outside the mip are zero
+    static void CopyLightMapTile(const SLightMapMip& mip, uint32_t pixelStride, uint32_t tileSize, uint32_t tileX, uint32_t tileY, uint8_t* pDestTile)
+    {
+        uint32_t beginX = tileX * tileSize;
+        uint32_t beginY = tileY * tileSize;
+        uint32_t rowWidth = std::min(tileSize, mip.m_width - beginX);
+        uint32_t rowNum = std::min(tileSize, mip.m_height - beginY);
 
-        std::vector<EVertexFormat>vertexLayouts;
-        vertexLayouts.push_back(EVertexFormat::FT_FLOAT3);
-        vertexLayouts.push_back(EVertexFormat::FT_FLOAT2);
+        memset(pDestTile, 0, uint64_t(tileSize) * tileSize * pixelStride);
+        for (uint32_t row = 0; row < rowNum; row++)
+        {
+            const uint8_t* pSrcRow = mip.m_pData + (uint64_t(beginY + row) * mip.m_width + beginX) * pixelStride;
+            memcpy(pDestTile + uint64_t(row) * tileSize * pixelStride, pSrcRow, uint64_t(rowWidth) * pixelStride);
+        }
+    }
 
-        std::vector<ETexFormat>rtFormats;
-        rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
-        rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+    bool hwrtl::gi::WriteLightMapContainer(const std::string& filePath, const std::vector<SOutputAtlasInfo>& outputAtlas, uint32_t tileSize)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        assert(outputAtlas.size() > 0);
+        assert(tileSize > 0);
+
+        const uint32_t layerNum = uint32_t(ELightMapLayer::LML_NUM);
+        const uint32_t pixelStride = outputAtlas[0].m_pixelStride;
+        const uint32_t atlasWidth = outputAtlas[0].m_lightMapSize.x;
+        const uint32_t atlasHeight = outputAtlas[0].m_lightMapSize.y;
+        const uint64_t tileByteSize = uint64_t(tileSize) * tileSize * pixelStride;
+        const uint64_t tileStride = AlignUp(tileByteSize, LightMapContainerTileAlignment);
+
+        // collect the mips of every atlas layer, stop at the first mip that fits into a single tile
+        std::vector<SOutputAtlasInfo> mipAtlas;
+        const std::vector<SOutputAtlasInfo>* pMipAtlas = &outputAtlas;
+        if (outputAtlas[0].m_mips.size() == 0)
+        {
+            mipAtlas = outputAtlas;
+            GenerateLightMapMipChain(mipAtlas);
+            pMipAtlas = &mipAtlas;
+        }
 
-        std::size_t dirPos = WstringConverter().from_bytes(__FILE__).find(L"hwrtl_gi.cpp");
-        std::wstring shaderPath = WstringConverter().from_bytes(__FILE__).substr(0, dirPos) + L"hwrtl_gi.hlsl";
+        std::vector<std::vector<SLightMapMip>> layerMips;
+        layerMips.resize(outputAtlas.size() * layerNum);
+        for (uint32_t atlasIndex = 0; atlasIndex < outputAtlas.size(); atlasIndex++)
+        {
+            const SOutputAtlasInfo& atlasInfo = (*pMipAtlas)[atlasIndex];
+            assert(atlasInfo.m_pixelStride == pixelStride);
+            assert(uint32_t(atlasInfo.m_lightMapSize.x) == atlasWidth && uint32_t(atlasInfo.m_lightMapSize.y) == atlasHeight);
 
-        SRasterizationPSOCreateDesc rsPsoCreateDesc = { shaderPath, rsShaders, rasterizationResources, vertexLayouts, rtFormats, ETexFormat::FT_None };
-        pGiBaker->m_pDenoisePSO = CGIBaker::GetDeviceCommand()->CreateRSPipelineState(rsPsoCreateDesc);
+            std::vector<SLightMapMip>& irradianceMips = layerMips[atlasIndex * layerNum + uint32_t(ELightMapLayer::LML_IRRADIANCE)];
+            std::vector<SLightMapMip>& directionalityMips = layerMips[atlasIndex * layerNum + uint32_t(ELightMapLayer::LML_DIRECTIONALITY)];
 
-        SDenoiseAndDilateParams denoiseAndDilateParams;
-        denoiseAndDilateParams.m_spatialBandWidth = 5.0f;
-        denoiseAndDilateParams.m_resultBandWidth = 0.2f;
-        denoiseAndDilateParams.m_normalBandWidth = 0.1f;
-        denoiseAndDilateParams.m_filterStrength = 10.0f;
-        denoiseAndDilateParams.m_inputTexSizeAndInvSize = Vec4(pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y, 1.0 / pGiBaker->m_nAtlasSize.x, 1.0 / pGiBaker->m_nAtlasSize.y);
-        pGiBaker->pDenoiseGlobalCB = CGIBaker::GetDeviceCommand()->CreateBuffer(&denoiseAndDilateParams, sizeof(SDenoiseAndDilateParams), sizeof(SDenoiseAndDilateParams), EBufferUsage::USAGE_CB);
+            irradianceMips.push_back(SLightMapMip{ atlasWidth, atlasHeight, (const uint8_t*)atlasInfo.destIrradianceOutputData });
+            directionalityMips.push_back(SLightMapMip{ atlasWidth, atlasHeight, (const uint8_t*)atlasInfo.destDirectionalityOutputData });
 
-        STextureCreateDesc pinPongtexCreateDesc{ ETexUsage::USAGE_SRV | ETexUsage::USAGE_RTV,ETexFormat::FT_RGBA32_FLOAT,pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y };
+            for (uint32_t mipIndex = 0; mipIndex < atlasInfo.m_mips.size(); mipIndex++)
+            {
+                if (irradianceMips.back().m_width <= tileSize && irradianceMips.back().m_height <= tileSize)
+                {
+                    break;
+                }
 
-        for (uint32_t index = 0; index < pGiBaker->m_atlas.size(); index++)
+                const SOutputMipInfo& mipInfo = atlasInfo.m_mips[mipIndex];
+                irradianceMips.push_back(SLightMapMip{ uint32_t(mipInfo.m_mipSize.x), uint32_t(mipInfo.m_mipSize.y), mipInfo.m_irradianceData.data() });
+                directionalityMips.push_back(SLightMapMip{ uint32_t(mipInfo.m_mipSize.x), uint32_t(mipInfo.m_mipSize.y), mipInfo.m_directionalityData.data() });
+            }
+        }
+        const uint32_t mipNum = uint32_t(layerMips[0].size());
+
+        // build the tables, all tile offsets are known before writing so the file can be written sequentially
+        std::vector<SLightMapContainerMip> containerMips;
+        std::vector<uint64_t> tileOffsets;
+        std::vector<SLightMapContainerMesh> containerMeshes;
+
+        for (uint32_t atlasIndex = 0; atlasIndex < outputAtlas.size(); atlasIndex++)
         {
-            SAtlas& altas = pGiBaker->m_atlas[index];
-            altas.m_irradianceAndSampleCountPingPongTex = CGIBaker::GetDeviceCommand()->CreateTexture2D(pinPongtexCreateDesc);
-            altas.m_shDirectionalityPingPongTex = CGIBaker::GetDeviceCommand()->CreateTexture2D(pinPongtexCreateDesc);
+            const SOutputAtlasInfo& atlasInfo = outputAtlas[atlasIndex];
+            for (uint32_t geoIndex = 0; geoIndex < atlasInfo.m_orginalMeshIndex.size(); geoIndex++)
+            {
+                SLightMapContainerMesh containerMesh = {};
+                containerMesh.m_orginalMeshIndex = atlasInfo.m_orginalMeshIndex[geoIndex];
+                containerMesh.m_atlasIndex = atlasIndex;
+                containerMesh.m_lightMapScaleAndBias = atlasInfo.m_lightMapScaleAndBias[geoIndex];
+                containerMeshes.push_back(containerMesh);
+            }
         }
 
-        Vec3 fullScreenPositionData[6] = { Vec3(1,-1,0),Vec3(-1,-1,0),Vec3(-1,1,0),Vec3(1,-1,0),Vec3(-1,1,0),Vec3(1,1,0) };
-        Vec2 fullScreenUVData[6] = { Vec2(1,1),Vec2(0,1),Vec2(0,0),Vec2(1,1),Vec2(0,0),Vec2(1,0), };
-        pGiBaker->pFullScreenVB = CGIBaker::GetDeviceCommand()->CreateBuffer(fullScreenPositionData, sizeof(Vec3) * 6, sizeof(Vec3), EBufferUsage::USAGE_VB);
-        pGiBaker->pFullScreenUV = CGIBaker::GetDeviceCommand()->CreateBuffer(fullScreenUVData, sizeof(Vec2) * 6, sizeof(Vec2), EBufferUsage::USAGE_VB);
+        const uint64_t mipTableOffset = sizeof(SLightMapContainerHeader);
+        const uint64_t tileTableOffset = mipTableOffset + sizeof(SLightMapContainerMip) * layerMips.size() * mipNum;
 
-        CGIBaker::GetDeviceCommand()->CloseAndExecuteCmdList();
-        CGIBaker::GetDeviceCommand()->WaitGPUCmdListFinish();
+        uint32_t tileNum = 0;
+        for (uint32_t layerIndex = 0; layerIndex < layerMips.size(); layerIndex++)
+        {
+            for (uint32_t mipIndex = 0; mipIndex < mipNum; mipIndex++)
+            {
+                const SLightMapMip& mip = layerMips[layerIndex][mipIndex];
+                tileNum += ((mip.m_width + tileSize - 1) / tileSize) * ((mip.m_height + tileSize - 1) / tileSize);
+            }
+        }
+
+        const uint64_t meshTableOffset = tileTableOffset + sizeof(uint64_t) * tileNum;
+        const uint64_t tileDataOffset = AlignUp(meshTableOffset + sizeof(SLightMapContainerMesh) * containerMeshes.size(), LightMapContainerTileAlignment);
+        const uint64_t zeroTileOffset = tileDataOffset;
+
+        std::vector<Vec3i> writeTiles; // (layer * mipNum + mip, tileX, tileY) of the non-empty tiles in file order
+        uint64_t nextTileOffset = zeroTileOffset + tileStride;
+        for (uint32_t layerIndex = 0; layerIndex < layerMips.size(); layerIndex++)
+        {
+            for (uint32_t mipIndex = 0; mipIndex < mipNum; mipIndex++)
+            {
+                const SLightMapMip& mip = layerMips[layerIndex][mipIndex];
+
+                SLightMapContainerMip containerMip;
+                containerMip.m_atlasIndex = layerIndex / layerNum;
+                containerMip.m_layerIndex = layerIndex % layerNum;
+                containerMip.m_mipIndex = mipIndex;
+                containerMip.m_mipWidth = mip.m_width;
+                containerMip.m_mipHeight = mip.m_height;
+                containerMip.m_tileNumX = (mip.m_width + tileSize - 1) / tileSize;
+                containerMip.m_tileNumY = (mip.m_height + tileSize - 1) / tileSize;
+                containerMip.m_firstTile = uint32_t(tileOffsets.size());
+                containerMips.push_back(containerMip);
+
+                for (uint32_t tileY = 0; tileY < containerMip.m_tileNumY; tileY++)
+                {
+                    for (uint32_t tileX = 0; tileX < containerMip.m_tileNumX; tileX++)
+                    {
+                        if (IsLightMapTileEmpty(mip, pixelStride, tileSize, tileX, tileY))
+                        {
+                            tileOffsets.push_back(zeroTileOffset);
+                        }
+                        else
+                        {
+                            tileOffsets.push_back(nextTileOffset);
+                            writeTiles.push_back(Vec3i(layerIndex * mipNum + mipIndex, tileX, tileY));
+                            nextTileOffset += tileStride;
+                        }
+                    }
+                }
+            }
+        }
+
+        SLightMapContainerHeader header = {};
+        header.m_magic = HWRTL_LIGHTMAP_CONTAINER_MAGIC;
+        header.m_version = HWRTL_LIGHTMAP_CONTAINER_VERSION;
+        header.m_tileSize = tileSize;
+        header.m_pixelStride = pixelStride;
+        header.m_atlasNum = uint32_t(outputAtlas.size());
+        header.m_layerNum = layerNum;
+        header.m_mipNum = mipNum;
+        header.m_meshNum = uint32_t(containerMeshes.size());
+        header.m_atlasWidth = atlasWidth;
+        header.m_atlasHeight = atlasHeight;
+        header.m_tileNum = tileNum;
+        header.m_tileByteSize = uint32_t(tileByteSize);
+        header.m_mipTableOffset = mipTableOffset;
+        header.m_tileTableOffset = tileTableOffset;
+        header.m_meshTableOffset = meshTableOffset;
+        header.m_tileDataOffset = tileDataOffset;
+
+        std::ofstream containerFile(filePath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (containerFile.good() == false)
+        {
+            return false;
+        }
+
+        // the tables and tiles are gathered into a large staging buffer and flushed with few large writes
+        std::vector<uint8_t> stagingBuffer;
+        stagingBuffer.reserve(std::max(LightMapContainerStagingSize, tileStride));
+
+        auto flushStaging = [&]()
+        {
+            containerFile.write((const char*)stagingBuffer.data(), stagingBuffer.size());
+            stagingBuffer.clear();
+        };
+
+        auto appendStaging = [&](const void* pData, uint64_t byteSize)
+        {
+            if (stagingBuffer.size() + byteSize > stagingBuffer.capacity())
+            {
+                flushStaging();
+            }
+            stagingBuffer.insert(stagingBuffer.end(), (const uint8_t*)pData, (const uint8_t*)pData + byteSize);
+        };
+
+        appendStaging(&header, sizeof(SLightMapContainerHeader));
+        appendStaging(containerMips.data(), sizeof(SLightMapContainerMip) * containerMips.size());
+        appendStaging(tileOffsets.data(), sizeof(uint64_t) * tileOffsets.size());
+        appendStaging(containerMeshes.data(), sizeof(SLightMapContainerMesh) * containerMeshes.size());
+
+        std::vector<uint8_t> tileData;
+        tileData.resize(tileStride);
+
+        // alignment padding and the shared zero tile
+        std::vector<uint8_t> paddingData;
+        paddingData.resize(tileDataOffset - meshTableOffset - sizeof(SLightMapContainerMesh) * containerMeshes.size());
+        appendStaging(paddingData.data(), paddingData.size());
+        appendStaging(tileData.data(), tileStride);
+
+        for (uint32_t writeIndex = 0; writeIndex < writeTiles.size(); writeIndex++)
+        {
+            const Vec3i& writeTile = writeTiles[writeIndex];
+            const SLightMapMip& mip = layerMips[writeTile.x / mipNum][writeTile.x % mipNum];
+            CopyLightMapTile(mip, pixelStride, tileSize, writeTile.y, writeTile.z, tileData.data());
+            appendStaging(tileData.data(), tileStride);
+        }
+        flushStaging();
+
+        return containerFile.good();
     }
 
-    static void ExecuteDenoiseLightMapPass()
+    static bool IsLightMapContainerArrayValid(uint64_t fileByteSize, uint64_t arrayOffset, uint64_t byteSize, uint64_t alignment)
     {
-        CGIBaker::GetGraphicsContext()->BeginRenderPasss();
-        CGIBaker::GetGraphicsContext()->SetGraphicsPipelineState(pGiBaker->m_pDenoisePSO);
+        return (arrayOffset % alignment) == 0 && arrayOffset <= fileByteSize && byteSize <= fileByteSize - arrayOffset;
+    }
 
-        for (uint32_t atlasIndex = 0; atlasIndex < pGiBaker->m_atlas.size(); atlasIndex++)
+    // the tables and tile offsets are validated once here, GetLightMapContainerTile only asserts the tile coordinates
+    static bool IsLightMapContainerValid(const uint8_t* pFileData, uint64_t fileByteSize)
+    {
+        const SLightMapContainerHeader* pHeader = (const SLightMapContainerHeader*)pFileData;
+        if (fileByteSize < sizeof(SLightMapContainerHeader) ||
+            pHeader->m_magic != HWRTL_LIGHTMAP_CONTAINER_MAGIC ||
+            pHeader->m_version != HWRTL_LIGHTMAP_CONTAINER_VERSION)
         {
-            SAtlas& altas = pGiBaker->m_atlas[atlasIndex];
+            return false;
+        }
 
-            std::vector<std::shared_ptr<CTexture2D>>renderTargets;
-            renderTargets.push_back(altas.m_irradianceAndSampleCountPingPongTex);
-            renderTargets.push_back(altas.m_shDirectionalityPingPongTex);
+        if (pHeader->m_layerNum != uint32_t(ELightMapLayer::LML_NUM) || pHeader->m_atlasNum == 0 || pHeader->m_mipNum == 0 || pHeader->m_tileSize == 0 ||
+            uint64_t(pHeader->m_tileByteSize) != uint64_t(pHeader->m_tileSize) * pHeader->m_tileSize * pHeader->m_pixelStride)
+        {
+            return false;
+        }
 
-            CGIBaker::GetGraphicsContext()->SetRenderTargets(renderTargets, nullptr);
-            CGIBaker::GetGraphicsContext()->SetViewport(pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y);
-            CGIBaker::GetGraphicsContext()->SetConstantBuffer(pGiBaker->pDenoiseGlobalCB, 0);
+        const uint64_t mipNum = uint64_t(pHeader->m_atlasNum) * pHeader->m_layerNum * pHeader->m_mipNum;
+        if (!IsLightMapContainerArrayValid(fileByteSize, pHeader->m_mipTableOffset, sizeof(SLightMapContainerMip) * mipNum, alignof(SLightMapContainerMip)) ||
+            !IsLightMapContainerArrayValid(fileByteSize, pHeader->m_tileTableOffset, sizeof(uint64_t) * uint64_t(pHeader->m_tileNum), alignof(uint64_t)) ||
+            !IsLightMapContainerArrayValid(fileByteSize, pHeader->m_meshTableOffset, sizeof(SLightMapContainerMesh) * uint64_t(pHeader->m_meshNum), alignof(SLightMapContainerMesh)) ||
+            !IsLightMapContainerArrayValid(fileByteSize, pHeader->m_tileDataOffset, 0, LightMapContainerTileAlignment))
+        {
+            return false;
+        }
 
-            CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_irradianceAndSampleCount, 0);
-            CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_shDirectionality, 1);
-            CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_hNormalTexture, 2);
-            
-            std::vector<std::shared_ptr<CBuffer>>vertexBuffers;
-            vertexBuffers.push_back(pGiBaker->pFullScreenVB);
-            vertexBuffers.push_back(pGiBaker->pFullScreenUV);
-            CGIBaker::GetGraphicsContext()->SetVertexBuffers(vertexBuffers);
-            CGIBaker::GetGraphicsContext()->DrawInstanced(6, 1, 0, 0);
+        const SLightMapContainerMip* pMips = (const SLightMapContainerMip*)(pFileData + pHeader->m_mipTableOffset);
+        for (uint64_t index = 0; index < mipNum; index++)
+        {
+            const SLightMapContainerMip& containerMip = pMips[index];
+            const uint32_t mipIndex = uint32_t(index % pHeader->m_mipNum);
+            const uint32_t layerIndex = uint32_t((index / pHeader->m_mipNum) % pHeader->m_layerNum);
+            const uint32_t atlasIndex = uint32_t(index / (uint64_t(pHeader->m_mipNum) * pHeader->m_layerNum));
+            if (containerMip.m_atlasIndex != atlasIndex || containerMip.m_layerIndex != layerIndex || containerMip.m_mipIndex != mipIndex)
+            {
+                return false;
+            }
+
+            // CompareLightMapContainer reads the full atlas from mip 0
+            if (mipIndex == 0 && (containerMip.m_mipWidth != pHeader->m_atlasWidth || containerMip.m_mipHeight != pHeader->m_atlasHeight))
+            {
+                return false;
+            }
+
+            if (containerMip.m_tileNumX != (uint64_t(containerMip.m_mipWidth) + pHeader->m_tileSize - 1) / pHeader->m_tileSize ||
+                containerMip.m_tileNumY != (uint64_t(containerMip.m_mipHeight) + pHeader->m_tileSize - 1) / pHeader->m_tileSize ||
+                uint64_t(containerMip.m_firstTile) + uint64_t(containerMip.m_tileNumX) * containerMip.m_tileNumY > pHeader->m_tileNum)
+            {
+                return false;
+            }
+        }
+
+        const uint64_t* pTileOffsets = (const uint64_t*)(pFileData + pHeader->m_tileTableOffset);
+        for (uint32_t index = 0; index < pHeader->m_tileNum; index++)
+        {
+            if (pTileOffsets[index] < pHeader->m_tileDataOffset ||
+                !IsLightMapContainerArrayValid(fileByteSize, pTileOffsets[index], pHeader->m_tileByteSize, LightMapContainerTileAlignment))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool hwrtl::gi::MapLightMapContainer(const std::string& filePath, SLightMapContainerView& outContainerView)
+    {
+        outContainerView = SLightMapContainerView();
+        if (MapFileForRead(filePath, outContainerView.m_mappedFile) == false)
+        {
+            return false;
         }
 
-        CGIBaker::GetGraphicsContext()->EndRenderPasss();
+        const uint8_t* pFileData = (const uint8_t*)outContainerView.m_mappedFile.m_pData;
+        if (IsLightMapContainerValid(pFileData, outContainerView.m_mappedFile.m_nByteSize) == false)
+        {
+            UnmapFile(outContainerView.m_mappedFile);
+            return false;
+        }
+
+        const SLightMapContainerHeader* pHeader = (const SLightMapContainerHeader*)pFileData;
+        outContainerView.m_pHeader = pHeader;
+        outContainerView.m_pMips = (const SLightMapContainerMip*)(pFileData + pHeader->m_mipTableOffset);
+        outContainerView.m_pTileOffsets = (const uint64_t*)(pFileData + pHeader->m_tileTableOffset);
+        outContainerView.m_pMeshes = (const SLightMapContainerMesh*)(pFileData + pHeader->m_meshTableOffset);
+        return true;
     }
 
-    static void PrePareDilateLightMapPass()
+    void hwrtl::gi::UnmapLightMapContainer(SLightMapContainerView& containerView)
     {
-        CGIBaker::GetDeviceCommand()->OpenCmdList();
+        UnmapFile(containerView.m_mappedFile);
+        containerView = SLightMapContainerView();
+    }
 
-        std::vector<SShader>rsShaders;
-        rsShaders.push_back(SShader{ ERayShaderType::RS_VS,L"DilateLightMapVS" });
-        rsShaders.push_back(SShader{ ERayShaderType::RS_PS,L"DilateeLightMapPS" });
+    const uint8_t* hwrtl::gi::GetLightMapContainerTile(const SLightMapContainerView& containerView, uint32_t atlasIndex, ELightMapLayer layer, uint32_t mipIndex, uint32_t tileX, uint32_t tileY)
+    {
+        const SLightMapContainerHeader* pHeader = containerView.m_pHeader;
+        assert(atlasIndex < pHeader->m_atlasNum && mipIndex < pHeader->m_mipNum);
 
-        SShaderResources rasterizationResources = { 2,0,1,0 };
+        const SLightMapContainerMip& containerMip = containerView.m_pMips[(atlasIndex * pHeader->m_layerNum + uint32_t(layer)) * pHeader->m_mipNum + mipIndex];
+        assert(tileX < containerMip.m_tileNumX && tileY < containerMip.m_tileNumY);
 
-        std::vector<EVertexFormat>vertexLayouts;
-        vertexLayouts.push_back(EVertexFormat::FT_FLOAT3);
-        vertexLayouts.push_back(EVertexFormat::FT_FLOAT2);
+        uint64_t tileOffset = containerView.m_pTileOffsets[containerMip.m_firstTile + tileY * containerMip.m_tileNumX + tileX];
+        return (const uint8_t*)containerView.m_mappedFile.m_pData + tileOffset;
+    }
 
-        std::vector<ETexFormat>rtFormats;
-        rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
-        rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
+    /***************************************************************************
+    * LightMap Diff
+    ***************************************************************************/
 
-        std::size_t dirPos = WstringConverter().from_bytes(__FILE__).find(L"hwrtl_gi.cpp");
-        std::wstring shaderPath = WstringConverter().from_bytes(__FILE__).substr(0, dirPos) + L"hwrtl_gi.hlsl";
+    struct SLightMapDiffAccumulator
+    {
+        uint64_t m_comparedTexelNum = 0;
+        uint64_t m_differentTexelNum = 0;
+        uint64_t m_comparedChannelNum = 0;
+        uint32_t m_maxAbsError = 0;
+        double m_squaredErrorSum = 0.0;
 
-        SRasterizationPSOCreateDesc rsPsoCreateDesc = { shaderPath, rsShaders, rasterizationResources, vertexLayouts, rtFormats, ETexFormat::FT_None };
-        pGiBaker->m_pDilatePSO = CGIBaker::GetDeviceCommand()->CreateRSPipelineState(rsPsoCreateDesc);
+        void AddTexel(const uint8_t* pReference, const uint8_t* pTest, uint32_t pixelStride)
+        {
+            bool bDifferent = false;
+            for (uint32_t channel = 0; channel < pixelStride; channel++)
+            {
+                uint32_t absError = uint32_t(std::abs(int(pReference[channel]) - int(pTest[channel])));
+                m_maxAbsError = std::max(m_maxAbsError, absError);
+                m_squaredErrorSum += double(absError) * double(absError);
+                bDifferent |= (absError != 0);
+            }
+            m_comparedTexelNum++;
+            m_comparedChannelNum += pixelStride;
+            m_differentTexelNum += bDifferent ? 1 : 0;
+        }
 
-        CGIBaker::GetDeviceCommand()->CloseAndExecuteCmdList();
-        CGIBaker::GetDeviceCommand()->WaitGPUCmdListFinish();
-    }
+        void Resolve(SLightMapDiff& outDiff) const
+        {
+            outDiff.m_comparedTexelNum = m_comparedTexelNum;
+            outDiff.m_differentTexelNum = m_differentTexelNum;
+            outDiff.m_maxAbsError = m_maxAbsError;
+            outDiff.m_rmse = m_comparedChannelNum > 0 ? std::sqrt(m_squaredErrorSum / double(m_comparedChannelNum)) : 0.0;
+            outDiff.m_psnr = outDiff.m_rmse > 0.0 ? 20.0 * std::log10(255.0 / outDiff.m_rmse) : std::numeric_limits<double>::infinity();
+        }
+    };
 
-    static void ExecuteDilateLightMapPass()
+    static bool IsLightMapAtlasLayoutEqual(const SOutputAtlasInfo& referenceAtlas, const SOutputAtlasInfo& testAtlas)
     {
-        CGIBaker::GetGraphicsContext()->BeginRenderPasss();
-        CGIBaker::GetGraphicsContext()->SetGraphicsPipelineState(pGiBaker->m_pDilatePSO);
+        return referenceAtlas.m_pixelStride == testAtlas.m_pixelStride &&
+            referenceAtlas.m_lightMapSize.x == testAtlas.m_lightMapSize.x &&
+            referenceAtlas.m_lightMapSize.y == testAtlas.m_lightMapSize.y &&
+            referenceAtlas.m_orginalMeshIndex == testAtlas.m_orginalMeshIndex;
+    }
 
-        for (uint32_t atlasIndex = 0; atlasIndex < pGiBaker->m_atlas.size(); atlasIndex++)
+    bool hwrtl::gi::CompareLightMapAtlases(const std::vector<SOutputAtlasInfo>& referenceAtlas, const std::vector<SOutputAtlasInfo>& testAtlas, SLightMapDiff& outDiff)
+    {
+        outDiff = SLightMapDiff();
+        if (referenceAtlas.size() != testAtlas.size())
         {
-            SAtlas& altas = pGiBaker->m_atlas[atlasIndex];
-
-            std::vector<std::shared_ptr<CTexture2D>>renderTargets;
-            renderTargets.push_back(altas.m_irradianceAndSampleCount);
-            renderTargets.push_back(altas.m_shDirectionality);
+            return false;
+        }
 
-            CGIBaker::GetGraphicsContext()->SetRenderTargets(renderTargets, nullptr);
-            CGIBaker::GetGraphicsContext()->SetViewport(pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y);
-            CGIBaker::GetGraphicsContext()->SetConstantBuffer(pGiBaker->pDenoiseGlobalCB, 0);
+        SLightMapDiffAccumulator diffAccumulator;
+        for (uint32_t atlasIndex = 0; atlasIndex < referenceAtlas.size(); atlasIndex++)
+        {
+            const SOutputAtlasInfo& referenceInfo = referenceAtlas[atlasIndex];
+            const SOutputAtlasInfo& testInfo = testAtlas[atlasIndex];
+            if (IsLightMapAtlasLayoutEqual(referenceInfo, testInfo) == false)
+            {
+                return false;
+            }
 
-            CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_irradianceAndSampleCountPingPongTex, 0);
-            CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_shDirectionalityPingPongTex, 1);
+            const uint32_t pixelStride = referenceInfo.m_pixelStride;
+            const uint64_t texelNum = uint64_t(referenceInfo.m_lightMapSize.x) * referenceInfo.m_lightMapSize.y;
+            const uint8_t* referenceLayers[] = { (const uint8_t*)referenceInfo.destIrradianceOutputData, (const uint8_t*)referenceInfo.destDirectionalityOutputData };
+            const uint8_t* testLayers[] = { (const uint8_t*)testInfo.destIrradianceOutputData, (const uint8_t*)testInfo.destDirectionalityOutputData };
 
-            std::vector<std::shared_ptr<CBuffer>>vertexBuffers;
-            vertexBuffers.push_back(pGiBaker->pFullScreenVB);
-            vertexBuffers.push_back(pGiBaker->pFullScreenUV);
-            CGIBaker::GetGraphicsContext()->SetVertexBuffers(vertexBuffers);
-            CGIBaker::GetGraphicsContext()->DrawInstanced(6, 1, 0, 0);
+            for (uint32_t layerIndex = 0; layerIndex < uint32_t(ELightMapLayer::LML_NUM); layerIndex++)
+            {
+                for (uint64_t texelIndex = 0; texelIndex < texelNum; texelIndex++)
+                {
+                    diffAccumulator.AddTexel(referenceLayers[layerIndex] + texelIndex * pixelStride, testLayers[layerIndex] + texelIndex * pixelStride, pixelStride);
+                }
+            }
         }
 
-        CGIBaker::GetGraphicsContext()->EndRenderPasss();
+        diffAccumulator.Resolve(outDiff);
+        return true;
     }
 
-    void hwrtl::gi::DenoiseAndDilateLightMap()
+    bool hwrtl::gi::CompareLightMapContainer(const SLightMapContainerView& referenceContainer, const std::vector<SOutputAtlasInfo>& testAtlas, SLightMapDiff& outDiff)
     {
-        PrePareDenoiseLightMapPass();
-        ExecuteDenoiseLightMapPass();
-        PrePareDilateLightMapPass();
-        ExecuteDilateLightMapPass();
-    }
+        outDiff = SLightMapDiff();
 
-    static void PrePareEncodeLightMapPass()
-    {
-        CGIBaker::GetDeviceCommand()->OpenCmdList();
+        const SLightMapContainerHeader* pHeader = referenceContainer.m_pHeader;
+        assert(pHeader != nullptr);
+        if (pHeader->m_atlasNum != testAtlas.size() || testAtlas.size() == 0 || pHeader->m_pixelStride != testAtlas[0].m_pixelStride ||
+            pHeader->m_atlasWidth != uint32_t(testAtlas[0].m_lightMapSize.x) || pHeader->m_atlasHeight != uint32_t(testAtlas[0].m_lightMapSize.y))
+        {
+            return false;
+        }
 
-        std::vector<SShader>rsShaders;
-        rsShaders.push_back(SShader{ ERayShaderType::RS_VS,L"EncodeLightMapVS" });
-        rsShaders.push_back(SShader{ ERayShaderType::RS_PS,L"EncodeLightMapPS" });
+        // the mesh table is written in atlas order, so the same mesh order means the same packing
+        uint32_t meshIndex = 0;
+        for (uint32_t atlasIndex = 0; atlasIndex < testAtlas.size(); atlasIndex++)
+        {
+            for (uint32_t geoIndex = 0; geoIndex < testAtlas[atlasIndex].m_orginalMeshIndex.size(); geoIndex++, meshIndex++)
+            {
+                if (meshIndex >= pHeader->m_meshNum ||
+                    referenceContainer.m_pMeshes[meshIndex].m_atlasIndex != atlasIndex ||
+                    referenceContainer.m_pMeshes[meshIndex].m_orginalMeshIndex != testAtlas[atlasIndex].m_orginalMeshIndex[geoIndex])
+                {
+                    return false;
+                }
+            }
+        }
+        if (meshIndex != pHeader->m_meshNum)
+        {
+            return false;
+        }
 
-        SShaderResources rasterizationResources = { 2,0,1,0 };
+        const uint32_t tileSize = pHeader->m_tileSize;
+        const uint32_t pixelStride = pHeader->m_pixelStride;
+        const uint32_t atlasWidth = pHeader->m_atlasWidth;
+        const uint32_t atlasHeight = pHeader->m_atlasHeight;
 
-        std::vector<EVertexFormat>vertexLayouts;
-        vertexLayouts.push_back(EVertexFormat::FT_FLOAT3);
-        vertexLayouts.push_back(EVertexFormat::FT_FLOAT2);
+        SLightMapDiffAccumulator diffAccumulator;
+        for (uint32_t atlasIndex = 0; atlasIndex < testAtlas.size(); atlasIndex++)
+        {
+            const SOutputAtlasInfo& testInfo = testAtlas[atlasIndex];
+            const uint8_t* testLayers[] = { (const uint8_t*)testInfo.destIrradianceOutputData, (const uint8_t*)testInfo.destDirectionalityOutputData };
 
-        std::vector<ETexFormat>rtFormats;
-        rtFormats.push_back(ETexFormat::FT_RGBA8_UNORM);
-        rtFormats.push_back(ETexFormat::FT_RGBA8_UNORM);
+            for (uint32_t layerIndex = 0; layerIndex < uint32_t(ELightMapLayer::LML_NUM); layerIndex++)
+            {
+                for (uint32_t y = 0; y < atlasHeight; y++)
+                {
+                    for (uint32_t x = 0; x < atlasWidth; x++)
+                    {
+                        const uint8_t* pTile = GetLightMapContainerTile(referenceContainer, atlasIndex, ELightMapLayer(layerIndex), 0, x / tileSize, y / tileSize);
+                        const uint8_t* pReferenceTexel = pTile + (uint64_t(y % tileSize) * tileSize + (x % tileSize)) * pixelStride;
+                        const uint8_t* pTestTexel = testLayers[layerIndex] + (uint64_t(y) * atlasWidth + x) * pixelStride;
+                        diffAccumulator.AddTexel(pReferenceTexel, pTestTexel, pixelStride);
+                    }
+                }
+            }
+        }
 
-        std::size_t dirPos = WstringConverter().from_bytes(__FILE__).find(L"hwrtl_gi.cpp");
-        std::wstring shaderPath = WstringConverter().from_bytes(__FILE__).substr(0, dirPos) + L"hwrtl_gi.hlsl";
+        diffAccumulator.Resolve(outDiff);
+        return true;
+    }
 
-        SRasterizationPSOCreateDesc rsPsoCreateDesc = { shaderPath, rsShaders, rasterizationResources, vertexLayouts, rtFormats, ETexFormat::FT_None };
-        pGiBaker->m_pEncodeLightMapPSO = CGIBaker::GetDeviceCommand()->CreateRSPipelineState(rsPsoCreateDesc);
+    /***************************************************************************
+    * Bake Scene
+    ***************************************************************************/
 
-        STextureCreateDesc encodeTexCreateDesc{ ETexUsage::USAGE_SRV | ETexUsage::USAGE_RTV,ETexFormat::FT_RGBA8_UNORM,pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y };
-        for (uint32_t index = 0; index < pGiBaker->m_atlas.size(); index++)
+    static constexpr uint64_t BakeSceneArrayAlignment = 16;
+
+    static_assert(sizeof(SRayTracingLight) == sizeof(SBakeSceneLight), "the bake scene light table is copied into the light buffer as is");
+
+    bool hwrtl::gi::WriteBakeScene(const std::string& filePath, const std::vector<SBakeMeshDesc>& bakeMeshDescs, const std::vector<SBakeSceneLight>& lights)
+    {
+        HWRTL_PROFILE_FUNCTION();
+
+        // instances of the same geometry share one scene mesh, keyed by the user vertex data like the shared vertex buffers
+        std::map<std::tuple<const void*, const void*, const void*>, uint32_t> sceneMeshIndices;
+        std::vector<const SBakeMeshDesc*> sceneMeshSources; // the first desc of every scene mesh
+        std::vector<SBakeSceneInstance> sceneInstances(bakeMeshDescs.size());
+        for (uint32_t index = 0; index < bakeMeshDescs.size(); index++)
         {
-            SAtlas& altas = pGiBaker->m_atlas[index];
-            altas.m_irradianceAndSampleCountEncoded = CGIBaker::GetDeviceCommand()->CreateTexture2D(encodeTexCreateDesc);
-            altas.m_shDirectionalityEncoded = CGIBaker::GetDeviceCommand()->CreateTexture2D(encodeTexCreateDesc);
+            const SBakeMeshDesc& bakeMeshDesc = bakeMeshDescs[index];
+            assert(bakeMeshDesc.m_pPositionData != nullptr);
+            assert(bakeMeshDesc.m_pLightMapUVData != nullptr);
+
+            auto meshKey = std::make_tuple((const void*)bakeMeshDesc.m_pPositionData, (const void*)bakeMeshDesc.m_pLightMapUVData, (const void*)bakeMeshDesc.m_pNormalData);
+            auto iter = sceneMeshIndices.find(meshKey);
+            if (iter == sceneMeshIndices.end())
+            {
+                iter = sceneMeshIndices.emplace(meshKey, uint32_t(sceneMeshSources.size())).first;
+                sceneMeshSources.push_back(&bakeMeshDesc);
+            }
+            assert(sceneMeshSources[iter->second]->m_nVertexCount == bakeMeshDesc.m_nVertexCount);
+
+            SBakeSceneInstance& sceneInstance = sceneInstances[index];
+            sceneInstance.m_meshInstanceInfo = bakeMeshDesc.m_meshInstanceInfo;
+            sceneInstance.m_sceneMeshIndex = iter->second;
+            sceneInstance.m_meshIndex = bakeMeshDesc.m_meshIndex;
+            sceneInstance.m_lightMapSize = bakeMeshDesc.m_nLightMapSize;
         }
 
-        CGIBaker::GetDeviceCommand()->CloseAndExecuteCmdList();
-        CGIBaker::GetDeviceCommand()->WaitGPUCmdListFinish();
-    }
+        // the tables are aligned like the arrays, sizeof(SBakeSceneInstance) is not a multiple of the alignment
+        const uint64_t meshTableOffset = sizeof(SBakeSceneHeader);
+        const uint64_t instanceTableOffset = AlignUp(meshTableOffset + sizeof(SBakeSceneMesh) * sceneMeshSources.size(), BakeSceneArrayAlignment);
+        const uint64_t lightTableOffset = AlignUp(instanceTableOffset + sizeof(SBakeSceneInstance) * sceneInstances.size(), BakeSceneArrayAlignment);
+        const uint64_t dataOffset = AlignUp(lightTableOffset + sizeof(SBakeSceneLight) * lights.size(), BakeSceneArrayAlignment);
 
-    static void ExecuteEncodeLightMapPass()
-    {
-        CGIBaker::GetGraphicsContext()->BeginRenderPasss();
-        CGIBaker::GetGraphicsContext()->SetGraphicsPipelineState(pGiBaker->m_pEncodeLightMapPSO);
+        // all array offsets are known before writing so the file can be written sequentially
+        std::vector<SBakeSceneMesh> sceneMeshes(sceneMeshSources.size());
+        uint64_t nextArrayOffset = dataOffset;
+        auto allocArray = [&nextArrayOffset](uint64_t byteSize)
+        {
+            uint64_t arrayOffset = nextArrayOffset;
+            nextArrayOffset = AlignUp(nextArrayOffset + byteSize, BakeSceneArrayAlignment);
+            return arrayOffset;
+        };
 
-        for (uint32_t atlasIndex = 0; atlasIndex < pGiBaker->m_atlas.size(); atlasIndex++)
+        for (uint32_t index = 0; index < sceneMeshSources.size(); index++)
         {
-            SAtlas& altas = pGiBaker->m_atlas[atlasIndex];
+            const SBakeMeshDesc& bakeMeshDesc = *sceneMeshSources[index];
+            SBakeSceneMesh& sceneMesh = sceneMeshes[index];
+            sceneMesh = SBakeSceneMesh();
+            sceneMesh.m_vertexNum = bakeMeshDesc.m_nVertexCount;
+            sceneMesh.m_positionOffset = allocArray(sizeof(Vec3) * bakeMeshDesc.m_nVertexCount);
+            sceneMesh.m_lightMapUVOffset = allocArray(sizeof(Vec2) * bakeMeshDesc.m_nVertexCount);
+            sceneMesh.m_normalOffset = bakeMeshDesc.m_pNormalData != nullptr ? allocArray(sizeof(Vec3) * bakeMeshDesc.m_nVertexCount) : 0;
+        }
 
-            std::vector<std::shared_ptr<CTexture2D>>renderTargets;
-            renderTargets.push_back(altas.m_irradianceAndSampleCountEncoded);
-            renderTargets.push_back(altas.m_shDirectionalityEncoded);
+        SBakeSceneHeader header = {};
+        header.m_magic = HWRTL_BAKE_SCENE_MAGIC;
+        header.m_version = HWRTL_BAKE_SCENE_VERSION;
+        header.m_meshNum = uint32_t(sceneMeshes.size());
+        header.m_instanceNum = uint32_t(sceneInstances.size());
+        header.m_lightNum = uint32_t(lights.size());
+        header.m_fileByteSize = nextArrayOffset;
+        header.m_meshTableOffset = meshTableOffset;
+        header.m_instanceTableOffset = instanceTableOffset;
+        header.m_lightTableOffset = lightTableOffset;
+        header.m_dataOffset = dataOffset;
+
+        std::ofstream sceneFile(filePath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (sceneFile.good() == false)
+        {
+            return false;
+        }
 
-            CGIBaker::GetGraphicsContext()->SetRenderTargets(renderTargets, nullptr);
-            CGIBaker::GetGraphicsContext()->SetViewport(pGiBaker->m_nAtlasSize.x, pGiBaker->m_nAtlasSize.y);
-            CGIBaker::GetGraphicsContext()->SetConstantBuffer(pGiBaker->pDenoiseGlobalCB, 0);
+        const char zeroPadding[BakeSceneArrayAlignment] = {};
+        auto writeArray = [&](const void* pData, uint64_t byteSize)
+        {
+            sceneFile.write((const char*)pData, byteSize);
+            sceneFile.write(zeroPadding, AlignUp(byteSize, BakeSceneArrayAlignment) - byteSize);
+        };
 
-            CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_irradianceAndSampleCount, 0);
-            CGIBaker::GetGraphicsContext()->SetShaderSRV(altas.m_shDirectionality, 1);
+        static_assert(sizeof(SBakeSceneHeader) % BakeSceneArrayAlignment == 0, "the mesh table starts right after the header");
+        sceneFile.write((const char*)&header, sizeof(SBakeSceneHeader));
+        writeArray(sceneMeshes.data(), sizeof(SBakeSceneMesh) * sceneMeshes.size());
+        writeArray(sceneInstances.data(), sizeof(SBakeSceneInstance) * sceneInstances.size());
+        writeArray(lights.data(), sizeof(SBakeSceneLight) * lights.size());
 
-            std::vector<std::shared_ptr<CBuffer>>vertexBuffers;
-            vertexBuffers.push_back(pGiBaker->pFullScreenVB);
-            vertexBuffers.push_back(pGiBaker->pFullScreenUV);
-            CGIBaker::GetGraphicsContext()->SetVertexBuffers(vertexBuffers);
-            CGIBaker::GetGraphicsContext()->DrawInstanced(6, 1, 0, 0);
+        for (uint32_t index = 0; index < sceneMeshSources.size(); index++)
+        {
+            const SBakeMeshDesc& bakeMeshDesc = *sceneMeshSources[index];
+            writeArray(bakeMeshDesc.m_pPositionData, sizeof(Vec3) * bakeMeshDesc.m_nVertexCount);
+            writeArray(bakeMeshDesc.m_pLightMapUVData, sizeof(Vec2) * bakeMeshDesc.m_nVertexCount);
+            if (bakeMeshDesc.m_pNormalData != nullptr)
+            {
+                writeArray(bakeMeshDesc.m_pNormalData, sizeof(Vec3) * bakeMeshDesc.m_nVertexCount);
+            }
         }
 
-        CGIBaker::GetGraphicsContext()->EndRenderPasss();
+        return sceneFile.good();
     }
 
-    void hwrtl::gi::EncodeResulttLightMap()
+    static bool IsBakeSceneArrayValid(uint64_t fileByteSize, uint64_t arrayOffset, uint64_t byteSize)
     {
-        PrePareEncodeLightMapPass();
-        ExecuteEncodeLightMapPass();
+        return (arrayOffset % BakeSceneArrayAlignment) == 0 && arrayOffset <= fileByteSize && byteSize <= fileByteSize - arrayOffset;
     }
 
-    void hwrtl::gi::GetEncodedLightMapTexture(std::vector<SOutputAtlasInfo>& outputAtlas)
+    // the offsets are validated once here, the mesh descs are built from the mapped data without further checks
+    static bool IsBakeSceneValid(const uint8_t* pFileData, uint64_t fileByteSize)
     {
-        outputAtlas.resize(pGiBaker->m_atlas.size());
-        pGiBaker->m_irradianceReadBackData.resize(pGiBaker->m_atlas.size());
-        pGiBaker->m_directionalityReadBackData.resize(pGiBaker->m_atlas.size());
-
-        uint32_t imageSize = pGiBaker->m_nAtlasSize.x * pGiBaker->m_nAtlasSize.y * sizeof(uint8_t) * 4;
-        for (uint32_t atlasIndex = 0; atlasIndex < pGiBaker->m_atlas.size(); atlasIndex++)
+        const SBakeSceneHeader* pHeader = (const SBakeSceneHeader*)pFileData;
+        if (fileByteSize < sizeof(SBakeSceneHeader) ||
+            pHeader->m_magic != HWRTL_BAKE_SCENE_MAGIC ||
+            pHeader->m_version != HWRTL_BAKE_SCENE_VERSION ||
+            pHeader->m_fileByteSize != fileByteSize)
         {
-            SAtlas& altas = pGiBaker->m_atlas[atlasIndex];
-            pGiBaker->m_irradianceReadBackData[atlasIndex] = malloc(imageSize);
-            pGiBaker->m_directionalityReadBackData[atlasIndex] = malloc(imageSize);
+            return false;
+        }
 
-            void* lockedIrradianceData = CGIBaker::GetDeviceCommand()->LockTextureForRead(altas.m_irradianceAndSampleCountEncoded);
-            void* lockedDirectionalityData = CGIBaker::GetDeviceCommand()->LockTextureForRead(altas.m_shDirectionalityEncoded);
+        if (!IsBakeSceneArrayValid(fileByteSize, pHeader->m_meshTableOffset, sizeof(SBakeSceneMesh) * uint64_t(pHeader->m_meshNum)) ||
+            !IsBakeSceneArrayValid(fileByteSize, pHeader->m_instanceTableOffset, sizeof(SBakeSceneInstance) * uint64_t(pHeader->m_instanceNum)) ||
+            !IsBakeSceneArrayValid(fileByteSize, pHeader->m_lightTableOffset, sizeof(SBakeSceneLight) * uint64_t(pHeader->m_lightNum)))
+        {
+            return false;
+        }
 
-            memcpy(pGiBaker->m_irradianceReadBackData[atlasIndex], lockedIrradianceData, imageSize);
-            memcpy(pGiBaker->m_directionalityReadBackData[atlasIndex], lockedDirectionalityData, imageSize);
+        const SBakeSceneMesh* pMeshes = (const SBakeSceneMesh*)(pFileData + pHeader->m_meshTableOffset);
+        for (uint32_t index = 0; index < pHeader->m_meshNum; index++)
+        {
+            const SBakeSceneMesh& sceneMesh = pMeshes[index];
 
-            CGIBaker::GetDeviceCommand()->UnLockTexture(altas.m_irradianceAndSampleCountEncoded);
-            CGIBaker::GetDeviceCommand()->UnLockTexture(altas.m_shDirectionalityEncoded);
+            // the baker takes unindexed triangle lists
+            if (sceneMesh.m_indexNum != 0 || (sceneMesh.m_vertexNum % 3) != 0)
+            {
+                return false;
+            }
 
-            outputAtlas[atlasIndex].destIrradianceOutputData= pGiBaker->m_irradianceReadBackData[atlasIndex];
-            outputAtlas[atlasIndex].destDirectionalityOutputData = pGiBaker->m_directionalityReadBackData[atlasIndex];
-            outputAtlas[atlasIndex].m_lightMapByteSize = imageSize;
-            outputAtlas[atlasIndex].m_pixelStride = sizeof(uint8_t) * 4;
-            outputAtlas[atlasIndex].m_lightMapSize = pGiBaker->m_nAtlasSize;
-            outputAtlas[atlasIndex].m_orginalMeshIndex.resize(altas.m_atlasGeometries.size());
-            for (uint32_t geoIndex = 0; geoIndex < altas.m_atlasGeometries.size(); geoIndex++)
+            if (!IsBakeSceneArrayValid(fileByteSize, sceneMesh.m_positionOffset, sizeof(Vec3) * uint64_t(sceneMesh.m_vertexNum)) ||
+                !IsBakeSceneArrayValid(fileByteSize, sceneMesh.m_lightMapUVOffset, sizeof(Vec2) * uint64_t(sceneMesh.m_vertexNum)) ||
+                (sceneMesh.m_normalOffset != 0 && !IsBakeSceneArrayValid(fileByteSize, sceneMesh.m_normalOffset, sizeof(Vec3) * uint64_t(sceneMesh.m_vertexNum))))
             {
-                SGIMesh& giMesh = altas.m_atlasGeometries[geoIndex];
-                outputAtlas[atlasIndex].m_orginalMeshIndex[geoIndex] = giMesh.m_meshIndex;
+                return false;
             }
         }
-    }
 
-    void hwrtl::gi::FreeLightMapCpuData()
-    {
-        for (uint32_t atlasIndex = 0; atlasIndex < pGiBaker->m_atlas.size(); atlasIndex++)
+        const SBakeSceneInstance* pInstances = (const SBakeSceneInstance*)(pFileData + pHeader->m_instanceTableOffset);
+        for (uint32_t index = 0; index < pHeader->m_instanceNum; index++)
         {
-            free(pGiBaker->m_irradianceReadBackData[atlasIndex]);
-            free(pGiBaker->m_directionalityReadBackData[atlasIndex]);
+            if (pInstances[index].m_sceneMeshIndex >= pHeader->m_meshNum)
+            {
+                return false;
+            }
         }
+        return true;
     }
 
-    void hwrtl::gi::PrePareVisualizeResultPass()
+    bool hwrtl::gi::MapBakeScene(const std::string& filePath, SBakeSceneView& outSceneView)
     {
-        CGIBaker::GetDeviceCommand()->OpenCmdList();
+        HWRTL_PROFILE_FUNCTION();
 
+        outSceneView = SBakeSceneView();
+        if (MapFileForRead(filePath, outSceneView.m_mappedFile) == false)
         {
-            Vec2i visualTex(1024, 1024);
-            Vec3 eyePosition = Vec3(0, -12, 6);
-            Vec3 eyeDirection = Vec3(0, 1, 0); // focus - eyePos
-            Vec3 upDirection = Vec3(0, 0, 1);
-
-            struct SViewCB
-            {
-                Matrix44 vpMat;
-                float padding[48];
-            }viewCB;
-            static_assert(sizeof(SViewCB) == 256, "sizeof(SViewCB) == 256");
-
-            float fovAngleY = 90;
-            float aspectRatio = float(visualTex.y) / float(visualTex.x);
-            viewCB.vpMat = GetViewProjectionMatrixRightHand(eyePosition, eyeDirection, upDirection, fovAngleY, aspectRatio, 0.1, 100.0).GetTrasnpose();
-            pGiBaker->pVisualizeViewCB = CGIBaker::GetDeviceCommand()->CreateBuffer(&viewCB, sizeof(SViewCB), sizeof(SViewCB), EBufferUsage::USAGE_CB);
+            return false;
         }
 
-        std::size_t dirPos = WstringConverter().from_bytes(__FILE__).find(L"hwrtl_gi.cpp");
-        std::wstring shaderPath = WstringConverter().from_bytes(__FILE__).substr(0, dirPos) + L"hwrtl_gi.hlsl";
-
-        std::vector<SShader>rsShaders;
-        rsShaders.push_back(SShader{ ERayShaderType::RS_VS,L"VisualizeGIResultVS" });
-        rsShaders.push_back(SShader{ ERayShaderType::RS_PS,L"VisualizeGIResultPS" });
-
-        SShaderResources rasterizationResources = { 2,0,2,0 };
-
-        std::vector<EVertexFormat>vertexLayouts;
-        vertexLayouts.push_back(EVertexFormat::FT_FLOAT3);
-        vertexLayouts.push_back(EVertexFormat::FT_FLOAT2);
-        vertexLayouts.push_back(EVertexFormat::FT_FLOAT3);
-
-        std::vector<ETexFormat>rtFormats;
-        rtFormats.push_back(ETexFormat::FT_RGBA32_FLOAT);
-
-        SRasterizationPSOCreateDesc rsPsoCreateDesc = { shaderPath, rsShaders, rasterizationResources, vertexLayouts, rtFormats, ETexFormat::FT_DepthStencil };
-        pGiBaker->m_pVisualizeGIPSO = CGIBaker::GetDeviceCommand()->CreateRSPipelineState(rsPsoCreateDesc);
+        const uint8_t* pFileData = (const uint8_t*)outSceneView.m_mappedFile.m_pData;
+        if (IsBakeSceneValid(pFileData, outSceneView.m_mappedFile.m_nByteSize) == false)
+        {
+            UnmapFile(outSceneView.m_mappedFile);
+            return false;
+        }
 
-        CGIBaker::GetDeviceCommand()->CloseAndExecuteCmdList();
-        CGIBaker::GetDeviceCommand()->WaitGPUCmdListFinish();
+        const SBakeSceneHeader* pHeader = (const SBakeSceneHeader*)pFileData;
+        outSceneView.m_pHeader = pHeader;
+        outSceneView.m_pMeshes = (const SBakeSceneMesh*)(pFileData + pHeader->m_meshTableOffset);
+        outSceneView.m_pInstances = (const SBakeSceneInstance*)(pFileData + pHeader->m_instanceTableOffset);
+        outSceneView.m_pLights = (const SBakeSceneLight*)(pFileData + pHeader->m_lightTableOffset);
+        return true;
     }
 
-    void hwrtl::gi::ExecuteVisualizeResultPass()
+    void hwrtl::gi::UnmapBakeScene(SBakeSceneView& sceneView)
     {
-        Vec2i visualTex(1024,1024);
-        STextureCreateDesc texCreateDesc{ ETexUsage::USAGE_RTV,ETexFormat::FT_RGBA32_FLOAT,visualTex.x,visualTex.y };
-        STextureCreateDesc dsCreateDesc{ ETexUsage::USAGE_DSV,ETexFormat::FT_DepthStencil,visualTex.x,visualTex.y };
-        std::shared_ptr<CTexture2D> renderTarget = CGIBaker::GetDeviceCommand()->CreateTexture2D(texCreateDesc);
-        std::shared_ptr<CTexture2D> dsTarget = CGIBaker::GetDeviceCommand()->CreateTexture2D(dsCreateDesc);
- 
-        CGIBaker::GetGraphicsContext()->BeginRenderPasss();
-        CGIBaker::GetGraphicsContext()->SetGraphicsPipelineState(pGiBaker->m_pVisualizeGIPSO);
+        UnmapFile(sceneView.m_mappedFile);
+        sceneView = SBakeSceneView();
+    }
 
-        std::vector<std::shared_ptr<CTexture2D>>renderTargets;
-        renderTargets.push_back(renderTarget);
-        CGIBaker::GetGraphicsContext()->SetRenderTargets(renderTargets, dsTarget);
-        CGIBaker::GetGraphicsContext()->SetViewport(visualTex.x, visualTex.y);
-        CGIBaker::GetGraphicsContext()->SetConstantBuffer(pGiBaker->pVisualizeViewCB,1);
+    void hwrtl::gi::GetBakeSceneMeshDescs(const SBakeSceneView& sceneView, std::vector<SBakeMeshDesc>& outBakeMeshDescs)
+    {
+        const uint8_t* pFileData = (const uint8_t*)sceneView.m_mappedFile.m_pData;
+        const SBakeSceneHeader* pHeader = sceneView.m_pHeader;
 
-        for (uint32_t index = 0; index < pGiBaker->m_atlas.size(); index++)
+        outBakeMeshDescs.resize(pHeader->m_instanceNum);
+        for (uint32_t index = 0; index < pHeader->m_instanceNum; index++)
         {
-            SAtlas& atlas = pGiBaker->m_atlas[index];
-            CGIBaker::GetGraphicsContext()->SetShaderSRV(atlas.m_irradianceAndSampleCountEncoded, 0);
-            CGIBaker::GetGraphicsContext()->SetShaderSRV(atlas.m_shDirectionalityEncoded, 1);
-            for (uint32_t geoIndex = 0; geoIndex < atlas.m_atlasGeometries.size(); geoIndex++)
-            {
-                SGIMesh& giMesh = atlas.m_atlasGeometries[geoIndex];
-                CGIBaker::GetGraphicsContext()->SetConstantBuffer(giMesh.m_hConstantBuffer, 0);
-                std::vector<std::shared_ptr<CBuffer>>vertexBuffers;
-                vertexBuffers.push_back(giMesh.m_positionVB);
-                vertexBuffers.push_back(giMesh.m_lightMapUVVB);
-                vertexBuffers.push_back(giMesh.m_normalVB);
-                CGIBaker::GetGraphicsContext()->SetVertexBuffers(vertexBuffers);
-                CGIBaker::GetGraphicsContext()->DrawInstanced(giMesh.m_nVertexCount, 1, 0, 0);
-            }
+            const SBakeSceneInstance& sceneInstance = sceneView.m_pInstances[index];
+            const SBakeSceneMesh& sceneMesh = sceneView.m_pMeshes[sceneInstance.m_sceneMeshIndex];
+
+            SBakeMeshDesc& bakeMeshDesc = outBakeMeshDescs[index];
+            bakeMeshDesc.m_pPositionData = (const Vec3*)(pFileData + sceneMesh.m_positionOffset);
+            bakeMeshDesc.m_pLightMapUVData = (const Vec2*)(pFileData + sceneMesh.m_lightMapUVOffset);
+            bakeMeshDesc.m_pNormalData = sceneMesh.m_normalOffset != 0 ? (const Vec3*)(pFileData + sceneMesh.m_normalOffset) : nullptr;
+            bakeMeshDesc.m_nVertexCount = sceneMesh.m_vertexNum;
+            bakeMeshDesc.m_nLightMapSize = sceneInstance.m_lightMapSize;
+            bakeMeshDesc.m_meshIndex = sceneInstance.m_meshIndex;
+            bakeMeshDesc.m_meshInstanceInfo = sceneInstance.m_meshInstanceInfo;
         }
-        CGIBaker::GetGraphicsContext()->EndRenderPasss();
     }
 
-	void hwrtl::gi::DeleteGIBaker()
-	{
-		delete pGiBaker;
-        Shutdown();
-	}
+    void hwrtl::gi::AddBakeSceneLights(const SBakeSceneView& sceneView)
+    {
+        const SRayTracingLight* pLights = (const SRayTracingLight*)sceneView.m_pLights;
+        for (uint32_t lightIndex = 0; lightIndex < sceneView.m_pHeader->m_lightNum; lightIndex++)
+        {
+            assert((pLights[lightIndex].m_eLightType != ELightType::LT_MESH) && "mesh lights reference the baker triangles, add them with AddMeshLight");
+            assert((pLights[lightIndex].m_eLightType != ELightType::LT_ENVIRONMENT) && "add the environment light with SetEnvironmentLight");
+        }
+        pGiBaker->m_aRayTracingLights.insert(pGiBaker->m_aRayTracingLights.end(), pLights, pLights + sceneView.m_pHeader->m_lightNum);
+    }
 
     /***************************************************************************
     * PackMeshIntoAtlas
@@ -1009,6 +4797,8 @@ namespace gi
 
     static void PackMeshIntoAtlas()
     {
+        HWRTL_PROFILE_FUNCTION();
+
         Vec2i nAtlasSize = pGiBaker->m_nAtlasSize;
         nAtlasSize = Vec2i(0, 0);
 
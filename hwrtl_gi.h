@@ -25,14 +25,24 @@ SOFTWARE.
 // DOCUMENTATION
 // 
 // Basic usage:
-//		step 1. copy hwrtl.h, d3dx12.h, hwrtl_dx12.cpp, hwrtl_gi.h and hwrtl_gi.cpp to your project
+//		step 1. copy hwrtl.h, d3dx12.h, hwrtl_dx12.cpp, hwrtl_profiler.cpp, hwrtl_gi.h and hwrtl_gi.cpp to your project
 // 
 // Custom denoiser usage:
 //		
+// Instanced mesh usage:
+//		bake mesh descs with the same m_pPositionData and m_nVertexCount share one vertex buffer and one BLAS,
+//		every desc is still an instance with its own m_meshIndex, light map and m_meshInstanceInfo transform
+// 
+// Streaming usage:
+//		call BakeLightMapStreaming instead of the separate passes if the atlases don't fit into gpu memory at once,
+//		the output is identical to the separate passes
+// 
+// Cpu probe usage:
+//		set SBakeConfig::m_bCpuProbeRayTracing to trace the probe pass with the cpu wavefront path tracer,
+//		the pass calls and GetProbeVolumeData are unchanged
+// 
 // Notice:
 //		1. we use right-handed coordinate system, so the front face of the triangle is counter-clockwise
-// TODO:
-//		1. instance mesh		
 // 
 
 #pragma once
@@ -45,6 +55,12 @@ namespace hwrtl
 {
 namespace gi
 {
+	enum class EBakeMode : uint32_t
+	{
+		BM_LIGHTING = 0, // path traced irradiance and sh directionality
+		BM_AMBIENT_OCCLUSION = 1, // ambient occlusion and bent normal, see EncodeAOLightMapPS in hwrtl_gi.hlsl
+	};
+
 	struct SBakeConfig
 	{
 		uint32_t m_maxAtlasSize;
@@ -52,6 +68,35 @@ namespace gi
 		bool m_bDebugRayTracing = false; // see RT_DEBUG_OUTPUT in hwrtl_gi.hlsl
 		bool m_bAddVisualizePass = false;
 		bool m_bUseCustomDenoiser = false; // use custom denoiser or hwrtl default denoiser
+		uint32_t m_probeRayCount = 128; // rays traced from each probe per baker sample
+
+		// BM_AMBIENT_OCCLUSION only traces one occlusion ray per texel and sample, the output atlas layout is the same as BM_LIGHTING
+		// irradiance output rgb: ambient occlusion, directionality output rgb: bent normal * 0.5 + 0.5
+		EBakeMode m_bakeMode = EBakeMode::BM_LIGHTING;
+		float m_aoMaxDistance = 1.0f; // occluders farther than this distance are ignored
+
+		bool m_bSHL2Directionality = false; // BM_LIGHTING only, output the L2 luminance sh, see SOutputAtlasInfo::m_shL2DirectionalityData
+		bool m_bCollectRayStats = false; // see GetLightMapRayTracingStats
+		bool m_bTraversalCostOutput = false; // see SOutputAtlasInfo::m_traversalCost and GetMostExpensiveMeshes
+		bool m_bCompactGBuffer = false; // 16 instead of 32 bytes per gbuffer texel, see COMPACT_GBUFFER in hwrtl_gi.hlsl
+		uint32_t m_albedoCacheSize = 32; // max width and height of the per mesh albedo cache, see SBakeMeshDesc::m_pBaseColorData
+		uint32_t m_opacityMicroMapLevel = 3; // 4^level micro triangles per alpha tested triangle, see SBakeMeshDesc::m_pAlphaMaskData
+
+		// trace the probe pass on the cpu with the wavefront path tracer instead of the ray tracing pipeline
+		// the mesh position data must be valid until PrePareProbeRayTracingPass, alpha masks are ignored by the cpu tracer
+		bool m_bCpuProbeRayTracing = false;
+		uint32_t m_cpuWavefrontSize = 1 << 18; // paths in flight per wavefront, rounded down to whole probes
+		bool m_bCpuRayReordering = false; // sort the bounce and shadow rays of the cpu probe pass by direction octant and origin before traversal
+
+		// fast preview bake for light placement, m_bakerSamples is ignored and every texel traces a single sample
+		// BM_LIGHTING only bakes the direct lighting of the texel: one light sample and its shadow ray, no bounces
+		// DenoiseAndDilateLightMap uses a small normal aware blur instead of the JNLM denoiser
+		bool m_bPreviewBake = false;
+		float m_previewLightMapScale = 0.5f; // scale of SBakeMeshDesc::m_nLightMapSize in the preview bake
+
+		// bakes with the same seed, meshes, lights and config are bit identical, the sample sequence of a texel
+		// depends on the original mesh index and the texel inside the mesh light map, not on the atlas packing
+		uint32_t m_bakeSeed = 0;
 	};
 
 	// must match the shading model id define in the hlsl shader
@@ -63,11 +108,24 @@ namespace gi
 
 	struct SBakeMeshDesc
 	{
-		const Vec3* m_pPositionData = nullptr;
+		const Vec3* m_pPositionData = nullptr; // descs with the same position data are instances of the same geometry
 		const Vec2* m_pLightMapUVData = nullptr;
 		//const Vec3i* m_pIndexData = nullptr;
 		const Vec3* m_pNormalData = nullptr; // optional
 
+		// optional base color texture, box filtered once into the low resolution albedo cache sampled by the bounce rays
+		// descs with the same base color data and size share the cache texels
+		const Vec2* m_pTextureUVData = nullptr; // wrapped, required by m_pBaseColorData
+		const uint32_t* m_pBaseColorData = nullptr; // rgba8 srgb, m_baseColorSize.x * m_baseColorSize.y texels
+		Vec2i m_baseColorSize;
+		Vec3 m_baseColor = Vec3(0.55f, 0.55f, 0.55f); // linear, used if there is no base color texture
+
+		// optional alpha mask, texels below the cutoff don't block rays
+		// an opacity micro map is baked per triangle, only the micro triangles that are neither opaque nor transparent read the mask during traversal
+		const uint8_t* m_pAlphaMaskData = nullptr; // m_alphaMaskSize.x * m_alphaMaskSize.y texels, uses m_pTextureUVData
+		Vec2i m_alphaMaskSize;
+		float m_alphaCutoff = 0.5f;
+
 		uint32_t m_nVertexCount = 0;
 		//uint32_t m_nIndexCount = 0;
 
@@ -85,14 +143,325 @@ namespace gi
 		virtual void InitDenoiser() = 0;
 	};
 
+	#define HWRTL_SH_L2_COEFFICIENT_NUM 9
+
+	// mip 1 to mip n of an output atlas, see GenerateLightMapMipChain
+	struct SOutputMipInfo
+	{
+		Vec2i m_mipSize;
+		std::vector<uint8_t> m_irradianceData;
+		std::vector<uint8_t> m_directionalityData;
+	};
+
+	// packed L2 sh directionality:
+	//		coefficient i (1 - 8) of the luminance sh is stored as a byte b_i, sh_i = (b_i / 255 * 2 - 1) * SHL2PackRange[i] * sh_0 
+	//		sh_0 is the dc coefficient of the luminance sh, b_1 - b_4 are in m_shL2DirectionalityData[0], b_5 - b_8 are in m_shL2DirectionalityData[1]
+	//		SHL2PackRange[i] is max(|Y_i|) / Y_0, which bounds the coefficients of any non negative signal
+	static constexpr float SHL2PackRange[HWRTL_SH_L2_COEFFICIENT_NUM] = { 1.0f, 1.732051f, 1.732051f, 1.732051f, 1.936492f, 1.936492f, 2.236068f, 1.936492f, 1.936492f };
+
 	struct SOutputAtlasInfo
 	{
 		std::vector<uint32_t> m_orginalMeshIndex;
+		std::vector<Vec4> m_lightMapScaleAndBias; // same order as m_orginalMeshIndex
 		void* destIrradianceOutputData = nullptr;
 		void* destDirectionalityOutputData = nullptr;
 		uint32_t m_lightMapByteSize = 0;
 		uint32_t m_pixelStride = 0;
 		Vec2i m_lightMapSize;
+		EBakeMode m_bakeMode = EBakeMode::BM_LIGHTING; // BM_LIGHTING irradiance is sqrt encoded, BM_AMBIENT_OCCLUSION is linear
+
+		std::vector<uint8_t> m_coverage; // gbuffer coverage, 1 byte per texel, 0 for the texels not covered by any mesh
+		std::vector<SOutputMipInfo> m_mips; // empty until GenerateLightMapMipChain is called
+
+		std::vector<uint8_t> m_shL2DirectionalityData[2]; // rgba8 atlases, empty if SBakeConfig::m_bSHL2Directionality is false
+
+		// per texel average of x: traced rays per sample, y: path length, empty if SBakeConfig::m_bTraversalCostOutput is false
+		// the hardware ray tracing api doesn't expose the bvh node and triangle test counts, so the traced ray count is the cost metric
+		std::vector<Vec2> m_traversalCost;
+	};
+
+	struct SMeshTraversalCost
+	{
+		uint32_t m_orginalMeshIndex;
+		uint32_t m_texelNum;
+		double m_totalCost; // sum of the traced rays per sample of all texels of the mesh
+	};
+
+	// probes of a uniform volume are stored x first, then y, then z: probeIndex = (z * resolution.y + y) * resolution.x + x
+	// every probe has HWRTL_PROBE_SH_COEFFICIENT_NUM rgb coefficients, coefficient i of probe p is at m_shCoefficients[(p * HWRTL_PROBE_SH_COEFFICIENT_NUM + i) * 3]
+	// the coefficients are the L2 projection of the incoming radiance, convolve them with the cosine lobe to get irradiance
+	#define HWRTL_PROBE_SH_COEFFICIENT_NUM 9
+	#define HWRTL_INVALID_PROBE_INDEX 0xFFFFFFFF
+
+	// every probe has a HWRTL_PROBE_DEPTH_OCT_SIZE^2 octahedral map of the hit distance moments for the runtime chebyshev visibility test, 
+	// texel (x, y) of probe p is at m_depthMoments[((p * HWRTL_PROBE_DEPTH_OCT_SIZE + y) * HWRTL_PROBE_DEPTH_OCT_SIZE + x) * 2], 
+	// it contains two half floats: mean distance / m_probeMaxDepth, mean squared distance / m_probeMaxDepth^2
+	#define HWRTL_PROBE_DEPTH_OCT_SIZE 8
+
+	// a leaf of the adaptive probe octree, positions and sizes are in finest octree cells relative to the volume min
+	// corner i is at m_cellMin + m_cellSize * Vec3i(i & 1, (i >> 1) & 1, (i >> 2) & 1)
+	struct SProbeBrick
+	{
+		Vec3i m_cellMin;
+		uint32_t m_cellSize;
+		uint32_t m_probeIndices[8]; // HWRTL_INVALID_PROBE_INDEX for the probes culled by the inside geometry test
+	};
+
+	struct SOutputProbeVolumeInfo
+	{
+		Vec3 m_volumeMin;
+		Vec3 m_volumeMax;
+		Vec3i m_probeResolution; // uniform volume only
+		std::vector<Vec3> m_probePositions;
+		std::vector<float> m_shCoefficients;
+
+		float m_probeMaxDepth;
+		std::vector<uint16_t> m_depthMoments;
+
+		// adaptive volume only, runtime lookup: finest cell -> m_indirection -> brick -> trilinear interpolation between the brick corners
+		Vec3i m_indirectionSize; // finest octree cell number per axis
+		std::vector<uint32_t> m_indirection; // brick index of every finest cell, stored x first, then y, then z
+		std::vector<SProbeBrick> m_bricks;
+	};
+
+	#define HWRTL_RAY_STATS_MAX_BOUNCES 32 // must match maxBounces in hwrtl_gi.hlsl
+
+	// counters of the last ExecuteLightMapRayTracingPass, the bvh node and triangle test counts are not exposed by the hardware ray tracing api
+	struct SRayTracingStats
+	{
+		uint64_t m_primaryRayCount = 0; // first material ray of every path
+		uint64_t m_bounceRayCount = 0;
+		uint64_t m_shadowRayCount = 0;
+		uint64_t m_occlusionRayCount = 0; // BM_AMBIENT_OCCLUSION only
+		uint64_t m_hitCount = 0;
+		uint64_t m_missCount = 0;
+		uint64_t m_pathLengthHistogram[HWRTL_RAY_STATS_MAX_BOUNCES + 1] = {}; // number of paths that end at bounce n
+
+		double m_passSeconds = 0.0; // wall time of the pass, includes the gpu time
+
+		uint64_t GetTotalRayCount() const { return m_primaryRayCount + m_bounceRayCount + m_shadowRayCount + m_occlusionRayCount; }
+		double GetMegaRaysPerSecond() const { return m_passSeconds > 0.0 ? double(GetTotalRayCount()) / m_passSeconds * 1e-6 : 0.0; }
+	};
+
+	// counters of the last ExecuteProbeRayTracingPass on the cpu, see SBakeConfig::m_bCpuProbeRayTracing
+	struct SCpuRayTracingStats
+	{
+		uint64_t m_extensionRayCount = 0; // probe rays and bounce rays
+		uint64_t m_shadowRayCount = 0;
+		uint64_t m_nodeVisitCount = 0; // bvh nodes popped from the traversal stack
+		uint64_t m_triangleTestCount = 0;
+
+		double m_passSeconds = 0.0;
+		double m_reorderSeconds = 0.0; // included in m_passSeconds, 0 if SBakeConfig::m_bCpuRayReordering is false
+
+		uint64_t GetTotalRayCount() const { return m_extensionRayCount + m_shadowRayCount; }
+		double GetNodesPerRay() const { return GetTotalRayCount() > 0 ? double(m_nodeVisitCount) / double(GetTotalRayCount()) : 0.0; }
+		double GetMegaRaysPerSecond() const { return m_passSeconds > 0.0 ? double(GetTotalRayCount()) / m_passSeconds * 1e-6 : 0.0; }
+	};
+
+	// Light map container:
+	//		the baked atlases are stored as fixed size tiles with a mip chain, so that the runtime can stream tiles by visibility
+	//		the file is designed to be memory mapped and used without parsing:
+	//		
+	//		SLightMapContainerHeader
+	//		SLightMapContainerMip[atlasNum * layerNum * mipNum]	mip (atlasIndex, layerIndex, mipIndex) is at ((atlasIndex * layerNum) + layerIndex) * mipNum + mipIndex
+	//		uint64_t[tileNum]									tile offset table, tiles of a mip are stored row by row starting at SLightMapContainerMip::m_firstTile
+	//		SLightMapContainerMesh[meshNum]
+	//		tile data											every tile is tileSize * tileSize * pixelStride bytes and starts at a page aligned offset
+	//		
+	//		tiles that contain only zero texels (atlas gutter) share one zero tile
+	//		the last mip of the chain is the first mip that fits into a single tile
+	//		mips are taken from SOutputAtlasInfo::m_mips, they are generated by GenerateLightMapMipChain if it is empty
+
+	#define HWRTL_LIGHTMAP_CONTAINER_MAGIC 0x4D4C5748 // 'HWLM'
+	#define HWRTL_LIGHTMAP_CONTAINER_VERSION 1
+
+	enum class ELightMapLayer : uint32_t
+	{
+		LML_IRRADIANCE = 0,
+		LML_DIRECTIONALITY = 1,
+		LML_NUM = 2,
+	};
+
+	struct SLightMapContainerHeader
+	{
+		uint32_t m_magic;
+		uint32_t m_version;
+		uint32_t m_tileSize;
+		uint32_t m_pixelStride;
+
+		uint32_t m_atlasNum;
+		uint32_t m_layerNum;
+		uint32_t m_mipNum; // mip num per atlas layer
+		uint32_t m_meshNum;
+
+		uint32_t m_atlasWidth;
+		uint32_t m_atlasHeight;
+		uint32_t m_tileNum;
+		uint32_t m_tileByteSize;
+
+		uint64_t m_mipTableOffset;
+		uint64_t m_tileTableOffset;
+		uint64_t m_meshTableOffset;
+		uint64_t m_tileDataOffset;
+	};
+	static_assert(sizeof(SLightMapContainerHeader) == 80, "sizeof(SLightMapContainerHeader) == 80");
+
+	struct SLightMapContainerMip
+	{
+		uint32_t m_atlasIndex;
+		uint32_t m_layerIndex;
+		uint32_t m_mipIndex;
+		uint32_t m_mipWidth;
+
+		uint32_t m_mipHeight;
+		uint32_t m_tileNumX;
+		uint32_t m_tileNumY;
+		uint32_t m_firstTile;
+	};
+	static_assert(sizeof(SLightMapContainerMip) == 32, "sizeof(SLightMapContainerMip) == 32");
+
+	struct SLightMapContainerMesh
+	{
+		uint32_t m_orginalMeshIndex;
+		uint32_t m_atlasIndex;
+		uint32_t m_meshPadding0;
+		uint32_t m_meshPadding1;
+		Vec4 m_lightMapScaleAndBias;
+	};
+	static_assert(sizeof(SLightMapContainerMesh) == 32, "sizeof(SLightMapContainerMesh) == 32");
+
+	// Bake scene file:
+	//		a flat scene description for bake jobs, the file is memory mapped and the mesh descs point into the mapped data
+	//		
+	//		SBakeSceneHeader
+	//		SBakeSceneMesh[meshNum]				geometry shared by the instances
+	//		SBakeSceneInstance[instanceNum]		one SBakeMeshDesc per instance
+	//		SBakeSceneLight[lightNum]
+	//		array data							position, light map uv, normal and index arrays
+	//		
+	//		every table and array starts at a 16 byte aligned offset, the gaps are zero padding
+	//		
+	//		the baker takes unindexed triangle lists, meshes with an index array are rejected by MapBakeScene for now
+
+	#define HWRTL_BAKE_SCENE_MAGIC 0x4E435348 // 'HSCN'
+	#define HWRTL_BAKE_SCENE_VERSION 1
+
+	// must match the light type define in hlsl code
+	enum class ELightType : uint32_t
+	{
+		LT_DIRECTION = 1 << 0,
+		LT_SPHERE   = 1 << 1,
+		LT_MESH     = 1 << 2, // emissive bake mesh, see AddMeshLight, not stored in bake scene files
+		LT_ENVIRONMENT = 1 << 3, // see SetEnvironmentLight, not stored in bake scene files
+	};
+
+	struct SBakeSceneHeader
+	{
+		uint32_t m_magic;
+		uint32_t m_version;
+		uint32_t m_meshNum;
+		uint32_t m_instanceNum;
+
+		uint32_t m_lightNum;
+		uint32_t m_headerPadding0;
+		uint64_t m_fileByteSize;
+
+		uint64_t m_meshTableOffset;
+		uint64_t m_instanceTableOffset;
+		uint64_t m_lightTableOffset;
+		uint64_t m_dataOffset;
+	};
+	static_assert(sizeof(SBakeSceneHeader) == 64, "sizeof(SBakeSceneHeader) == 64");
+
+	struct SBakeSceneMesh
+	{
+		uint32_t m_vertexNum;
+		uint32_t m_indexNum;
+		uint32_t m_meshPadding0;
+		uint32_t m_meshPadding1;
+
+		uint64_t m_positionOffset; // Vec3[m_vertexNum]
+		uint64_t m_lightMapUVOffset; // Vec2[m_vertexNum]
+		uint64_t m_normalOffset; // Vec3[m_vertexNum], 0 if the mesh has no normals
+		uint64_t m_indexOffset; // uint32_t[m_indexNum], 0 if the mesh is not indexed
+	};
+	static_assert(sizeof(SBakeSceneMesh) == 48, "sizeof(SBakeSceneMesh) == 48");
+
+	struct SBakeSceneInstance
+	{
+		SMeshInstanceInfo m_meshInstanceInfo;
+		uint32_t m_sceneMeshIndex;
+		int m_meshIndex; // SBakeMeshDesc::m_meshIndex
+		Vec2i m_lightMapSize;
+	};
+	static_assert(sizeof(SBakeSceneInstance) == 72, "sizeof(SBakeSceneInstance) == 72");
+
+	// same layout as the light buffer of the ray tracing pass
+	struct SBakeSceneLight
+	{
+		Vec3 m_color;
+		uint32_t m_isStationary;
+
+		Vec3 m_direction; // normalized, directional lights only
+		ELightType m_eLightType;
+
+		Vec3 m_worldPosition;
+		float m_attenuation;
+
+		float m_radius;
+		Vec3 m_lightPadding;
+	};
+	static_assert(sizeof(SBakeSceneLight) == 64, "sizeof(SBakeSceneLight) == 64");
+
+	// compact gbuffer texel, see COMPACT_GBUFFER in hwrtl_gi.hlsl
+	// the position is quantized to 16 bit per axis inside the world bounds of the mesh instance
+	struct SCompactGBufferTexel
+	{
+		uint32_t m_packedPositionXY;
+		uint32_t m_packedPositionZ;
+		uint32_t m_packedNormal; // octahedral, 2 x 16 bit snorm
+		uint32_t m_instanceIndexPlusOne; // 0 for the texels not covered by any mesh
+	};
+	static_assert(sizeof(SCompactGBufferTexel) == 16, "sizeof(SCompactGBufferTexel) == 16");
+
+	struct SLightMapDiff
+	{
+		uint64_t m_comparedTexelNum = 0;
+		uint64_t m_differentTexelNum = 0;
+		uint32_t m_maxAbsError = 0; // in 8 bit units
+		double m_rmse = 0.0; // in 8 bit units, over all channels of all compared texels
+		double m_psnr = 0.0; // in dB, infinity if the atlases are identical
+
+		bool IsBitIdentical() const { return m_differentTexelNum == 0; }
+		bool IsWithinThreshold(double maxRmse, double minPsnr) const { return m_rmse <= maxRmse && m_psnr >= minPsnr; }
+	};
+
+	struct SLightMapContainerView
+	{
+		SMappedFile m_mappedFile;
+		const SLightMapContainerHeader* m_pHeader = nullptr;
+		const SLightMapContainerMip* m_pMips = nullptr;
+		const uint64_t* m_pTileOffsets = nullptr;
+		const SLightMapContainerMesh* m_pMeshes = nullptr;
+	};
+
+	// a point on a mesh light, see SampleMeshLight
+	struct SMeshLightSample
+	{
+		Vec3 m_position;
+		Vec3 m_normal; // the emitting side
+		uint32_t m_triangleIndex; // inside the mesh light
+		float m_areaPdf; // 1 / total area of the mesh light
+	};
+
+	struct SBakeSceneView
+	{
+		SMappedFile m_mappedFile;
+		const SBakeSceneHeader* m_pHeader = nullptr;
+		const SBakeSceneMesh* m_pMeshes = nullptr;
+		const SBakeSceneInstance* m_pInstances = nullptr;
+		const SBakeSceneLight* m_pLights = nullptr;
 	};
 
 	void InitGIBaker(SBakeConfig bakeConfig);
@@ -102,11 +471,45 @@ namespace gi
 	void AddDirectionalLight(Vec3 color, Vec3 direction, bool isStationary);
 	void AddSphereLight(Vec3 color, Vec3 worldPosition, bool isStationary, float attenuation, float radius);
 
+	// the bake mesh with m_meshIndex == meshIndex emits emittedRadiance from its front faces, add the bake mesh first
+	// the triangles are sampled by area, returns the light index used by SampleMeshLight
+	uint32_t AddMeshLight(int meshIndex, Vec3 emittedRadiance, bool isStationary);
+
+	// cpu reference of the mesh light sampling in hwrtl_gi.hlsl, randomX picks the triangle and is reused with randomY for the barycentrics
+	bool SampleMeshLight(uint32_t lightIndex, float randomX, float randomY, SMeshLightSample& outSample);
+
+	// equirectangular hdr sky, z up, the first row is the zenith, pRadianceData is width * height linear radiance
+	// the texels are importance sampled by luminance, only one environment light per bake, returns the light index
+	uint32_t SetEnvironmentLight(const Vec3* pRadianceData, Vec2i environmentSize, float intensity, bool isStationary);
+
+	// bake scene files, see SBakeSceneHeader, the instances of the same geometry share one scene mesh
+	// the mesh descs returned by GetBakeSceneMeshDescs point into the mapped file, the baker reads the position data after the upload
+	// (compact gbuffer bounds, AddAdaptiveProbeVolume, the cpu probe pass), keep the file mapped until DeleteGIBaker
+	bool WriteBakeScene(const std::string& filePath, const std::vector<SBakeMeshDesc>& bakeMeshDescs, const std::vector<SBakeSceneLight>& lights);
+	bool MapBakeScene(const std::string& filePath, SBakeSceneView& outSceneView);
+	void UnmapBakeScene(SBakeSceneView& sceneView);
+	void GetBakeSceneMeshDescs(const SBakeSceneView& sceneView, std::vector<SBakeMeshDesc>& outBakeMeshDescs);
+	void AddBakeSceneLights(const SBakeSceneView& sceneView);
+
 	void PrePareLightMapGBufferPass();
 	void ExecuteLightMapGBufferPass();
 	
 	void PrePareLightMapRayTracingPass();
 	void ExecuteLightMapRayTracingPass();
+	void GetLightMapRayTracingStats(SRayTracingStats& outStats); // SBakeConfig::m_bCollectRayStats must be true
+
+	// probes are placed at the grid corners of the volume, probeResolution is the probe number per axis
+	void AddProbeVolume(Vec3 volumeMin, Vec3 volumeMax, Vec3i probeResolution);
+
+	// probes are placed at the corners of an octree that is only refined near the scene triangles, the finest cell is (volumeMax - volumeMin) / 2^maxOctreeDepth
+	// must be called after AddBakeMeshsAndCreateVB, the mesh position data must be valid during this call
+	// the probes inside the geometry are culled in PrePareProbeRayTracingPass
+	void AddAdaptiveProbeVolume(Vec3 volumeMin, Vec3 volumeMax, uint32_t maxOctreeDepth);
+
+	void PrePareProbeRayTracingPass();
+	void ExecuteProbeRayTracingPass();
+	void GetProbeVolumeData(std::vector<SOutputProbeVolumeInfo>& outputProbeVolumes);
+	void GetCpuProbeRayTracingStats(SCpuRayTracingStats& outStats); // SBakeConfig::m_bCpuProbeRayTracing must be true
 
 	void PrePareVisualizeResultPass();
 	void ExecuteVisualizeResultPass();
@@ -115,8 +518,32 @@ namespace gi
 	void EncodeResulttLightMap(); // optional pass, you can encode the lightmap by you self
 	void GetEncodedLightMapTexture(std::vector<SOutputAtlasInfo>& outputAtlas);
 
+	// runs every pass from the gbuffer pass to the readback for atlasWindowSize atlases at a time and releases their textures
+	// before the next window, the peak gpu memory scales with the window size instead of the atlas count
+	// replaces the PrePare / Execute / DenoiseAndDilateLightMap / EncodeResulttLightMap / GetEncodedLightMapTexture calls,
+	// the visualize pass is not supported
+	void BakeLightMapStreaming(std::vector<SOutputAtlasInfo>& outputAtlas, uint32_t atlasWindowSize = 1);
+
 	void FreeLightMapCpuData();
 
+	// the topN meshes with the largest total traversal cost, sorted by the total cost
+	void GetMostExpensiveMeshes(const std::vector<SOutputAtlasInfo>& outputAtlas, uint32_t topN, std::vector<SMeshTraversalCost>& outMeshCosts);
+
+	// coverage weighted mip chain down to 1x1, the texels of a mesh are only filtered with the texels of the same mesh
+	void GenerateLightMapMipChain(std::vector<SOutputAtlasInfo>& outputAtlas);
+
+	bool WriteLightMapContainer(const std::string& filePath, const std::vector<SOutputAtlasInfo>& outputAtlas, uint32_t tileSize = 128);
+	bool MapLightMapContainer(const std::string& filePath, SLightMapContainerView& outContainerView);
+	void UnmapLightMapContainer(SLightMapContainerView& containerView);
+	const uint8_t* GetLightMapContainerTile(const SLightMapContainerView& containerView, uint32_t atlasIndex, ELightMapLayer layer, uint32_t mipIndex, uint32_t tileX, uint32_t tileY);
+
+	SCompactGBufferTexel EncodeCompactGBufferTexel(Vec3 worldPosition, Vec3 worldFaceNormal, Vec3 boundsMin, Vec3 boundsSize, uint32_t instanceIndex);
+	void DecodeCompactGBufferTexel(const SCompactGBufferTexel& texel, Vec3 boundsMin, Vec3 boundsSize, Vec3& outWorldPosition, Vec3& outWorldFaceNormal);
+
+	// compare the encoded mip 0 of both layers of every atlas, return false if the atlas layouts don't match
+	bool CompareLightMapAtlases(const std::vector<SOutputAtlasInfo>& referenceAtlas, const std::vector<SOutputAtlasInfo>& testAtlas, SLightMapDiff& outDiff);
+	bool CompareLightMapContainer(const SLightMapContainerView& referenceContainer, const std::vector<SOutputAtlasInfo>& testAtlas, SLightMapDiff& outDiff);
+
 	void GetEncodedLightMap(uint32_t orinalMeshIndex); //TODO
 	void GetUnEncodedLightMapTexture(); // TODO:
 
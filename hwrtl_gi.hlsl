@@ -64,6 +64,76 @@ SamplerState gSamPointWarp : register(s0, space1000);
 SamplerState gSamLinearWarp : register(s4, space1000);
 SamplerState gSamLinearClamp : register(s5, space1000);
 
+/***************************************************************************
+*   Compact GBuffer
+*
+*   COMPACT_GBUFFER stores one RGBA32_UINT texel instead of a RGBA32_FLOAT position and a RGBA32_FLOAT normal
+*   x: 16 bit x | 16 bit y, y: 16 bit z, position quantized to the world bounds of the mesh instance
+*   z: octahedral face normal, 2 x 16 bit snorm
+*   w: gbuffer instance index + 1, 0 for the texels not covered by any mesh
+*   must match EncodeCompactGBufferTexel and DecodeCompactGBufferTexel in hwrtl_gi.cpp
+***************************************************************************/
+
+struct SGBufferInstanceGpuData
+{
+    float4 m_positionBoundsMin;
+    float4 m_positionBoundsSize;
+    uint4 m_texelKeyInfo; // same as CGeomConstantBuffer::m_texelKeyInfo
+};
+
+// [-1,1]^2 octahedral coordinate of a unit direction
+float2 OctahedronEncodeSigned(float3 direction)
+{
+    float3 octDirection = direction / (abs(direction.x) + abs(direction.y) + abs(direction.z));
+    float2 octCoord = octDirection.xy;
+    if(octDirection.z < 0.0)
+    {
+        float2 signNotZero = float2(octDirection.x >= 0.0 ? 1.0 : -1.0, octDirection.y >= 0.0 ? 1.0 : -1.0);
+        octCoord = (1.0 - abs(octDirection.yx)) * signNotZero;
+    }
+    return octCoord;
+}
+
+float3 OctahedronDecodeSigned(float2 octCoord)
+{
+    float3 direction = float3(octCoord, 1.0 - abs(octCoord.x) - abs(octCoord.y));
+    if(direction.z < 0.0)
+    {
+        float2 signNotZero = float2(direction.x >= 0.0 ? 1.0 : -1.0, direction.y >= 0.0 ? 1.0 : -1.0);
+        direction.xy = (1.0 - abs(direction.yx)) * signNotZero;
+    }
+    return normalize(direction);
+}
+
+uint PackSnorm2x16(float2 value)
+{
+    int2 quantized = int2(round(clamp(value, -1.0, 1.0) * 32767.0));
+    return (uint(quantized.x) & 0xFFFFu) | (uint(quantized.y) << 16);
+}
+
+float2 UnpackSnorm2x16(uint packedValue)
+{
+    int2 quantized = int2(int(packedValue << 16) >> 16, int(packedValue) >> 16);
+    return max(float2(quantized) / 32767.0, -1.0);
+}
+
+uint4 EncodeCompactGBuffer(float3 worldPosition, float3 worldFaceNormal, float3 boundsMin, float3 boundsSize, uint instanceIndex)
+{
+    uint3 quantizedPosition = uint3(round(saturate((worldPosition - boundsMin) / max(boundsSize, 1e-6)) * 65535.0));
+    return uint4(quantizedPosition.x | (quantizedPosition.y << 16), quantizedPosition.z, PackSnorm2x16(OctahedronEncodeSigned(worldFaceNormal)), instanceIndex + 1);
+}
+
+float3 DecodeCompactGBufferPosition(uint4 compactTexel, SGBufferInstanceGpuData instanceData)
+{
+    uint3 quantizedPosition = uint3(compactTexel.x & 0xFFFFu, compactTexel.x >> 16, compactTexel.y & 0xFFFFu);
+    return instanceData.m_positionBoundsMin.xyz + float3(quantizedPosition) * (1.0 / 65535.0) * instanceData.m_positionBoundsSize.xyz;
+}
+
+float3 DecodeCompactGBufferNormal(uint4 compactTexel)
+{
+    return OctahedronDecodeSigned(UnpackSnorm2x16(compactTexel.z));
+}
+
 /***************************************************************************
 *   LightMap GBuffer Generation Pass
 ***************************************************************************/
@@ -84,7 +154,11 @@ cbuffer CGeomConstantBuffer : register(b0)
 {
     float4x4 m_worldTM;
     float4   m_lightMapScaleAndBias;
-    float padding[44];
+    uint4    m_texelKeyInfo; // xy: mesh offset in the atlas, z: mesh light map width, w: original mesh index
+    float4   m_positionBoundsMin; // COMPACT_GBUFFER only, world bounds of the mesh instance
+    float4   m_positionBoundsSize;
+    uint4    m_gbufferInstanceInfo; // COMPACT_GBUFFER only, x: gbuffer instance index
+    float padding[28];
 };
 
 SGeometryVS2PS LightMapGBufferGenVS(SGeometryApp2VS IN )
@@ -100,8 +174,12 @@ SGeometryVS2PS LightMapGBufferGenVS(SGeometryApp2VS IN )
 
 struct SLightMapGBufferOutput
 {
+#if COMPACT_GBUFFER
+    uint4 m_compactGBuffer :SV_Target0;
+#else
     float4 m_worldPosition :SV_Target0;
     float4 m_worldFaceNormal :SV_Target1;
+#endif
 };
 
 SLightMapGBufferOutput LightMapGBufferGenPS(SGeometryVS2PS IN)
@@ -114,8 +192,16 @@ SLightMapGBufferOutput LightMapGBufferGenPS(SGeometryVS2PS IN)
     //float texelSize = max(deltaPosition.x, max(deltaPosition.y, deltaPosition.z));
     //texelSize *= sqrt(2.0); 
 
-    output.m_worldPosition      = IN.m_worldPosition;
-    output.m_worldFaceNormal = float4(-faceNormal, 1.0);
+#if COMPACT_GBUFFER
+    // the texel key is rebuilt from the gbuffer instance, see LoadLightMapGBufferTexel
+    output.m_compactGBuffer = EncodeCompactGBuffer(IN.m_worldPosition.xyz, -faceNormal, m_positionBoundsMin.xyz, m_positionBoundsSize.xyz, m_gbufferInstanceInfo.x);
+#else
+    // w components: texel index inside the mesh light map and original mesh index + 1, see GetLightMapTexelSampleKey
+    // both are integers below 2^24 so they are exact in a float, normal w is also the coverage flag
+    int2 meshTexel = max(int2(IN.m_position.xy) - int2(m_texelKeyInfo.xy), int2(0, 0));
+    output.m_worldPosition      = float4(IN.m_worldPosition.xyz, float(meshTexel.y * m_texelKeyInfo.z + meshTexel.x));
+    output.m_worldFaceNormal = float4(-faceNormal, float(m_texelKeyInfo.w + 1));
+#endif
     return output;
 }
 
@@ -136,6 +222,13 @@ SLightMapGBufferOutput LightMapGBufferGenPS(SGeometryVS2PS IN)
 // sample Light Define
 #define RT_LIGHT_TYPE_DIRECTIONAL (1 << 0)
 #define RT_LIGHT_TYPE_SPHERE (1 << 1)
+#define RT_LIGHT_TYPE_MESH (1 << 2)
+#define RT_LIGHT_TYPE_ENVIRONMENT (1 << 3)
+
+// must match EOpacityState in hwrtl_gi.cpp
+#define OMM_STATE_TRANSPARENT 0
+#define OMM_STATE_OPAQUE 1
+#define OMM_STATE_UNKNOWN 2
 // ray tacing shader index
 #define RT_MATERIAL_SHADER_INDEX 0
 #define RT_SHADOW_SHADER_INDEX 1
@@ -146,17 +239,30 @@ static const uint debugSample = 0;
 
 struct SRayTracingLight
 {
-    float3 m_color; // light power
+    float3 m_color; // light power, emitted radiance for mesh lights, average radiance for the environment light
     uint m_isStationary; // stationary or static light
 
     float3 m_lightDirection; // light direction
-    uint m_eLightType; // spjere light / directional light
+    uint m_eLightType; // spjere light / directional light / mesh light
 
-    float3 m_worldPosition; // spjere light world position
+    float3 m_worldPosition; // spjere light world position, bounds center for mesh lights
     float m_vAttenuation; // spjere light attenuation
 
-    float m_radius; // spjere light radius
-    float3 m_rtLightpadding;
+    float m_radius; // spjere light radius, bounds radius for mesh lights
+    float m_meshLightArea; // total area of the mesh light triangles
+    uint m_triangleOffset; // first triangle of the mesh light in rtMeshLightTriangles
+    uint m_triangleCount;
+};
+
+// world space triangle of a mesh light, m_cdf is the area cdf inside the mesh light, see AddMeshLight in hwrtl_gi.cpp
+struct SMeshLightTriangle
+{
+    float3 m_vertex0;
+    float m_cdf;
+    float3 m_vertex1;
+    float m_area;
+    float3 m_vertex2;
+    float m_trianglePadding;
 };
 
 struct SMeshInstanceGpuData
@@ -165,7 +271,9 @@ struct SMeshInstanceGpuData
     uint ibStride;
     uint ibIndex;
     uint vbIndex;
-    uint unused;
+    uint meshLightIndexPlusOne; // 0 if the instance isn't emissive
+    uint4 albedoInfo; // x: albedo cache offset, y: cache width | height << 16, 0 without base color texture, z: srgb rgba8 base color, w: texture uv bindless index
+    uint4 alphaInfo; // x: opacity micro map offset, y: alpha mask offset, z: mask width | height << 16, 0 if opaque, w: micro map level | alpha cutoff << 8
 };
 
 ByteAddressBuffer bindlessByteAddressBuffer[] : BINDLESS_BYTE_ADDRESS_BUFFER_REGISTER;
@@ -184,18 +292,75 @@ cbuffer CRtGlobalConstantBuffer : register(b0)
     uint m_nRtSceneLightCount;
     uint2 m_nAtlasSize;
     uint m_rtSampleIndex;
-    float m_rtGlobalCbPadding[60];
+    uint m_nProbeCount;
+    uint m_nProbeRayCount;
+    float m_fProbeMaxDepth;
+    float m_fAOMaxDistance;
+    uint m_nBakeSeed;
+    uint m_nEnvironmentLightIndex; // environment light index + 1, 0 if there is no environment light
+    uint2 m_nEnvironmentLightSize; // width and height of the environment map
+    float4 m_environmentSH[9]; // L2 sh projection of the environment radiance, rgb
+    float m_rtGlobalCbPadding[16];
 };
 
 RaytracingAccelerationStructure rtScene : register(t0);
+#if RT_PROBE_PASS
+StructuredBuffer<SRayTracingLight> rtSceneLights : register(t1);
+StructuredBuffer<SMeshInstanceGpuData> rtSceneInstanceGpuData : register(t2);
+StructuredBuffer<float4> rtProbePositions : register(t3);
+StructuredBuffer<SMeshLightTriangle> rtMeshLightTriangles : register(t4);
+StructuredBuffer<float4> rtEnvironmentLight : register(t5);
+StructuredBuffer<uint> rtAlbedoCache : register(t6);
+StructuredBuffer<uint> rtAlphaTestData : register(t7);
+
+#if RT_PROBE_INSIDE_TEST
+RWStructuredBuffer<uint> rtProbeBackfaceHitCount : register(u0);
+#else
+// 7 float4 per probe: 9 rgb sh coefficients + valid sample count
+RWStructuredBuffer<float4> rtProbeSHAndSampleCount : register(u0);
+
+// PROBE_DEPTH_OCT_SIZE * PROBE_DEPTH_OCT_SIZE float4 per probe: sum of hit distance, sum of squared hit distance, ray count
+RWStructuredBuffer<float4> rtProbeDepthMoments : register(u1);
+#endif
+#else
+#if COMPACT_GBUFFER
+Texture2D<uint4> rtCompactGBuffer : register(t1);
+StructuredBuffer<SGBufferInstanceGpuData> rtGBufferInstances : register(t2);
+#else
 Texture2D<float4> rtWorldPosition : register(t1);
 Texture2D<float4> rtWorldNormal : register(t2);
+#endif
 StructuredBuffer<SRayTracingLight> rtSceneLights : register(t3);
 StructuredBuffer<SMeshInstanceGpuData> rtSceneInstanceGpuData : register(t4);
+StructuredBuffer<SMeshLightTriangle> rtMeshLightTriangles : register(t5);
+
+// environment light, see SetEnvironmentLight in hwrtl_gi.cpp
+// [0, height): w is the marginal cdf of the rows
+// [height, height + width * height): rgb is the radiance, w is the conditional cdf inside the row
+StructuredBuffer<float4> rtEnvironmentLight : register(t6);
+
+// srgb rgba8 low resolution base color of the meshes, see SMeshInstanceGpuData::albedoInfo
+StructuredBuffer<uint> rtAlbedoCache : register(t7);
+
+// opacity micro maps and alpha masks of the alpha tested meshes, see SMeshInstanceGpuData::alphaInfo
+StructuredBuffer<uint> rtAlphaTestData : register(t8);
 
 RWTexture2D<float4> irradianceAndValidSampleCount : register(u0);
 RWTexture2D<float4> shDirectionality : register(u1);
 
+// two uint per counter: low 32 bit, high 32 bit, see RT_STATS_* below
+RWStructuredBuffer<uint> rtRayStats : register(u2);
+
+// sum of traced ray count, path length, ray hit count and sample count, only written if RT_COST_OUTPUT is enabled
+RWTexture2D<float4> rtTraversalCost : register(u3);
+
+#if RT_SH_L2
+// luminance sh coefficient 4 - 7 and coefficient 8, coefficient 0 - 3 are in shDirectionality
+RWTexture2D<float4> shDirectionalityL2Part0 : register(u4);
+RWTexture2D<float4> shDirectionalityL2Part1 : register(u5);
+#endif
+#endif
+
 struct SRayTracingIntersectionAttributes
 {
     float x;
@@ -213,6 +378,7 @@ struct SMaterialClosestHitPayload
 
     float m_vHiTt;
     uint m_eFlag; //e.g. front face flag
+    uint m_meshLightIndex; // mesh light index + 1, 0 if the hit instance isn't emissive
 
     // eval material
     float m_roughness;
@@ -268,12 +434,31 @@ float EstimateSphereLight(uint nlightIndex,float3 worldPosition)
     return lightPower * GetLightFallof(squaredLightDistance,nlightIndex) / squaredLightDistance;
 }
 
+// emitted power / squared distance to the bounds center, clamped to the bounds radius inside the bounds
+float EstimateMeshLight(uint nlightIndex,float3 worldPosition)
+{
+    float3 lightDirection = float3(rtSceneLights[nlightIndex].m_worldPosition - worldPosition);
+    float lightRadius = rtSceneLights[nlightIndex].m_radius;
+    float squaredLightDistance = max(dot(lightDirection,lightDirection), lightRadius * lightRadius);
+    float lightPower = Luminance(rtSceneLights[nlightIndex].m_color) * rtSceneLights[nlightIndex].m_meshLightArea * PI;
+
+    return lightPower / max(squaredLightDistance, 1e-4);
+}
+
+// the environment irradiance is about pi * average radiance
+float EstimateEnvironmentLight(uint nlightIndex)
+{
+    return Luminance(rtSceneLights[nlightIndex].m_color) * PI;
+}
+
 float EstimateLight(uint nlightIndex, float3 worldPosition,float3 worldNormal)
 {
     switch(rtSceneLights[nlightIndex].m_eLightType)
     {
         case RT_LIGHT_TYPE_DIRECTIONAL: return EstimateDirectionalLight(nlightIndex);
         case RT_LIGHT_TYPE_SPHERE: return EstimateSphereLight(nlightIndex,worldPosition);
+        case RT_LIGHT_TYPE_MESH: return EstimateMeshLight(nlightIndex,worldPosition);
+        case RT_LIGHT_TYPE_ENVIRONMENT: return EstimateEnvironmentLight(nlightIndex);
         default: return 0.0;
     }
 }
@@ -553,12 +738,161 @@ SLightSample SampleSphereLight(int nLightIndex, float2 randomSample, float3 worl
     return lightSample;
 }
 
+// the area pdf of a mesh light is 1 / total area: the triangle is picked by area and the point is uniform inside the triangle
+// converted to solid angle: pdf = squared distance / (cos light * total area)
+// must match SampleMeshLight in hwrtl_gi.cpp
+SLightSample SampleMeshLight(int nLightIndex, float2 randomSample, float3 worldPos, float3 worldNormal)
+{
+    uint firstTriangle = rtSceneLights[nLightIndex].m_triangleOffset;
+    uint triangleNum = rtSceneLights[nLightIndex].m_triangleCount;
+
+    // binary search of the first triangle whose cdf is greater than the random number
+    uint triangleIndex = firstTriangle;
+    for(uint vRange = triangleNum; vRange > 0;)
+    {
+        uint vStep = vRange / 2;
+        uint nMiddleIndex = triangleIndex + vStep;
+        if(randomSample.x < rtMeshLightTriangles[nMiddleIndex].m_cdf)
+        {
+            vRange = vStep;
+        }
+        else
+        {
+            triangleIndex = nMiddleIndex + 1;
+            vRange = vRange - (vStep + 1);
+        }
+    }
+    triangleIndex = min(triangleIndex, firstTriangle + triangleNum - 1);
+    SMeshLightTriangle lightTriangle = rtMeshLightTriangles[triangleIndex];
+
+    // reuse the random number inside the selected cdf interval for the barycentrics
+    float preCdf = triangleIndex > firstTriangle ? rtMeshLightTriangles[triangleIndex - 1].m_cdf : 0.0;
+    float barycentricRandom = saturate((randomSample.x - preCdf) / max(lightTriangle.m_cdf - preCdf, 1e-7));
+
+    float sqrtRandom = sqrt(barycentricRandom);
+    float barycentric0 = 1.0 - sqrtRandom;
+    float barycentric1 = randomSample.y * sqrtRandom;
+    float3 samplePosition = lightTriangle.m_vertex0 * barycentric0 + lightTriangle.m_vertex1 * barycentric1 + lightTriangle.m_vertex2 * (1.0 - barycentric0 - barycentric1);
+
+    // same winding as the face normal in MaterialClosestHitMain, the front face emits
+    float3 lightNormal = normalize(cross(lightTriangle.m_vertex2 - lightTriangle.m_vertex0, lightTriangle.m_vertex1 - lightTriangle.m_vertex0));
+
+    float3 lightDirection = samplePosition - worldPos;
+    float lightDistanceSquared = dot(lightDirection, lightDirection);
+    float lightDistance = sqrt(lightDistanceSquared);
+    lightDirection /= lightDistance;
+
+    SLightSample lightSample = (SLightSample)0;
+    float cosLight = dot(lightNormal, -lightDirection);
+    if(cosLight <= 0.0 || lightDistance <= 0.0)
+    {
+        return lightSample;
+    }
+
+    lightSample.m_direction = lightDirection;
+    lightSample.m_distance = lightDistance * 0.999; // don't hit the emitter itself
+    lightSample.m_pdf = lightDistanceSquared / (cosLight * rtSceneLights[nLightIndex].m_meshLightArea);
+    lightSample.m_radianceOverPdf = rtSceneLights[nLightIndex].m_color / lightSample.m_pdf;
+    return lightSample;
+}
+
+// equirectangular mapping, z up: u = phi / 2pi, v = theta / pi, v = 0 is the zenith
+// must match GetEnvironmentDirection in hwrtl_gi.cpp
+float3 GetEnvironmentDirection(float2 environmentUV, out float sinTheta)
+{
+    float phi = environmentUV.x * 2.0 * PI;
+    float theta = environmentUV.y * PI;
+    sinTheta = sin(theta);
+    return float3(sinTheta * cos(phi), sinTheta * sin(phi), cos(theta));
+}
+
+float2 GetEnvironmentUV(float3 direction)
+{
+    float phi = atan2(direction.y, direction.x);
+    phi = phi < 0.0 ? phi + 2.0 * PI : phi;
+    return float2(phi / (2.0 * PI), acos(clamp(direction.z, -1.0, 1.0)) / PI);
+}
+
+// first entry in [firstEntry, firstEntry + entryNum) whose cdf is greater than vRandom
+uint SearchEnvironmentCdf(uint firstEntry, uint entryNum, float vRandom)
+{
+    uint nEntryIndex = firstEntry;
+    for(uint vRange = entryNum; vRange > 0;)
+    {
+        uint vStep = vRange / 2;
+        uint nMiddleIndex = nEntryIndex + vStep;
+        if(vRandom < rtEnvironmentLight[nMiddleIndex].w)
+        {
+            vRange = vStep;
+        }
+        else
+        {
+            nEntryIndex = nMiddleIndex + 1;
+            vRange = vRange - (vStep + 1);
+        }
+    }
+    return min(nEntryIndex, firstEntry + entryNum - 1);
+}
+
+// piecewise constant 2d distribution over luminance * sin theta
+// solid angle pdf = marginal pdf * conditional pdf * width * height / (2 pi^2 sin theta)
+float GetEnvironmentPdf(uint nLightIndex, uint2 environmentTexel, float sinTheta)
+{
+    uint2 environmentSize = m_nEnvironmentLightSize;
+    uint nTexelEntry = environmentSize.y + environmentTexel.y * environmentSize.x + environmentTexel.x;
+
+    float marginalPdf = rtEnvironmentLight[environmentTexel.y].w - (environmentTexel.y > 0 ? rtEnvironmentLight[environmentTexel.y - 1].w : 0.0);
+    float conditionalPdf = rtEnvironmentLight[nTexelEntry].w - (environmentTexel.x > 0 ? rtEnvironmentLight[nTexelEntry - 1].w : 0.0);
+    return sinTheta > 0.0 ? marginalPdf * conditionalPdf * environmentSize.x * environmentSize.y / (2.0 * PI * PI * sinTheta) : 0.0;
+}
+
+float3 GetEnvironmentRadiance(uint nLightIndex, float3 direction, out uint2 environmentTexel)
+{
+    uint2 environmentSize = m_nEnvironmentLightSize;
+    environmentTexel = min(uint2(GetEnvironmentUV(direction) * environmentSize), environmentSize - 1);
+    return rtEnvironmentLight[environmentSize.y + environmentTexel.y * environmentSize.x + environmentTexel.x].rgb;
+}
+
+// the cdfs are built by SetEnvironmentLight in hwrtl_gi.cpp
+SLightSample SampleEnvironmentLight(int nLightIndex, float2 randomSample, float3 worldPos, float3 worldNormal)
+{
+    uint2 environmentSize = m_nEnvironmentLightSize;
+
+    uint nRow = SearchEnvironmentCdf(0, environmentSize.y, randomSample.x);
+    uint nRowEntry = environmentSize.y + nRow * environmentSize.x;
+    uint nColumn = SearchEnvironmentCdf(nRowEntry, environmentSize.x, randomSample.y) - nRowEntry;
+
+    // reuse the random numbers inside the selected cdf intervals for the position inside the texel
+    float preRowCdf = nRow > 0 ? rtEnvironmentLight[nRow - 1].w : 0.0;
+    float preColumnCdf = nColumn > 0 ? rtEnvironmentLight[nRowEntry + nColumn - 1].w : 0.0;
+    float2 texelOffset = float2(
+        saturate((randomSample.y - preColumnCdf) / max(rtEnvironmentLight[nRowEntry + nColumn].w - preColumnCdf, 1e-7)),
+        saturate((randomSample.x - preRowCdf) / max(rtEnvironmentLight[nRow].w - preRowCdf, 1e-7)));
+
+    float sinTheta = 0.0;
+    float3 direction = GetEnvironmentDirection((float2(nColumn, nRow) + texelOffset) / float2(environmentSize), sinTheta);
+
+    SLightSample lightSample = (SLightSample)0;
+    lightSample.m_pdf = GetEnvironmentPdf(nLightIndex, uint2(nColumn, nRow), sinTheta);
+    if(lightSample.m_pdf <= 0.0)
+    {
+        return lightSample;
+    }
+
+    lightSample.m_direction = direction;
+    lightSample.m_distance = POSITIVE_INFINITY;
+    lightSample.m_radianceOverPdf = rtEnvironmentLight[nRowEntry + nColumn].rgb / lightSample.m_pdf;
+    return lightSample;
+}
+
 SLightSample SampleLight(int nLightIndex,float2 vRandSample,float3 vWorldPos,float3 vWorldNormal)
 {
     switch(rtSceneLights[nLightIndex].m_eLightType)
     {
         case RT_LIGHT_TYPE_DIRECTIONAL: return SampleDirectionalLight(nLightIndex,vRandSample,vWorldPos,vWorldNormal);
         case RT_LIGHT_TYPE_SPHERE: return SampleSphereLight(nLightIndex,vRandSample,vWorldPos,vWorldNormal);
+        case RT_LIGHT_TYPE_MESH: return SampleMeshLight(nLightIndex,vRandSample,vWorldPos,vWorldNormal);
+        case RT_LIGHT_TYPE_ENVIRONMENT: return SampleEnvironmentLight(nLightIndex,vRandSample,vWorldPos,vWorldNormal);
         default: return (SLightSample)0;
     }
 }
@@ -636,6 +970,96 @@ float4 SHBasisFunction(float3 inputVector)
 	return projectionResult;
 }
 
+// https://www.ppsloan.org/publications/StupidSH36.pdf
+void SHBasisFunctionL2(float3 inputVector, out float shBasis[9])
+{
+    shBasis[0] = 0.282095f;
+    shBasis[1] = 0.488603f * inputVector.y;
+    shBasis[2] = 0.488603f * inputVector.z;
+    shBasis[3] = 0.488603f * inputVector.x;
+    shBasis[4] = 1.092548f * inputVector.x * inputVector.y;
+    shBasis[5] = 1.092548f * inputVector.y * inputVector.z;
+    shBasis[6] = 0.315392f * (3.0f * inputVector.z * inputVector.z - 1.0f);
+    shBasis[7] = 1.092548f * inputVector.x * inputVector.z;
+    shBasis[8] = 0.546274f * (inputVector.x * inputVector.x - inputVector.y * inputVector.y);
+}
+
+/***************************************************************************
+*   LightMap Ray Tracing Pass:
+*       Ray Stats
+***************************************************************************/
+
+// must match ERayStatsCounter in hwrtl_gi.cpp
+#define RT_STATS_PRIMARY_RAY 0 // first material ray of a path
+#define RT_STATS_BOUNCE_RAY 1
+#define RT_STATS_SHADOW_RAY 2
+#define RT_STATS_OCCLUSION_RAY 3
+#define RT_STATS_RAY_HIT 4 // material and occlusion rays
+#define RT_STATS_RAY_MISS 5
+#define RT_STATS_PATH_LENGTH 6 // RT_STATS_PATH_LENGTH + n: paths that end at bounce n
+#define RT_STATS_COUNTER_NUM (RT_STATS_PATH_LENGTH + maxBounces + 1)
+
+// the counters are accumulated per thread and merged per wave before the atomic add to rtRayStats
+// the per texel traversal cost output uses the same per thread counters
+#define RT_THREAD_RAY_STATS (RT_RAY_STATS || RT_COST_OUTPUT)
+static uint rtThreadRayStats[RT_STATS_PATH_LENGTH] = { 0, 0, 0, 0, 0, 0 };
+static int rtThreadPathLength = -1;
+
+void AddRayStats(uint counterIndex, uint value)
+{
+#if RT_THREAD_RAY_STATS
+    rtThreadRayStats[counterIndex] += value;
+#endif
+}
+
+void SetRayStatsPathLength(int pathLength)
+{
+#if RT_THREAD_RAY_STATS
+    rtThreadPathLength = pathLength;
+#endif
+}
+
+#if !RT_PROBE_PASS
+void AtomicAddRayStats(uint counterIndex, uint value)
+{
+    uint originalValue;
+    InterlockedAdd(rtRayStats[counterIndex * 2 + 0], value, originalValue);
+    if(originalValue + value < originalValue)
+    {
+        InterlockedAdd(rtRayStats[counterIndex * 2 + 1], 1);
+    }
+}
+
+// dxr doesn't expose the bvh node and triangle test counts, the traced ray count is the cost of a texel
+void AccumulateTraversalCost(uint2 texelIndex)
+{
+#if RT_COST_OUTPUT
+    uint tracedRayCount = rtThreadRayStats[RT_STATS_PRIMARY_RAY] + rtThreadRayStats[RT_STATS_BOUNCE_RAY] + rtThreadRayStats[RT_STATS_SHADOW_RAY] + rtThreadRayStats[RT_STATS_OCCLUSION_RAY];
+    uint rayHitCount = rtThreadRayStats[RT_STATS_RAY_HIT];
+    rtTraversalCost[texelIndex] += float4(tracedRayCount, max(rtThreadPathLength, 0), rayHitCount, 1.0);
+#endif
+}
+
+void FlushRayStats()
+{
+#if RT_RAY_STATS
+    for(uint counterIndex = 0; counterIndex < RT_STATS_PATH_LENGTH; counterIndex++)
+    {
+        uint waveValue = WaveActiveSum(rtThreadRayStats[counterIndex]);
+        if(WaveIsFirstLane() && waveValue > 0)
+        {
+            AtomicAddRayStats(counterIndex, waveValue);
+        }
+    }
+
+    if(rtThreadPathLength >= 0)
+    {
+        AtomicAddRayStats(RT_STATS_PATH_LENGTH + rtThreadPathLength, 1);
+    }
+#endif
+}
+#endif
+
 /***************************************************************************
 *   LightMap Ray Tracing Pass:
 *       Trace Light
@@ -696,16 +1120,61 @@ SLightTraceResult TraceSphereLight(RayDesc ray,uint nlightIndex)
     return lightTraceResult;
 }
 
+// mesh lights are scene geometry, their emission is added when the material ray hits them, see DoRayTracing
+SLightTraceResult TraceMeshLight(RayDesc ray,uint nlightIndex)
+{
+    SLightTraceResult lightTraceResult = (SLightTraceResult)0;
+    lightTraceResult.m_hitT = -1.0;
+    return lightTraceResult;
+}
+
+SLightTraceResult TraceEnvironmentLight(RayDesc ray,uint nlightIndex)
+{
+    SLightTraceResult lightTraceResult = (SLightTraceResult)0;
+    lightTraceResult.m_hitT = -1.0;
+    if(ray.TMax == POSITIVE_INFINITY)
+    {
+        uint2 environmentTexel;
+        lightTraceResult.m_radiance = GetEnvironmentRadiance(nlightIndex, ray.Direction, environmentTexel);
+        lightTraceResult.m_pdf = GetEnvironmentPdf(nlightIndex, environmentTexel, sqrt(saturate(1.0 - ray.Direction.z * ray.Direction.z)));
+        lightTraceResult.m_hitT = POSITIVE_INFINITY;
+    }
+    return lightTraceResult;
+}
+
+// cheap environment radiance without visibility, used by the material sample of the vertex before the path is cut
+float3 EvaluateEnvironmentSH(float3 direction)
+{
+    float shBasis[9];
+    SHBasisFunctionL2(direction, shBasis);
+
+    float3 environmentRadiance = 0.0;
+    for(uint shIndex = 0; shIndex < 9; shIndex++)
+    {
+        environmentRadiance += m_environmentSH[shIndex].rgb * shBasis[shIndex];
+    }
+    return max(environmentRadiance, 0.0);
+}
+
 SLightTraceResult TraceLight(RayDesc ray,uint nlightIndex)
 {
     switch(rtSceneLights[nlightIndex].m_eLightType)
     {
         case RT_LIGHT_TYPE_DIRECTIONAL: return TraceDirectionalLight(ray,nlightIndex);
         case RT_LIGHT_TYPE_SPHERE: return TraceSphereLight(ray,nlightIndex);
+        case RT_LIGHT_TYPE_MESH: return TraceMeshLight(ray,nlightIndex);
+        case RT_LIGHT_TYPE_ENVIRONMENT: return TraceEnvironmentLight(ray,nlightIndex);
         default: return (SLightTraceResult)0;
     }
 }
 
+// solid angle pdf of sampling the hit point with SampleMeshLight
+float GetMeshLightPdf(uint nlightIndex, float3 rayDirection, SMaterialClosestHitPayload payload)
+{
+    float cosLight = dot(payload.m_worldNormal, -rayDirection);
+    return cosLight > 0.0 ? payload.m_vHiTt * payload.m_vHiTt / (cosLight * rtSceneLights[nlightIndex].m_meshLightArea) : 0.0;
+}
+
 /***************************************************************************
 *   LightMap Ray Tracing Pass:
 *       Trace Light Ray
@@ -716,16 +1185,23 @@ SMaterialClosestHitPayload TraceLightRay(RayDesc ray, bool bLastBounce, inout fl
     SMaterialClosestHitPayload materialCHSPayload = (SMaterialClosestHitPayload)0;
     if(bLastBounce)
     {
+        // the environment seen by this ray was already added with its mis weight by the previous vertex, see DoRayTracing
         materialCHSPayload.m_vHiTt = -1.0;
         pathThroughput = 0.0;
         return materialCHSPayload;
     }
 
-    TraceRay(rtScene, RAY_FLAG_FORCE_OPAQUE, RAY_TRACING_MASK_OPAQUE, RT_MATERIAL_SHADER_INDEX, 1, 0, ray, materialCHSPayload);
+    TraceRay(rtScene, RAY_FLAG_NONE, RAY_TRACING_MASK_OPAQUE, RT_MATERIAL_SHADER_INDEX, 1, 0, ray, materialCHSPayload);
 
     // step3: Calculate Le in TraceLightRay function
     for(uint index = 0; index < m_nRtSceneLightCount; index++)
     {
+        // the environment light is mis weighted in DoRayTracing
+        if(index + 1 == m_nEnvironmentLightIndex)
+        {
+            continue;
+        }
+
         RayDesc lightRay = ray;
         lightRay.TMax = materialCHSPayload.m_vHiTt < 0.0 ? ray.TMax : materialCHSPayload.m_vHiTt;
         float3 lightRadiance = TraceLight(lightRay,index).m_radiance;
@@ -740,12 +1216,14 @@ SMaterialClosestHitPayload TraceLightRay(RayDesc ray, bool bLastBounce, inout fl
 *       Trace Ray
 ***************************************************************************/
 
+// startPayload is the first path vertex, the light map pass starts from the gbuffer texel (bounce 0)
+// and the probe pass starts from the hit point of the probe ray (bounce 1)
 void DoRayTracing(
 #if RT_DEBUG_OUTPUT
     inout float4 rtDebugOutput,
 #endif
-    float3 worldPosition,
-    float3 faceNormal,
+    SMaterialClosestHitPayload startPayload,
+    int startBounce,
     inout SRandomSequence randomSequence,
     inout bool bIsValidSample,
 
@@ -756,13 +1234,15 @@ void DoRayTracing(
 	inout float3 directionalLightRadianceDirection
 )
 {
-    float3 radiance = 0;
+    float3 radiance = radianceValue;
 
     RayDesc ray;
     
     // path state variables
 	float3 pathThroughput = 1.0;
     float aLightPickingCdf[RT_MAX_SCENE_LIGHT];
+    float vLightPickingCdfPreSum = 0.0;
+    float vMaterialSamplePdf = 0.0; // pdf of the material sample that generated the ray, used by the mesh light mis
 
     // render equation
     // Lo = Le + Int Li * fr * cos * vis
@@ -796,27 +1276,29 @@ void DoRayTracing(
     // for(uint index = 0; index < m_nRtSceneLightCount; index++)
     //  radiance += Le
 
-    for(int bounce = 0; bounce <= maxBounces; bounce++)
+    // mesh lights: step2 happens when the material ray hits an emissive instance, the light picking cdf is still the one of the previous vertex
+    // w(xg) = mis(materialSample.m_pdf, lightPickPdf * GetMeshLightPdf)
+
+    for(int bounce = startBounce; bounce <= maxBounces; bounce++)
     {
-        const bool bIsCameraRay = bounce == 0;
+        const bool bIsCameraRay = bounce == startBounce;
         const bool bIsLastBounce = bounce == maxBounces;
 
         SMaterialClosestHitPayload rtRaylod = (SMaterialClosestHitPayload)0;
         if(bIsCameraRay)
         {
-            rtRaylod.m_worldPosition = worldPosition;
-            rtRaylod.m_worldNormal = faceNormal;
-            rtRaylod.m_vHiTt = 1.0f;
-            rtRaylod.m_eFlag |= RT_PAYLOAD_FLAG_FRONT_FACE;
-            rtRaylod.m_roughness = 1.0f;
-            rtRaylod.m_baseColor = float3(1,1,1);
-            rtRaylod.m_diffuseColor = float3(1,1,1);
-            rtRaylod.m_specColor = float3(0,0,0);
+            rtRaylod = startPayload;
         }
         else
         {
             rtRaylod = TraceLightRay(ray,bIsLastBounce,pathThroughput,radiance);
+            if(!bIsLastBounce)
+            {
+                AddRayStats(bounce == startBounce + 1 ? RT_STATS_PRIMARY_RAY : RT_STATS_BOUNCE_RAY, 1);
+                AddRayStats(rtRaylod.m_vHiTt < 0.0 ? RT_STATS_RAY_MISS : RT_STATS_RAY_HIT, 1);
+            }
         }
+        SetRayStatsPathLength(bounce);
 
 #if RT_DEBUG_OUTPUT
         if(bounce == 1)
@@ -836,10 +1318,23 @@ void DoRayTracing(
             return;
         }
 
+        if(!bIsCameraRay && rtRaylod.m_meshLightIndex > 0)
+        {
+            uint nMeshLightIndex = rtRaylod.m_meshLightIndex - 1;
+            float3 lightContribution = pathThroughput * rtSceneLights[nMeshLightIndex].m_color;
+            if(vLightPickingCdfPreSum > 0)
+            {
+                float previousCdfValue = nMeshLightIndex > 0 ? aLightPickingCdf[nMeshLightIndex - 1] : 0.0;
+                float lightPickPdf = (aLightPickingCdf[nMeshLightIndex] - previousCdfValue) / vLightPickingCdfPreSum;
+                lightContribution *= MISWeightRobust(vMaterialSamplePdf, lightPickPdf * GetMeshLightPdf(nMeshLightIndex, ray.Direction, rtRaylod));
+            }
+            radiance += lightContribution;
+        }
+
         // x: light sample y: light direction sample z: light direction sample w: russian roulette
         float4 randomSample = GetRandomSampleFloat4(randomSequence);
 
-        float vLightPickingCdfPreSum = 0.0;
+        vLightPickingCdfPreSum = 0.0;
         float3 worldPosition = rtRaylod.m_worldPosition;
         float3 worldNormal = rtRaylod.m_worldNormal;
 
@@ -877,7 +1372,8 @@ void DoRayTracing(
                         shadowRay.TMax = lightSample.m_distance;
                         shadowRay.Origin += abs(worldPosition) * 0.001f * worldNormal; // todo : betther bias calculation
 
-                        TraceRay(rtScene, RAY_FLAG_FORCE_OPAQUE, RAY_TRACING_MASK_OPAQUE, RT_SHADOW_SHADER_INDEX, 1,0, shadowRay, shadowRayPaylod);
+                        TraceRay(rtScene, RAY_FLAG_NONE, RAY_TRACING_MASK_OPAQUE, RT_SHADOW_SHADER_INDEX, 1,0, shadowRay, shadowRayPaylod);
+                        AddRayStats(RT_STATS_SHADOW_RAY, 1);
 
                         float sampleContribution = 0.0;
                         if(shadowRayPaylod.m_vHiTt <= 0)
@@ -893,7 +1389,10 @@ void DoRayTracing(
                         SMaterialEval materialEval = EvalMaterial(lightSample.m_direction,rtRaylod);
                         
                         float3 lightContrib = pathThroughput * lightSample.m_radianceOverPdf * materialEval.m_weight * materialEval.m_pdf;
+#if !RT_PREVIEW_BAKE
+                        // the preview bake traces no material ray, the light sample gets the full weight
                         lightContrib *= MISWeightRobust(lightSample.m_pdf,materialEval.m_pdf);
+#endif
                         
                         if (bounce > 0)
                         {
@@ -913,6 +1412,11 @@ void DoRayTracing(
             }
         }
 
+#if RT_PREVIEW_BAKE
+        // direct lighting only
+        break;
+#endif
+
         // step2: Sample Material, Choose a [LIGHT DIRECTION] based on material randomly
         if(debugSample != 2)
         {
@@ -932,7 +1436,7 @@ void DoRayTracing(
             float maxPathThroughput = max(max(pathThroughput.x, pathThroughput.y),pathThroughput.z);
 
             float continuationProbability = sqrt(saturate(maxNextPathThroughput / maxPathThroughput));
-            if(continuationProbability < 1 && bounce != 0)
+            if(continuationProbability < 1 && !bIsCameraRay)
             {
                 float russianRouletteRand = randomSample.w;
 		    	if (russianRouletteRand >= continuationProbability)
@@ -946,6 +1450,7 @@ void DoRayTracing(
                 pathThroughput = nextPathThroughput;
             }
 
+            vMaterialSamplePdf = materialSample.m_pdf;
             ray.Origin = rtRaylod.m_worldPosition;
             ray.Direction = normalize(materialSample.m_direction);
             ray.TMin = 0.0f;
@@ -958,6 +1463,9 @@ void DoRayTracing(
                 radianceDirection = ray.Direction;
             }
 
+            // the next vertex is cut: the sky is assumed to be visible and the sh projection replaces the environment texel,
+            // the mis weight of the material sample is kept
+            const bool bNextBounceIsLast = bounce + 1 == maxBounces;
             for(uint index = 0; index < m_nRtSceneLightCount; index++)
             {
                 SLightTraceResult lightTraceResult = TraceLight(ray,index);
@@ -967,6 +1475,12 @@ void DoRayTracing(
                     continue;
                 }
 
+                const bool bEnvironmentSH = bNextBounceIsLast && index + 1 == m_nEnvironmentLightIndex;
+                if(bEnvironmentSH)
+                {
+                    lightTraceResult.m_radiance = EvaluateEnvironmentSH(ray.Direction);
+                }
+
                 float3 lightContribution = pathThroughput * lightTraceResult.m_radiance;
  
                 if(vLightPickingCdfPreSum > 0)
@@ -978,11 +1492,18 @@ void DoRayTracing(
 
                     if (any(lightContribution > 0))
                     {
+                        if(bEnvironmentSH)
+                        {
+                            radiance += lightContribution;
+                            continue;
+                        }
+
                         SMaterialClosestHitPayload shadowRayPaylod = (SMaterialClosestHitPayload)0;
                         RayDesc shadowRay = ray;
                         shadowRay.TMax = lightTraceResult.m_hitT;
 
-                        TraceRay(rtScene, RAY_FLAG_FORCE_OPAQUE, RAY_TRACING_MASK_OPAQUE, RT_SHADOW_SHADER_INDEX, 1, 0, shadowRay, shadowRayPaylod);
+                        TraceRay(rtScene, RAY_FLAG_NONE, RAY_TRACING_MASK_OPAQUE, RT_SHADOW_SHADER_INDEX, 1, 0, shadowRay, shadowRayPaylod);
+                        AddRayStats(RT_STATS_SHADOW_RAY, 1);
 
                         if(shadowRayPaylod.m_vHiTt > 0)
                         {
@@ -1000,24 +1521,318 @@ void DoRayTracing(
     radianceValue = radiance;
 }
 
+#if RT_PROBE_PASS
+/***************************************************************************
+*   LightMap Ray Tracing Pass:
+*       Probe Ray Gen
+***************************************************************************/
+
+// evenly distributed directions on the sphere
+float3 SphericalFibonacci(uint nIndex, uint nCount)
+{
+    const float goldenRatio = 1.61803398875;
+    float phi = 2.0 * PI * frac(nIndex * (goldenRatio - 1.0));
+    float cosTheta = 1.0 - (2.0 * nIndex + 1.0) / nCount;
+    float sinTheta = sqrt(saturate(1.0 - cosTheta * cosTheta));
+    return float3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+}
+
+// rotate the fibonacci directions with a different rotation every sample, otherwise every sample traces the same rays
+float3x3 GetRandomRotation(float3 randomSample)
+{
+    float cosTheta = 1.0 - 2.0 * randomSample.x;
+    float sinTheta = sqrt(saturate(1.0 - cosTheta * cosTheta));
+    float phi = 2.0 * PI * randomSample.y;
+    float3x3 tangentBasis = GetTangentBasis(float3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta));
+
+    float sinSpin, cosSpin;
+    sincos(2.0 * PI * randomSample.z, sinSpin, cosSpin);
+    float3x3 spinMatrix = float3x3(cosSpin, -sinSpin, 0, sinSpin, cosSpin, 0, 0, 0, 1);
+    return mul(spinMatrix, tangentBasis);
+}
+
+// must match HWRTL_PROBE_DEPTH_OCT_SIZE
+#define PROBE_DEPTH_OCT_SIZE 8
+
+// [0,1]^2 octahedral coordinate of a unit direction
+float2 OctahedronEncode(float3 direction)
+{
+    float3 octDirection = direction / (abs(direction.x) + abs(direction.y) + abs(direction.z));
+    float2 octCoord = octDirection.xy;
+    if(octDirection.z < 0.0)
+    {
+        float2 signNotZero = float2(octDirection.x >= 0.0 ? 1.0 : -1.0, octDirection.y >= 0.0 ? 1.0 : -1.0);
+        octCoord = (1.0 - abs(octDirection.yx)) * signNotZero;
+    }
+    return octCoord * 0.5 + 0.5;
+}
+
+#if RT_PROBE_INSIDE_TEST
+// a probe that sees many back faces is inside the geometry
+[shader("raygeneration")]
+void ProbeInsideTestRayGen()
+{
+    const uint probeIndex = DispatchRaysIndex().x;
+    if(probeIndex >= m_nProbeCount)
+    {
+        return;
+    }
+
+    uint backfaceHitCount = 0;
+    for(uint rayIndex = 0; rayIndex < m_nProbeRayCount; rayIndex++)
+    {
+        RayDesc ray;
+        ray.Origin = rtProbePositions[probeIndex].xyz;
+        ray.Direction = SphericalFibonacci(rayIndex, m_nProbeRayCount);
+        ray.TMin = 0.0f;
+        ray.TMax = POSITIVE_INFINITY;
+
+        SMaterialClosestHitPayload hitPayload = (SMaterialClosestHitPayload)0;
+        TraceRay(rtScene, RAY_FLAG_NONE, RAY_TRACING_MASK_OPAQUE, RT_MATERIAL_SHADER_INDEX, 1, 0, ray, hitPayload);
+
+        if(hitPayload.m_vHiTt > 0.0 && (hitPayload.m_eFlag & RT_PAYLOAD_FLAG_FRONT_FACE) == 0)
+        {
+            backfaceHitCount++;
+        }
+    }
+
+    rtProbeBackfaceHitCount[probeIndex] = backfaceHitCount;
+}
+#else
+[shader("raygeneration")]
+void ProbeRayTracingRayGen()
+{
+    const uint probeIndex = DispatchRaysIndex().x;
+    if(probeIndex >= m_nProbeCount)
+    {
+        return;
+    }
+
+    const float3 probePosition = rtProbePositions[probeIndex].xyz;
+
+    const uint probeSampleKey = StrongIntegerHash(probeIndex ^ StrongIntegerHash(m_nBakeSeed));
+
+    SRandomSequence randomSequence;
+    randomSequence.m_randomSeed = 0;
+    randomSequence.m_nSampleIndex = probeSampleKey + rtRenderPassInfo.m_renderPassIndex;
+
+    float3x3 rayRotation = GetRandomRotation(GetRandomSampleFloat4(randomSequence).xyz);
+
+    float3 shCoefficients[9];
+    for(uint shIndex = 0; shIndex < 9; shIndex++)
+    {
+        shCoefficients[shIndex] = 0;
+    }
+    float validSampleCount = 0;
+
+    for(uint rayIndex = 0; rayIndex < m_nProbeRayCount; rayIndex++)
+    {
+        randomSequence.m_nSampleIndex = probeSampleKey + rtRenderPassInfo.m_renderPassIndex * m_nProbeRayCount + rayIndex;
+        randomSequence.m_randomSeed = 4;
+
+        RayDesc ray;
+        ray.Origin = probePosition;
+        ray.Direction = mul(SphericalFibonacci(rayIndex, m_nProbeRayCount), rayRotation);
+        ray.TMin = 0.0f;
+        ray.TMax = POSITIVE_INFINITY;
+
+        // the probe ray is the camera ray, the surface it hits is the first path vertex
+        float3 pathThroughput = 1.0;
+        float3 radianceValue = 0;
+        SMaterialClosestHitPayload hitPayload = TraceLightRay(ray, false, pathThroughput, radianceValue);
+
+        // emitters and sky seen directly by the probe, there is no light sample to weight against
+        if(hitPayload.m_vHiTt > 0.0 && hitPayload.m_meshLightIndex > 0 && (hitPayload.m_eFlag & RT_PAYLOAD_FLAG_FRONT_FACE) != 0)
+        {
+            radianceValue += rtSceneLights[hitPayload.m_meshLightIndex - 1].m_color;
+        }
+        if(hitPayload.m_vHiTt < 0.0 && m_nEnvironmentLightIndex > 0)
+        {
+            radianceValue += TraceEnvironmentLight(ray, m_nEnvironmentLightIndex - 1).m_radiance;
+        }
+
+        // depth moments use every ray, the back faces hit by the invalid samples are occluders as well
+        {
+            float hitDistance = hitPayload.m_vHiTt > 0.0 ? min(hitPayload.m_vHiTt, m_fProbeMaxDepth) : m_fProbeMaxDepth;
+            uint2 depthTexel = min(uint2(OctahedronEncode(ray.Direction) * PROBE_DEPTH_OCT_SIZE), PROBE_DEPTH_OCT_SIZE - 1);
+            uint depthIndex = probeIndex * PROBE_DEPTH_OCT_SIZE * PROBE_DEPTH_OCT_SIZE + depthTexel.y * PROBE_DEPTH_OCT_SIZE + depthTexel.x;
+            rtProbeDepthMoments[depthIndex] += float4(hitDistance, hitDistance * hitDistance, 1.0, 0.0);
+        }
+
+        bool bIsValidSample = true;
+        if(hitPayload.m_vHiTt > 0.0)
+        {
+            float3 radianceDirection = 0;
+            float3 directionalLightRadianceValue = 0;
+            float3 directionalLightRadianceDirection = 0;
+
+#if RT_DEBUG_OUTPUT
+            float4 rtDebugOutput = 0.0;
+#endif
+            DoRayTracing(
+#if RT_DEBUG_OUTPUT
+                rtDebugOutput,
+#endif
+                hitPayload,
+                1,
+                randomSequence,
+                bIsValidSample,
+
+                radianceValue,
+                radianceDirection,
+
+                directionalLightRadianceValue,
+                directionalLightRadianceDirection);
+        }
+
+        if (any(isnan(radianceValue)) || any(radianceValue < 0) || any(isinf(radianceValue)))
+        {
+            bIsValidSample = false;
+        }
+
+        // rays that hit a back face are dropped, the probe is inside the geometry in that direction
+        if(bIsValidSample)
+        {
+            float shBasis[9];
+            SHBasisFunctionL2(ray.Direction, shBasis);
+            for(uint shIndex = 0; shIndex < 9; shIndex++)
+            {
+                shCoefficients[shIndex] += radianceValue * shBasis[shIndex];
+            }
+            validSampleCount += 1.0;
+        }
+    }
+
+    const uint outputIndex = probeIndex * 7;
+    rtProbeSHAndSampleCount[outputIndex + 0] += float4(shCoefficients[0], shCoefficients[1].x);
+    rtProbeSHAndSampleCount[outputIndex + 1] += float4(shCoefficients[1].yz, shCoefficients[2].xy);
+    rtProbeSHAndSampleCount[outputIndex + 2] += float4(shCoefficients[2].z, shCoefficients[3]);
+    rtProbeSHAndSampleCount[outputIndex + 3] += float4(shCoefficients[4], shCoefficients[5].x);
+    rtProbeSHAndSampleCount[outputIndex + 4] += float4(shCoefficients[5].yz, shCoefficients[6].xy);
+    rtProbeSHAndSampleCount[outputIndex + 5] += float4(shCoefficients[6].z, shCoefficients[7]);
+    rtProbeSHAndSampleCount[outputIndex + 6] += float4(shCoefficients[8], validSampleCount);
+}
+#endif
+#else
+struct SLightMapGBufferTexel
+{
+    float3 m_worldPosition;
+    float3 m_worldFaceNormal;
+    uint m_meshKey; // original mesh index + 1, 0 for the texels not covered by any mesh
+    uint m_meshTexelIndex; // texel index inside the mesh light map
+};
+
+SLightMapGBufferTexel LoadLightMapGBufferTexel(uint2 atlasTexel)
+{
+    SLightMapGBufferTexel gbufferTexel = (SLightMapGBufferTexel)0;
+#if COMPACT_GBUFFER
+    uint4 compactTexel = rtCompactGBuffer[atlasTexel];
+    if(compactTexel.w == 0)
+    {
+        return gbufferTexel;
+    }
+
+    SGBufferInstanceGpuData instanceData = rtGBufferInstances[compactTexel.w - 1];
+    int2 meshTexel = max(int2(atlasTexel) - int2(instanceData.m_texelKeyInfo.xy), int2(0, 0));
+    gbufferTexel.m_worldPosition = DecodeCompactGBufferPosition(compactTexel, instanceData);
+    gbufferTexel.m_worldFaceNormal = DecodeCompactGBufferNormal(compactTexel);
+    gbufferTexel.m_meshKey = instanceData.m_texelKeyInfo.w + 1;
+    gbufferTexel.m_meshTexelIndex = meshTexel.y * instanceData.m_texelKeyInfo.z + meshTexel.x;
+#else
+    float4 worldPosition = rtWorldPosition[atlasTexel];
+    float4 worldFaceNormal = rtWorldNormal[atlasTexel];
+    gbufferTexel.m_worldPosition = worldPosition.xyz;
+    gbufferTexel.m_worldFaceNormal = worldFaceNormal.xyz;
+    gbufferTexel.m_meshKey = uint(worldFaceNormal.w);
+    gbufferTexel.m_meshTexelIndex = uint(worldPosition.w);
+#endif
+    return gbufferTexel;
+}
+
+// keyed by the mesh and the texel inside the mesh light map instead of the atlas texel,
+// so the sample sequence of a texel doesn't change with the atlas packing
+uint GetLightMapTexelSampleKey(SLightMapGBufferTexel gbufferTexel)
+{
+    return StrongIntegerHash(StrongIntegerHash(gbufferTexel.m_meshKey ^ StrongIntegerHash(m_nBakeSeed)) + gbufferTexel.m_meshTexelIndex);
+}
+
+#if RT_AO_PASS
+// occlusion only pass: no light sampling and no bounces, a short visibility ray per texel and sample
+// irradianceAndValidSampleCount: unoccluded ray count, valid sample count
+// shDirectionality: sum of the unoccluded ray directions (bent normal), valid sample count
+[shader("raygeneration")]
+void LightMapAORayGen()
+{
+    const uint2 rayIndex = DispatchRaysIndex().xy;
+
+    SLightMapGBufferTexel gbufferTexel = LoadLightMapGBufferTexel(rayIndex);
+    if(gbufferTexel.m_meshKey == 0)
+    {
+        return;
+    }
+
+    float3 worldPosition = gbufferTexel.m_worldPosition;
+    float3 worldFaceNormal = gbufferTexel.m_worldFaceNormal;
+
+    SRandomSequence randomSequence;
+    randomSequence.m_randomSeed = 0;
+    randomSequence.m_nSampleIndex = GetLightMapTexelSampleKey(gbufferTexel) + rtRenderPassInfo.m_renderPassIndex;
+
+    // cosine weighted directions, so the unoccluded ratio is the cosine weighted ambient occlusion
+    float4 randomSample = GetRandomSampleFloat4(randomSequence);
+    float3 rayDirection = TangentToWorld(CosineSampleHemisphere(randomSample.xy).xyz, worldFaceNormal);
+
+    RayDesc aoRay;
+    aoRay.Origin = worldPosition + abs(worldPosition) * 0.001f * worldFaceNormal; // todo : betther bias calculation
+    aoRay.TMin = 0.0f;
+    aoRay.Direction = rayDirection;
+    aoRay.TMax = m_fAOMaxDistance;
+
+    // any hit ends the traversal, the closest hit shader is never invoked
+    SMaterialClosestHitPayload aoRayPayload = (SMaterialClosestHitPayload)0;
+    aoRayPayload.m_vHiTt = 1.0f;
+    TraceRay(rtScene, RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_SKIP_CLOSEST_HIT_SHADER, RAY_TRACING_MASK_OPAQUE, RT_SHADOW_SHADER_INDEX, 1, 0, aoRay, aoRayPayload);
+
+    float visibility = aoRayPayload.m_vHiTt <= 0 ? 1.0f : 0.0f;
+    irradianceAndValidSampleCount[rayIndex] += float4(visibility, visibility, visibility, 1.0);
+    shDirectionality[rayIndex] += float4(rayDirection * visibility, 1.0);
+
+    AddRayStats(RT_STATS_OCCLUSION_RAY, 1);
+    AddRayStats(visibility > 0.0f ? RT_STATS_RAY_MISS : RT_STATS_RAY_HIT, 1);
+    AccumulateTraversalCost(rayIndex);
+    FlushRayStats();
+}
+#else
+#if RT_SH_L2
+void AccumulateSHL2Directionality(uint2 texelIndex, float luminance, float3 direction)
+{
+    float shBasis[9];
+    SHBasisFunctionL2(direction, shBasis);
+    shDirectionalityL2Part0[texelIndex] += luminance * float4(shBasis[4], shBasis[5], shBasis[6], shBasis[7]);
+    shDirectionalityL2Part1[texelIndex] += luminance * float4(shBasis[8], 0, 0, 0);
+}
+#endif
+
 [shader("raygeneration")]
 void LightMapRayTracingRayGen()
 {
     const uint2 rayIndex = DispatchRaysIndex().xy;
 
-    float3 worldPosition = rtWorldPosition[rayIndex].xyz;
-    float3 worldFaceNormal = rtWorldNormal[rayIndex].xyz;
+    SLightMapGBufferTexel gbufferTexel = LoadLightMapGBufferTexel(rayIndex);
 
     bool bIsValidSample = true;
-    if(all(abs(worldPosition) < 0.001f) && all(abs(worldFaceNormal) < 0.001f))
+    if(gbufferTexel.m_meshKey == 0)
     {
         bIsValidSample = false;
         return;
     }
 
+    float3 worldPosition = gbufferTexel.m_worldPosition;
+    float3 worldFaceNormal = gbufferTexel.m_worldFaceNormal;
+
     SRandomSequence randomSequence;
     randomSequence.m_randomSeed = 0;
-    randomSequence.m_nSampleIndex = StrongIntegerHash(rayIndex.y * m_nAtlasSize.x + rayIndex.x) + rtRenderPassInfo.m_renderPassIndex;
+    randomSequence.m_nSampleIndex = GetLightMapTexelSampleKey(gbufferTexel) + rtRenderPassInfo.m_renderPassIndex;
 
     float3 radianceValue = 0; // unused currently
     float3 radianceDirection = 0;
@@ -1029,12 +1844,23 @@ void LightMapRayTracingRayGen()
     float4 rtDebugOutput = 0.0;
 #endif
 
+    // the gbuffer texel is the first path vertex, white base color to bake irradiance instead of outgoing radiance
+    SMaterialClosestHitPayload startPayload = (SMaterialClosestHitPayload)0;
+    startPayload.m_worldPosition = worldPosition;
+    startPayload.m_worldNormal = worldFaceNormal;
+    startPayload.m_vHiTt = 1.0f;
+    startPayload.m_eFlag |= RT_PAYLOAD_FLAG_FRONT_FACE;
+    startPayload.m_roughness = 1.0f;
+    startPayload.m_baseColor = float3(1,1,1);
+    startPayload.m_diffuseColor = float3(1,1,1);
+    startPayload.m_specColor = float3(0,0,0);
+
     DoRayTracing(
 #if RT_DEBUG_OUTPUT
         rtDebugOutput,
 #endif
-        worldPosition,
-        worldFaceNormal,
+        startPayload,
+        0,
         randomSequence,
         bIsValidSample,
 
@@ -1056,6 +1882,9 @@ void LightMapRayTracingRayGen()
             if(TangentZ > 0.0)
             {
                 shDirectionality[rayIndex].rgba += Luminance(directionalLightRadianceValue) * SHBasisFunction(directionalLightRadianceDirection);
+#if RT_SH_L2
+                AccumulateSHL2Directionality(rayIndex, Luminance(directionalLightRadianceValue), directionalLightRadianceDirection);
+#endif
             }
             irradianceAndValidSampleCount[rayIndex].rgb += directionalLightRadianceValue;
         }
@@ -1065,6 +1894,9 @@ void LightMapRayTracingRayGen()
             if(TangentZ > 0.0)
             {
                 shDirectionality[rayIndex].rgba += Luminance(radianceValue) * SHBasisFunction(radianceDirection);
+#if RT_SH_L2
+                AccumulateSHL2Directionality(rayIndex, Luminance(radianceValue), radianceDirection);
+#endif
             }
             irradianceAndValidSampleCount[rayIndex].rgb += radianceValue;            
         }
@@ -1076,10 +1908,102 @@ void LightMapRayTracingRayGen()
         irradianceAndValidSampleCount[rayIndex].w += 1.0;
     }
 
+    AccumulateTraversalCost(rayIndex);
+    FlushRayStats();
+
 #if RT_DEBUG_OUTPUT
     encodedIrradianceAndSubLuma1[rayIndex] = rtDebugOutput;
 #endif
 }
+#endif
+#endif
+
+float3 UnpackAlbedo(uint packedAlbedo)
+{
+    float3 srgbColor = float3(packedAlbedo & 0xFF, (packedAlbedo >> 8) & 0xFF, (packedAlbedo >> 16) & 0xFF) / 255.0;
+    return lerp(pow((srgbColor + 0.055) / 1.055, 2.4), srgbColor / 12.92, step(srgbColor, 0.04045));
+}
+
+// point sampled albedo cache, the cache is already box filtered on the host, see AddAlbedoCache in hwrtl_gi.cpp
+float3 GetHitAlbedo(SMeshInstanceGpuData meshInstanceGpuData, uint3 indices, float3 barycentrics)
+{
+    uint4 albedoInfo = meshInstanceGpuData.albedoInfo;
+    uint2 albedoCacheSize = uint2(albedoInfo.y & 0xFFFF, albedoInfo.y >> 16);
+    if(albedoCacheSize.x == 0)
+    {
+        return UnpackAlbedo(albedoInfo.z);
+    }
+
+    // texture uv stride = 32 bit * 2 = 8 byte
+    float2 textureUV0 = asfloat(bindlessByteAddressBuffer[albedoInfo.w].Load<float2>(indices.x * 8));
+    float2 textureUV1 = asfloat(bindlessByteAddressBuffer[albedoInfo.w].Load<float2>(indices.y * 8));
+    float2 textureUV2 = asfloat(bindlessByteAddressBuffer[albedoInfo.w].Load<float2>(indices.z * 8));
+    float2 textureUV = frac(textureUV0 * barycentrics.x + textureUV1 * barycentrics.y + textureUV2 * barycentrics.z);
+
+    uint2 albedoTexel = min(uint2(textureUV * albedoCacheSize), albedoCacheSize - 1);
+    return UnpackAlbedo(rtAlbedoCache[albedoInfo.x + albedoTexel.y * albedoCacheSize.x + albedoTexel.x]);
+}
+
+// micro triangle order matches AddOpacityMicroMap in hwrtl_gi.cpp: row by row along v, upright and inverted micro triangles alternate
+uint GetMicroTriangleIndex(float2 barycentrics, uint microMapLevel)
+{
+    const uint segmentNum = 1u << microMapLevel;
+    const float2 scaledBarycentrics = barycentrics * segmentNum;
+    const uint v = min(uint(scaledBarycentrics.y), segmentNum - 1);
+    const uint u = min(uint(scaledBarycentrics.x), segmentNum - 1 - v);
+    const uint inverted = (frac(scaledBarycentrics.x) + frac(scaledBarycentrics.y) > 1.0 && (u + v + 1 < segmentNum)) ? 1 : 0;
+    return v * (2 * segmentNum - v) + u * 2 + inverted;
+}
+
+bool IsAlphaTestedHitOpaque(SMeshInstanceGpuData meshInstanceGpuData, uint primitiveIndex, float2 barycentrics)
+{
+    const uint4 alphaInfo = meshInstanceGpuData.alphaInfo;
+    if(alphaInfo.z == 0)
+    {
+        return true;
+    }
+
+    const uint microMapLevel = alphaInfo.w & 0xFF;
+    const uint microTriangleNum = 1u << (2 * microMapLevel);
+    const uint triangleEntry = alphaInfo.x + primitiveIndex * (1 + (microTriangleNum * 2 + 31) / 32);
+
+    uint opacityState = rtAlphaTestData[triangleEntry];
+    if(opacityState == OMM_STATE_UNKNOWN)
+    {
+        const uint microTriangleIndex = GetMicroTriangleIndex(barycentrics, microMapLevel);
+        opacityState = (rtAlphaTestData[triangleEntry + 1 + microTriangleIndex / 16] >> ((microTriangleIndex % 16) * 2)) & 0x3;
+    }
+
+    if(opacityState != OMM_STATE_UNKNOWN)
+    {
+        return opacityState == OMM_STATE_OPAQUE;
+    }
+
+    // the micro triangle covers both opaque and transparent texels, point sample the alpha mask
+    const uint baseIndex = primitiveIndex * 3;
+    const uint textureUVIndex = meshInstanceGpuData.albedoInfo.w;
+    float2 textureUV0 = asfloat(bindlessByteAddressBuffer[textureUVIndex].Load<float2>(baseIndex * 8));
+    float2 textureUV1 = asfloat(bindlessByteAddressBuffer[textureUVIndex].Load<float2>((baseIndex + 1) * 8));
+    float2 textureUV2 = asfloat(bindlessByteAddressBuffer[textureUVIndex].Load<float2>((baseIndex + 2) * 8));
+    float2 textureUV = frac(textureUV0 * (1.0 - barycentrics.x - barycentrics.y) + textureUV1 * barycentrics.x + textureUV2 * barycentrics.y);
+
+    const uint2 alphaMaskSize = uint2(alphaInfo.z & 0xFFFF, alphaInfo.z >> 16);
+    const uint2 alphaTexel = min(uint2(textureUV * alphaMaskSize), alphaMaskSize - 1);
+    const uint texelIndex = alphaTexel.y * alphaMaskSize.x + alphaTexel.x;
+    const uint alpha = (rtAlphaTestData[alphaInfo.y + texelIndex / 4] >> ((texelIndex % 4) * 8)) & 0xFF;
+    return alpha >= (alphaInfo.w >> 8);
+}
+
+// only invoked for the non opaque blas of the alpha tested meshes, the other geometries are flagged opaque and skip it
+[shader("anyhit")]
+void AlphaTestAnyHitMain(inout SMaterialClosestHitPayload payload, in SRayTracingIntersectionAttributes attributes)
+{
+    SMeshInstanceGpuData meshInstanceGpuData = rtSceneInstanceGpuData[InstanceID()];
+    if(!IsAlphaTestedHitOpaque(meshInstanceGpuData, PrimitiveIndex(), float2(attributes.x, attributes.y)))
+    {
+        IgnoreHit();
+    }
+}
 
 [shader("closesthit")]
 void MaterialClosestHitMain(inout SMaterialClosestHitPayload payload, in SRayTracingIntersectionAttributes attributes)
@@ -1129,12 +2053,14 @@ void MaterialClosestHitMain(inout SMaterialClosestHitPayload payload, in SRayTra
 
     payload.m_roughness = 1.0;
 
-    //New concrete albedo = 0.55
-    payload.m_baseColor = float3(0.55,0.55,0.55);
+    // SBakeMeshDesc::m_baseColor defaults to new concrete albedo = 0.55
+    float3 hitAlbedo = GetHitAlbedo(meshInstanceGpuData, indices, barycentrics);
+    payload.m_baseColor = hitAlbedo;
     payload.m_specColor = float3(0,0,0);
-    payload.m_diffuseColor = float3(0.55,0.55,0.55);
+    payload.m_diffuseColor = hitAlbedo;
     payload.m_worldPosition = worldPosition;
     payload.m_worldNormal = FaceNormal;
+    payload.m_meshLightIndex = meshInstanceGpuData.meshLightIndexPlusOne;
 
 #if RT_DEBUG_OUTPUT
     payload.m_debugPayload = float4(payload.m_worldNormal * 0.5 + 0.5 ,1.0);
@@ -1196,6 +2122,10 @@ struct SDenoiseOutputs
 {
     float4 irradianceAndSampleCount :SV_Target0;
     float4 shDirectionality :SV_Target1;
+#if DENOISE_SH_L2
+    float4 shDirectionalityL2Part0 :SV_Target2;
+    float4 shDirectionalityL2Part1 :SV_Target3;
+#endif
 };
 
 struct SDenoiseParams
@@ -1213,7 +2143,15 @@ ConstantBuffer<SDenoiseParams> denoiseParamsBuffer      : register(b0);
 
 Texture2D<float4> denoiseInputIrradianceTexture         : register(t0);
 Texture2D<float4> denoiseInputSHDirectionalityTexture   : register(t1);
+#if COMPACT_GBUFFER
+Texture2D<uint4> denoiseInputCompactGBuffer             : register(t2);
+#else
 Texture2D<float4> denoiseInputNormalTexture             : register(t2);
+#endif
+#if DENOISE_SH_L2
+Texture2D<float4> denoiseInputSHL2Part0Texture          : register(t3);
+Texture2D<float4> denoiseInputSHL2Part1Texture          : register(t4);
+#endif
 
 //Joint Non-local means (JNLM) denoiser.
 //Based on Godot and YoctoImageDenoiser's JNLM implementation
@@ -1243,6 +2181,18 @@ Texture2D<float4> denoiseInputNormalTexture             : register(t2);
 // SOFTWARE.
 
 
+float3 LoadDenoiseNormal(float2 texUV)
+{
+#if COMPACT_GBUFFER
+    // integer textures can't be sampled, point wrap addressing by hand
+    uint2 texel = min(uint2(frac(texUV) * denoiseParamsBuffer.inputTexSizeAndInvSize.xy), uint2(denoiseParamsBuffer.inputTexSizeAndInvSize.xy) - 1);
+    uint4 compactTexel = denoiseInputCompactGBuffer[texel];
+    return compactTexel.w != 0 ? DecodeCompactGBufferNormal(compactTexel) : float3(0, 0, 0);
+#else
+    return denoiseInputNormalTexture.SampleLevel(gSamPointWarp, texUV, 0.0).xyz;
+#endif
+}
+
 float4 DenoiseLightMap(Texture2D<float4> inputTexture,float2 texUV)
 {
     const int HALF_PATCH_WINDOW = 4;
@@ -1264,7 +2214,7 @@ float4 DenoiseLightMap(Texture2D<float4> inputTexture,float2 texUV)
     float3 denoisedRGB = float3(0,0,0);
     float4 inputValue = inputTexture.SampleLevel(gSamPointWarp, texUV , 0.0).xyzw;
     float3 inputColor = inputValue.rgb;
-    float3 inputNormal = denoiseInputNormalTexture.SampleLevel(gSamPointWarp, texUV ,0.0).xyz;
+    float3 inputNormal = LoadDenoiseNormal(texUV);
     if (length(inputNormal) > EPSILON)
     {
         float sumWeights = 0.0f;
@@ -1277,7 +2227,7 @@ float4 DenoiseLightMap(Texture2D<float4> inputTexture,float2 texUV)
                 float2 searchUV = texUV + float2(searchX,searchY) * denoiseParamsBuffer.inputTexSizeAndInvSize.zw;
                 // TODO: point or linear sampler?
                 float3 searchRGB = inputTexture.SampleLevel(gSamPointWarp, searchUV, 0.0).xyz;
-                float3 searchNormal = denoiseInputNormalTexture.SampleLevel(gSamPointWarp, searchUV, 0.0).xyz;
+                float3 searchNormal = LoadDenoiseNormal(searchUV);
 
                 float patchSquareDist = 0.0f;
 				for (int offsetY = -HALF_PATCH_WINDOW; offsetY <= HALF_PATCH_WINDOW; offsetY++) 
@@ -1330,14 +2280,77 @@ float4 DenoiseLightMap(Texture2D<float4> inputTexture,float2 texUV)
     return float4(denoisedRGB,inputValue.w);
 }
 
+// the l2 sh directionality is not denoised, it is copied to the ping pong textures for the dilate pass
+void CopySHL2Directionality(float2 texUV, inout SDenoiseOutputs output)
+{
+#if DENOISE_SH_L2
+    output.shDirectionalityL2Part0 = denoiseInputSHL2Part0Texture.SampleLevel(gSamPointWarp, texUV, 0.0).xyzw;
+    output.shDirectionalityL2Part1 = denoiseInputSHL2Part1Texture.SampleLevel(gSamPointWarp, texUV, 0.0).xyzw;
+#endif
+}
+
 SDenoiseOutputs DenoiseLightMapPS(SDenoiseGeometryVS2PS IN )
 {
     SDenoiseOutputs output;
     output.irradianceAndSampleCount = DenoiseLightMap(denoiseInputIrradianceTexture,IN.textureCoord);
     output.shDirectionality = DenoiseLightMap(denoiseInputSHDirectionalityTexture,IN.textureCoord);
+    CopySHL2Directionality(IN.textureCoord, output);
     return output;
 }
 
+// preview bake: 5x5 box blur of the texels with a similar normal, the single sample per texel is too noisy for the JNLM patch distance
+SDenoiseOutputs PreviewBlurLightMap(float2 texUV)
+{
+    const int HALF_BLUR_WINDOW = 2;
+    const float EPSILON = 1e-6f;
+
+    SDenoiseOutputs output;
+    output.irradianceAndSampleCount = denoiseInputIrradianceTexture.SampleLevel(gSamPointWarp, texUV , 0.0).xyzw;
+    output.shDirectionality = denoiseInputSHDirectionalityTexture.SampleLevel(gSamPointWarp, texUV , 0.0).xyzw;
+    CopySHL2Directionality(texUV, output);
+    float3 inputNormal = LoadDenoiseNormal(texUV);
+    if (length(inputNormal) < EPSILON)
+    {
+        return output;
+    }
+
+    // rgb and the sh are sums over w samples, so weighting the neighbour mean by normalWeight * w accumulates the sums with the normal weight
+    // texels without valid samples add nothing to the mean, the sample count is blurred with the same weights
+    float4 blurredIrradianceAndSampleCount = float4(0,0,0,0);
+    float4 blurredSHDirectionality = float4(0,0,0,0);
+    float sumWeights = 0.0f;
+    for (int offsetY = -HALF_BLUR_WINDOW; offsetY <= HALF_BLUR_WINDOW; offsetY++) 
+    {
+        for (int offsetX = -HALF_BLUR_WINDOW; offsetX <= HALF_BLUR_WINDOW; offsetX++) 
+        {
+            float2 searchUV = texUV + float2(offsetX,offsetY) * denoiseParamsBuffer.inputTexSizeAndInvSize.zw;
+            float3 searchNormal = LoadDenoiseNormal(searchUV);
+            float weight = saturate(dot(inputNormal, searchNormal));
+            weight *= weight;
+            if(searchUV.x > 1.0 || searchUV.y > 1.0 || searchUV.x < 0.0 || searchUV.y < 0.0)
+            {
+                weight = 0.0;
+            }
+
+            blurredIrradianceAndSampleCount += weight * denoiseInputIrradianceTexture.SampleLevel(gSamPointWarp, searchUV, 0.0).xyzw;
+            blurredSHDirectionality += weight * denoiseInputSHDirectionalityTexture.SampleLevel(gSamPointWarp, searchUV, 0.0).xyzw;
+            sumWeights += weight;
+        }
+    }
+
+    if (blurredIrradianceAndSampleCount.w > EPSILON)
+    {
+        output.irradianceAndSampleCount = blurredIrradianceAndSampleCount / sumWeights;
+        output.shDirectionality = blurredSHDirectionality / sumWeights;
+    }
+    return output;
+}
+
+SDenoiseOutputs PreviewBlurLightMapPS(SDenoiseGeometryVS2PS IN )
+{
+    return PreviewBlurLightMap(IN.textureCoord);
+}
+
 /***************************************************************************
 *   LightMap Dilate Pass
 ***************************************************************************/
@@ -1366,6 +2379,10 @@ struct SDilateOutputs
 {
     float4 irradianceAndSampleCount :SV_Target0;
     float4 shDirectionality :SV_Target1;
+#if DILATE_SH_L2
+    float4 shDirectionalityL2Part0 :SV_Target2;
+    float4 shDirectionalityL2Part1 :SV_Target3;
+#endif
 };
 
 struct SDilateParams
@@ -1383,55 +2400,69 @@ ConstantBuffer<SDilateParams> dilateParamsBuffer      : register(b0);
 
 Texture2D<float4> dilateInputIrradianceTexture         : register(t0);
 Texture2D<float4> dilateInputSHDirectionalityTexture   : register(t1);
+#if DILATE_SH_L2
+Texture2D<float4> dilateInputSHL2Part0Texture          : register(t2);
+Texture2D<float4> dilateInputSHL2Part1Texture          : register(t3);
+#endif
 
 bool IsNotEmptyPixel(float4 pixel)
 {
     const float EPSILON = 1e-6f;
+#if DILATE_AO
+    // fully occluded texels have no visibility and no bent normal, only the sample count tells them from the gutter
+    return pixel.w > EPSILON;
+#else
     return abs(pixel.x) > EPSILON && abs(pixel.y) > EPSILON && abs(pixel.z) > EPSILON && abs(pixel.w) > EPSILON;
+#endif
 }
 
-float4 DilateLightMap(Texture2D<float4> inputTexture,float2 texUV)
+static const int DILATE_SEARCH_NUM = 24;
+static const float2 dilateSearchOffsets[DILATE_SEARCH_NUM] =
 {
-    float4 centerValue = inputTexture.SampleLevel(gSamPointWarp, texUV , 0.0).xyzw;
-
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(-1,+0) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+1,+0) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+0,-1) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+0,+1) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(-1,-1) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(-1,+1) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+1,-1) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+1,+1) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(-2,+0) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+2,+0) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+0,-2) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+0,+2) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(-2,-1) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(-2,+1) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+2,-1) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+2,+1) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
+    float2(-1,+0), float2(+1,+0), float2(+0,-1), float2(+0,+1),
+    float2(-1,-1), float2(-1,+1), float2(+1,-1), float2(+1,+1),
+    float2(-2,+0), float2(+2,+0), float2(+0,-2), float2(+0,+2),
+    float2(-2,-1), float2(-2,+1), float2(+2,-1), float2(+2,+1),
+    float2(-1,-2), float2(-1,+2), float2(+1,-2), float2(+1,+2),
+    float2(-2,+2), float2(+2,+2), float2(+2,-2), float2(-2,-2),
+};
 
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(-1,-2) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(-1,+2) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+1,-2) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+1,+2) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
+// the uv of the texel itself if it is not empty, otherwise the uv of the nearest non empty texel
+float2 FindDilateUV(Texture2D<float4> inputTexture,float2 texUV)
+{
+    if(IsNotEmptyPixel(inputTexture.SampleLevel(gSamPointWarp, texUV , 0.0).xyzw))
+    {
+        return texUV;
+    }
 
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(-2,+2) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+2,+2) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+2,-2) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
-    centerValue = IsNotEmptyPixel(centerValue) ? centerValue : inputTexture.SampleLevel(gSamPointWarp, texUV + float2(+2,+2) * dilateParamsBuffer.inputTexSizeAndInvSize.zw, 0.0).xyzw;
+    for(int index = 0; index < DILATE_SEARCH_NUM; index++)
+    {
+        float2 searchUV = texUV + dilateSearchOffsets[index] * dilateParamsBuffer.inputTexSizeAndInvSize.zw;
+        if(IsNotEmptyPixel(inputTexture.SampleLevel(gSamPointWarp, searchUV , 0.0).xyzw))
+        {
+            return searchUV;
+        }
+    }
+    return texUV;
+}
 
-    return centerValue;
+float4 DilateLightMap(Texture2D<float4> inputTexture,float2 texUV)
+{
+    return inputTexture.SampleLevel(gSamPointWarp, FindDilateUV(inputTexture, texUV), 0.0).xyzw;
 }
 
 SDilateOutputs DilateeLightMapPS(SDilateGeometryVS2PS IN )
 {
     SDilateOutputs output;
     output.irradianceAndSampleCount = DilateLightMap(dilateInputIrradianceTexture,IN.textureCoord);
-    output.shDirectionality = DilateLightMap(dilateInputSHDirectionalityTexture,IN.textureCoord);
+
+    float2 shDilateUV = FindDilateUV(dilateInputSHDirectionalityTexture,IN.textureCoord);
+    output.shDirectionality = dilateInputSHDirectionalityTexture.SampleLevel(gSamPointWarp, shDilateUV, 0.0).xyzw;
+#if DILATE_SH_L2
+    // the l2 coefficients are taken from the same texel as the l1 directionality they are packed with
+    output.shDirectionalityL2Part0 = dilateInputSHL2Part0Texture.SampleLevel(gSamPointWarp, shDilateUV, 0.0).xyzw;
+    output.shDirectionalityL2Part1 = dilateInputSHL2Part1Texture.SampleLevel(gSamPointWarp, shDilateUV, 0.0).xyzw;
+#endif
     return output;
 }
 
@@ -1507,6 +2538,35 @@ SEncodeOutputs EncodeLightMapPS(SEncodeGeometryVS2PS IN )
     return output;
 }
 
+// ambient occlusion bake mode: rgb of the first output is the ambient occlusion, rgb of the second output is the encoded bent normal
+SEncodeOutputs EncodeAOLightMapPS(SEncodeGeometryVS2PS IN )
+{
+    SEncodeOutputs output;
+
+    float4 visibilityAndSampleCount = encodeInputIrradianceTexture.SampleLevel(gSamPointWarp, IN.textureCoord, 0.0).xyzw;
+    float4 bentNormalAndSampleCount = encodeInputSHDirectionalityTexture.SampleLevel(gSamPointWarp, IN.textureCoord, 0.0).xyzw;
+
+    float sampleCount = visibilityAndSampleCount.w;
+    if(sampleCount > 0)
+    {
+        float ambientOcclusion = saturate(visibilityAndSampleCount.x / sampleCount);
+        
+        // fully occluded texels don't have a bent direction
+        float bentNormalLength = length(bentNormalAndSampleCount.xyz);
+        float3 bentNormal = bentNormalLength > 0.0 ? bentNormalAndSampleCount.xyz / bentNormalLength : float3(0,0,0);
+
+        output.irradianceAndLuma = float4(ambientOcclusion, ambientOcclusion, ambientOcclusion, 1.0);
+        output.shDirectionalityAndLuma = float4(bentNormal * 0.5 + 0.5, 1.0);
+    }
+    else
+    {
+        output.irradianceAndLuma = float4(0,0,0,0);
+        output.shDirectionalityAndLuma = float4(0,0,0,0);
+    }
+
+    return output;
+}
+
 /***************************************************************************
 *   LightMap Visualize Pass
 ***************************************************************************/
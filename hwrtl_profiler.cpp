@@ -0,0 +1,194 @@
+/***************************************************************************
+MIT License
+
+Copyright(c) 2023 lvchengTSH
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this softwareand associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright noticeand this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+***************************************************************************/
+
+// DOCUMENTATION
+// 
+// Profiler:
+//      every thread records its zones into its own ring buffer, see HWRTL_PROFILE_SCOPE in hwrtl.h
+//      the ring buffer lock is only contended while the zones are exported, so the export can run while other threads record
+//
+
+#include "hwrtl.h"
+#if HWRTL_ENABLE_PROFILER
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+
+namespace hwrtl
+{
+    struct SProfileRingBuffer
+    {
+        std::mutex m_mutex; // guards the zones and the zone count against the export
+        uint32_t m_threadIndex = 0;
+        uint64_t m_zoneCount = 0; // total zones written, zone i is at m_zones[i % HWRTL_PROFILER_RING_BUFFER_SIZE]
+        SProfileZone m_zones[HWRTL_PROFILER_RING_BUFFER_SIZE];
+    };
+
+    static std::mutex profilerMutex;
+    static std::vector<std::shared_ptr<SProfileRingBuffer>> profilerRingBuffers;
+    static uint32_t profilerThreadNum = 0;
+
+    static uint64_t GetProfilerTimeNs()
+    {
+        static const std::chrono::steady_clock::time_point profilerStartTime = std::chrono::steady_clock::now();
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profilerStartTime).count());
+    }
+
+    // the registry keeps the ring buffer alive after the thread exits, so the zones of the worker threads can still be exported
+    static SProfileRingBuffer* GetThreadProfileRingBuffer()
+    {
+        thread_local std::shared_ptr<SProfileRingBuffer> threadRingBuffer;
+        if (threadRingBuffer == nullptr)
+        {
+            threadRingBuffer = std::make_shared<SProfileRingBuffer>();
+
+            std::lock_guard<std::mutex> lock(profilerMutex);
+            threadRingBuffer->m_threadIndex = profilerThreadNum++;
+            profilerRingBuffers.push_back(threadRingBuffer);
+        }
+        return threadRingBuffer.get();
+    }
+
+    // the zones of every ring buffer still in the ring, oldest first, the caller holds profilerMutex
+    template<typename ZoneVisitor>
+    static void VisitProfileZones(ZoneVisitor zoneVisitor)
+    {
+        for (uint32_t bufferIndex = 0; bufferIndex < profilerRingBuffers.size(); bufferIndex++)
+        {
+            SProfileRingBuffer& ringBuffer = *profilerRingBuffers[bufferIndex];
+            std::lock_guard<std::mutex> ringBufferLock(ringBuffer.m_mutex);
+
+            uint64_t zoneCount = ringBuffer.m_zoneCount;
+            uint64_t firstZone = zoneCount > HWRTL_PROFILER_RING_BUFFER_SIZE ? zoneCount - HWRTL_PROFILER_RING_BUFFER_SIZE : 0;
+            for (uint64_t zoneIndex = firstZone; zoneIndex < zoneCount; zoneIndex++)
+            {
+                zoneVisitor(ringBuffer.m_threadIndex, ringBuffer.m_zones[zoneIndex % HWRTL_PROFILER_RING_BUFFER_SIZE]);
+            }
+        }
+    }
+
+    // innermost open zone of the thread, used to attribute the memory peak to a stage
+    static thread_local const char* currentProfileZoneName = nullptr;
+
+    const char* GetCurrentProfileZoneName()
+    {
+        return currentProfileZoneName;
+    }
+
+    hwrtl::CScopedProfileZone::CScopedProfileZone(const char* name)
+        : m_name(name)
+        , m_parentName(currentProfileZoneName)
+        , m_beginNs(GetProfilerTimeNs())
+    {
+        currentProfileZoneName = name;
+    }
+
+    hwrtl::CScopedProfileZone::~CScopedProfileZone()
+    {
+        currentProfileZoneName = m_parentName;
+
+        SProfileRingBuffer* ringBuffer = GetThreadProfileRingBuffer();
+        uint64_t endNs = GetProfilerTimeNs();
+
+        std::lock_guard<std::mutex> ringBufferLock(ringBuffer->m_mutex);
+        SProfileZone& profileZone = ringBuffer->m_zones[ringBuffer->m_zoneCount % HWRTL_PROFILER_RING_BUFFER_SIZE];
+        profileZone.m_name = m_name;
+        profileZone.m_beginNs = m_beginNs;
+        profileZone.m_durationNs = endNs - m_beginNs;
+        ringBuffer->m_zoneCount++;
+    }
+
+    // the zones that are open while resetting are recorded when they close
+    void ResetProfiler()
+    {
+        std::lock_guard<std::mutex> lock(profilerMutex);
+
+        // drop the ring buffers of the exited threads
+        profilerRingBuffers.erase(std::remove_if(profilerRingBuffers.begin(), profilerRingBuffers.end(), 
+            [](const std::shared_ptr<SProfileRingBuffer>& ringBuffer) { return ringBuffer.use_count() == 1; }), profilerRingBuffers.end());
+
+        for (uint32_t index = 0; index < profilerRingBuffers.size(); index++)
+        {
+            std::lock_guard<std::mutex> ringBufferLock(profilerRingBuffers[index]->m_mutex);
+            profilerRingBuffers[index]->m_zoneCount = 0;
+        }
+    }
+
+    static void WriteChromeTraceString(std::ofstream& traceFile, const char* str)
+    {
+        traceFile << '"';
+        for (const char* pChar = str; *pChar != 0; pChar++)
+        {
+            if (*pChar == '"' || *pChar == '\\')
+            {
+                traceFile << '\\';
+            }
+            traceFile << *pChar;
+        }
+        traceFile << '"';
+    }
+
+    bool WriteProfilerChromeTrace(const std::string& filePath)
+    {
+        std::ofstream traceFile(filePath, std::ios::out | std::ios::trunc);
+        if (!traceFile.is_open())
+        {
+            return false;
+        }
+
+        traceFile << "{\"traceEvents\":[";
+        traceFile << std::fixed << std::setprecision(3);
+
+        // copy the zones out first, the ring buffers are not locked while writing the file
+        std::vector<std::pair<uint32_t, SProfileZone>> threadZones;
+        {
+            std::lock_guard<std::mutex> lock(profilerMutex);
+            VisitProfileZones([&](uint32_t threadIndex, const SProfileZone& profileZone) { threadZones.push_back(std::make_pair(threadIndex, profileZone)); });
+        }
+
+        for (uint32_t index = 0; index < threadZones.size(); index++)
+        {
+            const SProfileZone& profileZone = threadZones[index].second;
+
+            // complete event, timestamps are in microseconds
+            traceFile << (index == 0 ? "\n" : ",\n") << "{\"name\":";
+            WriteChromeTraceString(traceFile, profileZone.m_name);
+            traceFile << ",\"cat\":\"hwrtl\",\"ph\":\"X\",\"pid\":0,\"tid\":" << threadZones[index].first;
+            traceFile << ",\"ts\":" << double(profileZone.m_beginNs) / 1000.0 << ",\"dur\":" << double(profileZone.m_durationNs) / 1000.0 << "}";
+        }
+
+        traceFile << "\n]}\n";
+        return traceFile.good();
+    }
+
+    void GetProfileZones(std::vector<SProfileZone>& outZones)
+    {
+        std::lock_guard<std::mutex> lock(profilerMutex);
+        VisitProfileZones([&](uint32_t, const SProfileZone& profileZone) { outZones.push_back(profileZone); });
+    }
+}
+#endif